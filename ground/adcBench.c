@@ -0,0 +1,544 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    adcBench - the analog IMU's ADC pipeline: the DMA handler's scan
+    accumulation, the task's per block rate path and the slow path's
+    conversion to volts, each against the code it replaced
+
+    build:  make adcBench
+    use:    adcBench [blocks]
+
+    ADC_DMA_HANDLER, adcTaskCode and its helpers are extracted from
+    onboard/adc.c, the sensor constants from adc.h, config.h and the
+    6.1 board header.  The handler is fed scans of synthetic sensor
+    words, ADC_SAMPLES of them per block, and the task runs each block
+    as soon as the handler hands it over: CoWaitForSingleFlag is where
+    the next block gets sampled.  The voltScale table is set up the way
+    adcInit does it.  Sums are unsigned long as on the target, 64 bits
+    here.
+
+    Checked on every block: the bank holds each sensor's words summed
+    over the block, the double rate gyro outputs are the old per block
+    rate formula applied to the average of the last ADC_RATE_TAPS blocks
+    (temperature terms and all), and every slow output's volts match the
+    old explicit per channel scaling of the summed blocks, with the mag
+    block right after each set/reset flip left out.  The slow rates must
+    match the same formula on those volts.
+
+    The task is timed in a second pass that hands it the recorded banks
+    back to back, without the sampling and checks in between.  Times are
+    TSC ticks on the host (ns elsewhere), minimum and median over all
+    calls.  The old rate only block is adcTaskCode's before the banks
+    plus the copy and clear its DMA handler did: the bias polynomial,
+    three divides and a double precision scale per block.  The host has
+    a pipelined divider and double precision hardware, so the old block
+    comes out level with the new one here.  On the M4 each of those
+    divides takes 14 cycles and each double multiply is a library call.
+    These are not Cortex-M4 cycles.
+
+    The task used to clear the bank with a memset after summing it,
+    which cost as much as the rest of a rate only block here; it now
+    clears each sum as it adds it.  Dropping that clear, or the
+    firstAfterFlip reset, makes this fail.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+typedef int OS_TID;
+typedef int OS_FlagID;
+
+typedef struct {
+    int state;
+} digitalPin;
+
+#include "gen/adc.h"
+
+#define digitalGet(pin)		((pin)->state)
+#define digitalHi(pin)		benchFlip(pin, 1)
+#define digitalLo(pin)		benchFlip(pin, 0)
+
+#define AQ_NOTICE(s)
+#define CoEnterISR()
+#define CoExitISR()
+#define isr_SetFlag(flag)
+#define CoWaitForSingleFlag(flag, timeout)	if (!benchTaskWait()) return
+
+#define ADC_DMA_HANDLER		adcDmaHandler
+#define ADC_DMA_ISR		benchDmaIsr
+#define ADC_DMA_CR		benchDmaCr
+#define ADC_DMA_FLAGS		0x3d
+#define ADC_DMA_TC_FLAG		0x20
+#define RESET			0
+
+#define BENCH_MICROS		2500	// per block, 400Hz
+#define BENCH_VOLT_TOL		1e-6f	// relative
+#define BENCH_RATE_TOL		2e-4f
+
+adcStruct_t adcData;
+struct {
+    uint16_t adc123Raw1[ADC_CHANNELS*3];
+    uint16_t adc123Raw2[ADC_CHANNELS*3];
+} adcDMAData;
+
+float p[CONFIG_NUM_PARAMS];
+
+struct {
+    float cosRot, sinRot;
+} imuData;
+
+struct {
+    float vIn;
+} analogData;
+
+static uint32_t benchDmaIsr, benchDmaCr;
+static uint32_t benchMicros;
+static digitalPin benchMagPin;
+static long benchFlipBlock = -1;	// block whose handler flipped the mag set/reset
+
+static uint32_t timerMicros(void) {
+    return benchMicros;
+}
+
+static void benchFlip(digitalPin *pin, int state);
+static int benchTaskWait(void);
+static void imuAdcDRateReady(void);
+static void imuAdcSensorReady(void);
+
+#include "gen/adc.c"
+
+// which DMA words ADC_DMA_HANDLER adds into each sensor, -1 unused
+static const int8_t benchWords[ADC_SENSORS][4] = {
+    {36, 39, 42, 45}, { 1,  4,  7, 10}, { 2,  5,  8, 11},	// rates
+    { 0,  3,  6,  9}, {12, 15, 18, 21}, {24, 27, 30, 33},	// mags
+    {14, -1, -1, -1}, {32, -1, -1, -1},				// temp1, Vin
+    {13, 16, 19, 22}, {25, 28, 31, 34}, {37, 40, 43, 46},	// accs
+    {20, 23, 26, 29}, {38, 41, 44, 47},				// press1, press2
+    {17, -1, -1, -1}, {35, -1, -1, -1}				// temp2, temp3
+};
+
+// sensor levels in ADC counts, temp3 keeps the thermistor formula in range
+static const float benchLevel[ADC_SENSORS] = {
+    1390, 1410, 1400, 2050, 1980, 2110, 1700, 1250, 2040, 2060, 2480, 2600, 2590, 1690, 1900
+};
+
+typedef struct {
+    uint64_t *ticks;
+    long n;
+} benchTimes_t;
+
+static long benchBlocks, benchBlock;
+static int benchReplay;				// second pass, blocks handed over without sampling
+static unsigned long (*benchSums)[ADC_SENSORS];	// each block's bank as handed over
+static unsigned long benchWindow[ADC_SENSORS];	// blocks since the last slow output
+static float benchTemp;				// adcData.temperature as the block starts
+static uint64_t benchStart;
+static int benchSlow, benchDRate, benchSensor;
+static int errors;
+
+static benchTimes_t benchIsr, benchRateTask, benchSlowTask, benchOldRate, benchNewConvert, benchOldConvert;
+static volatile float benchSink;
+
+static uint64_t benchTicks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void benchTime(benchTimes_t *t, uint64_t ticks) {
+    t->ticks[t->n++] = ticks;
+}
+
+static void benchFlip(digitalPin *pin, int state) {
+    pin->state = state;
+    benchFlipBlock = benchBlock;
+}
+
+static void imuAdcDRateReady(void) {
+    benchDRate++;
+}
+
+static void imuAdcSensorReady(void) {
+    benchSensor++;
+}
+
+// rates come out of a difference of nearly equal volts and biases, so they get a looser bound
+static int benchCheck(const char *what, long block, float got, float want, float tol) {
+    if (fabsf(got - want) <= tol * (1.0f + fabsf(want)))
+	return 0;
+
+    if (errors++ < 10)
+	fprintf(stderr, "block %ld %s %g, expected %g\n", block, what, got, want);
+
+    return 1;
+}
+
+// the rate formula adcTaskCode applied to every block before the banks
+static void benchRateRef(const float *v, float dTemp, float *r) {
+    float dTemp2 = dTemp*dTemp, dTemp3 = dTemp2*dTemp;
+    float x, y, z, a, b, c;
+
+    x = +(v[0] + adcData.rateBiasX + p[IMU_GYO_BIAS1_X]*dTemp + p[IMU_GYO_BIAS2_X]*dTemp2 + p[IMU_GYO_BIAS3_X]*dTemp3);
+    y = -(v[1] + adcData.rateBiasY + p[IMU_GYO_BIAS1_Y]*dTemp + p[IMU_GYO_BIAS2_Y]*dTemp2 + p[IMU_GYO_BIAS3_Y]*dTemp3);
+    z = -(v[2] + adcData.rateBiasZ + p[IMU_GYO_BIAS1_Z]*dTemp + p[IMU_GYO_BIAS2_Z]*dTemp2 + p[IMU_GYO_BIAS3_Z]*dTemp3);
+
+    a = x + y*p[IMU_GYO_ALGN_XY] + z*p[IMU_GYO_ALGN_XZ];
+    b = x*p[IMU_GYO_ALGN_YX] + y + z*p[IMU_GYO_ALGN_YZ];
+    c = x*p[IMU_GYO_ALGN_ZX] + y*p[IMU_GYO_ALGN_ZY] + z;
+
+    a /= p[IMU_GYO_SCAL_X];
+    b /= p[IMU_GYO_SCAL_Y];
+    c /= p[IMU_GYO_SCAL_Z];
+
+    r[0] = a * imuData.cosRot - b * imuData.sinRot;
+    r[1] = b * imuData.cosRot + a * imuData.sinRot;
+    r[2] = c;
+}
+
+// a rate only block before the banks: the task's sum and double rate path with its half
+// step smoothing, and the copy & clear the DMA handler did at the end of every block
+static void benchOldRateBlock(unsigned long *adcSums, unsigned long *hist, unsigned long *channelSums, float dTemp, float dTemp2, float dTemp3) {
+    float dRateVoltageX, dRateVoltageY, dRateVoltageZ;
+    float x, y, z, a, b, c;
+    unsigned long *sums = hist;
+    int i;
+
+    for (i = 0; i < ADC_SENSORS; i++) {
+	hist[i] = adcSums[i];
+	adcSums[i] = 0;
+    }
+
+    for (i = 0; i < ADC_SENSORS; i++)
+	channelSums[i] += sums[i];
+
+    dRateVoltageX = sums[ADC_VOLTS_RATEX] * ADC_DIVISOR * (1.0 / 4.0);
+    dRateVoltageY = sums[ADC_VOLTS_RATEY] * ADC_DIVISOR * (1.0 / 4.0);
+    dRateVoltageZ = sums[ADC_VOLTS_RATEZ] * ADC_DIVISOR * (1.0 / 4.0);
+
+    x = +(dRateVoltageX + adcData.rateBiasX + p[IMU_GYO_BIAS1_X]*dTemp + p[IMU_GYO_BIAS2_X]*dTemp2 + p[IMU_GYO_BIAS3_X]*dTemp3);
+    y = -(dRateVoltageY + adcData.rateBiasY + p[IMU_GYO_BIAS1_Y]*dTemp + p[IMU_GYO_BIAS2_Y]*dTemp2 + p[IMU_GYO_BIAS3_Y]*dTemp3);
+    z = -(dRateVoltageZ + adcData.rateBiasZ + p[IMU_GYO_BIAS1_Z]*dTemp + p[IMU_GYO_BIAS2_Z]*dTemp2 + p[IMU_GYO_BIAS3_Z]*dTemp3);
+
+    a = x + y*p[IMU_GYO_ALGN_XY] + z*p[IMU_GYO_ALGN_XZ];
+    b = x*p[IMU_GYO_ALGN_YX] + y + z*p[IMU_GYO_ALGN_YZ];
+    c = x*p[IMU_GYO_ALGN_ZX] + y*p[IMU_GYO_ALGN_ZY] + z;
+
+    a /= p[IMU_GYO_SCAL_X];
+    b /= p[IMU_GYO_SCAL_Y];
+    c /= p[IMU_GYO_SCAL_Z];
+
+    adcData.dRateX = (adcData.dRateX + a * imuData.cosRot - b * imuData.sinRot) * 0.5f;
+    adcData.dRateY = (adcData.dRateY + b * imuData.cosRot + a * imuData.sinRot) * 0.5f;
+    adcData.dRateZ = (adcData.dRateZ + c) * 0.5f;
+
+    imuAdcDRateReady();
+}
+
+// the old slow path conversion, one line per channel, then the clear
+static void benchOldConvertSums(float *volts, unsigned long *channelSums) {
+    int i;
+
+    volts[ADC_VOLTS_RATEX] = channelSums[ADC_VOLTS_RATEX] * ADC_DIVISOR * (1.0f / 8.0f);
+    volts[ADC_VOLTS_RATEY] = channelSums[ADC_VOLTS_RATEY] * ADC_DIVISOR * (1.0f / 8.0f);
+    volts[ADC_VOLTS_RATEZ] = channelSums[ADC_VOLTS_RATEZ] * ADC_DIVISOR * (1.0f / 8.0f);
+
+    volts[ADC_VOLTS_MAGX]  = channelSums[ADC_VOLTS_MAGX] * ADC_DIVISOR * (1.0f / 4.0f);
+    volts[ADC_VOLTS_MAGY]  = channelSums[ADC_VOLTS_MAGY] * ADC_DIVISOR * (1.0f / 4.0f);
+    volts[ADC_VOLTS_MAGZ]  = channelSums[ADC_VOLTS_MAGZ] * ADC_DIVISOR * (1.0f / 4.0f);
+
+    volts[ADC_VOLTS_TEMP1] = channelSums[ADC_VOLTS_TEMP1] * ADC_DIVISOR * (1.0f / 2.0f);
+    volts[ADC_VOLTS_VIN]   = channelSums[ADC_VOLTS_VIN]   * ADC_DIVISOR * (1.0f / 2.0f);
+
+    volts[ADC_VOLTS_ACCX] = channelSums[ADC_VOLTS_ACCX] * ADC_DIVISOR * (1.0f / 8.0f);
+    volts[ADC_VOLTS_ACCY] = channelSums[ADC_VOLTS_ACCY] * ADC_DIVISOR * (1.0f / 8.0f);
+    volts[ADC_VOLTS_ACCZ] = channelSums[ADC_VOLTS_ACCZ] * ADC_DIVISOR * (1.0f / 8.0f);
+
+    volts[ADC_VOLTS_PRES1] = channelSums[ADC_VOLTS_PRES1] * ADC_DIVISOR * (1.0f / 8.0f);
+    volts[ADC_VOLTS_PRES2] = channelSums[ADC_VOLTS_PRES2] * ADC_DIVISOR * (1.0f / 8.0f);
+
+    volts[ADC_VOLTS_TEMP2] = channelSums[ADC_VOLTS_TEMP2] * ADC_DIVISOR * (1.0f / 2.0f);
+    volts[ADC_VOLTS_TEMP3] = channelSums[ADC_VOLTS_TEMP3] * ADC_DIVISOR * (1.0f / 2.0f);
+
+    for (i = 0; i < ADC_SENSORS; i++)
+	channelSums[i] = 0;
+}
+
+// one scan into whichever half the handler is about to read
+static void benchScan(long block, int scan, unsigned long *want) {
+    uint16_t *w = (scan & 1) ? adcDMAData.adc123Raw2 : adcDMAData.adc123Raw1;
+    float drift;
+    int i, j;
+
+    for (i = 0; i < ADC_SENSORS; i++) {
+	drift = 40.0f * sinf(block * (0.01f + i * 0.003f));
+	for (j = 0; j < 4 && benchWords[i][j] >= 0; j++) {
+	    w[benchWords[i][j]] = (uint16_t)(benchLevel[i] + drift) + (rand() & 15);
+	    want[i] += w[benchWords[i][j]];
+	}
+    }
+
+    benchDmaIsr = (scan & 1) ? ADC_DMA_TC_FLAG : 0;
+}
+
+// what the task produced for the block it just finished
+static void benchCheckBlock(long block) {
+    const unsigned long *s = benchSums[block];
+    const unsigned long *prev = benchSums[block > 0 ? block - 1 : 0];
+    float v[3], r[3], volts[ADC_SENSORS];
+    int i;
+
+    if (benchDRate != 1) {
+	errors++;
+	fprintf(stderr, "block %ld: %d double rate outputs\n", block, benchDRate);
+    }
+
+    // boxcar of the last two blocks
+    if (block > 0) {
+	for (i = 0; i < 3; i++)
+	    v[i] = (s[ADC_VOLTS_RATEX + i] + prev[ADC_VOLTS_RATEX + i]) * (ADC_DIVISOR / (4.0f * ADC_RATE_TAPS));
+	benchRateRef(v, benchTemp - IMU_ROOM_TEMP, r);
+	benchCheck("dRateX", block, adcData.dRateX, r[0], BENCH_RATE_TOL);
+	benchCheck("dRateY", block, adcData.dRateY, r[1], BENCH_RATE_TOL);
+	benchCheck("dRateZ", block, adcData.dRateZ, r[2], BENCH_RATE_TOL);
+    }
+
+    for (i = 0; i < ADC_SENSORS; i++)
+	if (i < ADC_VOLTS_MAGX || i > ADC_VOLTS_MAGZ || benchFlipBlock != block - 1)
+	    benchWindow[i] += s[i];
+
+    if (benchSensor != benchSlow) {
+	errors++;
+	fprintf(stderr, "block %ld: %d sensor outputs, %d expected\n", block, benchSensor, benchSlow);
+    }
+    if (!benchSlow)
+	return;
+
+    benchOldConvertSums(volts, benchWindow);
+    for (i = 0; i < ADC_SENSORS; i++)
+	benchCheck("volts", block, adcData.voltages[i], volts[i], BENCH_VOLT_TOL);
+
+    benchRateRef(volts, adcData.temperature - IMU_ROOM_TEMP, r);
+    benchCheck("rateX", block, adcData.rateX, r[0], BENCH_RATE_TOL);
+    benchCheck("rateY", block, adcData.rateY, r[1], BENCH_RATE_TOL);
+    benchCheck("rateZ", block, adcData.rateZ, r[2], BENCH_RATE_TOL);
+}
+
+// the end of ADC_DMA_HANDLER's block for a recorded bank
+static void benchHandOver(long block) {
+    adcData.readyBank = adcData.accBank;
+    adcData.accBank ^= 0x01;
+    memcpy(adcData.accSums[adcData.readyBank], benchSums[block], sizeof(benchSums[0]));
+    if (++adcData.loops & 0x01)
+	benchMagPin.state ^= 1;
+    adcData.bankPending = 1;
+
+    benchSlow = !(adcData.loops % ADC_DECIMATE);
+    benchBlock++;
+}
+
+// the task waits here: time the iteration just finished, check it, then sample the next block.
+// Replayed blocks only time the task, straight after the last one like a busy CPU would run it.
+static int benchTaskWait(void) {
+    uint64_t t = benchTicks();
+    unsigned long want[ADC_SENSORS];
+    int scan, i;
+
+    if (benchReplay) {
+	if (benchBlock > 0)
+	    benchTime(benchSlow ? &benchSlowTask : &benchRateTask, t - benchStart);
+	if (benchBlock == benchBlocks)
+	    return 0;
+	benchHandOver(benchBlock);
+	benchStart = benchTicks();
+	return 1;
+    }
+
+    if (benchBlock > 0)
+	benchCheckBlock(benchBlock - 1);
+
+    if (benchBlock == benchBlocks)
+	return 0;
+
+    memset(want, 0, sizeof(want));
+    for (scan = 0; scan < ADC_SAMPLES; scan++) {
+	benchScan(benchBlock, scan, want);
+	t = benchTicks();
+	adcDmaHandler();
+	benchTime(&benchIsr, benchTicks() - t);
+    }
+    benchMicros += BENCH_MICROS;
+
+    if (!adcData.bankPending) {
+	errors++;
+	fprintf(stderr, "block %ld not handed over\n", benchBlock);
+	return 0;
+    }
+
+    memcpy(benchSums[benchBlock], adcData.accSums[adcData.readyBank], sizeof(benchSums[0]));
+    for (i = 0; i < ADC_SENSORS; i++) {
+	if (benchSums[benchBlock][i] != want[i] && errors++ < 10)
+	    fprintf(stderr, "block %ld sensor %d: bank %lu, words %lu\n", benchBlock, i, benchSums[benchBlock][i], want[i]);
+    }
+
+    benchSlow = !(adcData.loops % ADC_DECIMATE);
+    benchDRate = benchSensor = 0;
+    benchTemp = adcData.temperature;
+    benchBlock++;
+
+    return 1;
+}
+
+static int benchCompare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void benchReport(const char *name, benchTimes_t *t) {
+    qsort(t->ticks, t->n, sizeof(uint64_t), benchCompare);
+    printf("%-36s %8llu %8llu\n", name, (unsigned long long)t->ticks[0], (unsigned long long)t->ticks[t->n / 2]);
+}
+
+static void benchAlloc(benchTimes_t *t, long n) {
+    t->ticks = calloc(n, sizeof(uint64_t));
+    t->n = 0;
+}
+
+int main(int argc, char **argv) {
+    float volts[ADC_SENSORS];
+    unsigned long sums[ADC_SENSORS], hist[ADC_SENSORS], channelSums[ADC_SENSORS];
+    float dTemp;
+    uint64_t t;
+    long n;
+    int i;
+
+    benchBlocks = (argc > 1) ? atol(argv[1]) : 20000;
+    if (benchBlocks < 2 * ADC_DECIMATE) {
+	fprintf(stderr, "usage: adcBench [blocks >= %d]\n", 2 * ADC_DECIMATE);
+	return 1;
+    }
+
+    benchSums = calloc(benchBlocks, sizeof(benchSums[0]));
+    benchAlloc(&benchIsr, benchBlocks * ADC_SAMPLES);
+    benchAlloc(&benchRateTask, benchBlocks);
+    benchAlloc(&benchSlowTask, benchBlocks);
+    benchAlloc(&benchOldRate, benchBlocks);
+    benchAlloc(&benchNewConvert, benchBlocks);
+    benchAlloc(&benchOldConvert, benchBlocks);
+
+    // calibration a board might carry
+    for (i = 0; i < 3; i++) {
+	p[IMU_GYO_BIAS1_X + i] = 0.0012f * (i + 1);
+	p[IMU_GYO_BIAS2_X + i] = -0.00003f * (i + 1);
+	p[IMU_GYO_BIAS3_X + i] = 0.0000004f * (i + 1);
+	p[IMU_GYO_SCAL_X + i] = 0.0072f + 0.0001f * i;
+    }
+    p[IMU_GYO_ALGN_XY] = 0.011f; p[IMU_GYO_ALGN_XZ] = -0.007f;
+    p[IMU_GYO_ALGN_YX] = -0.009f; p[IMU_GYO_ALGN_YZ] = 0.004f;
+    p[IMU_GYO_ALGN_ZX] = 0.006f; p[IMU_GYO_ALGN_ZY] = -0.012f;
+    p[IMU_ACC_SCAL_X] = p[IMU_ACC_SCAL_Y] = p[IMU_ACC_SCAL_Z] = 0.033f;
+    p[IMU_MAG_SCAL_X] = p[IMU_MAG_SCAL_Y] = p[IMU_MAG_SCAL_Z] = 0.21f;
+    imuData.cosRot = cosf(0.3f);
+    imuData.sinRot = sinf(0.3f);
+
+    // as adcInit leaves things
+    for (i = 0; i < ADC_SENSORS; i++)
+	adcData.voltScale[i] = ADC_DIVISOR / (float)(adcScanSamples[i] * ADC_DECIMATE);
+    adcData.magSetReset = &benchMagPin;
+    adcData.sample = ADC_SAMPLES - 1;
+    adcData.rateBiasX = -1.12f;
+    adcData.rateBiasY = -1.14f;
+    adcData.rateBiasZ = -1.13f;
+    adcData.temp3 = adcData.temperature = 25.0f;
+
+    // the first scan completes a block, as after adcInit
+    memset(sums, 0, sizeof(sums));
+    benchScan(0, 0, sums);
+    adcDmaHandler();
+    adcData.bankPending = 0;
+    memset(adcData.accSums, 0, sizeof(adcData.accSums));
+
+    adcTaskCode(0);
+
+    if (benchBlock != benchBlocks) {
+	fprintf(stderr, "task stopped after %ld blocks\n", benchBlock);
+	errors++;
+    }
+
+    benchReplay = 1;
+    benchBlock = 0;
+    adcData.bankPending = 0;
+    adcTaskCode(0);
+
+    // the kernels the task used to run, on the same blocks
+    dTemp = adcData.temperature - IMU_ROOM_TEMP;
+    memset(channelSums, 0, sizeof(channelSums));
+    for (n = 0; n < benchBlocks; n++) {
+	memcpy(sums, benchSums[n], sizeof(sums));
+	t = benchTicks();
+	benchOldRateBlock(sums, hist, channelSums, dTemp, dTemp*dTemp, dTemp*dTemp*dTemp);
+	benchTime(&benchOldRate, benchTicks() - t);
+	benchSink += channelSums[n % ADC_SENSORS];
+
+	memcpy(sums, benchSums[n], sizeof(sums));
+	t = benchTicks();
+	adcConvert(volts, sums, adcData.voltScale);
+	memset(sums, 0, sizeof(sums));
+	benchTime(&benchNewConvert, benchTicks() - t);
+	benchSink += volts[n % ADC_SENSORS];
+
+	memcpy(sums, benchSums[n], sizeof(sums));
+	t = benchTicks();
+	benchOldConvertSums(volts, sums);
+	benchTime(&benchOldConvert, benchTicks() - t);
+	benchSink += volts[n % ADC_SENSORS];
+    }
+
+    printf("%ld blocks of %d scans, %d sensors, slow output every %d blocks, %lu overruns\n\n",
+	benchBlocks, ADC_SAMPLES, ADC_SENSORS, ADC_DECIMATE, adcData.overruns);
+#if defined(__x86_64__) || defined(__i386__)
+    printf("%-36s %8s %8s\n", "ticks", "min", "median");
+#else
+    printf("%-36s %8s %8s\n", "ns", "min", "median");
+#endif
+    benchReport("DMA handler, one scan", &benchIsr);
+    benchReport("task, rate only block", &benchRateTask);
+    benchReport("task, block with slow output", &benchSlowTask);
+    printf("\n");
+    benchReport("rate only block before the banks", &benchOldRate);
+    benchReport("adcConvert + clear", &benchNewConvert);
+    benchReport("per channel conversion + clear", &benchOldConvert);
+
+    if (errors)
+	printf("FAILED, %d errors\n", errors);
+
+    return errors != 0;
+}
@@ -0,0 +1,543 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    aqlDecode - reference reader for AQL logs written by onboard/logger.c
+
+    build:  gcc -O2 -o aqlDecode aqlDecode.c
+    use:    aqlDecode [-g group] [-s] AQL.LOG > group.csv
+
+    Prints the records of one field group (default 0, main) as CSV with
+    a header line of field names, -s prints record counts and decode
+    throughput to stderr.
+
+    Record format, all values little endian.  Every record ends with a
+    Fletcher checksum (ckA, ckB) over the bytes following its 3 byte
+    signature.
+
+	AqH	numFields, {fieldId, fieldType} x numFields
+		field table of group 0 (main), unchanged from earlier logs
+	AqM	values of the group 0 fields in table order
+	AqG	group, rate (u16, run loops per record, 0 when update driven),
+		numFields, {fieldId, fieldType} x numFields
+		field table of groups 1.. (GPS, radio, power)
+	AqD	group, values of that group's fields in table order
+
+    Field types are those of logger.h: 0 double, 1 float, 2 u32, 3 s32,
+    4 u16, 5 s16, 6 u8, 7 s8.  Each group's first field is LASTUPDATE
+    (u32 us) so groups logged at different rates can be aligned in time.
+    Headers are repeated whenever the logger restarts, a record is only
+    decoded once its group's header has been seen.
+
+    Logs built with USE_LOG_COMPRESS carry AqC blocks in place of AqM
+    and AqD records:
+
+	AqC	group, length (u16), frames, checksum over group..frames
+
+    A block holds length bytes of whole frames, one per record, each
+    being the group's fields in table order as LEB128 varints (7 bits
+    per byte, low first, bit 7 set on all but the last byte).  Every
+    field is coded against its previous value in the block, which
+    starts at 0 for each block:
+
+	double		value = varint ^ previous (64 bits)
+	float		value = varint ^ previous (32 bits)
+	integers	d = (varint >> 1) ^ -(varint & 1), value = previous + d
+			(32 bits, then truncated to the field's type)
+
+    -s also reports how many bytes the records would take uncompressed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#define AQL_MAX_GROUPS		16
+#define AQL_MAX_FIELDS		255
+
+enum {
+    AQL_TYPE_DOUBLE = 0,
+    AQL_TYPE_FLOAT,
+    AQL_TYPE_U32,
+    AQL_TYPE_S32,
+    AQL_TYPE_U16,
+    AQL_TYPE_S16,
+    AQL_TYPE_U8,
+    AQL_TYPE_S8,
+    AQL_NUM_TYPES
+};
+
+// logger.h field ids, in order
+static const char *aqlFieldNames[] = {
+    "LASTUPDATE",
+    "VOLTAGE0",
+    "VOLTAGE1",
+    "VOLTAGE2",
+    "VOLTAGE3",
+    "VOLTAGE4",
+    "VOLTAGE5",
+    "VOLTAGE6",
+    "VOLTAGE7",
+    "VOLTAGE8",
+    "VOLTAGE9",
+    "VOLTAGE10",
+    "VOLTAGE11",
+    "VOLTAGE12",
+    "VOLTAGE13",
+    "VOLTAGE14",
+    "IMU_RATEX",
+    "IMU_RATEY",
+    "IMU_RATEZ",
+    "IMU_ACCX",
+    "IMU_ACCY",
+    "IMU_ACCZ",
+    "IMU_MAGX",
+    "IMU_MAGY",
+    "IMU_MAGZ",
+    "GPS_PDOP",
+    "GPS_HDOP",
+    "GPS_VDOP",
+    "GPS_TDOP",
+    "GPS_NDOP",
+    "GPS_EDOP",
+    "GPS_ITOW",
+    "GPS_POS_UPDATE",
+    "GPS_LAT",
+    "GPS_LON",
+    "GPS_HEIGHT",
+    "GPS_HACC",
+    "GPS_VACC",
+    "GPS_VEL_UPDATE",
+    "GPS_VELN",
+    "GPS_VELE",
+    "GPS_VELD",
+    "GPS_SACC",
+    "ADC_PRESSURE1",
+    "ADC_PRESSURE2",
+    "ADC_TEMP0",
+    "ADC_TEMP1",
+    "ADC_TEMP2",
+    "ADC_VIN",
+    "ADC_MAG_SIGN",
+    "UKF_Q1",
+    "UKF_Q2",
+    "UKF_Q3",
+    "UKF_Q4",
+    "UKF_POSN",
+    "UKF_POSE",
+    "UKF_POSD",
+    "UKF_PRES_ALT",
+    "UKF_ALT",
+    "UKF_VELN",
+    "UKF_VELE",
+    "UKF_VELD",
+    "MOT_MOTOR0",
+    "MOT_MOTOR1",
+    "MOT_MOTOR2",
+    "MOT_MOTOR3",
+    "MOT_MOTOR4",
+    "MOT_MOTOR5",
+    "MOT_MOTOR6",
+    "MOT_MOTOR7",
+    "MOT_MOTOR8",
+    "MOT_MOTOR9",
+    "MOT_MOTOR10",
+    "MOT_MOTOR11",
+    "MOT_MOTOR12",
+    "MOT_MOTOR13",
+    "MOT_THROTTLE",
+    "MOT_PITCH",
+    "MOT_ROLL",
+    "MOT_YAW",
+    "RADIO_QUALITY",
+    "RADIO_CHANNEL0",
+    "RADIO_CHANNEL1",
+    "RADIO_CHANNEL2",
+    "RADIO_CHANNEL3",
+    "RADIO_CHANNEL4",
+    "RADIO_CHANNEL5",
+    "RADIO_CHANNEL6",
+    "RADIO_CHANNEL7",
+    "RADIO_CHANNEL8",
+    "RADIO_CHANNEL9",
+    "RADIO_CHANNEL10",
+    "RADIO_CHANNEL11",
+    "RADIO_CHANNEL12",
+    "RADIO_CHANNEL13",
+    "RADIO_CHANNEL14",
+    "RADIO_CHANNEL15",
+    "RADIO_CHANNEL16",
+    "RADIO_CHANNEL17",
+    "RADIO_ERRORS",
+    "GMBL_TRIGGER",
+    "ACC_BIAS_X",
+    "ACC_BIAS_Y",
+    "ACC_BIAS_Z",
+    "CURRENT_PDB",
+    "CURRENT_EXT",
+    "VIN_PDB",
+    "UKF_ALT_VEL",
+    "IMU_TIME",
+    "IMU_DT",
+    "GPS_LAG",
+};
+
+static const int aqlTypeSize[AQL_NUM_TYPES] = {8, 4, 4, 4, 2, 2, 1, 1};
+
+typedef struct {
+    uint8_t id[AQL_MAX_FIELDS];
+    uint8_t type[AQL_MAX_FIELDS];
+    int numFields;
+    int size;				// bytes of one uncompressed record
+    int rate;
+    int valid;
+} aqlGroup_t;
+
+static aqlGroup_t aqlGroups[AQL_MAX_GROUPS];
+static int aqlGroup;			// group being printed
+static int aqlHeaderDone;
+static unsigned long aqlRecords[256];	// by signature letter
+static unsigned long aqlErrors;
+static unsigned long aqlRawBytes;	// size of the records as AqM/AqD
+
+static void aqlChecksum(const uint8_t *buf, int len, uint8_t *ckA, uint8_t *ckB) {
+    uint8_t a = 0, b = 0;
+
+    while (len-- > 0) {
+	a += *buf++;
+	b += a;
+    }
+
+    *ckA = a;
+    *ckB = b;
+}
+
+// checksum of len bytes following the signature at p, 0 if it does not match
+static int aqlCheck(const uint8_t *p, int len, long avail) {
+    uint8_t a, b;
+
+    if (3 + len + 2 > avail)
+	return 0;
+
+    aqlChecksum(p + 3, len, &a, &b);
+
+    return (p[3 + len] == a && p[3 + len + 1] == b);
+}
+
+// parse a field table, returns its length or -1
+static int aqlTable(aqlGroup_t *grp, const uint8_t *p, long avail) {
+    int n, i;
+
+    if (avail < 1)
+	return -1;
+
+    n = p[0];
+    if (1 + 2*n > avail)
+	return -1;
+
+    grp->numFields = n;
+    grp->size = 0;
+    for (i = 0; i < n; i++) {
+	grp->id[i] = p[1 + 2*i];
+	grp->type[i] = p[2 + 2*i];
+	if (grp->type[i] >= AQL_NUM_TYPES)
+	    return -1;
+	grp->size += aqlTypeSize[grp->type[i]];
+    }
+
+    return 1 + 2*n;
+}
+
+static void aqlPrintHeader(aqlGroup_t *grp) {
+    int i, id;
+
+    for (i = 0; i < grp->numFields; i++) {
+	id = grp->id[i];
+	if (id < (int)(sizeof(aqlFieldNames) / sizeof(aqlFieldNames[0])))
+	    printf("%s%s", i ? "," : "", aqlFieldNames[id]);
+	else
+	    printf("%sFIELD%d", i ? "," : "", id);
+    }
+    printf("\n");
+
+    aqlHeaderDone = 1;
+}
+
+static void aqlPrintValue(int first, int type, const void *v) {
+    const char *sep = first ? "" : ",";
+    double d;
+    float f;
+    uint32_t u32;
+    uint16_t u16;
+    uint8_t u8;
+
+    switch (type) {
+	case AQL_TYPE_DOUBLE:
+	    memcpy(&d, v, 8);
+	    printf("%s%.10f", sep, d);
+	    break;
+	case AQL_TYPE_FLOAT:
+	    memcpy(&f, v, 4);
+	    printf("%s%.7g", sep, f);
+	    break;
+	case AQL_TYPE_U32:
+	    memcpy(&u32, v, 4);
+	    printf("%s%u", sep, u32);
+	    break;
+	case AQL_TYPE_S32:
+	    memcpy(&u32, v, 4);
+	    printf("%s%d", sep, (int32_t)u32);
+	    break;
+	case AQL_TYPE_U16:
+	    memcpy(&u16, v, 2);
+	    printf("%s%u", sep, u16);
+	    break;
+	case AQL_TYPE_S16:
+	    memcpy(&u16, v, 2);
+	    printf("%s%d", sep, (int16_t)u16);
+	    break;
+	case AQL_TYPE_U8:
+	    u8 = *(const uint8_t *)v;
+	    printf("%s%u", sep, u8);
+	    break;
+	case AQL_TYPE_S8:
+	    u8 = *(const uint8_t *)v;
+	    printf("%s%d", sep, (int8_t)u8);
+	    break;
+    }
+}
+
+// one record of raw values in table order
+static void aqlPrintRecord(aqlGroup_t *grp, const uint8_t *p) {
+    int i;
+
+    if (!aqlHeaderDone)
+	aqlPrintHeader(grp);
+
+    for (i = 0; i < grp->numFields; i++) {
+	aqlPrintValue(i == 0, grp->type[i], p);
+	p += aqlTypeSize[grp->type[i]];
+    }
+    printf("\n");
+}
+
+static const uint8_t *aqlVarint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    int shift = 0;
+
+    *v = 0;
+    do {
+	if (p >= end || shift > 63)
+	    return 0;
+	*v |= (uint64_t)(*p & 0x7f) << shift;
+	shift += 7;
+    } while (*p++ & 0x80);
+
+    return p;
+}
+
+// expand the frames of an AqC payload, returns 0 if they do not fit it exactly
+static int aqlBlock(aqlGroup_t *grp, const uint8_t *p, int len, int print) {
+    const uint8_t *end = p + len;
+    uint64_t prev[AQL_MAX_FIELDS];
+    uint8_t rec[AQL_MAX_FIELDS * 8];
+    uint8_t *out;
+    uint64_t v;
+    uint32_t v32;
+    uint16_t v16;
+    int i;
+
+    memset(prev, 0, sizeof(prev));
+
+    while (p < end) {
+	out = rec;
+
+	for (i = 0; i < grp->numFields; i++) {
+	    if (!(p = aqlVarint(p, end, &v)))
+		return 0;
+
+	    switch (grp->type[i]) {
+		case AQL_TYPE_DOUBLE:
+		    prev[i] ^= v;
+		    memcpy(out, &prev[i], 8);
+		    break;
+		case AQL_TYPE_FLOAT:
+		    v32 = (uint32_t)prev[i] ^ (uint32_t)v;
+		    prev[i] = v32;
+		    memcpy(out, &v32, 4);
+		    break;
+		default:
+		    v32 = (uint32_t)prev[i] + ((uint32_t)(v >> 1) ^ (0 - (uint32_t)(v & 1)));
+		    prev[i] = v32;
+		    v16 = v32;
+		    if (aqlTypeSize[grp->type[i]] == 4)
+			memcpy(out, &v32, 4);
+		    else if (aqlTypeSize[grp->type[i]] == 2)
+			memcpy(out, &v16, 2);
+		    else
+			*out = v32;
+		    break;
+	    }
+	    out += aqlTypeSize[grp->type[i]];
+	}
+
+	if (print)
+	    aqlPrintRecord(grp, rec);
+	aqlRawBytes += 3 + (grp != &aqlGroups[0]) + grp->size + 2;
+    }
+
+    return 1;
+}
+
+// decode the record at p, returns its length or 0 if it is not one
+static long aqlRecord(const uint8_t *p, long avail) {
+    aqlGroup_t tmp, *grp;
+    int g, len;
+
+    if (avail < 6 || p[0] != 'A' || p[1] != 'q')
+	return 0;
+
+    switch (p[2]) {
+	case 'H':
+	    if ((len = aqlTable(&tmp, p + 3, avail - 5)) < 0 || !aqlCheck(p, len, avail))
+		return 0;
+	    tmp.rate = 1;
+	    tmp.valid = 1;
+	    aqlGroups[0] = tmp;
+	    break;
+
+	case 'G':
+	    if (avail < 8 || (g = p[3]) >= AQL_MAX_GROUPS)
+		return 0;
+	    if ((len = aqlTable(&tmp, p + 6, avail - 8)) < 0 || !aqlCheck(p, 3 + len, avail))
+		return 0;
+	    len += 3;
+	    tmp.rate = p[4] | (p[5] << 8);
+	    tmp.valid = 1;
+	    aqlGroups[g] = tmp;
+	    break;
+
+	case 'M':
+	    grp = &aqlGroups[0];
+	    if (!grp->valid || !aqlCheck(p, (len = grp->size), avail))
+		return 0;
+	    if (aqlGroup == 0)
+		aqlPrintRecord(grp, p + 3);
+	    aqlRawBytes += 3 + len + 2;
+	    break;
+
+	case 'D':
+	    if ((g = p[3]) >= AQL_MAX_GROUPS)
+		return 0;
+	    grp = &aqlGroups[g];
+	    if (!grp->valid || !aqlCheck(p, (len = 1 + grp->size), avail))
+		return 0;
+	    if (aqlGroup == g)
+		aqlPrintRecord(grp, p + 4);
+	    aqlRawBytes += 3 + len + 2;
+	    break;
+
+	case 'C':
+	    if (avail < 8 || (g = p[3]) >= AQL_MAX_GROUPS)
+		return 0;
+	    grp = &aqlGroups[g];
+	    len = 3 + (p[4] | (p[5] << 8));
+	    if (!grp->valid || !grp->numFields || !aqlCheck(p, len, avail))
+		return 0;
+	    if (!aqlBlock(grp, p + 6, len - 3, aqlGroup == g))
+		return 0;
+	    break;
+
+	default:
+	    return 0;
+    }
+
+    aqlRecords[p[2]]++;
+
+    return 3 + len + 2;
+}
+
+int main(int argc, char **argv) {
+    const char *fileName = 0;
+    uint8_t *buf;
+    long size, pos, n;
+    int stats = 0;
+    clock_t start;
+    FILE *f;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+	if (!strcmp(argv[i], "-g") && i + 1 < argc)
+	    aqlGroup = atoi(argv[++i]);
+	else if (!strcmp(argv[i], "-s"))
+	    stats = 1;
+	else
+	    fileName = argv[i];
+    }
+
+    if (!fileName || aqlGroup < 0 || aqlGroup >= AQL_MAX_GROUPS) {
+	fprintf(stderr, "usage: %s [-g group] [-s] file\n", argv[0]);
+	return 1;
+    }
+
+    if (!(f = fopen(fileName, "rb"))) {
+	perror(fileName);
+	return 1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (!(buf = malloc(size ? size : 1)) || fread(buf, 1, size, f) != (size_t)size) {
+	fprintf(stderr, "%s: read failed\n", fileName);
+	return 1;
+    }
+    fclose(f);
+
+    start = clock();
+
+    // skip anything that does not check out one byte at a time
+    pos = 0;
+    while (pos < size) {
+	if ((n = aqlRecord(buf + pos, size - pos)) > 0) {
+	    pos += n;
+	}
+	else {
+	    if (buf[pos] == 'A' && pos + 1 < size && buf[pos + 1] == 'q')
+		aqlErrors++;
+	    pos++;
+	}
+    }
+
+    if (stats) {
+	double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	fprintf(stderr, "%ld bytes, H %lu G %lu M %lu D %lu C %lu, %lu resyncs\n", size,
+		aqlRecords['H'], aqlRecords['G'], aqlRecords['M'], aqlRecords['D'], aqlRecords['C'], aqlErrors);
+	if (aqlRecords['C'])
+	    fprintf(stderr, "%lu bytes uncompressed, ratio %.2f\n", aqlRawBytes, size ? (double)aqlRawBytes / size : 0.0);
+	if (secs > 0.0)
+	    fprintf(stderr, "decoded at %.1f MB/s\n", size / secs / 1e6);
+    }
+
+    free(buf);
+
+    return 0;
+}
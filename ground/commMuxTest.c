@@ -0,0 +1,424 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    commMuxTest - round trips interleaved multiplexed streams through a
+    Linux socket pair and checks the comm mux scheduler
+
+    build:  make commMuxTest
+    use:    commMuxTest [seed] [frames]
+
+    commMuxFrame, commMuxNext, commMuxCharIn and commMuxDispatch are
+    extracted from onboard/comm.c.  The sender queues frames from several
+    streams on one commMuxTx_t, serves them in the order commMuxNext picks,
+    as _commSchedule() does, and writes them to one end of the pair.  On
+    the way some frames get a byte flipped, some are cut short and some
+    are preceded by line noise.  The other end feeds every byte it reads
+    to commMuxCharIn.
+
+    Every frame that arrives must be one that was sent intact, in order
+    for its stream.  Every intact frame must arrive unless a damaged frame
+    started less than a header and a full payload before it, since a
+    damaged length may swallow that much.  Frames for a stream nobody
+    registered are counted as dropped.  The noise never holds the two
+    sync bytes in a row; a false start there is only caught by the 16 bit
+    checksum, which is not what this tests.
+
+    The scheduler part keeps every stream busy with frames of random size
+    and checks the deficit round robin fairness bound at every pick: two
+    busy streams never drift apart by more than 2 + max/Qa + max/Qb rounds
+    of their quanta.  One stream idles half the time, and must not bring
+    banked credit back with it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "gen/commMux.h"
+
+#define MUX_PORT		0
+#define MUX_MAX_FRAME		(COMM_MUX_HEADER_SIZE + COMM_RX_BUF_SIZE)
+#define MUX_ID_SIZE		5			// stream index & frame number at the start of each payload
+#define MUX_CORRUPT		0.02			// chance a frame gets a byte flipped
+#define MUX_TRUNCATE		0.01			// chance a frame is cut short
+#define MUX_NOISE		0.03			// chance of line noise before a frame
+#define MUX_NOISE_MAX		40
+
+typedef void commRcvrCallback_t(commRcvrStruct_t *r);
+
+// the part of commStruct_t the mux uses
+typedef struct {
+    uint8_t portStreams[MUX_PORT+1];
+    uint8_t streamRcvrs[COMM_MAX_CONSUMERS];
+    commRcvrCallback_t *rcvrFuncs[COMM_MAX_CONSUMERS];
+    uint8_t muxTxSeq[COMM_MUX_STREAMS];
+} commMuxStruct_t;
+
+static commMuxStruct_t commData;
+
+#include "gen/commMux.c"
+
+typedef struct {
+    uint8_t *payload;
+    uint16_t len;
+    uint8_t damaged;
+    uint8_t expected;
+    uint8_t received;
+} muxFrame_t;
+
+// streams sent, the last one has no receiver
+static const uint8_t muxTypes[] = {COMM_STREAM_TYPE_MAVLINK, COMM_STREAM_TYPE_TELEMETRY, COMM_STREAM_TYPE_GPS, COMM_STREAM_TYPE_FILEIO, COMM_STREAM_TYPE_OMAP_CONSOLE};
+#define MUX_NUM_TYPES		(sizeof(muxTypes) / sizeof(muxTypes[0]))
+#define MUX_RCVR_TYPES		(MUX_NUM_TYPES - 1)
+
+static muxFrame_t *muxFrames[MUX_NUM_TYPES];
+static long muxSent[MUX_NUM_TYPES];
+static long muxLast[MUX_NUM_TYPES];
+static commMuxRx_t muxRx;
+static unsigned long muxErrors;
+
+static void muxError(const char *s, int t, long n) {
+    muxErrors++;
+    if (muxErrors < 20)
+	fprintf(stderr, "%s: stream %d frame %ld\n", s, t, n);
+}
+
+static double muxRand(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static int muxTypeIndex(uint8_t type) {
+    unsigned int t;
+
+    for (t = 0; t < MUX_NUM_TYPES; t++)
+	if (muxTypes[t] == type)
+	    return t;
+
+    return -1;
+}
+
+static void muxRcvr(commRcvrStruct_t *r) {
+    muxFrame_t *f;
+    long n;
+    int t;
+
+    if (r->port != MUX_PORT || (t = muxTypeIndex(muxRx.type)) < 0 || r->len < MUX_ID_SIZE || r->buf[0] != t) {
+	muxError("unknown frame", -1, -1);
+	return;
+    }
+
+    n = r->buf[1] | r->buf[2]<<8 | r->buf[3]<<16 | (long)r->buf[4]<<24;
+    if (n < 0 || n >= muxSent[t]) {
+	muxError("frame never sent", t, n);
+	return;
+    }
+    f = &muxFrames[t][n];
+
+    if (n <= muxLast[t])
+	muxError("out of order", t, n);
+    muxLast[t] = n;
+
+    if (f->damaged)
+	muxError("damaged frame accepted", t, n);
+    else if (r->len != f->len || memcmp(r->buf, f->payload, f->len))
+	muxError("payload differs", t, n);
+
+    f->received = 1;
+}
+
+static commTxBuf_t *muxNewFrame(int t, int maxLen) {
+    commTxBuf_t *txBuf;
+    uint8_t *p;
+    muxFrame_t *f;
+    long n = muxSent[t];
+    int len, i;
+
+    len = MUX_ID_SIZE + rand() % (maxLen - MUX_ID_SIZE + 1);
+    txBuf = malloc(COMM_HEADER_SIZE + len);
+    txBuf->type = muxTypes[t];
+
+    p = &txBuf->buf;
+    p[0] = t;
+    p[1] = n;
+    p[2] = n>>8;
+    p[3] = n>>16;
+    p[4] = n>>24;
+    for (i = MUX_ID_SIZE; i < len; i++)
+	p[i] = rand();
+
+    commMuxFrame(txBuf, len);
+
+    if (txBuf->seq != (uint8_t)n)
+	muxError("bad sequence id", t, n);
+
+    f = &muxFrames[t][n];
+    f->payload = malloc(len);
+    memcpy(f->payload, p, len);
+    f->len = len;
+    muxSent[t]++;
+
+    return txBuf;
+}
+
+static void muxPush(commMuxTx_t *mux, int s, commTxBuf_t *txBuf, uint16_t size) {
+    commTxStack_t *stack = &mux->txStack[s][mux->txStackHeads[s]];
+
+    stack->port = MUX_PORT;
+    stack->txBuf = txBuf;
+    stack->memory = txBuf ? txBuf->sync : 0;
+    stack->size = size;
+    mux->txStackHeads[s] = (mux->txStackHeads[s] + 1) % COMM_MUX_DEPTH;
+}
+
+static int muxQueued(commMuxTx_t *mux, int s) {
+    return (mux->txStackHeads[s] - mux->txStackTails[s] + COMM_MUX_DEPTH) % COMM_MUX_DEPTH;
+}
+
+static void muxDrain(int fd) {
+    uint8_t buf[4096];
+    ssize_t n, i;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+	for (i = 0; i < n; i++)
+	    commMuxCharIn(MUX_PORT, &muxRx, buf[i]);
+}
+
+static void muxWrite(int txFd, int rxFd, const uint8_t *p, int len) {
+    ssize_t n;
+
+    while (len > 0) {
+	if ((n = write(txFd, p, len)) > 0) {
+	    p += n;
+	    len -= n;
+	}
+	muxDrain(rxFd);
+    }
+}
+
+static void muxRoundTrip(long frames) {
+    commMuxTx_t mux;
+    commTxStack_t *stack;
+    commTxBuf_t *txBuf;
+    uint8_t noise[MUX_NOISE_MAX], wire[MUX_MAX_FRAME];
+    uint8_t *p;
+    long wirePos = 0, lastDamage = -MUX_MAX_FRAME - 1, total = 0, expected = 0, received = 0, unclaimed = 0;
+    muxFrame_t *f;
+    int fds[2], s, len, i, j;
+    unsigned int k;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+	perror("socketpair");
+	exit(1);
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    memset(&commData, 0, sizeof(commData));
+    memset(&mux, 0, sizeof(mux));
+    memset(&muxRx, 0, sizeof(muxRx));
+
+    commData.portStreams[MUX_PORT] = COMM_STREAM_TYPE_MULTIPLEX;
+    for (k = 0; k < MUX_NUM_TYPES; k++)
+	commData.portStreams[MUX_PORT] |= muxTypes[k];
+    for (k = 0; k < MUX_RCVR_TYPES; k++) {
+	commData.streamRcvrs[k] = muxTypes[k];
+	commData.rcvrFuncs[k] = muxRcvr;
+    }
+
+    for (k = 0; k < MUX_NUM_TYPES; k++) {
+	muxFrames[k] = calloc(frames, sizeof(muxFrame_t));
+	muxSent[k] = 0;
+	muxLast[k] = -1;
+    }
+
+    while (total < frames) {
+	// new traffic from random streams, up to the stack depth
+	for (k = 0; k < MUX_NUM_TYPES; k++) {
+	    s = commMuxIndex(muxTypes[k]);
+	    if (muxSent[k] < frames && muxQueued(&mux, s) < COMM_MUX_DEPTH - 1 && muxRand() < 0.3) {
+		len = (k == 0) ? 64 : (k == 3) ? COMM_RX_BUF_SIZE : 256;
+		txBuf = muxNewFrame(k, len);
+		muxPush(&mux, s, txBuf, txBuf->len + COMM_MUX_HEADER_SIZE);
+	    }
+	}
+
+	if ((s = commMuxNext(&mux)) < 0)
+	    continue;
+
+	// the port accepts it right away
+	stack = &mux.txStack[s][mux.txStackTails[s]];
+	mux.deficit[s] -= stack->size;
+	mux.txStackTails[s] = (mux.txStackTails[s] + 1) % COMM_MUX_DEPTH;
+
+	txBuf = stack->txBuf;
+	p = &txBuf->buf;
+	f = &muxFrames[p[0]][p[1] | p[2]<<8 | p[3]<<16 | (long)p[4]<<24];
+	len = stack->size;
+	memcpy(wire, stack->memory, len);
+	free(txBuf);
+
+	if (muxRand() < MUX_NOISE) {
+	    j = 1 + rand() % MUX_NOISE_MAX;
+	    for (i = 0; i < j; i++) {
+		noise[i] = (muxRand() < 0.2) ? COMM_MUX_SYNC1 : rand();
+		if (i > 0 && noise[i-1] == COMM_MUX_SYNC1 && noise[i] == COMM_MUX_SYNC2)
+		    noise[i] = COMM_MUX_SYNC1;
+	    }
+	    muxWrite(fds[0], fds[1], noise, j);
+	    wirePos += j;
+	}
+
+	if (muxRand() < MUX_CORRUPT) {
+	    wire[rand() % len] ^= 1 + rand() % 255;
+	    f->damaged = 1;
+	}
+	else if (muxRand() < MUX_TRUNCATE) {
+	    len = rand() % len;
+	    f->damaged = 1;
+	}
+
+	if (f->damaged)
+	    lastDamage = wirePos;
+	else if (wirePos - lastDamage > MUX_MAX_FRAME)
+	    f->expected = 1;
+
+	muxWrite(fds[0], fds[1], wire, len);
+	wirePos += len;
+	total++;
+    }
+
+    // flush a frame swallowed at the very end
+    memset(wire, 0, sizeof(wire));
+    muxWrite(fds[0], fds[1], wire, sizeof(wire));
+    muxDrain(fds[1]);
+
+    for (k = 0; k < MUX_NUM_TYPES; k++) {
+	for (i = 0; i < muxSent[k]; i++) {
+	    f = &muxFrames[k][i];
+	    if (k < MUX_RCVR_TYPES) {
+		if (f->expected && !f->received)
+		    muxError("intact frame lost", k, i);
+		expected += f->expected;
+		received += f->received;
+	    }
+	    else {
+		unclaimed += f->expected;
+	    }
+	    free(f->payload);
+	}
+	free(muxFrames[k]);
+    }
+
+    if (muxRx.dropped < unclaimed)
+	muxError("unclaimed frames not dropped", MUX_RCVR_TYPES, muxRx.dropped);
+    if (muxRx.frames != received)
+	muxError("frame count", -1, muxRx.frames);
+
+    printf("round trip: %ld frames, %ld bytes, %ld must arrive, %ld did, %u checksum errors, %u dropped\n", total, wirePos, expected, received, muxRx.errors, muxRx.dropped);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void muxFairness(long picks) {
+    commMuxTx_t mux;
+    commTxStack_t *stack;
+    long served[COMM_MUX_STREAMS];
+    double share, worst = 0.0, bound;
+    int idle = COMM_MUX_STREAMS - 1;
+    int busy, s, a, b;
+    long i;
+
+    memset(&mux, 0, sizeof(mux));
+    memset(served, 0, sizeof(served));
+
+    if (commMuxNext(&mux) != -1)
+	muxError("pick from an empty mux", -1, 0);
+
+    for (i = 0; i < picks; i++) {
+	// the last stream comes and goes, counting from when it comes back
+	busy = (i / 5000) & 1;
+	for (s = 0; s < COMM_MUX_STREAMS; s++) {
+	    if (s == idle && !busy)
+		continue;
+	    if (s == idle && muxQueued(&mux, s) == 0) {
+		if (mux.deficit[s])
+		    muxError("banked credit", s, i);
+		for (a = 0; a < COMM_MUX_STREAMS; a++)
+		    served[a] = 0;
+	    }
+	    while (muxQueued(&mux, s) < COMM_MUX_DEPTH - 1)
+		muxPush(&mux, s, 0, COMM_MUX_HEADER_SIZE + rand() % (COMM_RX_BUF_SIZE + 1));
+	}
+
+	if ((s = commMuxNext(&mux)) < 0) {
+	    muxError("nothing picked", -1, i);
+	    break;
+	}
+
+	stack = &mux.txStack[s][mux.txStackTails[s]];
+	if (stack->size > mux.deficit[s])
+	    muxError("sent past its deficit", s, i);
+	mux.deficit[s] -= stack->size;
+	mux.txStackTails[s] = (mux.txStackTails[s] + 1) % COMM_MUX_DEPTH;
+	served[s] += stack->size;
+
+	for (a = 0; a < COMM_MUX_STREAMS; a++) {
+	    for (b = a + 1; b < COMM_MUX_STREAMS; b++) {
+		if ((a == idle || b == idle) && !busy)
+		    continue;
+		share = (double)served[a] / commMuxQuanta[a] - (double)served[b] / commMuxQuanta[b];
+		bound = 2.0 + (double)MUX_MAX_FRAME / commMuxQuanta[a] + (double)MUX_MAX_FRAME / commMuxQuanta[b];
+		if (share < 0.0)
+		    share = -share;
+		if (share / bound > worst)
+		    worst = share / bound;
+		if (share > bound)
+		    muxError("unfair", a * 10 + b, i);
+	    }
+	}
+    }
+
+    // drain, the mux must say so when it is done
+    while ((s = commMuxNext(&mux)) >= 0) {
+	mux.deficit[s] -= mux.txStack[s][mux.txStackTails[s]].size;
+	mux.txStackTails[s] = (mux.txStackTails[s] + 1) % COMM_MUX_DEPTH;
+    }
+
+    printf("scheduler: %ld picks, worst drift %.3f of the fairness bound\n", picks, worst);
+}
+
+int main(int argc, char **argv) {
+    long frames;
+
+    srand((argc > 1) ? atoi(argv[1]) : 1);
+    frames = (argc > 2) ? atol(argv[2]) : 20000;
+
+    muxFairness(200000);
+    muxRoundTrip(frames);
+
+    if (muxErrors)
+	printf("%lu errors\n", muxErrors);
+
+    return muxErrors ? 1 : 0;
+}
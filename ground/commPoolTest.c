@@ -0,0 +1,269 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    commPoolTest - multithreaded stress test of the lock free comm tx
+    packet pool (commTxBufPop/commTxBufFree in onboard/comm.c)
+
+    build:  make commPoolTest
+    use:    commPoolTest [threads] [iterations per thread]
+
+    The pool code is extracted from onboard/comm.c and laid out the way
+    commInit() does it.  Each thread stands in for a task or the DMA
+    completion ISR: it keeps a few buffers at a time, stamps the ones it
+    owns and checks nobody else wrote them, and hands some to the next
+    thread to free, like a completion on another context.  Afterwards
+    every size class must hold each of its buffers exactly once.
+
+    With the ABA tags taken out of commTxBufPop/commTxBufFree this
+    reports millions of errors, so it does exercise the races.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "gen/commPool.h"
+
+#define POOL_MAX_THREADS	16
+#define POOL_HELD		8		// buffers a thread may hold at once
+
+// the part of commStruct_t the pool uses
+typedef struct {
+    uint16_t txPacketBufSizes[COMM_TX_NUM_SIZES];
+    uint8_t txPacketBufNum[COMM_TX_NUM_SIZES];
+    void *txPacketBufs[COMM_TX_NUM_SIZES];
+    volatile uint32_t txBufFreeHeads[COMM_TX_NUM_SIZES];
+    volatile uint8_t txBufFree[COMM_TX_NUM_SIZES];
+    uint8_t txBufLow[COMM_TX_NUM_SIZES];
+} commPoolStruct_t;
+
+static commPoolStruct_t commData;
+
+// give up the CPU between reading the top and swapping it now and then,
+// so the races an ISR would cause on the target also happen on one host core
+static __thread unsigned int poolTick;
+
+static int poolCas(volatile uint32_t *ptr, uint32_t oldVal, uint32_t newVal) {
+    if (!(++poolTick % 5))
+	sched_yield();
+
+    return __sync_bool_compare_and_swap(ptr, oldVal, newVal);
+}
+
+#define __sync_bool_compare_and_swap(ptr, oldVal, newVal)	poolCas(ptr, oldVal, newVal)
+#include "gen/commPool.c"
+#undef __sync_bool_compare_and_swap
+
+static volatile uint8_t poolOwner[COMM_TX_NUM_SIZES][256];
+static commTxBuf_t *volatile poolMailbox[POOL_MAX_THREADS];
+static volatile unsigned long poolErrors;
+static unsigned long poolEmpty[POOL_MAX_THREADS];
+static unsigned long poolHandoffs[POOL_MAX_THREADS];
+static int poolThreads;
+static long poolIterations;
+
+static int poolClass(commTxBuf_t *txBuf, int *n) {
+    int size;
+
+    for (size = COMM_TX_NUM_SIZES-1; size > 0; size--)
+	if ((void *)txBuf >= commData.txPacketBufs[size])
+	    break;
+
+    *n = ((uint8_t *)txBuf - (uint8_t *)commData.txPacketBufs[size]) / (commData.txPacketBufSizes[size] + COMM_HEADER_SIZE);
+
+    return size;
+}
+
+static void poolError(const char *s, int size, int n) {
+    __sync_add_and_fetch(&poolErrors, 1);
+    fprintf(stderr, "%s: class %d buffer %d\n", s, size, n);
+}
+
+static void poolClaim(commTxBuf_t *txBuf, int id) {
+    int size, n;
+
+    size = poolClass(txBuf, &n);
+    if (__sync_lock_test_and_set(&poolOwner[size][n], id + 1) != 0)
+	poolError("popped twice", size, n);
+
+    txBuf->status = COMM_TX_BUF_ALLOCATED;
+    memset(&txBuf->buf, id + 1, commData.txPacketBufSizes[size]);
+}
+
+static void poolRelease(commTxBuf_t *txBuf, int id) {
+    uint8_t *p = &txBuf->buf;
+    int size, n, i;
+
+    size = poolClass(txBuf, &n);
+    for (i = 0; i < commData.txPacketBufSizes[size]; i++) {
+	if (p[i] != id + 1) {
+	    poolError("written while owned", size, n);
+	    break;
+	}
+    }
+
+    __sync_lock_release(&poolOwner[size][n]);
+    commTxBufFree(txBuf);
+}
+
+static void *poolThread(void *arg) {
+    int id = (int)(intptr_t)arg;
+    commTxBuf_t *held[POOL_HELD];
+    commTxBuf_t *txBuf;
+    unsigned int seed = id * 7919 + 1;
+    int numHeld = 0;
+    int next = (id + 1) % poolThreads;
+    long i;
+
+    for (i = 0; i < poolIterations; i++) {
+	// completions handed over from the previous thread
+	if ((txBuf = __sync_lock_test_and_set(&poolMailbox[id], 0)) != 0) {
+	    memset(&txBuf->buf, id + 1, commData.txPacketBufSizes[poolClass(txBuf, &(int){0})]);
+	    poolRelease(txBuf, id);
+	}
+
+	if (numHeld < POOL_HELD && (numHeld == 0 || rand_r(&seed) & 1)) {
+	    if ((txBuf = commTxBufPop(rand_r(&seed) % COMM_TX_NUM_SIZES)) != 0) {
+		poolClaim(txBuf, id);
+		held[numHeld++] = txBuf;
+	    }
+	    else {
+		poolEmpty[id]++;
+	    }
+	}
+	else if (numHeld) {
+	    txBuf = held[--numHeld];
+
+	    // a completion on another context frees it
+	    if (poolThreads > 1 && !(rand_r(&seed) & 3) && __sync_bool_compare_and_swap(&poolMailbox[next], 0, txBuf)) {
+		poolHandoffs[id]++;
+	    }
+	    else {
+		poolRelease(txBuf, id);
+	    }
+	}
+
+	if (!(i & 0xff))
+	    sched_yield();
+    }
+
+    while (numHeld)
+	poolRelease(held[--numHeld], id);
+
+    return 0;
+}
+
+// same layout as commInit()
+static void poolInit(void) {
+    uint8_t *txBufs;
+    int i, j;
+
+    j = 0;
+    for (i = 0; i < COMM_TX_NUM_SIZES; i++) {
+	commData.txPacketBufSizes[i] = commTxBufSizes[i];
+	commData.txPacketBufNum[i] = commTxBufNums[i];
+	j += commData.txPacketBufNum[i] * (commData.txPacketBufSizes[i] + COMM_HEADER_SIZE);
+    }
+    txBufs = calloc(j, sizeof(uint8_t));
+
+    for (i = 0; i < COMM_TX_NUM_SIZES; i++) {
+	commData.txPacketBufs[i] = txBufs;
+	txBufs += commData.txPacketBufNum[i] * (commData.txPacketBufSizes[i] + COMM_HEADER_SIZE);
+    }
+
+    for (i = 0; i < COMM_TX_NUM_SIZES; i++) {
+	commData.txBufFreeHeads[i] = COMM_TX_BUF_NONE;
+	commData.txBufFree[i] = 0;
+	commData.txBufLow[i] = commData.txPacketBufNum[i];
+	for (j = commData.txPacketBufNum[i]-1; j >= 0; j--)
+	    commTxBufFree(commTxBufAddr(i, j));
+    }
+}
+
+// every buffer on its free list exactly once
+static void poolCheck(void) {
+    uint8_t seen[256];
+    uint16_t n;
+    int i, count;
+
+    for (i = 0; i < COMM_TX_NUM_SIZES; i++) {
+	memset(seen, 0, sizeof(seen));
+	count = 0;
+
+	n = commData.txBufFreeHeads[i] & 0xffff;
+	while (n != COMM_TX_BUF_NONE && count <= commData.txPacketBufNum[i]) {
+	    if (n >= commData.txPacketBufNum[i]) {
+		poolError("bad link", i, n);
+		break;
+	    }
+	    if (seen[n]++)
+		poolError("listed twice", i, n);
+	    if (commTxBufAddr(i, n)->status != COMM_TX_BUF_FREE)
+		poolError("free but not marked free", i, n);
+	    count++;
+	    n = commTxBufAddr(i, n)->len;
+	}
+
+	if (count != commData.txPacketBufNum[i] || commData.txBufFree[i] != commData.txPacketBufNum[i])
+	    poolError("buffers lost", i, count);
+
+	printf("class %3u x%-2u low water %u\n", commData.txPacketBufSizes[i], commData.txPacketBufNum[i], commData.txBufLow[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    pthread_t threads[POOL_MAX_THREADS];
+    unsigned long empty = 0, handoffs = 0;
+    int i;
+
+    poolThreads = (argc > 1) ? atoi(argv[1]) : 4;
+    poolIterations = (argc > 2) ? atol(argv[2]) : 2000000;
+
+    if (poolThreads < 1 || poolThreads > POOL_MAX_THREADS) {
+	fprintf(stderr, "usage: %s [threads 1-%d] [iterations]\n", argv[0], POOL_MAX_THREADS);
+	return 1;
+    }
+
+    poolInit();
+
+    for (i = 0; i < poolThreads; i++)
+	pthread_create(&threads[i], 0, poolThread, (void *)(intptr_t)i);
+    for (i = 0; i < poolThreads; i++)
+	pthread_join(threads[i], 0);
+
+    // whatever is still in flight between threads
+    for (i = 0; i < poolThreads; i++) {
+	if (poolMailbox[i]) {
+	    memset(&poolMailbox[i]->buf, i + 1, commData.txPacketBufSizes[poolClass(poolMailbox[i], &(int){0})]);
+	    poolRelease(poolMailbox[i], i);
+	}
+	empty += poolEmpty[i];
+	handoffs += poolHandoffs[i];
+    }
+
+    poolCheck();
+
+    printf("%d threads x %ld iterations, %lu empty pops, %lu cross thread frees, %lu errors\n",
+	poolThreads, poolIterations, empty, handoffs, poolErrors);
+
+    return poolErrors ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+#
+# Pull named definitions out of an onboard source file so host tests
+# can compile the firmware's own code without its hardware headers.
+#
+#   awk -v names="commTxBufPop commTxBuf_t COMM_HEADER_SIZE" -f extract.awk ../onboard/comm.c
+#
+# A name matches a function defined at column 0 (through its closing
+# brace at column 0), a typedef'd struct/enum/union ending in "} name;",
+# a named enum "enum name {", an anonymous enum holding "name" as one of
+# its constants, a file scope "static const ... name[...] = ..." table
+# on one line or running to "};", a table "... name[] = {" running to
+# "};" or a single line "#define name".
+#
+
+BEGIN {
+    n = split(names, list, " ")
+    for (i = 1; i <= n; i++)
+	want[list[i]] = 1
+    mode = ""
+}
+
+# vendor files keep CRLF
+{
+    sub(/\r$/, "")
+}
+
+function flush() {
+    printf "%s", block
+    block = ""
+}
+
+# inside a function or named enum, copy through the closing brace
+mode == "copy" {
+    print
+    if ($0 ~ /^}/) {
+	mode = ""
+	print ""
+    }
+    next
+}
+
+# inside an anonymous enum, keep it if any constant is wanted
+mode == "enum" {
+    block = block $0 "\n"
+    t = $0
+    if (sub(/^[ \t]*/, "", t) && match(t, /^[A-Za-z_][A-Za-z_0-9]*/) && substr(t, 1, RLENGTH) in want)
+	keep = 1
+    if ($0 ~ /^}/) {
+	if (keep)
+	    flush()
+	else
+	    block = ""
+	mode = ""
+    }
+    next
+}
+
+# inside a typedef, keep it only if its name is wanted
+mode == "typedef" {
+    block = block $0 "\n"
+    if ($0 ~ /^}/) {
+	t = $0
+	sub(/;.*/, "", t)
+	sub(/.*[ }]/, "", t)
+	if (t in want)
+	    flush()
+	else
+	    block = ""
+	mode = ""
+    }
+    next
+}
+
+/^#define[ \t]/ {
+    t = $2
+    sub(/\(.*/, "", t)
+    if (t in want) {
+	print
+	while ($0 ~ /\\$/ && (getline) > 0)
+	    print
+    }
+    next
+}
+
+/^typedef (struct|enum|union)[^;]*$/ {
+    block = $0 "\n"
+    mode = "typedef"
+    next
+}
+
+/^enum [A-Za-z_0-9]+ *\{/ {
+    t = $2
+    sub(/\{.*/, "", t)
+    if (t in want) {
+	print
+	mode = "copy"
+    }
+    next
+}
+
+/^enum *\{ *$/ {
+    block = $0 "\n"
+    keep = 0
+    mode = "enum"
+    next
+}
+
+/^static const [^(]*\[[^(]*=/ {
+    t = $0
+    sub(/\[.*/, "", t)
+    sub(/.*[ *]/, "", t)
+    if (t in want) {
+	print
+	if ($0 ~ /\{ *$/)
+	    mode = "copy"
+    }
+    next
+}
+
+/^[A-Za-z_][^;=(]*[ *][A-Za-z_0-9]+\[[^]]*\] *= *\{ *$/ {
+    t = $0
+    sub(/\[.*/, "", t)
+    sub(/.*[ *]/, "", t)
+    if (t in want) {
+	print
+	mode = "copy"
+    }
+    next
+}
+
+/^[A-Za-z_][^;=]*[ *][A-Za-z_0-9]+\(.*\) *\{ *$/ {
+    t = $0
+    sub(/\(.*/, "", t)
+    sub(/.*[ *]/, "", t)
+    if (t in want) {
+	print
+	mode = "copy"
+    }
+    next
+}
@@ -0,0 +1,420 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    fatBench - card traffic of the filer's log streams on a FAT32 image
+    holding gigabytes of logs, with and without the FAT sector cache
+
+    build:  make fatBench fatBench0
+    use:    fatBench [MB of logs] [MB per log] [image GB]
+
+    onboard/ff.c is compiled whole with 32 bit DWORDs (fatBench0 with
+    _FAT_CACHE 0) on top of a disk_read/disk_write backed by a sparse
+    file, formatted by f_mkfs with 32KB clusters like a stock SDHC card.
+    The stream, sync and close code is the filer's own, extracted from
+    onboard/filer.c.  A logger fills a 63KB ring at 40KB/s in 200Hz
+    filer loops, so syncs come every second of log as they do in flight.
+    Multi sector writes are the raw stream's log data: they are counted
+    and dropped, which keeps the image sparse.  Everything FatFs writes
+    a sector at a time lands in the image.
+
+    Logs are streamed one after another until the total is reached,
+    the volume is remounted and one more log is written, then a log
+    whose ring is not sector aligned goes through f_write.  Reported
+    per phase are FAT and other (directory, FSINFO) sector reads and
+    writes; for each block reservation the FAT sectors f_expand read,
+    which is how long the filer task is busy while the ring fills.
+
+    Afterwards every log must have its exact size and the clusters in
+    use must add up to the logs' sizes, so nothing reserved but not
+    written is left behind.  The hash of the FAT and the root directory
+    must be the same for fatBench and fatBench0.
+
+    With the defaults (4 x 1GB) f_expand walked the whole chain for every
+    block, 267 FAT sectors by the end of each log, until it started from
+    where its previous expansion ended.  A log closed right at the end of
+    a block kept the size of its last sync, and a 4095MB log wrapped the
+    32 bit size at its 128th block and left its unwritten end allocated.
+    Both fail the checks here.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define sync ffSync		// not unistd.h's
+#include "ff.c"
+#undef sync
+
+typedef int OS_FlagID;
+
+#include "gen/filer.h"
+
+#define BENCH_RATE	40000		// B/s into the log ring
+#define BENCH_LOOP_HZ	200		// filer loops per second
+#define BENCH_RING	((1<<16)-1024)	// as loggerInit sizes it
+#define BENCH_AU	32768		// bytes per cluster
+
+typedef struct {
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+} benchLatency_t;
+
+typedef struct {
+    struct {
+	benchLatency_t sync;
+    } diskStats;
+    char buf[64];
+    uint32_t session;
+    uint32_t loops;
+} filerStruct_t;
+
+typedef struct {
+    uint32_t fatReads, fatWrites;
+    uint32_t otherReads, otherWrites;
+    uint32_t streamWrites;
+    uint64_t streamSectors;
+} benchIo_t;
+
+filerStruct_t filerData;
+
+static FATFS benchFs;
+static int benchFd;
+static DWORD benchSectors;
+static benchIo_t benchIo;
+static uint8_t benchRing[BENCH_RING] __attribute__((aligned(4)));
+
+static uint32_t timerMicros(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void utilLatencyAdd(benchLatency_t *l, uint32_t us) {
+    l->count++;
+    l->sum += us;
+    if (us > l->max)
+	l->max = us;
+}
+
+#include "gen/filer.c"
+
+static int benchIsFat(DWORD sect) {
+    FATFS *fs = FatFs[0];
+
+    return fs && fs->fs_type && sect >= fs->fatbase && sect < fs->fatbase + fs->fsize * fs->n_fats;
+}
+
+DSTATUS disk_initialize(BYTE drv) {
+    return 0;
+}
+
+DSTATUS disk_status(BYTE drv) {
+    return 0;
+}
+
+DRESULT disk_read(BYTE drv, BYTE *buf, DWORD sect, BYTE count) {
+    if (sect + count > benchSectors || pread(benchFd, buf, count * 512, (off_t)sect * 512) != count * 512)
+	return RES_ERROR;
+
+    if (benchIsFat(sect))
+	benchIo.fatReads += count;
+    else
+	benchIo.otherReads += count;
+
+    return RES_OK;
+}
+
+DRESULT disk_write(BYTE drv, const BYTE *buf, DWORD sect, BYTE count) {
+    if (sect + count > benchSectors)
+	return RES_ERROR;
+
+    if (count > 1) {
+	benchIo.streamWrites++;
+	benchIo.streamSectors += count;
+	return RES_OK;
+    }
+
+    if (pwrite(benchFd, buf, 512, (off_t)sect * 512) != 512)
+	return RES_ERROR;
+
+    if (benchIsFat(sect))
+	benchIo.fatWrites++;
+    else
+	benchIo.otherWrites++;
+
+    return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buf) {
+    switch (ctrl) {
+    case CTRL_SYNC:
+	return RES_OK;
+    case GET_SECTOR_COUNT:
+	*(DWORD *)buf = benchSectors;
+	return RES_OK;
+    case GET_SECTOR_SIZE:
+	*(WORD *)buf = 512;
+	return RES_OK;
+    case GET_BLOCK_SIZE:
+	*(DWORD *)buf = 8192;		// 4MB allocation unit
+	return RES_OK;
+    }
+
+    return RES_PARERR;
+}
+
+DWORD get_fattime(void) {
+    return ((2014 - 1980) << 25) | (1 << 21) | (1 << 16);
+}
+
+typedef struct {
+    uint32_t expands;
+    uint32_t expandFatMax;		// FAT sectors read by the worst f_expand
+    uint32_t expandFatLast;
+    uint32_t expandMicrosMax;
+    benchIo_t io;
+} benchPhase_t;
+
+static void benchIoDiff(benchIo_t *d, const benchIo_t *a, const benchIo_t *b) {
+    d->fatReads = b->fatReads - a->fatReads;
+    d->fatWrites = b->fatWrites - a->fatWrites;
+    d->otherReads = b->otherReads - a->otherReads;
+    d->otherWrites = b->otherWrites - a->otherWrites;
+    d->streamWrites = b->streamWrites - a->streamWrites;
+    d->streamSectors = b->streamSectors - a->streamSectors;
+}
+
+// stream one log the way the logger and filer task do, returns 0 when closed cleanly
+static int benchLog(filerFileStruct_t *f, uint32_t bytes, benchPhase_t *p) {
+    uint32_t step = BENCH_RATE / BENCH_LOOP_HZ;
+    uint32_t written = 0;
+    uint32_t sects, start, us;
+    benchIo_t io0, io1, d;
+
+    io0 = benchIo;
+    f->head = f->tail = 0;
+    f->gapMax = 0;
+    filerData.loops = 0;
+
+    while (written < bytes) {
+	if (step > bytes - written)
+	    step = bytes - written;
+	f->head = (f->head + step) % f->length;
+	written += step;
+
+	sects = f->sects;
+	io1 = benchIo;
+	start = timerMicros();
+	if (filerProcessStream(f, 0) < 0)
+	    return -1;
+	if (f->sects != sects) {
+	    us = timerMicros() - start;
+	    benchIoDiff(&d, &io1, &benchIo);
+	    p->expands++;
+	    p->expandFatLast = d.fatReads;
+	    if (d.fatReads > p->expandFatMax)
+		p->expandFatMax = d.fatReads;
+	    if (us > p->expandMicrosMax)
+		p->expandMicrosMax = us;
+	}
+
+	if (!(++filerData.loops % FILER_STREAM_SYNC) && filerProcessSync(f) < 0)
+	    return -1;
+	if (f->gapMax >= f->length - step)
+	    return -1;
+    }
+
+    if (filerProcessStream(f, 1) < 0 || f->head != f->tail || filerProcessClose(f) < 0)
+	return -1;
+
+    io1 = benchIo;
+    benchIoDiff(&d, &io0, &io1);
+    p->io.fatReads += d.fatReads;
+    p->io.fatWrites += d.fatWrites;
+    p->io.otherReads += d.otherReads;
+    p->io.otherWrites += d.otherWrites;
+    p->io.streamWrites += d.streamWrites;
+    p->io.streamSectors += d.streamSectors;
+
+    return 0;
+}
+
+static void benchReport(const char *name, uint32_t logs, uint64_t bytes, benchPhase_t *p) {
+    double mb = bytes / (double)(1<<20);
+
+    printf("%-10s %4u %8.0f %9u %9u %9u %9u %7u %8u %8u %8u\n", name, logs, mb,
+	p->io.fatReads, p->io.fatWrites, p->io.otherReads, p->io.otherWrites,
+	p->expands, p->expandFatLast, p->expandFatMax, p->expandMicrosMax);
+}
+
+static uint32_t benchHash(uint32_t h, const BYTE *buf, int n) {
+    while (n--)
+	h = (h ^ *buf++) * 16777619;
+
+    return h;
+}
+
+// log sizes, cluster usage against the FAT and a hash of the FAT and root directory
+static int benchCheck(uint32_t nLogs, const uint32_t *sizes) {
+    FATFS *fs = &benchFs;
+    DIR dir;
+    FILINFO fno;
+    BYTE buf[512];
+    uint32_t n, i, clst, used, want, h;
+    DWORD sect;
+
+    if (f_opendir(&dir, "/") != FR_OK)
+	return -1;
+
+    n = 0;
+    want = 0;
+    while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0]) {
+	if (sscanf(fno.fname, "%u-", &i) != 1 || i >= nLogs || fno.fsize != sizes[i]) {
+	    fprintf(stderr, "%s: %u bytes\n", fno.fname, (unsigned)fno.fsize);
+	    return -1;
+	}
+	want += (fno.fsize + BENCH_AU - 1) / BENCH_AU;
+	n++;
+    }
+    if (n != nLogs) {
+	fprintf(stderr, "%u logs on the volume, %u written\n", n, nLogs);
+	return -1;
+    }
+
+    used = 0;
+    for (clst = 2; clst < fs->n_fatent; clst++)
+	if (get_fat(fs, clst))
+	    used++;
+    used--;				// root directory
+    if (used != want) {
+	fprintf(stderr, "%u clusters in use, %u for the logs\n", used, want);
+	return -1;
+    }
+
+    h = 2166136261u;
+    for (sect = fs->fatbase; sect < fs->fatbase + fs->fsize; sect++) {
+	if (pread(benchFd, buf, 512, (off_t)sect * 512) != 512)
+	    return -1;
+	h = benchHash(h, buf, 512);
+    }
+    for (sect = clust2sect(fs, fs->dirbase); sect < clust2sect(fs, fs->dirbase) + fs->csize; sect++) {
+	if (pread(benchFd, buf, 512, (off_t)sect * 512) != 512)
+	    return -1;
+	h = benchHash(h, buf, 512);
+    }
+    printf("FAT cache %d sectors, %u logs check out, image hash %08x\n", _FAT_CACHE, nLogs, h);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char path[] = "/tmp/fatBenchXXXXXX";
+    uint32_t total = argc > 1 ? atoi(argv[1]) : 4096;
+    uint32_t logMB = argc > 2 ? atoi(argv[2]) : 1024;
+    uint32_t imageGB = argc > 3 ? atoi(argv[3]) : 16;
+    static filerFileStruct_t f;
+    static uint32_t sizes[1000];
+    benchPhase_t streams, remount, fallback;
+    uint32_t nLogs, bytes;
+    uint64_t done;
+    int ret = 1;
+
+    if (!logMB || logMB >= 4096 || !total || total / logMB + 2 > sizeof(sizes)/sizeof(sizes[0]) || imageGB <= total / 1024 + 1) {
+	fprintf(stderr, "usage: fatBench [MB of logs] [MB per log < 4096] [image GB > logs]\n");
+	return 1;
+    }
+
+    benchFd = mkstemp(path);
+    if (benchFd < 0 || unlink(path) || ftruncate(benchFd, (off_t)imageGB << 30)) {
+	perror(path);
+	return 1;
+    }
+    benchSectors = (uint64_t)imageGB << 21;
+
+    if (f_mount(0, &benchFs) != FR_OK || f_mkfs(0, 0, BENCH_AU) != FR_OK || f_mount(0, &benchFs) != FR_OK) {
+	fprintf(stderr, "cannot format the image\n");
+	return 1;
+    }
+
+    memset(&streams, 0, sizeof(streams));
+    memset(&remount, 0, sizeof(remount));
+    memset(&fallback, 0, sizeof(fallback));
+
+    f.buf = benchRing;
+    f.length = BENCH_RING;
+    strcpy(f.fileName, "AQL");
+
+    // raw streams into contiguous blocks until the logs reach the total
+    nLogs = 0;
+    for (done = 0; done < (uint64_t)total << 20; done += bytes) {
+	bytes = logMB << 20;
+	if (bytes > ((uint64_t)total << 20) - done)
+	    bytes = ((uint64_t)total << 20) - done;
+	filerData.session = nLogs;
+	if (benchLog(&f, bytes, &streams) < 0) {
+	    fprintf(stderr, "log %u failed at %u bytes\n", nLogs, f.size);
+	    goto out;
+	}
+	sizes[nLogs++] = bytes;
+    }
+
+    // a new log after a power cycle, the free space hint comes from FSINFO
+    f_mount(0, 0);
+    if (f_mount(0, &benchFs) != FR_OK || f_opendir(&(DIR){0}, "/") != FR_OK)
+	goto out;
+    filerData.session = nLogs;
+    bytes = 64 << 20;
+    if (benchLog(&f, bytes, &remount) < 0) {
+	fprintf(stderr, "log after remount failed\n");
+	goto out;
+    }
+    sizes[nLogs++] = bytes;
+
+    // a ring FatFs has to write through
+    f.length = BENCH_RING - 1;
+    filerData.session = nLogs;
+    bytes = 64 << 20;
+    if (benchLog(&f, bytes, &fallback) < 0) {
+	fprintf(stderr, "log through f_write failed\n");
+	goto out;
+    }
+    sizes[nLogs++] = bytes;
+
+    printf("%-10s %4s %8s %9s %9s %9s %9s %7s %8s %8s %8s\n", "", "logs", "MB",
+	"FAT rd", "FAT wr", "other rd", "other wr", "expands", "last rd", "max rd", "max us");
+    benchReport("raw", nLogs - 2, done, &streams);
+    benchReport("remounted", 1, 64 << 20, &remount);
+    benchReport("f_write", 1, 64 << 20, &fallback);
+    printf("syncs %u, worst %u us\n", filerData.diskStats.sync.count, filerData.diskStats.sync.max);
+
+    if (benchCheck(nLogs, sizes) == 0)
+	ret = 0;
+
+out:
+    close(benchFd);
+
+    return ret;
+}
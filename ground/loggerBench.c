@@ -0,0 +1,322 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    loggerBench - cycles per AqM frame spent building the record:
+    the field copy and the Fletcher checksum
+
+    build:  make loggerBench
+    use:    loggerBench [frames per batch]
+
+    loggerChecksum, loggerCompile and loggerGroupRecord are extracted
+    from onboard/logger.c, the field list from loggerFieldsMain.  Field
+    sizes follow the type switch in loggerSetupGroup.  Where each field
+    is read from in flight depends on how the firmware's structs are laid
+    out, which the host does not know, so the sources are placed in a
+    scratch area with gaps that split them into a chosen number of copy
+    runs, from every field alone to one run for the whole frame.
+    loggerCompile must find exactly that many.
+
+    For comparison the same frame is also built the way loggerDo did
+    before the copy runs: one call through a function pointer per field
+    and a checksum a byte at a time.  Records start at every alignment
+    the stream head can be at.  loggerChecksum is checked against the
+    byte loop for every length and alignment up to a few frames.
+
+    Counts are TSC ticks on the host (ns elsewhere), the minimum over
+    several batches.  They rank the variants; they are not Cortex-M4
+    cycles.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "gen/logger.h"
+
+#define aqDataCalloc(n, s)	calloc(n, s)
+
+typedef char TCHAR;
+
+typedef struct {
+    TCHAR *loggerBuf;
+    TCHAR *recBuf;
+    uint32_t bufSize;
+    loggerGroup_t groups[LOGGER_NUM_GROUPS];
+    uint32_t loops;
+    int32_t recHead;
+    uint16_t recSize;
+    uint8_t logHandle;
+} loggerStruct_t;
+
+loggerStruct_t loggerData;
+
+static char benchRec[4096];
+static int benchAlign;
+
+// the stream head lands on any byte
+static char *loggerBegin(uint16_t size) {
+    return benchRec + benchAlign;
+}
+
+static void loggerCommit(char *buf) {
+    benchAlign = (benchAlign + 1) & 3;
+}
+
+#include "gen/logger.c"
+
+#define BENCH_BATCHES		50
+#define BENCH_GAP		8			// bytes between runs in the scratch area
+
+typedef int benchCopy_t(void *to, void *from);
+
+static benchCopy_t *benchCopyFuncs[256];		// numFields is a uint8_t
+static volatile uint32_t benchSink;
+
+static uint64_t benchTicks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// the per field copy functions loggerDo used to call
+static int benchCopy8(void *to, void *from) {
+    memcpy(to, from, 8);
+    return 8;
+}
+
+static int benchCopy4(void *to, void *from) {
+    memcpy(to, from, 4);
+    return 4;
+}
+
+static int benchCopy2(void *to, void *from) {
+    memcpy(to, from, 2);
+    return 2;
+}
+
+static int benchCopy1(void *to, void *from) {
+    *(uint8_t *)to = *(uint8_t *)from;
+    return 1;
+}
+
+static void benchChecksumBytes(const uint8_t *buf, int len, uint8_t *ckA, uint8_t *ckB) {
+    uint8_t a = 0, b = 0;
+
+    while (len--) {
+	a += *buf++;
+	b += a;
+    }
+
+    *ckA = a;
+    *ckB = b;
+}
+
+static int benchSize(uint8_t type) {
+    switch (type) {
+	case LOG_TYPE_DOUBLE:
+	    return 8;
+	case LOG_TYPE_FLOAT:
+	case LOG_TYPE_U32:
+	case LOG_TYPE_S32:
+	    return 4;
+	case LOG_TYPE_U16:
+	case LOG_TYPE_S16:
+	    return 2;
+	default:
+	    return 1;
+    }
+}
+
+// loggerChecksum must give what the byte loop gives
+static int benchCheckChecksum(void) {
+    uint8_t buf[1024 + 4];
+    uint8_t a1, b1, a2, b2;
+    int len, off, errors = 0;
+
+    for (len = 0; len < (int)sizeof(buf) - 4; len++)
+	buf[len] = rand();
+
+    for (off = 0; off < 4; off++) {
+	for (len = 0; len <= 1024; len++) {
+	    loggerChecksum(buf + off, len, &a1, &b1);
+	    benchChecksumBytes(buf + off, len, &a2, &b2);
+	    if (a1 != a2 || b1 != b2) {
+		if (errors++ < 5)
+		    fprintf(stderr, "checksum differs, offset %d length %d\n", off, len);
+	    }
+	}
+    }
+
+    return errors;
+}
+
+// place the sources so they fall into the given number of runs
+static int benchLayout(loggerGroup_t *grp, uint8_t *scratch, int runs) {
+    uint8_t *p = scratch;
+    int i, size;
+
+    for (i = 0; i < grp->numFields; i++) {
+	size = grp->fp[i].size;
+	if (i && (long)i * runs / grp->numFields != (long)(i - 1) * runs / grp->numFields)
+	    p += BENCH_GAP;
+	grp->fp[i].fieldPointer = p;
+	p += size;
+    }
+
+    free(grp->runs);
+    loggerCompile(grp);
+
+    return grp->numRuns;
+}
+
+static double benchPerField(loggerGroup_t *grp, long frames) {
+    uint64_t t, best = ~0ULL;
+    uint8_t ckA, ckB;
+    char *buf;
+    long n;
+    int b, i;
+
+    for (b = 0; b < BENCH_BATCHES; b++) {
+	t = benchTicks();
+	for (n = 0; n < frames; n++) {
+	    buf = benchRec + (n & 3);
+	    buf += 3;
+	    for (i = 0; i < grp->numFields; i++)
+		buf += benchCopyFuncs[i](buf, grp->fp[i].fieldPointer);
+	    benchChecksumBytes((uint8_t *)benchRec + (n & 3) + 3, grp->packetSize - 5, &ckA, &ckB);
+	    benchSink += ckA + ckB;
+	}
+	t = benchTicks() - t;
+	if (t < best)
+	    best = t;
+    }
+
+    return (double)best / frames;
+}
+
+static double benchRecord(long frames) {
+    uint64_t t, best = ~0ULL;
+    long n;
+    int b;
+
+    for (b = 0; b < BENCH_BATCHES; b++) {
+	t = benchTicks();
+	for (n = 0; n < frames; n++)
+	    loggerGroupRecord(LOGGER_GROUP_MAIN);
+	t = benchTicks() - t;
+	if (t < best)
+	    best = t;
+	benchSink += benchRec[loggerData.groups[LOGGER_GROUP_MAIN].packetSize];
+    }
+
+    return (double)best / frames;
+}
+
+static double benchChecksum(int len, int words, int off, long frames) {
+    uint64_t t, best = ~0ULL;
+    uint8_t ckA, ckB;
+    long n;
+    int b;
+
+    for (b = 0; b < BENCH_BATCHES; b++) {
+	t = benchTicks();
+	for (n = 0; n < frames; n++) {
+	    if (words)
+		loggerChecksum((uint8_t *)benchRec + off, len, &ckA, &ckB);
+	    else
+		benchChecksumBytes((uint8_t *)benchRec + off, len, &ckA, &ckB);
+	    benchSink += ckA + ckB;
+	}
+	t = benchTicks() - t;
+	if (t < best)
+	    best = t;
+    }
+
+    return (double)best / frames;
+}
+
+int main(int argc, char **argv) {
+    long frames = (argc > 1) ? atol(argv[1]) : 10000;
+    loggerGroup_t *grp = &loggerData.groups[LOGGER_GROUP_MAIN];
+    int numFields = sizeof(loggerFieldsMain) / sizeof(loggerFields_t);
+    uint8_t *scratch;
+    int i, runs, got, len, errors = 0;
+
+    errors += benchCheckChecksum();
+
+    grp->fields = loggerFieldsMain;
+    grp->numFields = numFields;
+    grp->packetSize = 3 + 2;
+    grp->fp = (fieldData_t *)calloc(numFields, sizeof(fieldData_t));
+    for (i = 0; i < numFields; i++) {
+	grp->fp[i].size = benchSize(loggerFieldsMain[i].fieldType);
+	grp->packetSize += grp->fp[i].size;
+	switch (grp->fp[i].size) {
+	    case 8: benchCopyFuncs[i] = benchCopy8; break;
+	    case 4: benchCopyFuncs[i] = benchCopy4; break;
+	    case 2: benchCopyFuncs[i] = benchCopy2; break;
+	    default: benchCopyFuncs[i] = benchCopy1; break;
+	}
+    }
+    scratch = calloc(grp->packetSize * 2 + numFields * BENCH_GAP * 2, 1);
+    for (i = 0; i < grp->packetSize * 2; i++)
+	scratch[i] = rand();
+
+    len = grp->packetSize - 5;
+    printf("AqM frame: %d fields, %d bytes, %d checksummed\n\n", numFields, grp->packetSize, len);
+
+#if defined(__x86_64__) || defined(__i386__)
+    printf("%-34s %10s\n", "", "ticks/frame");
+#else
+    printf("%-34s %10s\n", "", "ns/frame");
+#endif
+    printf("%-34s %10.1f\n", "checksum, byte loop", benchChecksum(len, 0, 3, frames));
+    printf("%-34s %10.1f\n", "loggerChecksum, aligned", benchChecksum(len, 1, 0, frames));
+    printf("%-34s %10.1f\n", "loggerChecksum, 3 byte head", benchChecksum(len, 1, 1, frames));
+    printf("\n");
+
+    benchLayout(grp, scratch, numFields);
+    printf("%-34s %10.1f\n", "per field copy + byte checksum", benchPerField(grp, frames));
+
+    for (runs = numFields; ; runs = (runs + 1) / 2) {
+	got = benchLayout(grp, scratch, runs);
+	if (got != runs) {
+	    fprintf(stderr, "loggerCompile made %d runs out of %d\n", got, runs);
+	    errors++;
+	}
+	printf("loggerGroupRecord, %3d runs %13.1f\n", got, benchRecord(frames));
+	if (runs == 1)
+	    break;
+    }
+
+    if (errors)
+	printf("FAILED, %d errors\n", errors);
+
+    return errors != 0;
+}
@@ -0,0 +1,367 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    mavlinkLinkTest - simulated serial & radio link for the MAVLink
+    stream scheduler in onboard/aq_mavlink.c
+
+    build:  make mavlinkLinkTest
+    use:    mavlinkLinkTest [-v]
+
+    mavlinkSchedule, mavlinkLinkCharge, mavlinkLinkRate, mavlinkStreamRates
+    and mavlinkRadioStatus are extracted as they are.  mavlinkSendStream is
+    replaced by a stub that charges each stream's usual message bytes, and
+    the run loop calls the scheduler every DIMU outer period, as mavlinkDo()
+    does.  A UART drains the bytes at baud / 10.
+
+    With no limit every stream must run at its requested rate, rounded up
+    to the loop period.  At lower baud rates the streams must give way
+    lowest priority first: the test fills the byte budget greedily by
+    priority and expects each stream's effective rate (from the firmware's
+    own once a second estimate) to match.  The UART queue must never hold
+    more than the token bucket plus one pass.
+
+    Behind a radio whose air rate is below the baud rate, RADIO_STATUS
+    reports of the radio's free buffer must bring linkScale down until the
+    radio buffer stops overflowing, and still use most of the air rate.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "gen/mavlinkLink.h"
+
+// from the MAVLink common & AutoQuad dialects
+enum {
+    MAV_DATA_STREAM_ALL = 0,
+    MAV_DATA_STREAM_RAW_SENSORS = 1,
+    MAV_DATA_STREAM_EXTENDED_STATUS = 2,
+    MAV_DATA_STREAM_RC_CHANNELS = 3,
+    MAV_DATA_STREAM_RAW_CONTROLLER = 4,
+    MAV_DATA_STREAM_POSITION = 6,
+    MAV_DATA_STREAM_EXTRA3 = 12,
+    MAV_DATA_STREAM_PROPULSION = 13
+};
+
+#define COMM_NUM_PORTS		4
+#define COMM_BAUD1		0
+#define LINK_PORT		1
+#define LINK_PERIOD		5000			// us, DIMU_OUTER_PERIOD
+#define LINK_HEARTBEAT		17			// bytes per second
+#define LINK_SETTLE		10			// seconds before measuring
+#define LINK_RADIO_SETTLE	20			// seconds for linkScale to come down from 1
+#define LINK_MEASURE		20			// seconds measured
+
+// the parts of commStruct_t & mavlinkStruct_t the scheduler uses
+typedef struct {
+    uint8_t portStreams[COMM_NUM_PORTS];
+    uint8_t portTypes[COMM_NUM_PORTS];
+} linkCommStruct_t;
+
+typedef struct {
+    mavlinkStreams_t streams[AQMAVLINK_TOTAL_STREAMS];
+    uint32_t txBytes;
+    float linkRate;
+    float linkScale;
+    float linkTokens;
+    unsigned long linkMicros;
+    unsigned long rateMicros;
+    uint32_t linkBytes;
+    uint32_t linkDeferred;
+} linkMavlinkStruct_t;
+
+static linkCommStruct_t commData;
+static linkMavlinkStruct_t mavlinkData;
+static float p[COMM_BAUD1 + COMM_NUM_PORTS];
+
+typedef struct {
+    uint8_t stream;
+    const char *name;
+    uint8_t priority;
+    float hz;				// requested
+    uint16_t bytes;			// per emission, MAVLink v1 framing included
+} linkStream_t;
+
+static const linkStream_t linkStreams[] = {
+    {MAV_DATA_STREAM_RAW_CONTROLLER,	"RAW_CONTROLLER",	AQMAVLINK_STREAM_PRIO_RAW_CONTROLLER,	25,	36+34},	    // attitude, nav_controller_output
+    {MAV_DATA_STREAM_POSITION,		"POSITION",		AQMAVLINK_STREAM_PRIO_POSITION,		10,	38+36},	    // gps_raw_int, local_position_ned
+    {MAV_DATA_STREAM_EXTENDED_STATUS,	"EXTENDED_STATUS",	AQMAVLINK_STREAM_PRIO_EXTENDED_STATUS,	2,	39+17},	    // sys_status, radio_status
+    {MAV_DATA_STREAM_RC_CHANNELS,	"RC_CHANNELS",		AQMAVLINK_STREAM_PRIO_RC_CHANNELS,	5,	30+29},	    // rc_channels_raw, servo_output_raw, twice per interval
+    {MAV_DATA_STREAM_PROPULSION,	"PROPULSION",		AQMAVLINK_STREAM_PRIO_PROPULSION,	10,	2*63},	    // aq_esc_telemetry for 8 motors
+    {MAV_DATA_STREAM_RAW_SENSORS,	"RAW_SENSORS",		AQMAVLINK_STREAM_PRIO_RAW_SENSORS,	20,	30+22},	    // scaled_imu, scaled_pressure
+    {MAV_DATA_STREAM_EXTRA3,		"EXTRA3",		AQMAVLINK_STREAM_PRIO_EXTRA3,		5,	2*90},	    // two aq_telemetry_f datasets
+};
+
+#define LINK_NUM_STREAMS	(sizeof(linkStreams) / sizeof(linkStreams[0]))
+
+static const linkStream_t *linkStreamCfg[AQMAVLINK_TOTAL_STREAMS];
+static unsigned long linkErrors;
+static int linkVerbose;
+
+static unsigned long mavlinkSendStream(uint8_t stream, unsigned long micros, int8_t streamAll) {
+    mavlinkData.txBytes += linkStreamCfg[stream]->bytes;
+
+    if (stream == MAV_DATA_STREAM_RC_CHANNELS)
+	return mavlinkData.streams[stream].interval / 2;
+
+    return mavlinkData.streams[stream].interval;
+}
+
+#include "gen/mavlinkLink.c"
+
+typedef struct {
+    float rate[AQMAVLINK_TOTAL_STREAMS];	// effective Hz, averaged over the measured seconds
+    float expect[AQMAVLINK_TOTAL_STREAMS];
+    float bytesPerSec;				// what went out the UART
+    float queueMax;				// UART bytes waiting
+    float queueBound;
+    float radioLost;				// bytes the radio had no room for
+    float scale;
+} linkResult_t;
+
+// emissions per second with the scheduler only looking every loop period
+static float linkQuantized(const linkStream_t *c) {
+    unsigned long interval = 1e6 / c->hz;
+
+    if (c->stream == MAV_DATA_STREAM_RC_CHANNELS)
+	interval /= 2;
+
+    return 1e6f / ((interval / LINK_PERIOD + 1) * LINK_PERIOD);
+}
+
+// fill the budget highest priority first, streams of equal priority share what is left
+static void linkGreedy(float budget, linkResult_t *r) {
+    float want, got;
+    int prio;
+    unsigned int i;
+
+    budget -= LINK_HEARTBEAT;
+    for (prio = 255; prio >= 0; prio--) {
+	want = 0.0f;
+	for (i = 0; i < LINK_NUM_STREAMS; i++)
+	    if (linkStreams[i].priority == prio)
+		want += linkStreams[i].bytes * linkQuantized(&linkStreams[i]);
+	if (want == 0.0f)
+	    continue;
+
+	got = (budget < want) ? budget : want;
+	for (i = 0; i < LINK_NUM_STREAMS; i++)
+	    if (linkStreams[i].priority == prio)
+		r->expect[linkStreams[i].stream] = linkQuantized(&linkStreams[i]) * got / want;
+	budget -= got;
+    }
+}
+
+static void linkRun(float baud, float airRate, float radioBuf, int settle, linkResult_t *r) {
+    unsigned long micros, nextHeartbeat, nextStatus;
+    uint32_t lastBytes;
+    float uart, radio, move;
+    int seconds, i;
+    unsigned int k;
+
+    memset(&commData, 0, sizeof(commData));
+    memset(&mavlinkData, 0, sizeof(mavlinkData));
+    memset(r, 0, sizeof(*r));
+    mavlinkData.linkScale = 1.0f;
+
+    // a USB port does not count against the budget
+    commData.portStreams[0] = COMM_STREAM_TYPE_MAVLINK;
+    commData.portTypes[0] = COMM_PORT_TYPE_USB;
+    if (baud > 0.0f) {
+	commData.portStreams[LINK_PORT] = COMM_STREAM_TYPE_MAVLINK;
+	commData.portTypes[LINK_PORT] = COMM_PORT_TYPE_SERIAL;
+	p[COMM_BAUD1 + LINK_PORT] = baud;
+    }
+
+    // as mavlinkInit() leaves it
+    micros = 1000000;
+    for (k = 0; k < LINK_NUM_STREAMS; k++) {
+	mavlinkStreams_t *s = &mavlinkData.streams[linkStreams[k].stream];
+
+	linkStreamCfg[linkStreams[k].stream] = &linkStreams[k];
+	s->interval = 1e6f / linkStreams[k].hz;
+	s->priority = linkStreams[k].priority;
+	s->enable = 1;
+	s->next = micros + 5000000 + k * 5000;
+    }
+
+    uart = radio = 0.0f;
+    nextHeartbeat = nextStatus = micros;
+    lastBytes = 0;
+
+    for (seconds = 0; seconds < settle + LINK_MEASURE; seconds++) {
+	for (i = 0; i < 1000000 / LINK_PERIOD; i++) {
+	    micros += LINK_PERIOD;
+
+	    if (nextHeartbeat < micros) {
+		mavlinkData.txBytes += LINK_HEARTBEAT;
+		nextHeartbeat = micros + 1000000;
+	    }
+
+	    mavlinkSchedule(micros, 0);
+	    mavlinkStreamRates(micros);
+
+	    // what this pass handed to comm goes in the UART queue
+	    uart += mavlinkData.txBytes - lastBytes;
+	    lastBytes = mavlinkData.txBytes;
+	    if (seconds >= settle && uart > r->queueMax)
+		r->queueMax = uart;
+
+	    move = (baud > 0.0f) ? baud / 10.0f * LINK_PERIOD / 1e6f : uart;
+	    if (move > uart)
+		move = uart;
+	    uart -= move;
+	    if (seconds >= settle)
+		r->bytesPerSec += move / LINK_MEASURE;
+
+	    // the radio sends at its air rate and drops what does not fit
+	    if (airRate > 0.0f) {
+		radio += move;
+		if (radio > radioBuf) {
+		    if (seconds >= settle)
+			r->radioLost += radio - radioBuf;
+		    radio = radioBuf;
+		}
+		radio -= (radio < airRate * LINK_PERIOD / 1e6f) ? radio : airRate * LINK_PERIOD / 1e6f;
+
+		if (nextStatus < micros) {
+		    mavlinkRadioStatus(100.0f * (radioBuf - radio) / radioBuf);
+		    nextStatus = micros + 1000000;
+		}
+	    }
+	}
+
+	if (seconds >= settle)
+	    for (k = 0; k < AQMAVLINK_TOTAL_STREAMS; k++)
+		r->rate[k] += mavlinkData.streams[k].rate / LINK_MEASURE;
+    }
+
+    r->scale = mavlinkData.linkScale;
+    if (baud > 0.0f) {
+	r->queueBound = baud / 10.0f * r->scale * AQMAVLINK_LINK_BURST;
+	if (r->queueBound < AQMAVLINK_LINK_MIN_BURST)
+	    r->queueBound = AQMAVLINK_LINK_MIN_BURST;
+	for (k = 0; k < LINK_NUM_STREAMS; k++)
+	    r->queueBound += linkStreams[k].bytes;
+    }
+}
+
+static void linkError(const char *s, float baud, const char *name, float a, float b) {
+    linkErrors++;
+    fprintf(stderr, "%s: baud %.0f %s %.2f vs %.2f\n", s, baud, name, a, b);
+}
+
+static void linkPrint(const char *title, linkResult_t *r) {
+    unsigned int k;
+
+    printf("%s\n", title);
+    for (k = 0; k < LINK_NUM_STREAMS; k++)
+	printf("    %-16s %2d %5.1f Hz requested, %5.1f expected, %5.1f effective\n", linkStreams[k].name, linkStreams[k].priority,
+		linkStreams[k].hz, r->expect[linkStreams[k].stream], r->rate[linkStreams[k].stream]);
+    printf("    %.0f B/s sent, UART queue max %.0f of %.0f, scale %.2f, deferred %u\n", r->bytesPerSec, r->queueMax, r->queueBound, r->scale, mavlinkData.linkDeferred);
+}
+
+// effective rates follow the greedy fill, within a tenth of a request or 0.5 Hz
+static void linkCheckRates(float baud, linkResult_t *r) {
+    const linkStream_t *c;
+    float tol;
+    unsigned int k;
+
+    for (k = 0; k < LINK_NUM_STREAMS; k++) {
+	c = &linkStreams[k];
+	tol = 0.1f * linkQuantized(c) + 0.5f;
+	if (fabsf(r->rate[c->stream] - r->expect[c->stream]) > tol)
+	    linkError("rate", baud, c->name, r->rate[c->stream], r->expect[c->stream]);
+    }
+}
+
+// nothing is cut while anything of lower priority still runs
+static void linkCheckOrder(float baud, linkResult_t *r) {
+    const linkStream_t *a, *b;
+    unsigned int i, j;
+
+    for (i = 0; i < LINK_NUM_STREAMS; i++) {
+	a = &linkStreams[i];
+	for (j = 0; j < LINK_NUM_STREAMS; j++) {
+	    b = &linkStreams[j];
+	    if (b->priority < a->priority && r->rate[b->stream] > 0.5f && r->rate[a->stream] < 0.9f * linkQuantized(a))
+		linkError("priority", baud, a->name, r->rate[a->stream], r->rate[b->stream]);
+	}
+    }
+}
+
+int main(int argc, char **argv) {
+    static const float bauds[] = {115200, 57600, 38400, 19200, 9600, 4800};
+    linkResult_t r;
+    char title[64];
+    float demand = LINK_HEARTBEAT;
+    unsigned int i, k;
+
+    linkVerbose = (argc > 1 && !strcmp(argv[1], "-v"));
+
+    for (k = 0; k < LINK_NUM_STREAMS; k++)
+	demand += linkStreams[k].bytes * linkQuantized(&linkStreams[k]);
+
+    // USB only, no budget
+    linkRun(0.0f, 0.0f, 0.0f, LINK_SETTLE, &r);
+    linkGreedy(1e9f, &r);
+    linkPrint("unlimited", &r);
+    linkCheckRates(0.0f, &r);
+
+    for (i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++) {
+	linkRun(bauds[i], 0.0f, 0.0f, LINK_SETTLE, &r);
+	linkGreedy(bauds[i] / 10.0f, &r);
+	sprintf(title, "%.0f baud, %.0f B/s wanted", bauds[i], demand);
+	if (linkVerbose || i == 1)
+	    linkPrint(title, &r);
+	else
+	    printf("%s: %.0f B/s sent, UART queue max %.0f\n", title, r.bytesPerSec, r.queueMax);
+
+	linkCheckRates(bauds[i], &r);
+	linkCheckOrder(bauds[i], &r);
+	if (r.queueMax > r.queueBound)
+	    linkError("UART queue", bauds[i], "bytes", r.queueMax, r.queueBound);
+	if (r.bytesPerSec < 0.9f * fminf(demand, bauds[i] / 10.0f))
+	    linkError("throughput", bauds[i], "B/s", r.bytesPerSec, fminf(demand, bauds[i] / 10.0f));
+    }
+
+    // 57600 baud to a radio with 2 kB of buffer and 1500 B/s over the air,
+    // the budget moves with linkScale so only the top stream is held to the greedy fill
+    linkRun(57600, 1500.0f, 2048.0f, LINK_RADIO_SETTLE, &r);
+    linkGreedy(1500.0f, &r);
+    linkPrint("57600 baud behind a 1500 B/s radio", &r);
+    printf("    %.0f bytes lost in the radio\n", r.radioLost);
+    for (k = 1, demand = 0.0f; k < LINK_NUM_STREAMS; k++)
+	demand += r.rate[linkStreams[k].stream] * linkStreams[k].bytes;
+    if (r.rate[linkStreams[0].stream] < 0.85f * r.expect[linkStreams[0].stream])
+	linkError("radio priority", 57600, linkStreams[0].name, r.rate[linkStreams[0].stream], r.expect[linkStreams[0].stream]);
+    if (demand > 0.1f * 1500.0f)
+	linkError("radio priority", 57600, "lower streams B/s", demand, 0.1f * 1500.0f);
+    if (r.radioLost > 0.0f)
+	linkError("radio overflow", 57600, "bytes", r.radioLost, 0.0f);
+    if (r.bytesPerSec < 0.7f * 1500.0f)
+	linkError("radio throughput", 57600, "B/s", r.bytesPerSec, 1500.0f);
+
+    if (linkErrors)
+	printf("%lu errors\n", linkErrors);
+
+    return linkErrors ? 1 : 0;
+}
@@ -0,0 +1,656 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    mscScsiTest - runs the USB mass storage SCSI & bulk only transport
+    layer against a RAM disk with transfers completing in random order
+
+    build:  make mscScsiTest
+    use:    mscScsiTest [seed] [commands]
+
+    onboard/usbd_msc_scsi.c, usbd_msc_bot.c and usbd_msc_data.c are
+    compiled whole, with CRs stripped, behind empty stand ins for the USB
+    library headers.  The storage callbacks, DCD_EP_Tx, DCD_EP_PrepareRx
+    and DCD_EP_Stall below only record what was asked for.  The main loop
+    then picks one of the outstanding events at random: the card finishing
+    its transfer (SCSI_ProcessReadComplete / WriteComplete, as the SDIO
+    interrupt does), the host taking what is queued on the IN endpoint
+    (MSC_BOT_DataIn), the host sending a CBW or write data to a prepared
+    OUT endpoint (MSC_BOT_DataOut), or the host clearing a stall.  How
+    often the card wins is changed every few hundred commands, so both a
+    card that keeps up with USB and one that does not are covered.
+
+    The host mostly reads, sequentially or at random, with writes mixed
+    in, half of them landing on the blocks just past the last read, which
+    is where the read ahead is.  A WRITE(10) right after a read finds the
+    card still filling a read buffer and has to wait in WritePending.
+    Reads that jump elsewhere leave stale buffers for ReadPrune to drop.
+    TEST UNIT READY, INQUIRY and READ CAPACITY come in between and must
+    pass while a read ahead keeps the card busy.  Some card reads fail;
+    the command they belong to must then fail with a HARDWARE ERROR
+    sense, or pass with correct data if the failed blocks were not needed
+    yet.  A few reads past the end of the disk must fail with ILLEGAL
+    REQUEST.
+
+    Checked on every command: data read matches the disk, data written
+    lands on the disk, CSW signature, tag, status and residue.  Checked
+    on every transfer: the endpoint is not already busy and neither USB
+    nor the card touches a buffer the other one is still moving.  No
+    event left to run with the host still waiting is reported as a hang.
+
+    Dropping the ReadFilling() test in SCSI_Write10 (no WritePending),
+    emptying SCSI_ReadPrune, skipping SCSI_ReadRelease in SCSI_ProcessRead
+    or the SCSI_ReadReset in SCSI_WriteStart, or sending the CSW of a
+    failed read while its last good data is still on the IN endpoint
+    each make this fail.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// what the USB library headers would have provided
+typedef struct {
+    int dummy;
+} USB_OTG_CORE_HANDLE;
+
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+#define __ALIGN_BEGIN
+#define __ALIGN_END
+#define MSC_MEDIA_PACKET	((1<<16) - 512)		// FILER_BUF_SIZE
+#define MSC_IN_EP		0x83
+#define MSC_OUT_EP		0x03
+
+#define __disable_irq()
+#define __enable_irq()
+
+uint32_t DCD_EP_Tx(USB_OTG_CORE_HANDLE *pdev, uint8_t ep, uint8_t *buf, uint32_t len);
+uint32_t DCD_EP_PrepareRx(USB_OTG_CORE_HANDLE *pdev, uint8_t ep, uint8_t *buf, uint16_t len);
+uint32_t DCD_EP_Stall(USB_OTG_CORE_HANDLE *pdev, uint8_t ep);
+uint32_t DCD_EP_Flush(USB_OTG_CORE_HANDLE *pdev, uint8_t ep);
+uint16_t USBD_GetRxCount(USB_OTG_CORE_HANDLE *pdev, uint8_t ep);
+uint32_t timerMicros(void);
+
+#include "gen/msc/usbd_msc_scsi.c"
+#include "gen/msc/usbd_msc_bot.c"
+#include "gen/msc/usbd_msc_data.c"
+
+#define MSC_BLOCKS		(1<<15)			// 16MB RAM disk
+#define MSC_BLOCK_SIZE		512
+#define MSC_MAX_BLOCKS		256			// per READ(10) / WRITE(10)
+#define MSC_READ_ERROR		0.005			// chance a card read fails
+#define MSC_BIAS_CMDS		300			// commands between changes of card speed
+
+enum {
+    MSC_EV_CARD = 0,
+    MSC_EV_IN,
+    MSC_EV_OUT,
+    MSC_EV_CLEAR
+};
+
+enum {
+    MSC_HOST_CBW = 0,
+    MSC_HOST_DATA_IN,
+    MSC_HOST_DATA_OUT,
+    MSC_HOST_CSW
+};
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t len;
+    uint8_t busy;
+} mscXfer_t;
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t addr;
+    uint32_t n;
+    uint8_t busy;
+    uint8_t write;
+} mscCard_t;
+
+typedef struct {
+    MSC_BOT_CBW_TypeDef cbw;
+    uint8_t phase;
+    uint8_t expect;				// CSW status it should get
+    uint8_t sense;				// sense key if it fails
+    uint32_t addr, n;			// blocks for READ(10) / WRITE(10)
+    uint32_t done;				// data bytes moved
+    uint32_t errors;			// card reads failed while it ran
+    uint8_t seq;				// READ(10) starting where the last one ended
+    uint8_t stream;				// ... and that one did too, so it should be read ahead
+    uint8_t data[MSC_MAX_BLOCKS * MSC_BLOCK_SIZE];
+} mscHostCmd_t;
+
+static USB_OTG_CORE_HANDLE mscDev;
+static uint8_t mscDisk[MSC_BLOCKS * MSC_BLOCK_SIZE];
+static mscCard_t mscCard;
+static mscXfer_t mscIn, mscOut;
+static uint8_t mscStall;
+static uint16_t mscRxCount;
+static uint32_t mscMicros;
+static mscHostCmd_t mscCmd;
+static uint32_t mscTag;
+static uint32_t mscSeqAddr;		// block after the last read
+static uint8_t mscStreaming;		// last READ(10) or WRITE(10) was a sequential read that passed
+static int mscCardWeight;
+static int mscErrors;
+
+static struct {
+    unsigned long cmds, reads, seqReads, streamReads, streamHits, writes, pending, failed, cardErrors, cardBusy, events;
+    unsigned long long readBytes, writeBytes;
+} mscCount;
+
+static int mscError(const char *what) {
+    if (mscErrors++ < 10)
+	fprintf(stderr, "cmd %lu (op 0x%02x addr %u n %u): %s\n", mscCount.cmds, mscCmd.cbw.CB[0], mscCmd.addr, mscCmd.n, what);
+    return 0;
+}
+
+static int mscOverlap(uint8_t *a, uint32_t alen, uint8_t *b, uint32_t blen) {
+    return (a < b + blen && b < a + alen);
+}
+
+uint32_t timerMicros(void) {
+    return mscMicros;
+}
+
+uint32_t DCD_EP_Tx(USB_OTG_CORE_HANDLE *pdev, uint8_t ep, uint8_t *buf, uint32_t len) {
+    if (ep != MSC_IN_EP)
+	mscError("Tx on the OUT endpoint");
+    if (mscIn.busy)
+	mscError("Tx while the IN endpoint is busy");
+    if (mscCard.busy && !mscCard.write && mscOverlap(buf, len, mscCard.buf, mscCard.n * MSC_BLOCK_SIZE))
+	mscError("Tx from a buffer the card is filling");
+
+    mscIn.buf = buf;
+    mscIn.len = len;
+    mscIn.busy = 1;
+
+    return 0;
+}
+
+uint32_t DCD_EP_PrepareRx(USB_OTG_CORE_HANDLE *pdev, uint8_t ep, uint8_t *buf, uint16_t len) {
+    if (ep != MSC_OUT_EP)
+	mscError("Rx on the IN endpoint");
+    if (mscOut.busy)
+	mscError("Rx while the OUT endpoint is busy");
+    if (mscCard.busy && mscOverlap(buf, len, mscCard.buf, mscCard.n * MSC_BLOCK_SIZE))
+	mscError("Rx into a buffer the card is using");
+
+    mscOut.buf = buf;
+    mscOut.len = len;
+    mscOut.busy = 1;
+
+    return 0;
+}
+
+uint32_t DCD_EP_Stall(USB_OTG_CORE_HANDLE *pdev, uint8_t ep) {
+    if (ep == MSC_IN_EP)
+	mscStall = 1;
+    else
+	mscError("OUT endpoint stalled");
+
+    return 0;
+}
+
+uint32_t DCD_EP_Flush(USB_OTG_CORE_HANDLE *pdev, uint8_t ep) {
+    return 0;
+}
+
+uint16_t USBD_GetRxCount(USB_OTG_CORE_HANDLE *pdev, uint8_t ep) {
+    return mscRxCount;
+}
+
+static int8_t mscStorageInit(uint8_t lun) {
+    return 0;
+}
+
+static int8_t mscStorageCapacity(uint8_t lun, uint32_t *block_num, uint32_t *block_size) {
+    *block_num = MSC_BLOCKS;
+    *block_size = MSC_BLOCK_SIZE;
+
+    return 0;
+}
+
+static int8_t mscStorageReady(uint8_t lun) {
+    return mscCard.busy ? -1 : 0;
+}
+
+static int8_t mscStorageProtected(uint8_t lun) {
+    return 0;
+}
+
+// like STORAGE_Read/Write, refuse while the card is busy
+static int8_t mscStorageStart(uint8_t *buf, uint32_t addr, uint16_t n, uint8_t write) {
+    if (mscCard.busy) {
+	mscCount.cardBusy++;
+	return -1;
+    }
+    if (mscIn.busy && (write == 0) && mscOverlap(buf, n * MSC_BLOCK_SIZE, mscIn.buf, mscIn.len))
+	mscError("card read into a buffer USB is sending");
+    if (mscOut.busy && mscOverlap(buf, n * MSC_BLOCK_SIZE, mscOut.buf, mscOut.len))
+	mscError("card using a buffer USB is receiving into");
+    if (!n || addr + n > MSC_BLOCKS || buf < MSC_BOT_Data || buf + n * MSC_BLOCK_SIZE > MSC_BOT_Data + MSC_MEDIA_PACKET)
+	mscError("card transfer out of range");
+
+    mscCard.buf = buf;
+    mscCard.addr = addr;
+    mscCard.n = n;
+    mscCard.write = write;
+    mscCard.busy = 1;
+
+    return 0;
+}
+
+static int8_t mscStorageRead(uint8_t lun, uint8_t *buf, uint32_t addr, uint16_t n) {
+    return mscStorageStart(buf, addr, n, 0);
+}
+
+static int8_t mscStorageWrite(uint8_t lun, uint8_t *buf, uint32_t addr, uint16_t n) {
+    return mscStorageStart(buf, addr, n, 1);
+}
+
+static int8_t mscStorageMaxLun(void) {
+    return 0;
+}
+
+static int8_t mscStorageEject(uint8_t lun) {
+    return 0;
+}
+
+static const int8_t mscInquiry[USBD_STD_INQUIRY_LENGTH] = {
+    0x00, 0x80, 0x02, 0x02, USBD_STD_INQUIRY_LENGTH - 5, 0x00, 0x00, 0x00,
+    'A', 'Q', ' ', ' ', ' ', ' ', ' ', ' ',
+    'R', 'A', 'M', ' ', 'd', 'i', 's', 'k', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ',
+    '0', '.', '0', '1'
+};
+
+static USBD_STORAGE_cb_TypeDef mscStorage = {
+    mscStorageInit,
+    mscStorageCapacity,
+    mscStorageReady,
+    mscStorageProtected,
+    mscStorageRead,
+    mscStorageWrite,
+    mscStorageMaxLun,
+    (int8_t *)mscInquiry,
+    mscStorageEject
+};
+
+USBD_STORAGE_cb_TypeDef *USBD_STORAGE_fops = &mscStorage;
+
+static uint32_t mscGet32(uint8_t *p) {
+    return (uint32_t)p[0]<<24 | (uint32_t)p[1]<<16 | (uint32_t)p[2]<<8 | p[3];
+}
+
+static void mscRw(mscHostCmd_t *c, uint8_t op, uint32_t addr, uint32_t n) {
+    c->cbw.CB[0] = op;
+    c->cbw.CB[2] = addr>>24;
+    c->cbw.CB[3] = addr>>16;
+    c->cbw.CB[4] = addr>>8;
+    c->cbw.CB[5] = addr;
+    c->cbw.CB[7] = n>>8;
+    c->cbw.CB[8] = n;
+    c->cbw.bCBLength = 10;
+    c->cbw.dDataLength = n * MSC_BLOCK_SIZE;
+    c->addr = addr;
+    c->n = n;
+}
+
+static uint32_t mscLength(void) {
+    // mostly what Windows & Linux ask for, sometimes anything
+    switch (rand() % 4) {
+    case 0:
+	return 1 + rand() % MSC_MAX_BLOCKS;
+    case 1:
+	return 64;
+    default:
+	return 128;
+    }
+}
+
+// the host's next command, after the CSW of the last one
+static void mscNext(void) {
+    mscHostCmd_t *c = &mscCmd;
+    uint8_t failed = (c->expect == CSW_CMD_FAILED);
+    uint8_t sense = c->sense;
+    uint32_t n;
+    int r;
+
+    memset(&c->cbw, 0, sizeof(c->cbw));
+    c->cbw.dSignature = BOT_CBW_SIGNATURE;
+    c->cbw.dTag = ++mscTag;
+    c->cbw.bCBLength = 6;
+    c->phase = MSC_HOST_CBW;
+    c->expect = CSW_CMD_PASSED;
+    c->sense = 0;
+    c->addr = c->n = 0;
+    c->done = 0;
+    c->errors = 0;
+    c->seq = c->stream = 0;
+
+    r = rand() % 100;
+
+    if (failed) {
+	// pick up why it failed
+	c->cbw.CB[0] = SCSI_REQUEST_SENSE;
+	c->cbw.CB[4] = REQUEST_SENSE_DATA_LEN;
+	c->cbw.bmFlags = 0x80;
+	c->cbw.dDataLength = REQUEST_SENSE_DATA_LEN;
+	c->sense = sense;
+    }
+    else if (r < 3) {
+	c->cbw.CB[0] = SCSI_INQUIRY;
+	c->cbw.CB[4] = USBD_STD_INQUIRY_LENGTH;
+	c->cbw.bmFlags = 0x80;
+	c->cbw.dDataLength = USBD_STD_INQUIRY_LENGTH;
+    }
+    else if (r < 8) {
+	c->cbw.CB[0] = SCSI_TEST_UNIT_READY;
+    }
+    else if (r < 10) {
+	c->cbw.CB[0] = SCSI_READ_CAPACITY10;
+	c->cbw.bCBLength = 10;
+	c->cbw.bmFlags = 0x80;
+	c->cbw.dDataLength = 8;
+    }
+    else if (r < 12) {
+	n = 1 + rand() % 8;
+	mscRw(c, SCSI_READ10, MSC_BLOCKS - n + 1 + rand() % n, n);
+	c->cbw.bmFlags = 0x80;
+	c->expect = CSW_CMD_FAILED;
+	c->sense = ILLEGAL_REQUEST;
+    }
+    else if (r < 30) {
+	n = mscLength();
+	mscRw(c, SCSI_WRITE10, (rand() % 2) ? mscSeqAddr : rand() % MSC_BLOCKS, n);
+	if (c->addr + n > MSC_BLOCKS)
+	    mscRw(c, SCSI_WRITE10, MSC_BLOCKS - n, n);
+	for (r = 0; r < n * MSC_BLOCK_SIZE; r++)
+	    c->data[r] = rand();
+	mscCount.writes++;
+    }
+    else {
+	n = mscLength();
+	if (rand() % 10 < 7) {
+	    if (mscSeqAddr + n > MSC_BLOCKS)
+		mscSeqAddr = mscStreaming = 0;
+	    mscRw(c, SCSI_READ10, mscSeqAddr, n);
+	    c->seq = 1;
+	    c->stream = mscStreaming;
+	    mscCount.seqReads++;
+	    mscCount.streamReads += c->stream;
+	}
+	else {
+	    mscRw(c, SCSI_READ10, rand() % (MSC_BLOCKS - n + 1), n);
+	}
+	c->cbw.bmFlags = 0x80;
+	mscCount.reads++;
+    }
+
+    mscCount.cmds++;
+    if (mscCount.cmds % MSC_BIAS_CMDS == 0)
+	mscCardWeight = 1 << (rand() % 5);
+}
+
+static void mscCheckData(mscHostCmd_t *c) {
+    uint8_t *d;
+
+    switch (c->cbw.CB[0]) {
+    case SCSI_READ10:
+	if (memcmp(c->data, &mscDisk[c->addr * MSC_BLOCK_SIZE], c->n * MSC_BLOCK_SIZE))
+	    mscError("read data differs from the disk");
+	mscSeqAddr = c->addr + c->n;
+	mscCount.readBytes += c->n * MSC_BLOCK_SIZE;
+	break;
+
+    case SCSI_WRITE10:
+	if (memcmp(c->data, &mscDisk[c->addr * MSC_BLOCK_SIZE], c->n * MSC_BLOCK_SIZE))
+	    mscError("written data is not on the disk");
+	mscCount.writeBytes += c->n * MSC_BLOCK_SIZE;
+	break;
+
+    case SCSI_READ_CAPACITY10:
+	d = c->data;
+	if (mscGet32(d) != MSC_BLOCKS - 1 || mscGet32(d + 4) != MSC_BLOCK_SIZE)
+	    mscError("wrong capacity");
+	break;
+
+    case SCSI_INQUIRY:
+	if (memcmp(c->data, mscInquiry, USBD_STD_INQUIRY_LENGTH))
+	    mscError("wrong inquiry data");
+	break;
+
+    case SCSI_REQUEST_SENSE:
+	if (c->data[0] != 0x70 || c->data[2] != c->sense)
+	    mscError("wrong sense key");
+	break;
+    }
+}
+
+static void mscCsw(mscHostCmd_t *c) {
+    MSC_BOT_CSW_TypeDef csw;
+
+    memcpy(&csw, mscIn.buf, BOT_CSW_LENGTH);
+
+    if (csw.dSignature != BOT_CSW_SIGNATURE)
+	mscError("bad CSW signature");
+    if (csw.dTag != c->cbw.dTag)
+	mscError("CSW tag does not match the CBW");
+    if (csw.dDataResidue != c->cbw.dDataLength - c->done)
+	mscError("CSW residue does not match the data moved");
+
+    if (csw.bStatus == CSW_CMD_PASSED && c->expect == CSW_CMD_PASSED) {
+	if (c->done != c->cbw.dDataLength)
+	    mscError("passed short");
+	else
+	    mscCheckData(c);
+    }
+    else if (csw.bStatus == CSW_CMD_FAILED && c->expect == CSW_CMD_PASSED && c->errors && c->cbw.CB[0] == SCSI_READ10) {
+	// a card read it needed failed
+	c->expect = CSW_CMD_FAILED;
+	c->sense = HARDWARE_ERROR;
+    }
+    else if (csw.bStatus != c->expect) {
+	mscError(csw.bStatus == CSW_CMD_PASSED ? "passed, should have failed" : "failed, should have passed");
+	c->expect = csw.bStatus;
+    }
+
+    if (c->cbw.CB[0] == SCSI_READ10 || c->cbw.CB[0] == SCSI_WRITE10)
+	mscStreaming = (c->cbw.CB[0] == SCSI_READ10 && c->seq && c->expect == CSW_CMD_PASSED);
+    if (c->expect == CSW_CMD_FAILED)
+	mscCount.failed++;
+    mscNext();
+}
+
+static void mscCardDone(void) {
+    uint32_t len = mscCard.n * MSC_BLOCK_SIZE;
+    uint8_t *disk = &mscDisk[mscCard.addr * MSC_BLOCK_SIZE];
+
+    mscCard.busy = 0;
+
+    if (mscCard.write) {
+	memcpy(disk, mscCard.buf, len);
+	SCSI_ProcessWriteComplete(len);
+    }
+    else if (rand() < MSC_READ_ERROR * RAND_MAX) {
+	mscCount.cardErrors++;
+	mscCmd.errors++;
+	SCSI_ProcessReadComplete(0);
+    }
+    else {
+	memcpy(mscCard.buf, disk, len);
+	SCSI_ProcessReadComplete(len);
+    }
+}
+
+static void mscInDone(void) {
+    mscHostCmd_t *c = &mscCmd;
+
+    mscIn.busy = 0;
+
+    if (mscIn.buf == (uint8_t *)&MSC_BOT_csw) {
+	if (mscIn.len != BOT_CSW_LENGTH)
+	    mscError("CSW of the wrong length");
+	else if (c->phase == MSC_HOST_CBW)
+	    mscError("CSW before the CBW");
+	else
+	    mscCsw(c);
+    }
+    else if (c->phase != MSC_HOST_DATA_IN || c->done + mscIn.len > c->cbw.dDataLength) {
+	mscError("unexpected IN data");
+    }
+    else {
+	memcpy(c->data + c->done, mscIn.buf, mscIn.len);
+	c->done += mscIn.len;
+	if (c->done == c->cbw.dDataLength)
+	    c->phase = MSC_HOST_CSW;
+	MSC_BOT_DataIn(&mscDev, MSC_IN_EP & 0x7f);
+    }
+}
+
+static void mscOutDone(void) {
+    mscHostCmd_t *c = &mscCmd;
+    uint32_t len, hits = SCSI_Stats.aheadHits;
+
+    mscOut.busy = 0;
+
+    if (c->phase == MSC_HOST_CBW) {
+	if (mscOut.buf != (uint8_t *)&MSC_BOT_cbw || mscOut.len != BOT_CBW_LENGTH) {
+	    mscError("CBW sent to a data buffer");
+	    return;
+	}
+	memcpy(mscOut.buf, &c->cbw, BOT_CBW_LENGTH);
+	mscRxCount = BOT_CBW_LENGTH;
+	if (!c->cbw.dDataLength)
+	    c->phase = MSC_HOST_CSW;
+	else if (c->cbw.bmFlags & 0x80)
+	    c->phase = MSC_HOST_DATA_IN;
+	else
+	    c->phase = MSC_HOST_DATA_OUT;
+	if (c->cbw.CB[0] == SCSI_WRITE10 && SCSI_ReadFilling())
+	    mscCount.pending++;
+    }
+    else {
+	if (mscOut.buf == (uint8_t *)&MSC_BOT_cbw) {
+	    mscError("write data sent to the CBW");
+	    return;
+	}
+	len = MIN(mscOut.len, c->cbw.dDataLength - c->done);
+	memcpy(mscOut.buf, c->data + c->done, len);
+	c->done += len;
+	mscRxCount = len;
+	if (c->done == c->cbw.dDataLength)
+	    c->phase = MSC_HOST_CSW;
+    }
+
+    MSC_BOT_DataOut(&mscDev, MSC_OUT_EP);
+
+    if (c->stream && SCSI_Stats.aheadHits != hits)
+	mscCount.streamHits++;
+}
+
+static int mscStep(void) {
+    int ev[40];
+    int i, n = 0;
+
+    if (mscCard.busy)
+	for (i = 0; i < mscCardWeight; i++)
+	    ev[n++] = MSC_EV_CARD;
+    if (mscIn.busy)
+	ev[n++] = MSC_EV_IN;
+    if (mscOut.busy && (mscCmd.phase == MSC_HOST_CBW || mscCmd.phase == MSC_HOST_DATA_OUT))
+	ev[n++] = MSC_EV_OUT;
+    if (mscStall && !mscIn.busy)
+	ev[n++] = MSC_EV_CLEAR;
+
+    if (!n)
+	return mscError("hung, nothing left to happen");
+
+    mscMicros += 10;
+    mscCount.events++;
+
+    switch (ev[rand() % n]) {
+    case MSC_EV_CARD:
+	mscCardDone();
+	break;
+    case MSC_EV_IN:
+	mscInDone();
+	break;
+    case MSC_EV_OUT:
+	mscOutDone();
+	break;
+    case MSC_EV_CLEAR:
+	mscStall = 0;
+	MSC_BOT_CplClrFeature(&mscDev, MSC_IN_EP);
+	break;
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    unsigned int seed = (argc > 1) ? atoi(argv[1]) : 1;
+    unsigned long cmds = (argc > 2) ? atol(argv[2]) : 10000;
+    unsigned long hits;
+    uint32_t i;
+
+    srand(seed);
+
+    MSC_BOT_Data = malloc(MSC_MEDIA_PACKET);
+    for (i = 0; i < sizeof(mscDisk); i++)
+	mscDisk[i] = rand();
+    mscCardWeight = 1;
+
+    MSC_BOT_Init(&mscDev);
+
+    // every host starts by asking how big the disk is
+    mscNext();
+    mscCmd.cbw.CB[0] = SCSI_READ_CAPACITY10;
+    mscCmd.cbw.bCBLength = 10;
+    mscCmd.cbw.bmFlags = 0x80;
+    mscCmd.cbw.dDataLength = 8;
+
+    while (mscCount.cmds <= cmds && !mscErrors)
+	mscStep();
+
+    hits = SCSI_Stats.aheadHits;
+    printf("%lu commands: %lu reads (%lu sequential) %llu MB, %lu writes (%lu behind a read ahead) %llu MB\n",
+	mscCount.cmds - 1, mscCount.reads, mscCount.seqReads, mscCount.readBytes >> 20, mscCount.writes, mscCount.pending, mscCount.writeBytes >> 20);
+    printf("%lu events, %lu card read errors, %lu commands failed, %lu refused by a busy card\n",
+	mscCount.events, mscCount.cardErrors, mscCount.failed, mscCount.cardBusy);
+    printf("read ahead hits %lu misses %lu (%.1f%%), %lu of %lu streaming reads\n", hits, (unsigned long)SCSI_Stats.aheadMisses,
+	100.0 * hits / (hits + SCSI_Stats.aheadMisses), mscCount.streamHits, mscCount.streamReads);
+
+    if (mscCount.cardBusy)
+	mscError("card started while busy");
+    if (!mscCount.pending)
+	mscError("no WRITE(10) had to wait for a read ahead");
+    // a failed read ahead is not retried
+    if (mscCount.streamHits + mscCount.cardErrors < mscCount.streamReads)
+	mscError("sequential reads are not being read ahead");
+
+    if (mscErrors)
+	printf("FAILED, %d errors\n", mscErrors);
+    else
+	printf("PASSED\n");
+
+    return mscErrors != 0;
+}
@@ -0,0 +1,173 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+/*
+    utilStatsTest - checks the sliding window statistics in onboard/util.c
+    against a naive two pass computation in double
+
+    build:  make utilStatsTest
+    use:    utilStatsTest [seed]
+
+    utilStatsInit/Fill/Add/Std are extracted from onboard/util.c.  Each
+    case feeds a window size and signal for many window lengths, so the
+    periodic exact recompute (every UTIL_STATS_REFRESH windows) happens
+    several times, and after every sample compares mean and standard
+    deviation with the last count samples summed in double.  The signals
+    mimic what the firmware feeds it: accelerometer noise on 1g, pressure
+    in Pa with a small noise floor, steps and outliers.
+
+    The mean must hold to 2e-5 of the signal's range.  A sliding float
+    Welford sum keeps the rounding of every update since the last
+    recompute, which shows once a large spread has slid out.  Each update
+    rounds to eps of its operands, |new - old| * (|new| + |old| + 2|mean|),
+    so the std may be off by sqrt(eps * the sum of those / (count-1)),
+    times a small constant, and no more.
+
+    With the periodic recompute taken out of utilStatsAdd the steps and
+    outliers cases fail by up to 40 times the tolerance.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+
+#include "gen/utilStats.h"
+#include "gen/utilStats.c"
+
+#define STATS_MAX_WINDOW	512
+#define STATS_MEAN_TOL		2e-5		// of signal range
+#define STATS_STD_TOL		16.0		// times sqrt(eps * update magnitudes since the last recompute)
+
+typedef struct {
+    const char *name;
+    double offset;
+    double noise;
+    double stepProb;			// chance per sample of a level change
+    double step;
+} statsSignal_t;
+
+static const statsSignal_t statsSignals[] = {
+    {"uniform",		0.0,		1.0,	0.0,	0.0},
+    {"accel",		-9.80665,	0.05,	0.0,	0.0},
+    {"pressure",	101325.0,	2.0,	0.0,	0.0},
+    {"steps",		0.0,		0.01,	0.002,	50.0},
+    {"outliers",	1.0,		0.001,	0.001,	1e4},
+};
+
+static const uint16_t statsWindows[] = {2, 3, 10, 64, 100, 257, 512};
+
+static unsigned long statsFailures;
+
+static double statsRand(void) {
+    return rand() / (RAND_MAX + 1.0) * 2.0 - 1.0;
+}
+
+// two pass over the last count samples
+static void statsNaive(const float *hist, long len, int count, double *mean, double *std) {
+    double sum = 0.0, m2 = 0.0, d;
+    long i;
+
+    for (i = len - count; i < len; i++)
+	sum += hist[i];
+    *mean = sum / count;
+
+    for (i = len - count; i < len; i++) {
+	d = hist[i] - *mean;
+	m2 += d*d;
+    }
+    *std = (count < 2) ? 0.0 : sqrt(m2 / (count - 1));
+}
+
+static void statsCase(const statsSignal_t *sig, uint16_t n) {
+    float buffer[STATS_MAX_WINDOW];
+    utilStats_t s;
+    float *hist;
+    long len, samples, i;
+    double level, mean, std, range, work, old, meanErr, stdErr, worstMean = 0.0, worstStd = 0.0;
+    float v;
+
+    samples = (long)n * UTIL_STATS_REFRESH * 4 + n / 2;
+    hist = malloc((samples + n) * sizeof(float));
+
+    utilStatsInit(&s, buffer, n);
+
+    // half the cases start from a filled window, as run.c does
+    level = sig->offset;
+    if (n & 1) {
+	utilStatsFill(&s, (float)level);
+	for (i = 0; i < n; i++)
+	    hist[i] = (float)level;
+	len = n;
+    }
+    else {
+	len = 0;
+    }
+
+    work = 0.0;
+    for (i = 0; i < samples; i++, len++) {
+	if (sig->stepProb > 0.0 && fabs(statsRand()) < sig->stepProb)
+	    level = sig->offset + sig->step * statsRand();
+
+	v = (float)(level + sig->noise * statsRand());
+	hist[len] = v;
+	utilStatsAdd(&s, v);
+
+	statsNaive(hist, len + 1, s.count, &mean, &std);
+
+	// rounding the running sums have picked up, cleared by the exact recompute
+	old = (len >= n) ? hist[len - n] : 0.0;
+	work += fabs(v - old) * (fabs(v) + fabs(old) + 2.0 * fabs(mean));
+	if (s.count == n && s.i == 0 && s.refresh == 0)
+	    work = 0.0;
+
+	range = fabs(mean) + sig->noise + fabs(sig->step);
+	meanErr = fabs(s.mean - mean) / range / STATS_MEAN_TOL;
+	stdErr = fabs(utilStatsStd(&s) - std) / (STATS_STD_TOL * sqrt(FLT_EPSILON * work / ((s.count > 1) ? s.count - 1 : 1)) + STATS_MEAN_TOL * range);
+
+	if (meanErr > worstMean)
+	    worstMean = meanErr;
+	if (stdErr > worstStd)
+	    worstStd = stdErr;
+    }
+
+    if (worstMean > 1.0 || worstStd > 1.0) {
+	statsFailures++;
+	printf("FAIL ");
+    }
+    else {
+	printf("ok   ");
+    }
+    printf("%-9s n %3u %7ld samples, worst error mean %.3f std %.3f of tolerance\n", sig->name, n, len, worstMean, worstStd);
+
+    free(hist);
+}
+
+int main(int argc, char **argv) {
+    unsigned int i, j;
+
+    srand((argc > 1) ? atoi(argv[1]) : 1);
+
+    for (i = 0; i < sizeof(statsSignals) / sizeof(statsSignals[0]); i++)
+	for (j = 0; j < sizeof(statsWindows) / sizeof(statsWindows[0]); j++)
+	    statsCase(&statsSignals[i], statsWindows[j]);
+
+    return statsFailures ? 1 : 0;
+}
@@ -217,6 +217,12 @@ extern void        CoTickToTime(U32 ticks,U8* hour,U8* minute,U8* sec,U16* mills
 /* Implement in file "hook.c"      */
 extern void        CoIdleTask(void* pdata);
 extern void        CoStkOverflowHook(OS_TID taskID);
+#if CFG_TASK_STATS_EN > 0
+extern void        CoTaskSwitchHook(OS_TID from,OS_TID to,BOOL preempted);
+extern void        CoIsrEnterHook(void);
+extern void        CoIsrExitHook(void);
+extern void        CoTickHook(void);
+#endif
 
 
 #endif
@@ -124,6 +124,13 @@ Enable(1) or disable(0) stack overflow checkout .
 */
 #define CFG_STK_CHECKOUT_EN     (0)
 
+/*!<
+Enable(1) or disable(0) per task CPU accounting hooks.  Costs a short
+interrupts off section in every Schedule(), SysTick and CoEnterISR/CoExitISR,
+so leave off for flight builds.
+*/
+#define CFG_TASK_STATS_EN       (0)
+
 
 
 /*---------------------- Memory Management Config ----------------------------*/
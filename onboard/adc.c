@@ -58,11 +58,59 @@ float adcVsenseToVin(float volts) {
     return (volts - ADC_VIN_OFFSET) * ADC_VIN_SLOPE;
 }
 
+// number of samples of each sensor taken in one ADC scan (see ADC_DMA_HANDLER)
+static const uint8_t adcScanSamples[ADC_SENSORS] = {
+    4, 4, 4,	    // rates
+    4, 4, 4,	    // mags
+    1, 1,	    // temp1, Vin
+    4, 4, 4,	    // accs
+    4, 4,	    // press1, press2
+    1, 1	    // temp2, temp3
+};
+
+// convert channel sums to volts in one pass
+static void adcConvert(float *volts, const unsigned long *sums, const float *scale) {
+    register int i;
+
+    for (i = 0; i < ADC_SENSORS; i++)
+	volts[i] = (float)sums[i] * scale[i];
+}
+
+// temperature compensated gyro offsets & scales, refreshed at the sensor rate
+static void adcRateParams(float dTemp, float dTemp2, float dTemp3) {
+    adcData.rateOffset[0] = adcData.rateBiasX + p[IMU_GYO_BIAS1_X]*dTemp + p[IMU_GYO_BIAS2_X]*dTemp2 + p[IMU_GYO_BIAS3_X]*dTemp3;
+    adcData.rateOffset[1] = adcData.rateBiasY + p[IMU_GYO_BIAS1_Y]*dTemp + p[IMU_GYO_BIAS2_Y]*dTemp2 + p[IMU_GYO_BIAS3_Y]*dTemp3;
+    adcData.rateOffset[2] = adcData.rateBiasZ + p[IMU_GYO_BIAS1_Z]*dTemp + p[IMU_GYO_BIAS2_Z]*dTemp2 + p[IMU_GYO_BIAS3_Z]*dTemp3;
+
+    adcData.rateScale[0] = 1.0f / p[IMU_GYO_SCAL_X];
+    adcData.rateScale[1] = 1.0f / p[IMU_GYO_SCAL_Y];
+    adcData.rateScale[2] = 1.0f / p[IMU_GYO_SCAL_Z];
+}
+
+// IDG500 & ISZ500 gyro voltages => aligned, scaled & rotated rates
+static void adcRateCalc(float vx, float vy, float vz, float *rx, float *ry, float *rz) {
+    float x, y, z;
+    float a, b, c;
+
+    x = +(vx + adcData.rateOffset[0]);
+    y = -(vy + adcData.rateOffset[1]);
+    z = -(vz + adcData.rateOffset[2]);
+
+    a = (x + y*p[IMU_GYO_ALGN_XY] + z*p[IMU_GYO_ALGN_XZ]) * adcData.rateScale[0];
+    b = (x*p[IMU_GYO_ALGN_YX] + y + z*p[IMU_GYO_ALGN_YZ]) * adcData.rateScale[1];
+    c = (x*p[IMU_GYO_ALGN_ZX] + y*p[IMU_GYO_ALGN_ZY] + z) * adcData.rateScale[2];
+
+    *rx = a * imuData.cosRot - b * imuData.sinRot;
+    *ry = b * imuData.cosRot + a * imuData.sinRot;
+    *rz = c;
+}
+
 void adcTaskCode(void *unused) {
-    float dRateVoltageX, dRateVoltageY, dRateVoltageZ;
+    unsigned long *sums, *hist;
     double sumMagX, sumMagY, sumMagZ;
     unsigned char magSign;
-    int countMag, firstAfterFlip;
+    int countMag, firstAfterFlip, magBlocks, rateTap;
+    float rx, ry, rz;
     float x, y, z;
     float a, b, c;
     float dTemp, dTemp2, dTemp3;
@@ -76,79 +124,68 @@ void adcTaskCode(void *unused) {
     dTemp = dTemp2 = dTemp3 = 0.0f;
     countMag = 0;
     firstAfterFlip = 0;
+    magBlocks = 0;
+    rateTap = 0;
+
+    adcRateParams(dTemp, dTemp2, dTemp3);
 
     while (1) {
 	// wait for work
 	CoWaitForSingleFlag(adcData.adcFlag, 0);
 
 	loops = adcData.loops;
+	sums = adcData.accSums[adcData.readyBank];
 
-	// sum adc values
-	for (i = 0; i < ADC_SENSORS; i++)
-	    adcData.channelSums[i] += adcData.adcSums[i];
-
-	// IDG500 & ISZ500 gyro double rate
-	dRateVoltageX = adcData.adcSums[ADC_VOLTS_RATEX] * ADC_DIVISOR * (1.0 / 4.0);
-	dRateVoltageY = adcData.adcSums[ADC_VOLTS_RATEY] * ADC_DIVISOR * (1.0 / 4.0);
-	dRateVoltageZ = adcData.adcSums[ADC_VOLTS_RATEZ] * ADC_DIVISOR * (1.0 / 4.0);
-
-	// rates
-	x = +(dRateVoltageX + adcData.rateBiasX + p[IMU_GYO_BIAS1_X]*dTemp + p[IMU_GYO_BIAS2_X]*dTemp2 + p[IMU_GYO_BIAS3_X]*dTemp3);// / p[IMU_GYO_SCAL_X];
-	y = -(dRateVoltageY + adcData.rateBiasY + p[IMU_GYO_BIAS1_Y]*dTemp + p[IMU_GYO_BIAS2_Y]*dTemp2 + p[IMU_GYO_BIAS3_Y]*dTemp3);// / p[IMU_GYO_SCAL_Y];
-	z = -(dRateVoltageZ + adcData.rateBiasZ + p[IMU_GYO_BIAS1_Z]*dTemp + p[IMU_GYO_BIAS2_Z]*dTemp2 + p[IMU_GYO_BIAS3_Z]*dTemp3);// / p[IMU_GYO_SCAL_Z];
-
-	a = x + y*p[IMU_GYO_ALGN_XY] + z*p[IMU_GYO_ALGN_XZ];
-	b = x*p[IMU_GYO_ALGN_YX] + y + z*p[IMU_GYO_ALGN_YZ];
-	c = x*p[IMU_GYO_ALGN_ZX] + y*p[IMU_GYO_ALGN_ZY] + z;
-
-	a /= p[IMU_GYO_SCAL_X];
-	b /= p[IMU_GYO_SCAL_Y];
-	c /= p[IMU_GYO_SCAL_Z];
-
-	adcData.dRateX = (adcData.dRateX + a * imuData.cosRot - b * imuData.sinRot) * 0.5f;
-	adcData.dRateY = (adcData.dRateY + b * imuData.cosRot + a * imuData.sinRot) * 0.5f;
-	adcData.dRateZ = (adcData.dRateZ + c) * 0.5f;
-//	adcData.dRateX = a * imuData.cosRot - b * imuData.sinRot;
-//	adcData.dRateY = b * imuData.cosRot + a * imuData.sinRot;
-//	adcData.dRateZ = c;
-
-	// notify IMU of double rate GYO readings are ready
-	imuAdcDRateReady();
+	// gyro double rate, boxcar decimation over the last ADC_RATE_TAPS blocks
+	hist = adcData.rateHist[rateTap];
+	for (i = 0; i < 3; i++) {
+	    adcData.rateHistSums[i] += sums[ADC_VOLTS_RATEX + i] - hist[i];
+	    hist[i] = sums[ADC_VOLTS_RATEX + i];
+	}
+	rateTap = (rateTap + 1) % ADC_RATE_TAPS;
 
 	// mags
-	// we need to discard frames after mag bias flips
+	// we need to discard frames after mag bias flips, taken back out before the sum below adds them
 	if (firstAfterFlip) {
-	    adcData.channelSums[ADC_VOLTS_MAGX] -= adcData.adcSums[ADC_VOLTS_MAGX];
-	    adcData.channelSums[ADC_VOLTS_MAGY] -= adcData.adcSums[ADC_VOLTS_MAGY];
-	    adcData.channelSums[ADC_VOLTS_MAGZ] -= adcData.adcSums[ADC_VOLTS_MAGZ];
+	    adcData.channelSums[ADC_VOLTS_MAGX] -= sums[ADC_VOLTS_MAGX];
+	    adcData.channelSums[ADC_VOLTS_MAGY] -= sums[ADC_VOLTS_MAGY];
+	    adcData.channelSums[ADC_VOLTS_MAGZ] -= sums[ADC_VOLTS_MAGZ];
 	    firstAfterFlip = 0;
 	}
+	else {
+	    magBlocks++;
+	}
 
-	if (!(loops & 0x01)) {
-	    // calculate voltages
-	    adcData.voltages[ADC_VOLTS_RATEX] = adcData.channelSums[ADC_VOLTS_RATEX] * ADC_DIVISOR * (1.0f / 8.0f);   // ratex
-	    adcData.voltages[ADC_VOLTS_RATEY] = adcData.channelSums[ADC_VOLTS_RATEY] * ADC_DIVISOR * (1.0f / 8.0f);   // ratey
-	    adcData.voltages[ADC_VOLTS_RATEZ] = adcData.channelSums[ADC_VOLTS_RATEZ] * ADC_DIVISOR * (1.0f / 8.0f);   // ratez
+	// sum adc values, clearing the bank as it is read, and release it back to the ISR
+	for (i = 0; i < ADC_SENSORS; i++) {
+	    adcData.channelSums[i] += sums[i];
+	    sums[i] = 0;
+	}
+	adcData.bankPending = 0;
 
-	    adcData.voltages[ADC_VOLTS_MAGX]  = adcData.channelSums[ADC_VOLTS_MAGX] * ADC_DIVISOR * (1.0f / 4.0f);   // magx
-	    adcData.voltages[ADC_VOLTS_MAGY]  = adcData.channelSums[ADC_VOLTS_MAGY] * ADC_DIVISOR * (1.0f / 4.0f);   // magy
-	    adcData.voltages[ADC_VOLTS_MAGZ]  = adcData.channelSums[ADC_VOLTS_MAGZ] * ADC_DIVISOR * (1.0f / 4.0f);   // magz
+	adcRateCalc(adcData.rateHistSums[0] * (ADC_DIVISOR / (4.0f * ADC_RATE_TAPS)),
+		    adcData.rateHistSums[1] * (ADC_DIVISOR / (4.0f * ADC_RATE_TAPS)),
+		    adcData.rateHistSums[2] * (ADC_DIVISOR / (4.0f * ADC_RATE_TAPS)), &rx, &ry, &rz);
 
-	    adcData.voltages[ADC_VOLTS_TEMP1] = adcData.channelSums[ADC_VOLTS_TEMP1] * ADC_DIVISOR * (1.0f / 2.0f);   // temp
-	    adcData.voltages[ADC_VOLTS_VIN]   = adcData.channelSums[ADC_VOLTS_VIN]   * ADC_DIVISOR * (1.0f / 2.0f);   // Vin
+	adcData.dRateX = rx;
+	adcData.dRateY = ry;
+	adcData.dRateZ = rz;
 
-	    adcData.voltages[ADC_VOLTS_ACCX] = adcData.channelSums[ADC_VOLTS_ACCX] * ADC_DIVISOR * (1.0f / 8.0f);   // accx
-	    adcData.voltages[ADC_VOLTS_ACCY] = adcData.channelSums[ADC_VOLTS_ACCY] * ADC_DIVISOR * (1.0f / 8.0f);   // accy
-	    adcData.voltages[ADC_VOLTS_ACCZ] = adcData.channelSums[ADC_VOLTS_ACCZ] * ADC_DIVISOR * (1.0f / 8.0f);   // accz
+	// notify IMU of double rate GYO readings are ready
+	imuAdcDRateReady();
 
-	    adcData.voltages[ADC_VOLTS_PRES1] = adcData.channelSums[ADC_VOLTS_PRES1] * ADC_DIVISOR * (1.0f / 8.0f);   // press1
-	    adcData.voltages[ADC_VOLTS_PRES2] = adcData.channelSums[ADC_VOLTS_PRES2] * ADC_DIVISOR * (1.0f / 8.0f);   // press2
+	if (!(loops % ADC_DECIMATE)) {
+	    // calculate voltages
+	    if (magBlocks) {
+		adcData.voltScale[ADC_VOLTS_MAGX] = ADC_DIVISOR / (4.0f * magBlocks);
+		adcData.voltScale[ADC_VOLTS_MAGY] = adcData.voltScale[ADC_VOLTS_MAGX];
+		adcData.voltScale[ADC_VOLTS_MAGZ] = adcData.voltScale[ADC_VOLTS_MAGX];
+	    }
 
-	    adcData.voltages[ADC_VOLTS_TEMP2] = adcData.channelSums[ADC_VOLTS_TEMP2] * ADC_DIVISOR * (1.0f / 2.0f);   // temp2
-	    adcData.voltages[ADC_VOLTS_TEMP3] = adcData.channelSums[ADC_VOLTS_TEMP3] * ADC_DIVISOR * (1.0f / 2.0f);   // temp3
+	    adcConvert((float *)adcData.voltages, adcData.channelSums, adcData.voltScale);
 
-	    for (i = 0; i < ADC_SENSORS; i++)
-		adcData.channelSums[i] = 0;
+	    memset(adcData.channelSums, 0, sizeof(adcData.channelSums));
+	    magBlocks = 0;
 
 	    // temperature from IDG500
 	    adcData.temp1 = adcData.temp1 * (1.0f - ADC_TEMP_SMOOTH) + (adcIDGVoltsToTemp(adcData.voltages[ADC_VOLTS_TEMP1]) + ADC_TEMP1_OFFSET) * ADC_TEMP_SMOOTH;
@@ -166,22 +203,14 @@ void adcTaskCode(void *unused) {
 	    dTemp2 = dTemp*dTemp;
 	    dTemp3 = dTemp2*dTemp;
 
-	    // rates
-	    x = +(adcData.voltages[ADC_VOLTS_RATEX] + adcData.rateBiasX + p[IMU_GYO_BIAS1_X]*dTemp + p[IMU_GYO_BIAS2_X]*dTemp2 + p[IMU_GYO_BIAS3_X]*dTemp3);// / p[IMU_GYO_SCAL_X];
-	    y = -(adcData.voltages[ADC_VOLTS_RATEY] + adcData.rateBiasY + p[IMU_GYO_BIAS1_Y]*dTemp + p[IMU_GYO_BIAS2_Y]*dTemp2 + p[IMU_GYO_BIAS3_Y]*dTemp3);// / p[IMU_GYO_SCAL_Y];
-	    z = -(adcData.voltages[ADC_VOLTS_RATEZ] + adcData.rateBiasZ + p[IMU_GYO_BIAS1_Z]*dTemp + p[IMU_GYO_BIAS2_Z]*dTemp2 + p[IMU_GYO_BIAS3_Z]*dTemp3);// / p[IMU_GYO_SCAL_Z];
-
-	    a = x + y*p[IMU_GYO_ALGN_XY] + z*p[IMU_GYO_ALGN_XZ];
-	    b = x*p[IMU_GYO_ALGN_YX] + y + z*p[IMU_GYO_ALGN_YZ];
-	    c = x*p[IMU_GYO_ALGN_ZX] + y*p[IMU_GYO_ALGN_ZY] + z;
+	    adcRateParams(dTemp, dTemp2, dTemp3);
 
-	    a /= p[IMU_GYO_SCAL_X];
-	    b /= p[IMU_GYO_SCAL_Y];
-	    c /= p[IMU_GYO_SCAL_Z];
+	    // rates
+	    adcRateCalc(adcData.voltages[ADC_VOLTS_RATEX], adcData.voltages[ADC_VOLTS_RATEY], adcData.voltages[ADC_VOLTS_RATEZ], &rx, &ry, &rz);
 
-	    adcData.rateX = a * imuData.cosRot - b * imuData.sinRot;
-	    adcData.rateY = b * imuData.cosRot + a * imuData.sinRot;
-	    adcData.rateZ = c;
+	    adcData.rateX = rx;
+	    adcData.rateY = ry;
+	    adcData.rateZ = rz;
 
 	    // Vin
 	    analogData.vIn = analogData.vIn * (1.0f - ADC_TEMP_SMOOTH) + adcVsenseToVin(adcData.voltages[ADC_VOLTS_VIN]) * ADC_TEMP_SMOOTH;
@@ -207,13 +236,13 @@ void adcTaskCode(void *unused) {
 
 #ifdef ADC_PRESSURE_3V3
 	    // MP3H61115A
-	    adcData.pressure1 = (adcData.pressure1  + ((adcData.voltages[ADC_VOLTS_PRES1] + (0.095f * ADC_REF_VOLTAGE)) * (1000.0f / (0.009f * ADC_REF_VOLTAGE)))) * 0.5f;
-	    adcData.pressure2 = (adcData.pressure2  + ((adcData.voltages[ADC_VOLTS_PRES2] + (0.095f * ADC_REF_VOLTAGE)) * (1000.0f / (0.009f * ADC_REF_VOLTAGE)))) * 0.5f;
+	    adcData.pressure1 = (adcData.voltages[ADC_VOLTS_PRES1] + (0.095f * ADC_REF_VOLTAGE)) * (1000.0f / (0.009f * ADC_REF_VOLTAGE));
+	    adcData.pressure2 = (adcData.voltages[ADC_VOLTS_PRES2] + (0.095f * ADC_REF_VOLTAGE)) * (1000.0f / (0.009f * ADC_REF_VOLTAGE));
 #endif
 
 #ifdef ADC_PRESSURE_5V
             // MPXH6101A
-            adcData.pressure1 = (adcData.pressure1  + (((ADC_REF_VOLTAGE - adcData.voltages[ADC_VOLTS_PRES1]) * (5.0f / ADC_REF_VOLTAGE)) + 0.54705f) / 0.05295f * 1000.0f) * 0.5f;
+            adcData.pressure1 = (((ADC_REF_VOLTAGE - adcData.voltages[ADC_VOLTS_PRES1]) * (5.0f / ADC_REF_VOLTAGE)) + 0.54705f) / 0.05295f * 1000.0f;
 #endif
 	    if (p[IMU_PRESS_SENSE] == 0.0f)
 		adcData.pressure = adcData.pressure1;
@@ -249,7 +278,7 @@ void adcTaskCode(void *unused) {
 	    sumMagZ += (double)adcData.voltages[ADC_VOLTS_MAGZ];
 	    countMag++;
 
-	    adcData.dt = (float)(adcData.sampleTime * 2) * (1.0f / (float)AQ_US_PER_SEC);
+	    adcData.dt = (float)(adcData.sampleTime * ADC_DECIMATE) * (1.0f / (float)AQ_US_PER_SEC);
 	    adcData.lastUpdate = adcData.lastSample;
 
 	    imuAdcSensorReady();
@@ -321,11 +350,15 @@ void adcInit(void) {
     ADC_CommonInitTypeDef ADC_CommonInitStructure;
     ADC_InitTypeDef ADC_InitStructure;
     NVIC_InitTypeDef NVIC_InitStructure;
+    int i;
 
     AQ_NOTICE("ADC init\n");
 
     memset((void *)&adcData, 0, sizeof(adcData));
 
+    for (i = 0; i < ADC_SENSORS; i++)
+	adcData.voltScale[i] = ADC_DIVISOR / (float)(adcScanSamples[i] * ADC_DECIMATE);
+
     // energize mag's set/reset circuit
     adcData.magSetReset = digitalInit(GPIOE, GPIO_Pin_10, 1);
 
@@ -518,9 +551,8 @@ void adcInit(void) {
 // every ~15.25us
 void ADC_DMA_HANDLER(void) {
     register uint32_t flag = ADC_DMA_ISR;
-    register unsigned long *s, *a;
+    register unsigned long *s;
     register uint16_t *w;
-    int i;
 
     // clear intr flags
     ADC_DMA_CR = (uint32_t)ADC_DMA_FLAGS;
@@ -529,7 +561,7 @@ void ADC_DMA_HANDLER(void) {
     w = ((flag & ADC_DMA_TC_FLAG) == RESET) ? adcDMAData.adc123Raw1 : adcDMAData.adc123Raw2;
 
     // accumulate totals
-    s = adcData.interrupt123Sums;
+    s = adcData.accSums[adcData.accBank];
     *s++ += (w[36] + w[39] + w[42] + w[45]);	// rateX
     *s++ += (w[1]  + w[4]  + w[7]  + w[10]);	// rateY
     *s++ += (w[2]  + w[5]  + w[8]  + w[11]);	// rateZ
@@ -550,6 +582,13 @@ void ADC_DMA_HANDLER(void) {
 	register unsigned long micros = timerMicros();
 	adcData.sample = 0;
 
+	// the task still owns the other bank, drop this block rather than swap into it
+	if (adcData.bankPending) {
+	    memset(adcData.accSums[adcData.accBank], 0, sizeof(adcData.accSums[0]));
+	    adcData.overruns++;
+	    return;
+	}
+
 	if (++adcData.loops & 0x01) {
 	    if (ADC_MAG_SIGN) {
 		digitalLo(adcData.magSetReset);
@@ -559,12 +598,10 @@ void ADC_DMA_HANDLER(void) {
 	    }
 	}
 
-	s = adcData.interrupt123Sums;
-	a = (unsigned long *)adcData.adcSums;
-	for (i = 0; i < ADC_SENSORS; i++) {
-	    *a++ = *s;
-	    *s++ = 0;
-	}
+	// hand the filled bank to the task and switch to the other
+	adcData.readyBank = adcData.accBank;
+	adcData.accBank ^= 0x01;
+	adcData.bankPending = 1;
 
 	adcData.sampleTime = micros - adcData.lastSample;
 	adcData.lastSample = micros;
@@ -38,6 +38,14 @@
 #define ADC_SENSORS		15
 #define ADC_CHANNELS		16
 
+#define ADC_DECIMATE		2			    // sample blocks per slow (sensor) output, one mag set/reset period
+#define ADC_RATE_TAPS		2			    // sample blocks averaged for each double rate gyro output
+
+// the DMA handler flips the mag set/reset every 2 blocks, any other window mixes polarities
+#if ADC_DECIMATE != 2
+#error ADC_DECIMATE must be 2
+#endif
+
 #define ADC_REF_VOLTAGE		3.3f
 #define ADC_DIVISOR		(ADC_REF_VOLTAGE / 4096.0f / ADC_SAMPLES)
 
@@ -99,12 +107,22 @@ typedef struct {
     OS_TID adcTask;
     OS_FlagID adcFlag;
 
-    unsigned long interrupt123Sums[ADC_SENSORS];
+    // ping-pong accumulators, ISR fills accSums[accBank] while the task drains accSums[readyBank]
+    unsigned long accSums[2][ADC_SENSORS];
+    volatile uint8_t accBank;
+    volatile uint8_t readyBank;
+    volatile uint8_t bankPending;
+    volatile unsigned long overruns;
 
-    unsigned long volatile adcSums[ADC_SENSORS];
     unsigned long channelSums[ADC_SENSORS];
+    unsigned long rateHist[ADC_RATE_TAPS][3];
+    unsigned long rateHistSums[3];
+    float voltScale[ADC_SENSORS];
     float volatile voltages[ADC_SENSORS];
 
+    float rateOffset[3];
+    float rateScale[3];
+
     float temp1, temp2, temp3;
     float temperature;
     float pressure1;
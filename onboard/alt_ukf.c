@@ -25,17 +25,43 @@ void altUkfPresUpdate(float *u, float *x, float *noise, float *y) {
     y[0] = x[ALT_STATE_POS] + noise[0];     // return altitude
 }
 
-static void altDoPresUpdate(float measuredPres) {
+// newest history entry sampled at or before the given time, else the oldest
+static int altUkfHistIndex(uint32_t micros) {
+    int histIndex;
+    int i;
+
+    histIndex = altUkfData.histIndex;
+    for (i = 0; i < ALT_HIST; i++) {
+	if (--histIndex < 0)
+	    histIndex = ALT_HIST - 1;
+
+	if ((int32_t)(micros - altUkfData.histTime[histIndex]) >= 0)
+	    break;
+    }
+
+    return histIndex;
+}
+
+static void altDoPresUpdate(uint32_t presMicros, float measuredPres) {
     float noise;        // measurement variance
     float y;            // measurment
+    float posDelta;
+    int histIndex;
 
     noise = ALT_PRES_NOISE;
     y = navUkfPresToAlt(measuredPres);
 
+    // update the position the pressure sample saw, then carry the change forward
+    histIndex = altUkfHistIndex(presMicros);
+    posDelta = ALT_POS - altUkfData.posHist[histIndex];
+    ALT_POS = altUkfData.posHist[histIndex];
+
     srcdkfMeasurementUpdate(altUkfData.kf, 0, &y, 1, 1, &noise, altUkfPresUpdate);
+
+    ALT_POS += posDelta;
 }
 
-void altUkfProcess(float measuredPres) {
+void altUkfProcess(uint32_t presMicros, float measuredPres) {
     float accIn[3];
     float acc[3];
 
@@ -47,14 +73,20 @@ void altUkfProcess(float measuredPres) {
     navUkfRotateVectorByQuat(acc, accIn, &UKF_Q1);
     acc[2] += GRAVITY;
 
-    srcdkfTimeUpdate(altUkfData.kf, &acc[2], AQ_OUTER_TIMESTEP);
+    srcdkfTimeUpdate(altUkfData.kf, &acc[2], imuData.dt);
 
-    altDoPresUpdate(measuredPres);
+    // store history
+    altUkfData.posHist[altUkfData.histIndex] = ALT_POS;
+    altUkfData.histTime[altUkfData.histIndex] = imuData.sensorTime;
+    altUkfData.histIndex = (altUkfData.histIndex + 1) % ALT_HIST;
+
+    altDoPresUpdate(presMicros, measuredPres);
 }
 
 void altUkfInit(void) {
     float Q[ALT_S];		// state variance
     float V[ALT_V];		// process variance
+    int i;
 
     memset((void *)&altUkfData, 0, sizeof(altUkfData));
 
@@ -74,4 +106,7 @@ void altUkfInit(void) {
     ALT_POS = navUkfPresToAlt(AQ_PRESSURE);
     ALT_VEL = 0.0f;
     ALT_BIAS = 0.0f;
+
+    for (i = 0; i < ALT_HIST; i++)
+	altUkfData.posHist[i] = ALT_POS;
 }
\ No newline at end of file
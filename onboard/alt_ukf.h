@@ -19,6 +19,8 @@
 #define ALT_VEL         altUkfData.x[ALT_STATE_VEL]
 #define ALT_BIAS        altUkfData.x[ALT_STATE_BIAS]
 
+#define ALT_HIST        16  // outer loops of history, must cover the age of the MS5611 median
+
 #define ALT_PRES_NOISE  0.02f
 #define ALT_BIAS_NOISE  5e-4f//5e-5f
 #define ALT_VEL_NOISE   5e-4f
@@ -26,11 +28,14 @@
 typedef struct {
     srcdkf_t *kf;
     float *x;               // states
+    float posHist[ALT_HIST];
+    uint32_t histTime[ALT_HIST];	// sensor timestamp of each history entry
+    int histIndex;
 } altUkfStruct_t;
 
 extern altUkfStruct_t altUkfData;
 
 extern void altUkfInit(void);
-extern void altUkfProcess(float measuredPres);
+extern void altUkfProcess(uint32_t presMicros, float measuredPres);
 
 #endif
\ No newline at end of file
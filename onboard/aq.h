@@ -29,6 +29,8 @@
 #define USE_SIGNALING                   // uncomment to use external signaling events and ports
 //#define USE_QUATOS
 //#define USE_EXTERNAL_ESC              // uncomment to use external ESCs on board version 8
+#define USE_BLACKBOX                    // comment out to disable the raw DIMU sample stream
+//#define USE_LOG_COMPRESS              // uncomment to write AQL data as compressed blocks
 
 #ifndef BOARD_VERSION
     #define BOARD_VERSION	6
@@ -21,6 +21,7 @@
 #include "aq_timer.h"
 #include "rtc.h"
 #include "filer.h"
+#include "fileio.h"
 #include "config.h"
 #include "serial.h"
 #include "comm.h"
@@ -33,6 +34,7 @@
 #include "gps.h"
 #include "nav.h"
 #include "logger.h"
+#include "blackbox.h"
 #include "alt_ukf.h"
 #include "nav_ukf.h"
 #include "aq_mavlink.h"
@@ -80,10 +82,14 @@ void aqInit(void *pdata) {
     gpsInit();
     navInit();
     commandInit();
+    fileioInit();
 #ifdef USE_SIGNALING
     signalingInit();
 #endif
     loggerInit();
+#if defined(USE_BLACKBOX) && defined(USE_DIGITAL_IMU)
+    blackboxInit();
+#endif
 #ifdef CAN_CALIB
     canCalibInit();
 #else
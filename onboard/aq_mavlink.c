@@ -39,6 +39,8 @@
 #include "gimbal.h"
 #include "d_imu.h"
 #include "run.h"
+#include "filer.h"
+#include "sdio.h"
 #include <CoOS.h>
 #include <string.h>
 #include <stdio.h>
@@ -46,20 +48,68 @@
 mavlinkStruct_t mavlinkData;
 mavlink_system_t mavlink_system;
 
+static mavlinkTx_t *mavlinkGetTx(void) {
+    return (CoGetCurTaskID() == commData.commTask) ? &mavlinkData.tx[0] : &mavlinkData.tx[1];
+}
+
+static void mavlinkFlush(mavlinkTx_t *tx) {
+    if (tx->txBuf) {
+	commSendTxBuf(tx->txBuf, tx->len);
+	mavlinkData.txBuffers++;
+	tx->txBuf = 0;
+    }
+}
+
+// reserve room for a whole message so header, payload & checksum are packed in place
+void mavlinkStartSend(mavlink_channel_t chan, uint16_t len) {
+    mavlinkTx_t *tx = mavlinkGetTx();
+    uint16_t size = len;
+
+    if (tx != &mavlinkData.tx[0])
+	CoEnterMutexSection(mavlinkData.txMutex);
+
+    // no room left, send what we have
+    if (tx->txBuf && tx->len + len > tx->size)
+	mavlinkFlush(tx);
+
+    if (tx->txBuf == 0) {
+	if (tx == &mavlinkData.tx[0] && mavlinkData.coalesce && size < AQMAVLINK_COALESCE_SIZE)
+	    size = AQMAVLINK_COALESCE_SIZE;
+
+	// cannot block, must fail
+	tx->txBuf = commGetTxBuf(COMM_STREAM_TYPE_MAVLINK, size);
+	if (tx->txBuf == 0 && size > len)
+	    tx->txBuf = commGetTxBuf(COMM_STREAM_TYPE_MAVLINK, (size = len));
+
+	tx->size = size;
+	tx->len = 0;
+    }
+
+    if (tx->txBuf == 0)
+	mavlinkData.txDrops++;
+}
+
 void mavlinkSendPacket(mavlink_channel_t chan, const uint8_t *buf, uint16_t len) {
-    commTxBuf_t *txBuf;
-    uint8_t *ptr;
-    int i;
+    mavlinkTx_t *tx = mavlinkGetTx();
+
+    if (tx->txBuf != 0 && tx->len + len <= tx->size) {
+	memcpy(&tx->txBuf->buf + tx->len, buf, len);
+	tx->len += len;
+    }
+}
 
-    txBuf = commGetTxBuf(COMM_STREAM_TYPE_MAVLINK, len);
-    // cannot block, must fail
-    if (txBuf != 0) {
-	ptr = &txBuf->buf;
+void mavlinkEndSend(mavlink_channel_t chan, uint16_t len) {
+    mavlinkTx_t *tx = mavlinkGetTx();
 
-	for (i = 0; i < len; i++)
-	    *ptr++ = *buf++;
+    mavlinkData.txPackets++;
+    mavlinkData.txBytes += len;
 
-	commSendTxBuf(txBuf, len);
+    if (tx != &mavlinkData.tx[0]) {
+	mavlinkFlush(tx);
+	CoLeaveMutexSection(mavlinkData.txMutex);
+    }
+    else if (!mavlinkData.coalesce) {
+	mavlinkFlush(tx);
     }
 }
 
@@ -144,39 +194,15 @@ void mavlinkSetSystemData(void) {
 	mavlinkData.sys_mode |= MAV_MODE_FLAG_SAFETY_ARMED;
 }
 
-void mavlinkDo(void) {
+// emit one stream's messages, returns time until it is due again
+static unsigned long mavlinkSendStream(uint8_t stream, unsigned long micros, int8_t streamAll) {
     static unsigned long mavCounter;
-    static unsigned long lastMicros = 0;
-    unsigned long micros, statusInterval;
-    int8_t battRemainPct, streamAll;
-
-    micros = timerMicros();
-
-    // handle rollover
-    if (micros < lastMicros) {
-	mavlinkData.nextHeartbeat = 0;
-	mavlinkData.nextParam = 0;
-	for (uint8_t i=0; i < AQMAVLINK_TOTAL_STREAMS; ++i)
-	    mavlinkData.streams[i].next = 0;
-    }
-
-    supervisorSendDataStart();
-
-    // heartbeat
-    if (mavlinkData.nextHeartbeat < micros) {
-	mavlinkSetSystemData();
-	mavlink_msg_heartbeat_send(MAVLINK_COMM_0, mavlinkData.sys_type, MAV_AUTOPILOT_AUTOQUAD, mavlinkData.sys_mode, mavlinkData.sys_nav_mode, mavlinkData.sys_state);
-	mavlinkData.nextHeartbeat = micros + AQMAVLINK_HEARTBEAT_INTERVAL;
-    }
-
-    // send streams
-
-    // first check if "ALL" stream is requested
-    if ((streamAll = mavlinkData.streams[MAV_DATA_STREAM_ALL].enable && mavlinkData.streams[MAV_DATA_STREAM_ALL].next < micros))
-	mavlinkData.streams[MAV_DATA_STREAM_ALL].next = micros + mavlinkData.streams[MAV_DATA_STREAM_ALL].interval;
+    unsigned long statusInterval;
+    int8_t battRemainPct;
 
+    switch (stream) {
     // status
-    if (streamAll || (mavlinkData.streams[MAV_DATA_STREAM_EXTENDED_STATUS].enable && mavlinkData.streams[MAV_DATA_STREAM_EXTENDED_STATUS].next < micros)) {
+    case MAV_DATA_STREAM_EXTENDED_STATUS:
 	// calculate idle time
 	statusInterval = streamAll ? mavlinkData.streams[MAV_DATA_STREAM_ALL].interval : mavlinkData.streams[MAV_DATA_STREAM_EXTENDED_STATUS].interval;
 	mavCounter = counter;
@@ -187,25 +213,24 @@ void mavlinkDo(void) {
 
 	mavlink_msg_sys_status_send(MAVLINK_COMM_0, 0, 0, 0, 1000-mavlinkData.idlePercent, analogData.vIn * 1000, -1, battRemainPct, 0, mavlinkData.packetDrops, 0, 0, 0, 0);
 	mavlink_msg_radio_status_send(MAVLINK_COMM_0, RADIO_QUALITY, 0, 0, 0, 0, RADIO_ERROR_COUNT, 0);
+	break;
 
-	mavlinkData.streams[MAV_DATA_STREAM_EXTENDED_STATUS].next = micros + mavlinkData.streams[MAV_DATA_STREAM_EXTENDED_STATUS].interval;
-    }
     // raw sensors
-    if (streamAll || (mavlinkData.streams[MAV_DATA_STREAM_RAW_SENSORS].enable && mavlinkData.streams[MAV_DATA_STREAM_RAW_SENSORS].next < micros)) {
+    case MAV_DATA_STREAM_RAW_SENSORS:
 	mavlink_msg_scaled_imu_send(MAVLINK_COMM_0, micros, IMU_ACCX*1000.0f, IMU_ACCY*1000.0f, IMU_ACCZ*1000.0f, IMU_RATEX*1000.0f, IMU_RATEY*1000.0f, IMU_RATEZ*1000.0f,
 		IMU_MAGX*1000.0f, IMU_MAGY*1000.0f, IMU_MAGZ*1000.0f);
 	mavlink_msg_scaled_pressure_send(MAVLINK_COMM_0, micros, AQ_PRESSURE*0.01f, 0.0f, IMU_TEMP*100);
-	mavlinkData.streams[MAV_DATA_STREAM_RAW_SENSORS].next = micros + mavlinkData.streams[MAV_DATA_STREAM_RAW_SENSORS].interval;
-    }
+	break;
+
     // position -- gps and ukf
-    if (streamAll || (mavlinkData.streams[MAV_DATA_STREAM_POSITION].enable && mavlinkData.streams[MAV_DATA_STREAM_POSITION].next < micros)) {
+    case MAV_DATA_STREAM_POSITION:
 	mavlink_msg_gps_raw_int_send(MAVLINK_COMM_0, micros, navData.fixType, gpsData.lat*(double)1e7, gpsData.lon*(double)1e7, gpsData.height*1e3,
 		gpsData.hAcc*100, gpsData.vAcc*100, gpsData.speed*100, gpsData.heading, 255);
 	mavlink_msg_local_position_ned_send(MAVLINK_COMM_0, micros, UKF_POSN, UKF_POSE, -UKF_POSD, UKF_VELN, UKF_VELE, -VELOCITYD);
-	mavlinkData.streams[MAV_DATA_STREAM_POSITION].next = micros + mavlinkData.streams[MAV_DATA_STREAM_POSITION].interval;
-    }
+	break;
+
     // rc channels and pwm outputs (would be nice to separate these)
-    if (streamAll || (mavlinkData.streams[MAV_DATA_STREAM_RC_CHANNELS].enable && mavlinkData.streams[MAV_DATA_STREAM_RC_CHANNELS].next < micros)) {
+    case MAV_DATA_STREAM_RC_CHANNELS:
 	if (!mavlinkData.indexPort++) {
 	    mavlink_msg_rc_channels_raw_send(MAVLINK_COMM_0, micros, 0, RADIO_THROT+1024, RADIO_ROLL+1024, RADIO_PITCH+1024, RADIO_RUDD+1024,
 		    RADIO_GEAR+1024, RADIO_FLAPS+1024, RADIO_AUX2+1024, RADIO_AUX3+1024, RADIO_QUALITY);
@@ -218,18 +243,17 @@ void mavlinkDo(void) {
 		    motorsData.value[12], motorsData.value[13], motorsData.value[14], motorsData.value[15]);
 	    mavlinkData.indexPort = 0;
 	}
-	mavlinkData.streams[MAV_DATA_STREAM_RC_CHANNELS].next = micros + mavlinkData.streams[MAV_DATA_STREAM_RC_CHANNELS].interval / 2;
-    }
+	return mavlinkData.streams[MAV_DATA_STREAM_RC_CHANNELS].interval / 2;
+
     // raw controller -- attitude and nav data
-    if (streamAll || (mavlinkData.streams[MAV_DATA_STREAM_RAW_CONTROLLER].enable && mavlinkData.streams[MAV_DATA_STREAM_RAW_CONTROLLER].next < micros)) {
+    case MAV_DATA_STREAM_RAW_CONTROLLER:
 	mavlink_msg_attitude_send(MAVLINK_COMM_0, micros, AQ_ROLL*DEG_TO_RAD, AQ_PITCH*DEG_TO_RAD, AQ_YAW*DEG_TO_RAD, -(IMU_RATEX - UKF_GYO_BIAS_X)*DEG_TO_RAD,
 		(IMU_RATEY - UKF_GYO_BIAS_Y)*DEG_TO_RAD, (IMU_RATEZ - UKF_GYO_BIAS_Z)*DEG_TO_RAD);
 	mavlink_msg_nav_controller_output_send(MAVLINK_COMM_0, navData.holdTiltE, navData.holdTiltN, navData.holdHeading, navData.holdCourse, navData.holdDistance, navData.holdAlt, 0, 0);
-	mavlinkData.streams[MAV_DATA_STREAM_RAW_CONTROLLER].next = micros + mavlinkData.streams[MAV_DATA_STREAM_RAW_CONTROLLER].interval;
-    }
+	break;
 #ifdef MAVLINK_MSG_ID_AQ_ESC_TELEMETRY
     // ESC/Motor telemetry
-    if (streamAll || (mavlinkData.streams[MAV_DATA_STREAM_PROPULSION].enable && mavlinkData.streams[MAV_DATA_STREAM_PROPULSION].next < micros)) {
+    case MAV_DATA_STREAM_PROPULSION: {
 	uint8_t id, i, m, s;
 	uint8_t mId[4], dataVer[4];
 	uint16_t statAge[4];
@@ -254,11 +278,12 @@ void mavlinkDo(void) {
 		m = 0;
 	    }
 	}
-	mavlinkData.streams[MAV_DATA_STREAM_PROPULSION].next = micros + mavlinkData.streams[MAV_DATA_STREAM_PROPULSION].interval;
+	break;
     }
 #endif
+
     // EXTRA3 stream -- AQ custom telemetry
-    if (streamAll || (mavlinkData.streams[MAV_DATA_STREAM_EXTRA3].enable && mavlinkData.streams[MAV_DATA_STREAM_EXTRA3].next < micros)) {
+    case MAV_DATA_STREAM_EXTRA3:
 	for (uint8_t i=0; i < AQMAV_DATASET_ENUM_END; ++i) {
 	    if (!mavlinkData.customDatasets[i])
 		continue;
@@ -299,20 +324,307 @@ void mavlinkDo(void) {
 			*gimbalData.passthroughPort->ccr, gimbalData.tilt, gimbalData.trigger, gimbalData.triggerLastTime, gimbalData.triggerLastLat, gimbalData.triggerLastLon,
 			gimbalData.triggerCount, 0,0,0,0,0,0,0,0,0);
 		break;
+#if CFG_TASK_STATS_EN > 0
+	    case AQMAV_DATASET_TASKLOAD :
+		mavlink_msg_aq_telemetry_f_send(MAVLINK_COMM_0, i, utilGetTaskLoad(mavlinkData.taskIds[0]), utilGetTaskLoad(mavlinkData.taskIds[1]), utilGetTaskLoad(mavlinkData.taskIds[2]),
+			utilGetTaskLoad(mavlinkData.taskIds[3]), utilGetTaskLoad(mavlinkData.taskIds[4]), utilGetTaskLoad(mavlinkData.taskIds[5]), utilGetTaskLoad(mavlinkData.taskIds[6]),
+			utilGetTaskLoad(mavlinkData.taskIds[7]), utilGetTaskLoad(mavlinkData.taskIds[8]), utilGetTaskLoad(mavlinkData.taskIds[9]), utilGetTaskLoad(mavlinkData.taskIds[10]),
+			utilGetIsrLoad(), 0,0,0,0,0,0,0,0);
+		break;
+	    case AQMAV_DATASET_TASKSLICE :
+		mavlink_msg_aq_telemetry_f_send(MAVLINK_COMM_0, i, utilGetTaskMaxSlice(mavlinkData.taskIds[0]), utilGetTaskMaxSlice(mavlinkData.taskIds[1]), utilGetTaskMaxSlice(mavlinkData.taskIds[2]),
+			utilGetTaskMaxSlice(mavlinkData.taskIds[3]), utilGetTaskMaxSlice(mavlinkData.taskIds[4]), utilGetTaskMaxSlice(mavlinkData.taskIds[5]), utilGetTaskMaxSlice(mavlinkData.taskIds[6]),
+			utilGetTaskMaxSlice(mavlinkData.taskIds[7]), utilGetTaskMaxSlice(mavlinkData.taskIds[8]), utilGetTaskMaxSlice(mavlinkData.taskIds[9]),
+			utilGetTaskPreempts(mavlinkData.taskIds[0]), utilGetTaskPreempts(mavlinkData.taskIds[1]), utilGetTaskPreempts(mavlinkData.taskIds[2]),
+			utilGetTaskPreempts(mavlinkData.taskIds[3]), utilGetTaskPreempts(mavlinkData.taskIds[4]), utilGetTaskPreempts(mavlinkData.taskIds[5]), utilGetTaskPreempts(mavlinkData.taskIds[6]),
+			utilGetTaskPreempts(mavlinkData.taskIds[7]), utilGetTaskPreempts(mavlinkData.taskIds[8]), utilGetTaskPreempts(mavlinkData.taskIds[9]));
+		break;
+#endif
+	    case AQMAV_DATASET_SDSTATS :
+		mavlink_msg_aq_telemetry_f_send(MAVLINK_COMM_0, i, filerData.diskStats.writeRate, sdioData.writeStats.latency.count, sdioData.writeStats.latency.max,
+			sdioData.writeStats.retries, sdioData.writeStats.errors, sdioData.writeStats.busyWait,
+			sdioData.writeStats.latency.hist[0], sdioData.writeStats.latency.hist[1], sdioData.writeStats.latency.hist[2], sdioData.writeStats.latency.hist[3],
+			sdioData.writeStats.latency.hist[4], sdioData.writeStats.latency.hist[5], sdioData.writeStats.latency.hist[6], sdioData.writeStats.latency.hist[7],
+			sdioData.writeStats.latency.hist[8], sdioData.writeStats.latency.hist[9],
+			sdioData.readStats.latency.count, sdioData.readStats.latency.max, filerGetGapMax(), filerData.diskStats.sync.max);
+		break;
+	    case AQMAV_DATASET_LINK :
+		mavlink_msg_aq_telemetry_f_send(MAVLINK_COMM_0, i, mavlinkData.linkRate, mavlinkData.linkScale, mavlinkData.linkTokens, mavlinkData.linkDeferred,
+			mavlinkData.streams[1].rate, mavlinkData.streams[2].rate, mavlinkData.streams[3].rate, mavlinkData.streams[4].rate, mavlinkData.streams[5].rate,
+			mavlinkData.streams[6].rate, mavlinkData.streams[7].rate, mavlinkData.streams[8].rate, mavlinkData.streams[9].rate, mavlinkData.streams[10].rate,
+			mavlinkData.streams[11].rate, mavlinkData.streams[12].rate, mavlinkData.streams[13].rate, 0,0,0);
+		break;
 	    }
 	}
 
-	mavlinkData.streams[MAV_DATA_STREAM_EXTRA3].next = micros + mavlinkData.streams[MAV_DATA_STREAM_EXTRA3].interval;
+	break;
     }
-    // end streams
 
-    // list all requested/remaining parameters
-    if (mavlinkData.currentParam < CONFIG_NUM_PARAMS && mavlinkData.nextParam < micros) {
-	mavlink_msg_param_value_send(MAVLINK_COMM_0, configParameterStrings[mavlinkData.currentParam], p[mavlinkData.currentParam], MAVLINK_TYPE_FLOAT, CONFIG_NUM_PARAMS, mavlinkData.currentParam);
-	mavlinkData.currentParam++;
-	mavlinkData.nextParam = micros + AQMAVLINK_PARAM_INTERVAL;
+    return mavlinkData.streams[stream].interval;
+}
+
+// slowest port carrying MAVLink sets our byte budget, 0 if unlimited
+static void mavlinkLinkRate(void) {
+    float rate = 0.0f;
+    int i;
+
+    for (i = 0; i < COMM_NUM_PORTS; i++)
+	if ((commData.portStreams[i] & COMM_STREAM_TYPE_MAVLINK) && commData.portTypes[i] != COMM_PORT_TYPE_USB && commData.portTypes[i] != COMM_PORT_TYPE_NONE)
+	    if (rate == 0.0f || p[COMM_BAUD1+i] / 10.0f < rate)
+		rate = p[COMM_BAUD1+i] / 10.0f;
+
+    mavlinkData.linkRate = rate;
+}
+
+// once a second, effective stream rates
+static void mavlinkStreamRates(unsigned long micros) {
+    float dt;
+    int i;
+
+    if (micros - mavlinkData.rateMicros >= AQMAVLINK_RATE_PERIOD) {
+	dt = (micros - mavlinkData.rateMicros) / 1e6f;
+
+	for (i = 0; i < AQMAVLINK_TOTAL_STREAMS; i++) {
+	    mavlinkData.streams[i].rate = mavlinkData.streams[i].count / dt;
+	    mavlinkData.streams[i].count = 0;
+	}
+
+	mavlinkLinkRate();
+	mavlinkData.rateMicros = micros;
+    }
+}
+
+// everything sent since the last call is paid for, heartbeats & params included
+static void mavlinkLinkCharge(void) {
+    if (mavlinkData.linkRate > 0.0f)
+	mavlinkData.linkTokens -= mavlinkData.txBytes - mavlinkData.linkBytes;
+    mavlinkData.linkBytes = mavlinkData.txBytes;
+}
+
+// buffer feedback from a telemetry radio (% free), back off before it overflows
+static void mavlinkRadioStatus(uint8_t txbuf) {
+    if (txbuf < AQMAVLINK_RADIO_TXBUF_LOW)
+	mavlinkData.linkScale *= 0.8f;
+    else if (txbuf > AQMAVLINK_RADIO_TXBUF_HIGH)
+	mavlinkData.linkScale *= 1.05f;
+
+    if (mavlinkData.linkScale < AQMAVLINK_LINK_MIN_SCALE)
+	mavlinkData.linkScale = AQMAVLINK_LINK_MIN_SCALE;
+    else if (mavlinkData.linkScale > 1.0f)
+	mavlinkData.linkScale = 1.0f;
+}
+
+// send due streams, highest priority then earliest deadline first, within the link's token bucket
+static void mavlinkSchedule(unsigned long micros, int8_t streamAll) {
+    mavlinkStreams_t *s;
+    unsigned long payback;
+    uint32_t bytes;
+    uint16_t sent = 0;
+    float burst, reserve;
+    int8_t best;
+    int i;
+
+    if (mavlinkData.linkRate > 0.0f) {
+	burst = mavlinkData.linkRate * mavlinkData.linkScale * AQMAVLINK_LINK_BURST;
+	if (burst < AQMAVLINK_LINK_MIN_BURST)
+	    burst = AQMAVLINK_LINK_MIN_BURST;
+
+	mavlinkData.linkTokens += mavlinkData.linkRate * mavlinkData.linkScale * (micros - mavlinkData.linkMicros) / 1e6f;
+	if (mavlinkData.linkTokens > burst)
+	    mavlinkData.linkTokens = burst;
+    }
+    mavlinkData.linkMicros = micros;
+    mavlinkLinkCharge();
+
+    while (1) {
+	best = -1;
+
+	for (i = 1; i < AQMAVLINK_TOTAL_STREAMS; i++) {
+	    s = &mavlinkData.streams[i];
+
+	    if ((sent & (1<<i)) || !(streamAll || (s->enable && s->next < micros)))
+		continue;
+
+	    if (best < 0 || s->priority > mavlinkData.streams[best].priority ||
+		    (s->priority == mavlinkData.streams[best].priority && s->next < mavlinkData.streams[best].next))
+		best = i;
+	}
+
+	if (best < 0)
+	    break;
+
+	s = &mavlinkData.streams[best];
+
+	if (mavlinkData.linkRate > 0.0f) {
+	    // keep what higher priorities need if they fall due before this stream's bytes are paid back
+	    payback = micros + (unsigned long)(s->bytes * 1e6f / (mavlinkData.linkRate * mavlinkData.linkScale));
+	    reserve = 0.0f;
+	    for (i = 1; i < AQMAVLINK_TOTAL_STREAMS; i++)
+		if (mavlinkData.streams[i].enable && mavlinkData.streams[i].priority > s->priority && mavlinkData.streams[i].next < payback)
+		    reserve += mavlinkData.streams[i].bytes;
+
+	    // out of budget, lower priorities wait behind this one
+	    if (mavlinkData.linkTokens - reserve < s->bytes) {
+		mavlinkData.linkDeferred++;
+		break;
+	    }
+	}
+
+	bytes = mavlinkData.txBytes;
+	s->next = micros + mavlinkSendStream(best, micros, streamAll);
+	s->bytes = mavlinkData.txBytes - bytes;
+	s->count++;
+	sent |= (1<<best);
+
+	mavlinkLinkCharge();
+    }
+}
+
+#if CFG_TASK_STATS_EN > 0
+// stacks reported in the task datasets, in field order
+static const char *mavlinkTaskNames[AQMAVLINK_TASKS] = {
+    "INIT", "FILER", "SUPERVISOR", "ADC", "RADIO", "CONTROL", "GPS", "RUN", "COMM", "DIMU", "IDLE"
+};
+
+static void mavlinkTaskIds(void) {
+    int i;
+
+    for (i = 0; i < AQMAVLINK_TASKS; i++)
+	mavlinkData.taskIds[i] = utilGetTaskId(mavlinkTaskNames[i]);
+}
+#endif
+
+// utilCrc32() inverts its state on the way in and out, the GCS hash does not
+static uint32_t mavlinkCrc32(uint32_t crc, const void *buf, uint32_t len) {
+    return ~utilCrc32(~crc, buf, len);
+}
+
+// CRC32 over all parameter names & values in name order, lets a GCS with a cached table skip the download
+static uint32_t mavlinkParamHash(void) {
+    uint32_t crc = 0;
+    int i, j;
+
+    for (i = 0; i < CONFIG_NUM_PARAMS; i++) {
+	j = mavlinkData.paramOrder[i];
+	crc = mavlinkCrc32(crc, configParameterStrings[j], strlen(configParameterStrings[j]));
+	crc = mavlinkCrc32(crc, &p[j], sizeof(float));
+    }
+
+    return crc;
+}
+
+// insertion sort, the table only changes with the firmware
+static void mavlinkParamSort(void) {
+    uint16_t *order = mavlinkData.paramOrder;
+    uint16_t k;
+    int i, j;
+
+    for (i = 0; i < CONFIG_NUM_PARAMS; i++) {
+	k = i;
+	for (j = i; j > 0 && strcmp(configParameterStrings[order[j-1]], configParameterStrings[k]) > 0; j--)
+	    order[j] = order[j-1];
+	order[j] = k;
+    }
+}
+
+static void mavlinkSendParamHash(void) {
+    uint32_t hash = mavlinkParamHash();
+    float value;
+
+    memcpy(&value, &hash, sizeof(value));
+    mavlink_msg_param_value_send(MAVLINK_COMM_0, AQMAVLINK_PARAM_HASH, value, MAV_PARAM_TYPE_UINT32, CONFIG_NUM_PARAMS, -1);
+}
+
+static void mavlinkSendParam(uint16_t i) {
+    mavlink_msg_param_value_send(MAVLINK_COMM_0, configParameterStrings[i], p[i], MAVLINK_TYPE_FLOAT, CONFIG_NUM_PARAMS, i);
+
+    if (mavlinkData.paramShadow)
+	mavlinkData.paramShadow[i] = p[i];
+}
+
+// next parameter changed since the GCS last saw it, -1 if none within the scan budget
+static int mavlinkParamChanged(int *scan) {
+    int j;
+
+    if (!mavlinkData.paramSync || !mavlinkData.paramShadow)
+	return -1;
+
+    while (*scan > 0) {
+	(*scan)--;
+
+	j = mavlinkData.paramScan;
+	mavlinkData.paramScan = (j + 1) % CONFIG_NUM_PARAMS;
+
+	if (memcmp(&mavlinkData.paramShadow[j], &p[j], sizeof(float)))
+	    return j;
+    }
+
+    return -1;
+}
+
+static void mavlinkParamSync(void) {
+    int scan = AQMAVLINK_PARAM_SCAN;
+    int i, n;
+
+    for (n = 0; n < AQMAVLINK_PARAM_BURST && (mavlinkData.linkRate == 0.0f || mavlinkData.linkTokens > 0.0f); n++) {
+	if (mavlinkData.paramHashPending) {
+	    mavlinkSendParamHash();
+	    mavlinkData.paramHashPending = 0;
+	}
+	else if (mavlinkData.currentParam < CONFIG_NUM_PARAMS) {
+	    mavlinkSendParam(mavlinkData.currentParam++);
+	}
+	else if ((i = mavlinkParamChanged(&scan)) >= 0) {
+	    mavlinkSendParam(i);
+	}
+	else {
+	    break;
+	}
+
+	mavlinkLinkCharge();
+    }
+}
+
+void mavlinkDo(void) {
+    static unsigned long lastMicros = 0;
+    unsigned long micros;
+    int8_t streamAll;
+
+    micros = timerMicros();
+
+    // handle rollover
+    if (micros < lastMicros) {
+	mavlinkData.nextHeartbeat = 0;
+	for (uint8_t i=0; i < AQMAVLINK_TOTAL_STREAMS; ++i)
+	    mavlinkData.streams[i].next = 0;
+    }
+
+    supervisorSendDataStart();
+
+    // pack everything sent this pass into as few buffers as possible
+    mavlinkData.coalesce = 1;
+
+    // heartbeat
+    if (mavlinkData.nextHeartbeat < micros) {
+	mavlinkSetSystemData();
+	mavlink_msg_heartbeat_send(MAVLINK_COMM_0, mavlinkData.sys_type, MAV_AUTOPILOT_AUTOQUAD, mavlinkData.sys_mode, mavlinkData.sys_nav_mode, mavlinkData.sys_state);
+	mavlinkData.nextHeartbeat = micros + AQMAVLINK_HEARTBEAT_INTERVAL;
     }
 
+    // send streams
+
+    // first check if "ALL" stream is requested
+    if ((streamAll = mavlinkData.streams[MAV_DATA_STREAM_ALL].enable && mavlinkData.streams[MAV_DATA_STREAM_ALL].next < micros))
+	mavlinkData.streams[MAV_DATA_STREAM_ALL].next = micros + mavlinkData.streams[MAV_DATA_STREAM_ALL].interval;
+
+    mavlinkSchedule(micros, streamAll);
+    mavlinkStreamRates(micros);
+
+    // end streams
+
+    // list all requested/remaining parameters, then any that changed
+    mavlinkParamSync();
+
     // request announced waypoints from mission planner
     if (mavlinkData.wpCurrent < mavlinkData.wpCount && mavlinkData.wpAttempt <= AQMAVLINK_WP_MAX_ATTEMPTS && mavlinkData.wpNext < micros) {
 	mavlinkData.wpAttempt++;
@@ -328,6 +640,9 @@ void mavlinkDo(void) {
 	AQ_NOTICE("Error: Waypoint request timeout!");
     }
 
+    mavlinkData.coalesce = 0;
+    mavlinkFlush(&mavlinkData.tx[0]);
+
     supervisorSendDataStop();
 
     lastMicros = micros;
@@ -463,6 +778,15 @@ void mavlinkDoCommand(mavlink_message_t *msg) {
 		    // toggle all other streams because legacy mode sends a lot of data
 		    mavlinkToggleStreams(!enable);
 		}
+#if CFG_TASK_STATS_EN > 0
+		// tasks exist by now, look their ids up once rather than per send
+		if (((uint8_t)param3 == AQMAV_DATASET_TASKLOAD || (uint8_t)param3 == AQMAV_DATASET_TASKSLICE || (uint8_t)param3 == AQMAV_DATASET_ALL) && enable)
+		    mavlinkTaskIds();
+
+		// one time table of all tasks
+		if ((uint8_t)param3 == AQMAV_DATASET_TASKLOAD && enable)
+		    utilTaskStatsDump();
+#endif
 
 		// check if any datasets are active and enable/disable EXTRA3 stream accordingly
 		// AQMAV_DATASET_ALL is special and toggles all datasets
@@ -511,6 +835,9 @@ void mavlinkRecvTaskCode(commRcvrStruct_t *r) {
     char paramId[17];
     uint8_t c;
 
+    // replies go out together
+    mavlinkData.coalesce = 1;
+
     // process incoming data
     while (commAvailable(r)) {
 	c = commReadChar(r);
@@ -525,6 +852,10 @@ void mavlinkRecvTaskCode(commRcvrStruct_t *r) {
 		    }
 		    break;
 
+		case MAVLINK_MSG_ID_RADIO_STATUS:
+		    mavlinkRadioStatus(mavlink_msg_radio_status_get_txbuf(&msg));
+		    break;
+
 		case MAVLINK_MSG_ID_CHANGE_OPERATOR_CONTROL:
 		    if (mavlink_msg_change_operator_control_get_target_system(&msg) == mavlink_system.sysid) {
 			mavlink_msg_change_operator_control_ack_send(MAVLINK_COMM_0, msg.sysid, mavlink_msg_change_operator_control_get_control_request(&msg), 0);
@@ -762,18 +1093,37 @@ void mavlinkRecvTaskCode(commRcvrStruct_t *r) {
 
 		case MAVLINK_MSG_ID_PARAM_REQUEST_READ:
 		    if (mavlink_msg_param_request_read_get_target_system(&msg) == mavlink_system.sysid) {
-			uint16_t paramIndex;
+			int paramIndex;
 
 			paramIndex = mavlink_msg_param_request_read_get_param_index(&msg);
-			if (paramIndex < CONFIG_NUM_PARAMS)
-			    mavlink_msg_param_value_send(MAVLINK_COMM_0, configParameterStrings[paramIndex], p[paramIndex], MAVLINK_TYPE_FLOAT, CONFIG_NUM_PARAMS, paramIndex);
+
+			// by name
+			if (paramIndex < 0) {
+			    mavlink_msg_param_request_read_get_param_id(&msg, paramId);
+			    paramId[16] = 0;
+
+			    // GCS checking its cached table, from here on only changes are sent
+			    if (!strcmp(paramId, AQMAVLINK_PARAM_HASH)) {
+				mavlinkSendParamHash();
+				if (mavlinkData.paramShadow)
+				    memcpy(mavlinkData.paramShadow, p, CONFIG_NUM_PARAMS * sizeof(float));
+				mavlinkData.paramSync = 1;
+				break;
+			    }
+
+			    paramIndex = configGetParamIdByName(paramId);
+			}
+
+			if (paramIndex >= 0 && paramIndex < CONFIG_NUM_PARAMS)
+			    mavlinkSendParam(paramIndex);
 		    }
 		    break;
 
 		case MAVLINK_MSG_ID_PARAM_REQUEST_LIST:
 		    if (mavlink_msg_param_request_list_get_target_system(&msg) == mavlink_system.sysid) {
+			mavlinkData.paramHashPending = 1;
 			mavlinkData.currentParam = 0;
-			mavlinkData.nextParam = 0;
+			mavlinkData.paramSync = 1;
 		    }
 		    break;
 
@@ -789,7 +1139,7 @@ void mavlinkRecvTaskCode(commRcvrStruct_t *r) {
 			    if (!isnan(paramValue) && !isinf(paramValue) && !(supervisorData.state & STATE_FLYING))
 				p[paramIndex] = paramValue;
 			    // send back what we have no matter what
-			    mavlink_msg_param_value_send(MAVLINK_COMM_0, paramId, p[paramIndex], MAVLINK_TYPE_FLOAT, CONFIG_NUM_PARAMS, paramIndex);
+			    mavlinkSendParam(paramIndex);
 			}
 		    }
 		    break;
@@ -838,6 +1188,9 @@ void mavlinkRecvTaskCode(commRcvrStruct_t *r) {
 	// Update global packet drops counter
 	mavlinkData.packetDrops += mavlinkData.mavlinkStatus.packet_rx_drop_count;
     }
+
+    mavlinkData.coalesce = 0;
+    mavlinkFlush(&mavlinkData.tx[0]);
 }
 
 void mavlinkSetSystemType(void) {
@@ -878,6 +1231,9 @@ void mavlinkInit(void) {
 
     memset((void *)&mavlinkData, 0, sizeof(mavlinkData));
 
+    mavlinkData.txMutex = CoCreateMutex();
+    mavlinkData.linkScale = 1.0f;
+
     // register notice function with comm module
     commRegisterNoticeFunc(mavlinkSendNotice);
     commRegisterTelemFunc(mavlinkDo);
@@ -886,6 +1242,12 @@ void mavlinkInit(void) {
     AQ_NOTICE("Mavlink init\n");
 
     mavlinkData.currentParam = CONFIG_NUM_PARAMS;
+    mavlinkData.paramShadow = (float *)aqDataCalloc(CONFIG_NUM_PARAMS, sizeof(float));
+    mavlinkData.paramOrder = (uint16_t *)aqDataCalloc(CONFIG_NUM_PARAMS, sizeof(uint16_t));
+    mavlinkParamSort();
+#if CFG_TASK_STATS_EN > 0
+    memset(mavlinkData.taskIds, -1, sizeof(mavlinkData.taskIds));
+#endif
     mavlinkData.wpCount = navGetWaypointCount();
     mavlinkData.wpCurrent = mavlinkData.wpCount + 1;
     mavlinkData.sys_mode = MAV_MODE_PREFLIGHT;
@@ -906,6 +1268,14 @@ void mavlinkInit(void) {
     mavlinkData.streams[MAV_DATA_STREAM_EXTRA3].dfltInterval = AQMAVLINK_STREAM_RATE_EXTRA3;
     mavlinkData.streams[MAV_DATA_STREAM_PROPULSION].dfltInterval = AQMAVLINK_STREAM_RATE_PROPULSION;
 
+    mavlinkData.streams[MAV_DATA_STREAM_RAW_SENSORS].priority = AQMAVLINK_STREAM_PRIO_RAW_SENSORS;
+    mavlinkData.streams[MAV_DATA_STREAM_EXTENDED_STATUS].priority = AQMAVLINK_STREAM_PRIO_EXTENDED_STATUS;
+    mavlinkData.streams[MAV_DATA_STREAM_RC_CHANNELS].priority = AQMAVLINK_STREAM_PRIO_RC_CHANNELS;
+    mavlinkData.streams[MAV_DATA_STREAM_RAW_CONTROLLER].priority = AQMAVLINK_STREAM_PRIO_RAW_CONTROLLER;
+    mavlinkData.streams[MAV_DATA_STREAM_POSITION].priority = AQMAVLINK_STREAM_PRIO_POSITION;
+    mavlinkData.streams[MAV_DATA_STREAM_EXTRA3].priority = AQMAVLINK_STREAM_PRIO_EXTRA3;
+    mavlinkData.streams[MAV_DATA_STREAM_PROPULSION].priority = AQMAVLINK_STREAM_PRIO_PROPULSION;
+
     // turn on streams & spread them out
     micros = timerMicros();
     for (i = 0; i < AQMAVLINK_TOTAL_STREAMS; i++) {
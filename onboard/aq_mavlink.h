@@ -24,18 +24,32 @@
 #include "serial.h"
 #include "digital.h"
 #include "config.h"
+#include "comm.h"
 #include "../mavlink_types.h"
 
 #define MAVLINK_USE_CONVENIENCE_FUNCTIONS
+#define MAVLINK_START_UART_SEND			mavlinkStartSend
 #define MAVLINK_SEND_UART_BYTES			mavlinkSendPacket
+#define MAVLINK_END_UART_SEND			mavlinkEndSend
+
+#define AQMAVLINK_COALESCE_SIZE			256	    // messages from one comm task pass are packed into buffers this size
 
 #define AQMAVLINK_HEARTBEAT_INTERVAL		1e6f		    // 1Hz
-#define AQMAVLINK_PARAM_INTERVAL		(1e6f / 150.0f)	    // 150Hz
+#define AQMAVLINK_PARAM_BURST			16		    // most parameters sent per pass, further limited by the link budget
+#define AQMAVLINK_PARAM_SCAN			32		    // parameters checked for changes per pass
+#define AQMAVLINK_PARAM_HASH			"_HASH_CHECK"	    // pseudo parameter carrying the parameter table CRC
+
+// The _HASH_CHECK value is the QGC/PX4 one: a CRC32 (reflected 0xEDB88320,
+// zero initial value, no final inversion) over each parameter's name and its
+// 4 float bytes, taken in strcmp order of the names.  It is sent ahead of the
+// list on PARAM_REQUEST_LIST and when read by name.
+
 #define AQMAVLINK_WP_TIMEOUT			1e6f		    // 1 second - retry frequency for waypoint requests to planner
 #define AQMAVLINK_WP_MAX_ATTEMPTS		20		    // maximum number of retries for wpnt. requests
 
 // this should equal MAV_DATA_STREAM_ENUM_END from mavlink.h
 #define AQMAVLINK_TOTAL_STREAMS			14
+#define AQMAVLINK_TASKS				11		    // stacks in the task load & slice datasets
 // default stream rates in microseconds
 #define AQMAVLINK_STREAM_RATE_ALL		0
 #define AQMAVLINK_STREAM_RATE_RAW_SENSORS	0	    // IMU and baro
@@ -47,6 +61,21 @@
 #define AQMAVLINK_STREAM_RATE_EXTRA2		0	    // unused
 #define AQMAVLINK_STREAM_RATE_EXTRA3		0	    // AQ custom telemetry options
 #define AQMAVLINK_STREAM_RATE_PROPULSION	0	    // ESC/Motor telemetry
+// stream priorities when the link is short of bandwidth, highest first to be served
+#define AQMAVLINK_STREAM_PRIO_RAW_CONTROLLER	6
+#define AQMAVLINK_STREAM_PRIO_POSITION		5
+#define AQMAVLINK_STREAM_PRIO_EXTENDED_STATUS	4
+#define AQMAVLINK_STREAM_PRIO_RC_CHANNELS	3
+#define AQMAVLINK_STREAM_PRIO_PROPULSION	2
+#define AQMAVLINK_STREAM_PRIO_RAW_SENSORS	1
+#define AQMAVLINK_STREAM_PRIO_EXTRA3		1
+
+#define AQMAVLINK_LINK_BURST			0.1f	    // token bucket depth in seconds of link time
+#define AQMAVLINK_LINK_MIN_BURST		300	    // bytes, largest stream pass must fit
+#define AQMAVLINK_LINK_MIN_SCALE		0.1f	    // radio feedback never throttles below this fraction of baud
+#define AQMAVLINK_RADIO_TXBUF_LOW		40	    // % free in radio buffer to back off below
+#define AQMAVLINK_RADIO_TXBUF_HIGH		80	    // % free in radio buffer to speed up above
+#define AQMAVLINK_RATE_PERIOD			1000000	    // us between effective rate updates
 
 enum mavlinkCustomDataSets {
     AQMAV_DATASET_LEGACY1 = 0,	// legacy sets can eventually be phased out
@@ -58,6 +87,10 @@ enum mavlinkCustomDataSets {
     AQMAV_DATASET_SUPERVISOR,
     AQMAV_DATASET_STACKSFREE,
     AQMAV_DATASET_GIMBAL,
+    AQMAV_DATASET_TASKLOAD,
+    AQMAV_DATASET_TASKSLICE,
+    AQMAV_DATASET_SDSTATS,
+    AQMAV_DATASET_LINK,
     AQMAV_DATASET_ENUM_END
 };
 
@@ -66,8 +99,18 @@ typedef struct {
     unsigned long dfltInterval;	    // default stream interval at startup
     unsigned long next;		    // when to send next stream data
     uint8_t enable;		    // enable/disable stream
+    uint8_t priority;		    // higher served first when bandwidth is short
+    uint16_t bytes;		    // size of last emission
+    uint16_t count;		    // emissions this rate period
+    float rate;			    // effective Hz over the last rate period
 } mavlinkStreams_t;
 
+typedef struct {
+    commTxBuf_t *txBuf;		    // comm buffer being packed, 0 if none
+    uint16_t size;		    // bytes reserved
+    uint16_t len;		    // bytes packed so far
+} mavlinkTx_t;
+
 typedef struct {
     uint8_t sys_type;		    // System type (MAV_TYPE enum)
     uint8_t sys_state;		    // System state (MAV_STATE enum)
@@ -79,8 +122,32 @@ typedef struct {
     uint8_t customDatasets[AQMAV_DATASET_ENUM_END];
 
     unsigned long nextHeartbeat;
-    unsigned long nextParam;
     unsigned int currentParam;
+    float *paramShadow;		// values last sent to the GCS
+    uint16_t *paramOrder;	// parameter indexes sorted by name, for the hash
+    uint16_t paramScan;		// where to continue looking for changed parameters
+    uint8_t paramSync;		// GCS holds a copy of our parameter table
+    uint8_t paramHashPending;	// send the hash before the list
+
+    mavlinkTx_t tx[2];		// comm task (coalescing) & other callers
+    OS_MutexID txMutex;		// serializes callers outside of the comm task
+    uint8_t coalesce;		// comm task is in a send pass
+    uint32_t txPackets;
+    uint32_t txBuffers;		// comm buffers sent
+    uint32_t txDrops;		// messages lost to buffer starvation
+    uint32_t txBytes;		// bytes handed to comm
+
+#if CFG_TASK_STATS_EN > 0
+    int8_t taskIds[AQMAVLINK_TASKS];	// CoOS ids of the stacks reported in the task datasets
+#endif
+
+    float linkRate;		// bytes/s of slowest MAVLink port, 0 if unlimited
+    float linkScale;		// fraction of linkRate allowed by radio feedback
+    float linkTokens;		// token bucket, bytes
+    unsigned long linkMicros;	// last refill
+    unsigned long rateMicros;	// start of rate period
+    uint32_t linkBytes;		// txBytes already charged
+    uint32_t linkDeferred;	// passes cut short by the budget
 
     uint16_t packetDrops;	// global packet drop counter
     uint16_t idlePercent;	// MCU idle time
@@ -107,7 +174,9 @@ extern void mavlinkWpAnnounceCurrent(uint16_t seqId);
 extern void mavlinkAnnounceHome(void);
 extern void comm_send_ch(mavlink_channel_t chan, uint8_t ch);
 extern void mavlinkDo(void);
+extern void mavlinkStartSend(mavlink_channel_t chan, uint16_t len);
 extern void mavlinkSendPacket(mavlink_channel_t chan, const uint8_t *buf, uint16_t len);
+extern void mavlinkEndSend(mavlink_channel_t chan, uint16_t len);
 extern void mavlinkSendParameter(uint8_t sysId, uint8_t compId, const char *paramName, float value);
 
 #endif
@@ -63,6 +63,10 @@ OS_STK *InitTaskContext(FUNCPtr task,void *param,OS_STK *pstk)
  */
 void SysTick_Handler(void)
 {
+#if CFG_TASK_STATS_EN > 0
+    CoIsrEnterHook();
+    CoTickHook();
+#endif
     OSSchedLock++;                  /* Lock scheduler.                        */
     OSTickCnt++;                    /* Increment systerm time.                */
 #if CFG_TASK_WAITTING_EN >0
@@ -96,4 +100,7 @@ void SysTick_Handler(void)
 #endif
 	TaskSchedReq = Co_TRUE;
     OsSchedUnlock();
+#if CFG_TASK_STATS_EN > 0
+    CoIsrExitHook();
+#endif
 }
@@ -0,0 +1,107 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#include "aq.h"
+#if defined(USE_BLACKBOX) && defined(USE_DIGITAL_IMU)
+#include "blackbox.h"
+#include "imu.h"
+#include "filer.h"
+#include "logger.h"
+#include "util.h"
+#include "comm.h"
+#include <string.h>
+
+blackboxStruct_t blackboxData;
+
+// called from the DIMU task, the only producer; the filer task drains the tail
+void blackboxSample(void) {
+    uint8_t rec[BLACKBOX_RECORD_SIZE];
+    blackboxSample_t s;
+    int32_t head, space, n;
+
+    if (!blackboxData.buf || !filerAvailable())
+	return;
+
+    head = filerGetHead(blackboxData.handle);
+    space = (filerGetTail(blackboxData.handle) - head - 1 + blackboxData.bufSize) % blackboxData.bufSize;
+
+    // drop rather than overwrite what the card has not taken yet
+    if (space < BLACKBOX_RECORD_SIZE) {
+	blackboxData.overruns++;
+	return;
+    }
+
+    s.time = IMU_SAMPLE_TIME;
+    s.gyo[0] = IMU_RAW_DRATEX;
+    s.gyo[1] = IMU_RAW_DRATEY;
+    s.gyo[2] = IMU_RAW_DRATEZ;
+    s.acc[0] = IMU_RAW_ACCX;
+    s.acc[1] = IMU_RAW_ACCY;
+    s.acc[2] = IMU_RAW_ACCZ;
+    s.mag[0] = IMU_RAW_MAGX;
+    s.mag[1] = IMU_RAW_MAGY;
+    s.mag[2] = IMU_RAW_MAGZ;
+    s.pres = AQ_PRESSURE;
+    s.magTime = IMU_MAG_TIME;
+    s.presTime = AQ_PRESSURE_TIME;
+
+    rec[0] = 'A';
+    rec[1] = 'q';
+    rec[2] = 'R';
+    memcpy(&rec[3], &s, sizeof(s));
+    loggerChecksum(&rec[3], sizeof(s), &rec[3 + sizeof(s)], &rec[4 + sizeof(s)]);
+
+    // records may wrap, the buffer is sized in sectors for the filer
+    n = blackboxData.bufSize - head;
+    if (n >= BLACKBOX_RECORD_SIZE) {
+	memcpy(blackboxData.buf + head, rec, BLACKBOX_RECORD_SIZE);
+    }
+    else {
+	memcpy(blackboxData.buf + head, rec, n);
+	memcpy(blackboxData.buf, rec + n, BLACKBOX_RECORD_SIZE - n);
+    }
+
+    filerSetHead(blackboxData.handle, (head + BLACKBOX_RECORD_SIZE) % blackboxData.bufSize);
+    blackboxData.samples++;
+}
+
+void blackboxInit(void) {
+    uint8_t *buf;
+
+    memset((void *)&blackboxData, 0, sizeof(blackboxData));
+
+    // SDIO DMA cannot reach CCM
+    buf = (uint8_t *)aqCalloc(BLACKBOX_BUF_SIZE, sizeof(uint8_t));
+    if (!buf) {
+	AQ_NOTICE("Blackbox: cannot allocate buffer\n");
+	return;
+    }
+
+    blackboxData.bufSize = BLACKBOX_BUF_SIZE;
+    blackboxData.handle = filerGetHandle(BLACKBOX_FNAME);
+    if (blackboxData.handle < 0) {
+	AQ_NOTICE("Blackbox: no filer handle\n");
+	return;
+    }
+
+    filerStream(blackboxData.handle, buf, blackboxData.bufSize);
+
+    // enables the producer
+    blackboxData.buf = buf;
+}
+#endif
@@ -0,0 +1,53 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#ifndef _blackbox_h
+#define _blackbox_h
+
+#include "aq.h"
+
+#define BLACKBOX_FNAME		"RAW"
+#define BLACKBOX_BUF_SIZE	(16*512)	// whole sectors, ~360ms at the inner rate
+
+// one record per DIMU inner loop
+typedef struct {
+    uint32_t time;			// gyo sample time
+    float gyo[3];			// raw, averaged over the inner period
+    float acc[3];			// raw, updated at the outer rate
+    float mag[3];
+    float pres;
+    uint32_t magTime;
+    uint32_t presTime;
+} blackboxSample_t;
+
+#define BLACKBOX_RECORD_SIZE	(3 + sizeof(blackboxSample_t) + 2)
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t bufSize;
+    uint32_t samples;
+    uint32_t overruns;
+    int8_t handle;
+} blackboxStruct_t;
+
+extern blackboxStruct_t blackboxData;
+
+extern void blackboxInit(void);
+extern void blackboxSample(void);
+
+#endif
@@ -27,6 +27,7 @@
 #include "usb.h"
 #include <CoOS.h>
 #include <string.h>
+#include <stdio.h>
 
 OS_STK *commTaskStack;
 
@@ -36,6 +37,10 @@ commStruct_t commData __attribute__((section(".ccm")));
 char commLog[COMM_LOG_BUF_SIZE];
 #endif
 
+static const int16_t commMuxQuanta[COMM_MUX_STREAMS] = COMM_MUX_QUANTA;
+static const uint16_t commTxBufSizes[COMM_TX_NUM_SIZES] = COMM_TX_BUF_SIZES;
+static const uint8_t commTxBufNums[COMM_TX_NUM_SIZES] = COMM_TX_BUF_NUMS;
+
 char *commGetNoticeBuf(void) {
     uint8_t p;
 
@@ -57,6 +62,15 @@ static void commTriggerSchedule(void) {
     NVIC->STIR = CRYP_IRQn;
 }
 
+static uint8_t commMuxIndex(uint8_t streamType) {
+    // MAVLINK is bit 1
+    return __builtin_ctz(streamType) - 1;
+}
+
+static uint8_t commPortMux(uint8_t port) {
+    return (commData.portStreams[port] & COMM_STREAM_TYPE_MULTIPLEX);
+}
+
 uint8_t commStreamUsed(uint8_t streamType) {
     return (commData.typesUsed & streamType);
 }
@@ -98,6 +112,13 @@ void commRegisterRcvrFunc(uint8_t streamType, commRcvrCallback_t *func) {
 uint8_t commReadChar(commRcvrStruct_t *r) {
     uint8_t port = r->port;
 
+    // demultiplexed payload
+    if (r->buf) {
+        if (r->point < r->len)
+            return r->buf[r->point++];
+        return 0;
+    }
+
     switch (commData.portTypes[port]) {
         case COMM_PORT_TYPE_SERIAL:
             if (commData.portHandles[port])
@@ -122,6 +143,9 @@ uint8_t commReadChar(commRcvrStruct_t *r) {
 uint8_t commAvailable(commRcvrStruct_t *r) {
     uint8_t port = r->port;
 
+    if (r->buf)
+        return (r->len - r->point > 255) ? 255 : r->len - r->point;
+
     switch (commData.portTypes[port]) {
         case COMM_PORT_TYPE_SERIAL:
             if (commData.portHandles[port])
@@ -143,11 +167,60 @@ uint8_t commAvailable(commRcvrStruct_t *r) {
     return 0;
 }
 
+static commTxBuf_t *commTxBufAddr(uint8_t size, uint16_t n) {
+    return (commTxBuf_t *)(commData.txPacketBufs[size] + (commData.txPacketBufSizes[size] + COMM_HEADER_SIZE) * n);
+}
+
+// lock free pop, the tag in the top half defeats ABA
+static commTxBuf_t *commTxBufPop(uint8_t size) {
+    commTxBuf_t *txBuf;
+    uint32_t top, next;
+    uint8_t n;
+
+    do {
+        top = commData.txBufFreeHeads[size];
+        if ((top & 0xffff) == COMM_TX_BUF_NONE)
+            return 0;
+
+        txBuf = commTxBufAddr(size, top & 0xffff);
+        next = ((top + 0x10000) & 0xffff0000) | txBuf->len;
+    } while (!__sync_bool_compare_and_swap(&commData.txBufFreeHeads[size], top, next));
+
+    n = __sync_sub_and_fetch(&commData.txBufFree[size], 1);
+    if (n < commData.txBufLow[size])
+        commData.txBufLow[size] = n;
+
+    return txBuf;
+}
+
+// lock free push, safe from ISRs
+static void commTxBufFree(commTxBuf_t *txBuf) {
+    uint32_t top, next;
+    uint16_t n;
+    int size;
+
+    // size classes are laid out in ascending order
+    for (size = COMM_TX_NUM_SIZES-1; size > 0; size--)
+        if ((void *)txBuf >= commData.txPacketBufs[size])
+            break;
+
+    n = ((void *)txBuf - commData.txPacketBufs[size]) / (commData.txPacketBufSizes[size] + COMM_HEADER_SIZE);
+
+    txBuf->status = COMM_TX_BUF_FREE;
+
+    do {
+        top = commData.txBufFreeHeads[size];
+        txBuf->len = top & 0xffff;
+        next = ((top + 0x10000) & 0xffff0000) | n;
+    } while (!__sync_bool_compare_and_swap(&commData.txBufFreeHeads[size], top, next));
+
+    __sync_add_and_fetch(&commData.txBufFree[size], 1);
+}
+
 // return 0 if none are available
 commTxBuf_t *commGetTxBuf(uint8_t streamType, uint16_t maxSize) {
     commTxBuf_t *txBuf = 0;
-    commTxBuf_t *tmp;
-    int i, j;
+    int i;
 
     // is this stream type even active?
     if (commData.typesUsed & streamType) {
@@ -156,65 +229,96 @@ commTxBuf_t *commGetTxBuf(uint8_t streamType, uint16_t maxSize) {
             if (commData.txPacketBufSizes[i] >= maxSize)
                 break;
 
-        CoEnterMutexSection(commData.txBufferMutex);
+        // upgrade to the next larger size when empty
+        for (; i < COMM_TX_NUM_SIZES; i++) {
+            if ((txBuf = commTxBufPop(i)) != 0)
+                break;
 
-        commTopOfSearch:
+            // make a note of this
+            commData.txBufUpgrades[i]++;
+        }
 
-        // not too big?
-        if (i < COMM_TX_NUM_SIZES) {
-            // look for free buffer in this block
-            for (j = 0; j < commData.txPacketBufNum[i]; j++) {
-                tmp = (commTxBuf_t *)(commData.txPacketBufs[i] + (commData.txPacketBufSizes[i] + COMM_HEADER_SIZE) * j);
+        if (txBuf == 0) {
+            commData.txBufStarved++;
+        }
+        else {
+            txBuf->status = COMM_TX_BUF_ALLOCATED;
+            txBuf->type = streamType;
+            commData.txPacketSizeHits[i]++;
+        }
+    }
 
-                if (tmp->status == COMM_TX_BUF_FREE) {
-                    txBuf = tmp;
-                    txBuf->status = COMM_TX_BUF_ALLOCATED;
-                    txBuf->type = streamType;
-                    break;
-                }
-            }
+    return txBuf;
+}
 
-            // need an upgrade?
-            if (j == commData.txPacketBufNum[i]) {
-                // make a note of this
-                commData.txBufUpgrades[i]++;
-                // next larger size
-                i++;
+// returns 1 if the port accepted the request
+static uint8_t commStartTx(uint8_t port, commTxStack_t *stack) {
+    switch (commData.portTypes[port]) {
+        case COMM_PORT_TYPE_SERIAL:
+            if (!((serialPort_t *)(commData.portHandles[port]))->txDmaRunning && _serialStartTxDMA(commData.portHandles[port], stack->memory, stack->size, commTxFinished, stack))
+                return 1;
+            break;
 
-                // try again
-                goto commTopOfSearch;
+        case COMM_PORT_TYPE_CAN:
+            if (((canUartStruct_t *)(commData.portHandles[port]))->txTail == ((canUartStruct_t *)(commData.portHandles[port]))->txHead) {
+                canUartTxBuf(commData.portHandles[port], stack->memory, stack->size, commTxFinished, stack);
+                return 1;
             }
+            break;
+    }
+
+    return 0;
+}
+
+// deficit round robin over the streams waiting on a multiplexed port
+static int8_t commMuxNext(commMuxTx_t *mux) {
+    uint8_t s;
+    int i;
+
+    for (i = 0; i < COMM_MUX_STREAMS; i++)
+        if (mux->txStackHeads[i] != mux->txStackTails[i])
+            break;
+
+    if (i == COMM_MUX_STREAMS)
+        return -1;
+
+    while (1) {
+        s = mux->txStream;
+
+        if (mux->txStackHeads[s] == mux->txStackTails[s]) {
+            // idle streams do not bank credit
+            mux->deficit[s] = 0;
         }
+        else {
+            if (mux->txStack[s][mux->txStackTails[s]].size <= mux->deficit[s])
+                return s;
 
-        CoLeaveMutexSection(commData.txBufferMutex);
+            mux->deficit[s] += commMuxQuanta[s];
+        }
 
-        if (txBuf == 0)
-            commData.txBufStarved++;
-        else
-            commData.txPacketSizeHits[i]++;
+        mux->txStream = (s + 1) % COMM_MUX_STREAMS;
     }
-
-    return txBuf;
 }
 
 static void _commSchedule(uint8_t port) {
-    uint8_t tail = commData.txStackTails[port];
-    commTxStack_t *stack = &commData.txStack[port][tail];
-
-    if (commData.txStackHeads[port] != tail)
-        switch (commData.portTypes[port]) {
-            case COMM_PORT_TYPE_SERIAL:
-                if (!((serialPort_t *)(commData.portHandles[port]))->txDmaRunning && _serialStartTxDMA(commData.portHandles[port], stack->memory, stack->size, commTxFinished, stack))
-                    commData.txStackTails[port] = (tail + 1) % COMM_STACK_DEPTH;
-                break;
-
-            case COMM_PORT_TYPE_CAN:
-                if (((canUartStruct_t *)(commData.portHandles[port]))->txTail == ((canUartStruct_t *)(commData.portHandles[port]))->txHead) {
-                    canUartTxBuf(commData.portHandles[port], stack->memory, stack->size, commTxFinished, stack);
-                    commData.txStackTails[port] = (tail + 1) % COMM_STACK_DEPTH;
-                }
-                break;
+    commMuxTx_t *mux = commData.muxTx[port];
+    uint8_t tail;
+    int8_t s;
+
+    if (mux) {
+        if ((s = commMuxNext(mux)) >= 0) {
+            tail = mux->txStackTails[s];
+            if (commStartTx(port, &mux->txStack[s][tail])) {
+                mux->deficit[s] -= mux->txStack[s][tail].size;
+                mux->txStackTails[s] = (tail + 1) % COMM_MUX_DEPTH;
+            }
         }
+    }
+    else {
+        tail = commData.txStackTails[port];
+        if (commData.txStackHeads[port] != tail && commStartTx(port, &commData.txStack[port][tail]))
+            commData.txStackTails[port] = (tail + 1) % COMM_STACK_DEPTH;
+    }
 }
 
 static void commSchedule(void) {
@@ -232,22 +336,49 @@ void commTxFinished(void *param) {
 
     // if no pending tx's for this buffer, free it
     if (__sync_sub_and_fetch(&txBuf->status, 1) == COMM_TX_BUF_SENDING)
-        txBuf->status = COMM_TX_BUF_FREE;
+        commTxBufFree(txBuf);
 
     // re-schedule
     _commSchedule(txStackPtr->port);
 }
 
+// fill in the multiplex header in front of the payload
+static void commMuxFrame(commTxBuf_t *txBuf, uint16_t size) {
+    uint8_t *c = &txBuf->seq;
+    uint8_t ckA, ckB;
+    int i;
+
+    txBuf->sync[0] = COMM_MUX_SYNC1;
+    txBuf->sync[1] = COMM_MUX_SYNC2;
+    txBuf->seq = commData.muxTxSeq[commMuxIndex(txBuf->type)]++;
+    txBuf->len = size;
+
+    // seq, type, len & payload
+    ckA = ckB = 0;
+    for (i = 0; i < size + 4; i++) {
+        ckA += c[i];
+        ckB += ckA;
+    }
+    txBuf->ck[0] = ckA;
+    txBuf->ck[1] = ckB;
+}
+
 void commSendTxBuf(commTxBuf_t *txBuf, uint16_t size) {
+    commTxStack_t *stack;
+    commMuxTx_t *mux;
     uint8_t head;
     uint8_t toBeScheduled[COMM_NUM_PORTS];
     uint8_t newHeads[COMM_NUM_PORTS];
     uint8_t sent = 0;
+    uint8_t framed = 0;
+    uint8_t s;
     int i;
 
     if (txBuf) {
-        // reset status to sending
-        txBuf->status = COMM_TX_BUF_SENDING;
+        // reset status to sending, holding our own reference until USB is done with it
+        txBuf->status = COMM_TX_BUF_SENDING + 1;
+
+        s = commMuxIndex(txBuf->type);
 
         CoEnterMutexSection(commData.txBufferMutex);
 
@@ -279,19 +410,41 @@ void commSendTxBuf(commTxBuf_t *txBuf, uint16_t size) {
                 }
             }
             // multiplex case
-            else if (commData.portStreams[i] & txBuf->type) {
-                // TODO
+            else if (commPortMux(i) && (commData.portStreams[i] & txBuf->type) && (mux = commData.muxTx[i])) {
+                head = mux->txStackHeads[s];
+                newHeads[i] = (head + 1) % COMM_MUX_DEPTH;
+
+                if (newHeads[i] == mux->txStackTails[s]) {
+                    commData.txStackOverruns[i]++;
+                }
+                else {
+                    if (!framed) {
+                        commMuxFrame(txBuf, size);
+                        framed = 1;
+                    }
+
+                    txBuf->status++;
+
+                    stack = &mux->txStack[s][head];
+                    stack->port = i;
+                    stack->txBuf = txBuf;
+                    stack->memory = txBuf->sync;
+                    stack->size = size + COMM_MUX_HEADER_SIZE;
+
+                    toBeScheduled[i] = 1;
+                    sent = 1;
+                }
             }
         }
 
-        if (!sent) {
-            // release buffer
-            txBuf->status = COMM_TX_BUF_FREE;
-        }
-        else {
+        if (sent) {
             for (i = 0; i < COMM_NUM_PORTS; i++) {
-                if (toBeScheduled[i])
-                    commData.txStackHeads[i] = newHeads[i];
+                if (toBeScheduled[i]) {
+                    if (commData.muxTx[i])
+                        commData.muxTx[i]->txStackHeads[s] = newHeads[i];
+                    else
+                        commData.txStackHeads[i] = newHeads[i];
+                }
                 commTriggerSchedule();
             }
         }
@@ -299,11 +452,68 @@ void commSendTxBuf(commTxBuf_t *txBuf, uint16_t size) {
         CoLeaveMutexSection(commData.txBufferMutex);
 
 #ifdef COMM_USB_PORT
-        if (commData.portStreams[COMM_USB_PORT] == txBuf->type)
+        if (commData.portStreams[COMM_USB_PORT] == txBuf->type) {
             usbTx(&txBuf->buf, size);
+        }
+        else if (commPortMux(COMM_USB_PORT) && (commData.portStreams[COMM_USB_PORT] & txBuf->type)) {
+            // USB is not rate limited, frames go out in order
+            if (!framed)
+                commMuxFrame(txBuf, size);
+            usbTx(txBuf->sync, size + COMM_MUX_HEADER_SIZE);
+        }
 #endif
+
+        // release our reference, free the buffer if no port is still sending it
+        if (__sync_sub_and_fetch(&txBuf->status, 1) == COMM_TX_BUF_SENDING)
+            commTxBufFree(txBuf);
+    }
+}
+
+#ifdef COMM_LOG_FNAME
+// one line to the MSG log
+static void commLogString(const char *s) {
+    int i;
+
+    i = 0;
+    while (s[i] != 0) {
+        if (s[i] != '\n') {
+            commLog[commData.logPointer] = s[i];
+            commData.logPointer = (commData.logPointer + 1) % COMM_LOG_BUF_SIZE;
+        }
+        i++;
+    }
+    commLog[commData.logPointer] = '\n';
+    commData.logPointer = (commData.logPointer + 1) % COMM_LOG_BUF_SIZE;
+
+    filerSetHead(commData.logHandle, commData.logPointer);
+}
+
+// packet pool usage for tuning COMM_TX_BUF_NUMS, a line per pass as the log drains
+static void commLogTxBufStats(uint32_t loops) {
+    char s[COMM_NOTICE_LENGTH];
+    int i = commData.statsLine;
+
+    if (!(loops % COMM_STATS_LOOPS))
+        i = 0;
+
+    if (i > COMM_TX_NUM_SIZES)
+        return;
+
+    if ((filerGetTail(commData.logHandle) - commData.logPointer - 1 + COMM_LOG_BUF_SIZE) % COMM_LOG_BUF_SIZE < COMM_NOTICE_LENGTH) {
+        commData.statsLine = i;
+        return;
     }
+
+    if (i < COMM_TX_NUM_SIZES)
+        sprintf(s, "txbuf %u x%u hits %u upgrades %u low %u", commData.txPacketBufSizes[i], commData.txPacketBufNum[i],
+            (unsigned int)commData.txPacketSizeHits[i], (unsigned int)commData.txBufUpgrades[i], commData.txBufLow[i]);
+    else
+        sprintf(s, "txbuf starved %u", (unsigned int)commData.txBufStarved);
+
+    commLogString(s);
+    commData.statsLine = i + 1;
 }
+#endif
 
 static void commCheckNotices(void) {
     StatusType result;
@@ -315,18 +525,7 @@ static void commCheckNotices(void) {
         int i;
 #ifdef COMM_LOG_FNAME
         // write to disk
-        i = 0;
-        while (s[i] != 0) {
-            if (s[i] != '\n') {
-                commLog[commData.logPointer] = s[i];
-                commData.logPointer = (commData.logPointer + 1) % COMM_LOG_BUF_SIZE;
-            }
-            i++;
-        }
-        commLog[commData.logPointer] = '\n';
-        commData.logPointer = (commData.logPointer + 1) % COMM_LOG_BUF_SIZE;
-
-        filerSetHead(commData.logHandle, commData.logPointer);
+        commLogString(s);
 #endif
 
         for (i = 0; i < COMM_MAX_CONSUMERS; i++)
@@ -344,13 +543,138 @@ static void commCheckTelem(void) {
                 commData.telemFuncs[i]();
 }
 
+static void commMuxDispatch(uint8_t port, commMuxRx_t *mux) {
+    commRcvrStruct_t r;
+    int j;
+
+    if (commData.portStreams[port] & mux->type) {
+        for (j = 0; j < COMM_MAX_CONSUMERS; j++) {
+            if (commData.streamRcvrs[j] == mux->type) {
+                r.port = port;
+                r.buf = mux->buf;
+                r.len = mux->len;
+                r.point = 0;
+
+                commData.rcvrFuncs[j](&r);
+                mux->frames++;
+                return;
+            }
+        }
+    }
+
+    mux->dropped++;
+}
+
+static void commMuxCharIn(uint8_t port, commMuxRx_t *mux, uint8_t c) {
+    switch (mux->state) {
+        case COMM_MUX_WAIT_SYNC1:
+            if (c == COMM_MUX_SYNC1)
+                mux->state = COMM_MUX_WAIT_SYNC2;
+            break;
+
+        case COMM_MUX_WAIT_SYNC2:
+            if (c == COMM_MUX_SYNC2)
+                mux->state = COMM_MUX_WAIT_CK1;
+            else if (c != COMM_MUX_SYNC1)
+                mux->state = COMM_MUX_WAIT_SYNC1;
+            break;
+
+        case COMM_MUX_WAIT_CK1:
+            mux->ck[0] = c;
+            mux->state = COMM_MUX_WAIT_CK2;
+            break;
+
+        case COMM_MUX_WAIT_CK2:
+            mux->ck[1] = c;
+            mux->checkA = mux->checkB = 0;
+            mux->state = COMM_MUX_WAIT_SEQ;
+            break;
+
+        case COMM_MUX_WAIT_SEQ:
+            mux->checkA += c;
+            mux->checkB += mux->checkA;
+            mux->state = COMM_MUX_WAIT_TYPE;
+            break;
+
+        case COMM_MUX_WAIT_TYPE:
+            mux->checkA += c;
+            mux->checkB += mux->checkA;
+            mux->type = c;
+            mux->state = COMM_MUX_WAIT_LEN1;
+            break;
+
+        case COMM_MUX_WAIT_LEN1:
+            mux->checkA += c;
+            mux->checkB += mux->checkA;
+            mux->len = c;
+            mux->state = COMM_MUX_WAIT_LEN2;
+            break;
+
+        case COMM_MUX_WAIT_LEN2:
+            mux->checkA += c;
+            mux->checkB += mux->checkA;
+            mux->len |= c<<8;
+            mux->point = 0;
+
+            if (mux->len > COMM_RX_BUF_SIZE) {
+                mux->errors++;
+                mux->state = COMM_MUX_WAIT_SYNC1;
+                break;
+            }
+
+            mux->state = COMM_MUX_PAYLOAD;
+            if (mux->len > 0)
+                break;
+            // fall through for empty frames
+
+        case COMM_MUX_PAYLOAD:
+            if (mux->point < mux->len) {
+                mux->checkA += c;
+                mux->checkB += mux->checkA;
+                mux->buf[mux->point++] = c;
+            }
+
+            if (mux->point == mux->len) {
+                if (mux->ck[0] == mux->checkA && mux->ck[1] == mux->checkB)
+                    commMuxDispatch(port, mux);
+                else
+                    mux->errors++;
+
+                mux->state = COMM_MUX_WAIT_SYNC1;
+            }
+            break;
+    }
+}
+
+static void commMuxRecv(uint8_t port) {
+    commRcvrStruct_t r;
+    commMuxRx_t *mux;
+
+    if (commData.muxRx[port] == 0)
+        commData.muxRx[port] = (commMuxRx_t *)aqCalloc(1, sizeof(commMuxRx_t));
+
+    if ((mux = commData.muxRx[port]) == 0)
+        return;
+
+    r.port = port;
+    r.buf = 0;
+    while (commAvailable(&r))
+        commMuxCharIn(port, mux, commReadChar(&r));
+}
+
 static void commCheckRcvr(void) {
     commRcvrStruct_t r;
     int i, j;
 
+    r.buf = 0;
+
     for (i = 0; i < COMM_NUM_PORTS; i++) {
         r.port = i;
-        if (commAvailable(&r) && commData.portStreams[i] > COMM_STREAM_TYPE_NONE) {
+        if (commPortMux(i)) {
+            if (commAvailable(&r))
+                commMuxRecv(i);
+        }
+        else if (commAvailable(&r) && commData.portStreams[i] > COMM_STREAM_TYPE_NONE) {
             for (j = 0; j < COMM_MAX_CONSUMERS; j++) {
                 if (commData.streamRcvrs[j] == commData.portStreams[i]) {
                     commData.rcvrFuncs[j](&r);
@@ -368,6 +692,9 @@ void commTaskCode(void *unused) {
         yield(1);
 
         commCheckNotices();
+#ifdef COMM_LOG_FNAME
+        commLogTxBufStats(loops);
+#endif
         commCheckTelem();
         canCheckMessage(loops);
         commCheckRcvr();
@@ -387,6 +714,12 @@ void commSetTypesUsed(void) {
     commData.typesUsed = typesUsed;
 }
 
+static void commMuxInit(uint8_t port) {
+    // USB sends directly and needs no tx stacks
+    if (commPortMux(port) && commData.portTypes[port] != COMM_PORT_TYPE_USB && commData.muxTx[port] == 0)
+        commData.muxTx[port] = (commMuxTx_t *)aqCalloc(1, sizeof(commMuxTx_t));
+}
+
 void commSetStreamType(uint8_t port, uint8_t type) {
     commData.portStreams[port] = type;
     commSetTypesUsed();
@@ -395,9 +728,11 @@ void commSetStreamType(uint8_t port, uint8_t type) {
 void commInit(void) {
     NVIC_InitTypeDef NVIC_InitStructure;
     uint16_t flowControl;
-    int i;
+    uint8_t *txBufs;
+    int i, j;
 
     memset((void *)&commData, 0, sizeof(commData));
+    commData.statsLine = COMM_TX_NUM_SIZES + 1;
 
 #ifdef COMM_LOG_FNAME
     commData.logHandle = filerGetHandle(COMM_LOG_FNAME);
@@ -451,24 +786,32 @@ void commInit(void) {
     // record which stream types that we are working with
     commSetTypesUsed();
 
-    // perhaps make this dynamic later
-    commData.txPacketBufSizes[0] = 16;
-    commData.txPacketBufSizes[1] = 32;
-    commData.txPacketBufSizes[2] = 64;
-    commData.txPacketBufSizes[3] = 128;
-    commData.txPacketBufSizes[4] = 256;
-    commData.txPacketBufSizes[5] = 512;
-
-    commData.txPacketBufNum[0] = 16;
-    commData.txPacketBufNum[1] = 16;
-    commData.txPacketBufNum[2] = 8;
-    commData.txPacketBufNum[3] = 4;
-    commData.txPacketBufNum[4] = 6;
-    commData.txPacketBufNum[5] = 4;
-
-    // allocate transmission buffers' memory
-    for (i = 0; i < COMM_TX_NUM_SIZES; i++)
-        commData.txPacketBufs[i] = aqCalloc(commData.txPacketBufNum[i], commData.txPacketBufSizes[i] + COMM_HEADER_SIZE);
+    for (i = 0; i < COMM_NUM_PORTS; i++)
+        if (commData.portHandles[i])
+            commMuxInit(i);
+
+    // allocate transmission buffers' memory as one block, smallest size first
+    j = 0;
+    for (i = 0; i < COMM_TX_NUM_SIZES; i++) {
+        commData.txPacketBufSizes[i] = commTxBufSizes[i];
+        commData.txPacketBufNum[i] = commTxBufNums[i];
+        j += commData.txPacketBufNum[i] * (commData.txPacketBufSizes[i] + COMM_HEADER_SIZE);
+    }
+    txBufs = aqCalloc(j, sizeof(uint8_t));
+
+    for (i = 0; i < COMM_TX_NUM_SIZES; i++) {
+        commData.txPacketBufs[i] = txBufs;
+        txBufs += commData.txPacketBufNum[i] * (commData.txPacketBufSizes[i] + COMM_HEADER_SIZE);
+    }
+
+    // commTxBufFree() finds a buffer's class from the block addresses, so all must be set first
+    for (i = 0; i < COMM_TX_NUM_SIZES; i++) {
+        commData.txBufFreeHeads[i] = COMM_TX_BUF_NONE;
+        commData.txBufFree[i] = 0;
+        commData.txBufLow[i] = commData.txPacketBufNum[i];
+        for (j = commData.txPacketBufNum[i]-1; j >= 0; j--)
+            commTxBufFree(commTxBufAddr(i, j));
+    }
 
     // Enable CRYP interrupt (for our stack management)
     NVIC_InitStructure.NVIC_IRQChannel = CRYP_IRQn;
@@ -500,6 +843,7 @@ void commRegisterCanUart(void *ptr, uint8_t type, uint8_t n) {
     commData.portStreams[COMM_CAN_PORT+n] = (uint8_t)p[COMM_STREAM_TYP5+n];
 
     commSetTypesUsed();
+    commMuxInit(COMM_CAN_PORT+n);
 }
 
 void CRYP_IRQHandler(void) {
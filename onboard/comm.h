@@ -29,6 +29,7 @@
 
 #define COMM_LOG_BUF_SIZE	512
 #define COMM_LOG_FNAME		"MSG"		// comment out to disable logging
+#define COMM_STATS_LOOPS	60000		// comm task passes (~1ms) between tx packet pool reports in the log
 
 #ifdef HAS_USB
 #define COMM_NUM_PORTS		8
@@ -47,9 +48,19 @@
 
 #define COMM_STACK_DEPTH	32			// number of outstanding requests allowed (per port)
 #define COMM_TX_NUM_SIZES	6
+#define COMM_TX_BUF_SIZES	{16, 32, 64, 128, 256, 512}	// packet buffer size classes, ascending
+#define COMM_TX_BUF_NUMS	{16, 16, 8, 4, 6, 4}		// buffers per class, tune from the txbuf lines in the MSG log
+#define COMM_TX_BUF_NONE	0xffff				// end of free list
 
 #define COMM_MAX_CONSUMERS	5
 
+#define COMM_MUX_SYNC1		'A'
+#define COMM_MUX_SYNC2		'x'
+#define COMM_MUX_STREAMS	7			// stream types a multiplexed port can carry
+#define COMM_MUX_DEPTH		8			// outstanding requests allowed (per stream per port)
+#define COMM_MUX_QUANTA		{512, 256, 256, 256, 128, 128, 128} // bytes per scheduling round for each stream type (MAVLINK .. OMAP_PPP)
+#define COMM_MUX_USB_STREAMS	(COMM_STREAM_TYPE_MULTIPLEX | COMM_STREAM_TYPE_MAVLINK | COMM_STREAM_TYPE_TELEMETRY | COMM_STREAM_TYPE_GPS | COMM_STREAM_TYPE_FILEIO)
+
 #define AQ_NOTICE		commNotice
 #define AQ_PRINTF(fmt, args...)	{char *sTemp = commGetNoticeBuf(); snprintf(sTemp, COMM_NOTICE_LENGTH, fmt, args); commNotice(sTemp);}
 
@@ -84,11 +95,12 @@ typedef struct {
     uint8_t ck[2];					    // packet checksum
     uint8_t seq;					    // seq id
     uint8_t type;					    // protocol type
-    uint16_t len;					    // payload length
+    uint16_t len;					    // payload length, next free buffer while in the pool
     uint8_t buf;
 } __attribute__((packed)) commTxBuf_t;
 
-#define COMM_HEADER_SIZE	8			    // TODO: hard-coded for now
+#define COMM_MUX_HEADER_SIZE	8			    // sync + ck + seq + type + len
+#define COMM_HEADER_SIZE	(COMM_MUX_HEADER_SIZE + 1)	    // plus status
 
 typedef struct {
     commTxBuf_t *txBuf;					    // pointer to tx packet
@@ -97,8 +109,44 @@ typedef struct {
     uint8_t port;					    // port this stack element belongs to
 } commTxStack_t;
 
+typedef struct {
+    commTxStack_t txStack[COMM_MUX_STREAMS][COMM_MUX_DEPTH]; // tx stack for each stream
+    int16_t deficit[COMM_MUX_STREAMS];			    // bytes each stream may still send this round
+    uint8_t txStackHeads[COMM_MUX_STREAMS];
+    volatile uint8_t txStackTails[COMM_MUX_STREAMS];
+    uint8_t txStream;					    // stream currently being served
+} commMuxTx_t;
+
+enum commMuxRxStates {
+    COMM_MUX_WAIT_SYNC1 = 0,
+    COMM_MUX_WAIT_SYNC2,
+    COMM_MUX_WAIT_CK1,
+    COMM_MUX_WAIT_CK2,
+    COMM_MUX_WAIT_SEQ,
+    COMM_MUX_WAIT_TYPE,
+    COMM_MUX_WAIT_LEN1,
+    COMM_MUX_WAIT_LEN2,
+    COMM_MUX_PAYLOAD
+};
+
+typedef struct {
+    uint8_t buf[COMM_RX_BUF_SIZE];
+    uint32_t frames;
+    uint32_t errors;					    // bad checksums & lengths
+    uint32_t dropped;					    // no consumer for stream
+    uint16_t len;
+    uint16_t point;
+    uint8_t state;
+    uint8_t type;
+    uint8_t ck[2];
+    uint8_t checkA, checkB;
+} commMuxRx_t;
+
 typedef struct {
     uint8_t port;
+    uint8_t *buf;					    // demultiplexed payload, 0 when reading the port directly
+    uint16_t len;
+    uint16_t point;
 } commRcvrStruct_t;
 
 typedef void commNoticeCallback_t(const char *s);
@@ -124,6 +172,10 @@ typedef struct {
     uint8_t portStreams[COMM_NUM_PORTS];		    // stream assignments for each port
     uint8_t portTypes[COMM_NUM_PORTS];                      // type of port (serial, CAN, USB)
 
+    commMuxTx_t *muxTx[COMM_NUM_PORTS];			    // per stream tx stacks for multiplexed ports
+    commMuxRx_t *muxRx[COMM_NUM_PORTS];			    // demultiplexers
+    uint8_t muxTxSeq[COMM_MUX_STREAMS];			    // next multiplex sequence id for each stream
+
     uint8_t txStackHeads[COMM_NUM_PORTS];		    // stack heads
     volatile uint8_t txStackTails[COMM_NUM_PORTS];	    // stack tails
 
@@ -135,7 +187,11 @@ typedef struct {
     uint8_t txPacketBufNum[COMM_TX_NUM_SIZES];		    // list of number of buffers per size
     void *txPacketBufs[COMM_TX_NUM_SIZES];		    // pointers to start of block for each buffer size
     uint32_t txPacketSizeHits[COMM_TX_NUM_SIZES];
+    volatile uint32_t txBufFreeHeads[COMM_TX_NUM_SIZES];   // free list tops, buffer index in low half, ABA tag in high half
+    volatile uint8_t txBufFree[COMM_TX_NUM_SIZES];	    // buffers currently free per size
+    uint8_t txBufLow[COMM_TX_NUM_SIZES];		    // least number ever free per size
     int logPointer;
+    uint8_t statsLine;					    // next pool report line in the log, idle past COMM_TX_NUM_SIZES
 
     uint8_t typesUsed;					    // types configured
     uint8_t noticePointer;
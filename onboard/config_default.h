@@ -178,7 +178,7 @@
 #define DEFAULT_COMM_BAUD5	    115200                       // CAN UART stream ID 1
 #define DEFAULT_COMM_BAUD6	    115200                       // CAN UART stream ID 2
 #define DEFAULT_COMM_BAUD7	    115200                       // CAN UART stream ID 3
-#define DEFAULT_COMM_STREAM_TYP1    COMM_STREAM_TYPE_MAVLINK
+#define DEFAULT_COMM_STREAM_TYP1    COMM_STREAM_TYPE_MAVLINK    // or COMM_STREAM_TYPE_MULTIPLEX plus any stream types to interleave
 #define DEFAULT_COMM_STREAM_TYP2    0
 #define DEFAULT_COMM_STREAM_TYP3    0
 #define DEFAULT_COMM_STREAM_TYP4    0
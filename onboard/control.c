@@ -262,7 +262,7 @@ void controlTaskCode(void *unused) {
 	    motorsOff();
 	}
 
-	controlData.lastUpdate = IMU_LASTUPD;
+	controlData.lastUpdate = imuData.dRateTime;
 	controlData.loops++;
     }
 }
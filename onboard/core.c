@@ -39,6 +39,9 @@ volatile BOOL   TaskSchedReq  = Co_FALSE;
  */
 void CoEnterISR(void)
 {
+#if CFG_TASK_STATS_EN > 0
+    CoIsrEnterHook();
+#endif
     Inc8(&OSIntNesting);                /* OSIntNesting increment             */
 }
 
@@ -68,6 +71,9 @@ void CoExitISR(void)
 			OSSchedLock--;
         }
     }
+#if CFG_TASK_STATS_EN > 0
+    CoIsrExitHook();
+#endif
 }
 
 
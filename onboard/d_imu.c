@@ -26,6 +26,7 @@
 #include "comm.h"
 #include "aq_init.h"
 #include "nav_ukf.h"
+#include "blackbox.h"
 
 OS_STK *dIMUTaskStack;
 
@@ -348,6 +349,10 @@ static void dIMUTaskCode(void *unused) {
             dIMUCalcTempDiff();
         }
 
+#ifdef USE_BLACKBOX
+        blackboxSample();
+#endif
+
         loops++;
     }
 }
@@ -270,6 +270,31 @@ static
 FILESEM	Files[_FS_SHARE];	/* File lock semaphores */
 #endif
 
+#if _FAT_CACHE
+typedef struct {
+	FATFS	*fs;		/* Owner file system object, 0:free */
+	DWORD	sect;		/* Sector held */
+	DWORD	age;		/* Last access stamp */
+	BYTE	dirty;		/* 1:must be written back */
+} FATCACHE;
+
+static
+FATCACHE FatCache[_FAT_CACHE];	/* FAT cache entries */
+
+static
+BYTE FatCacheBuf[_FAT_CACHE][_MAX_SS] _FAT_CACHE_ATTR;	/* FAT cache sector buffers */
+
+#if !_FS_READONLY
+static
+BYTE FatCacheBounce[_MAX_SS];	/* Write back buffer the disk driver can always reach */
+#endif
+
+static
+DWORD FatCacheAge;
+
+#define	IS_FAT_SECT(fs, sect)	((sect) >= (fs)->fatbase && (sect) < (fs)->fatbase + (fs)->fsize)
+#endif
+
 #if _USE_LFN == 0			/* No LFN */
 #define	DEF_NAMEBUF			BYTE sfn[12]
 #define INIT_BUF(dobj)		(dobj).fn = sfn
@@ -500,6 +525,163 @@ void clear_lock (	/* Clear lock entries of the volume */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT sector cache                                                      */
+/*-----------------------------------------------------------------------*/
+#if _FAT_CACHE
+
+static
+int cache_find (	/* Entry index or -1 if not cached */
+	FATFS *fs,
+	DWORD sect
+)
+{
+	int i;
+
+
+	for (i = 0; i < _FAT_CACHE; i++) {
+		if (FatCache[i].fs == fs && FatCache[i].sect == sect) return i;
+	}
+	return -1;
+}
+
+
+#if !_FS_READONLY
+static
+FRESULT cache_write (	/* Write back an entry to all FAT copies */
+	int i
+)
+{
+	FATCACHE *c = &FatCache[i];
+	DWORD sect = c->sect;
+	BYTE nf;
+
+
+	mem_cpy(FatCacheBounce, FatCacheBuf[i], SS(c->fs));	/* fs->win may hold another dirty sector */
+	if (disk_write(c->fs->drv, FatCacheBounce, sect, 1) != RES_OK)
+		return FR_DISK_ERR;
+	for (nf = c->fs->n_fats; nf > 1; nf--) {	/* Reflect the change to all FAT copies */
+		sect += c->fs->fsize;
+		disk_write(c->fs->drv, FatCacheBounce, sect, 1);
+	}
+	c->dirty = 0;
+
+	return FR_OK;
+}
+#endif
+
+
+static
+int cache_alloc (	/* Free or least recently used entry, -1 on write back failure */
+	FATFS *fs,
+	DWORD sect
+)
+{
+	int i, lru = 0;
+
+
+	for (i = 0; i < _FAT_CACHE; i++) {
+		if (!FatCache[i].fs) {
+			lru = i;
+			break;
+		}
+		if (FatCache[i].age - FatCache[lru].age > 0x80000000) lru = i;	/* Older, wrap safe */
+	}
+#if !_FS_READONLY
+	if (FatCache[lru].fs && FatCache[lru].dirty && cache_write(lru) != FR_OK)
+		return -1;
+#endif
+	FatCache[lru].fs = fs;
+	FatCache[lru].sect = sect;
+	FatCache[lru].dirty = 0;
+
+	return lru;
+}
+
+
+#if !_FS_READONLY
+static
+FRESULT cache_store (	/* Take over the dirty window */
+	FATFS *fs,
+	DWORD sect
+)
+{
+	int i;
+
+
+	i = cache_find(fs, sect);
+	if (i < 0 && (i = cache_alloc(fs, sect)) < 0)
+		return FR_DISK_ERR;
+	mem_cpy(FatCacheBuf[i], fs->win, SS(fs));
+	FatCache[i].dirty = 1;
+	FatCache[i].age = ++FatCacheAge;
+
+	return FR_OK;
+}
+
+
+static
+FRESULT cache_flush (	/* Write back all dirty entries of the volume */
+	FATFS *fs
+)
+{
+	int i;
+
+
+	for (i = 0; i < _FAT_CACHE; i++) {
+		if (FatCache[i].fs == fs && FatCache[i].dirty) {
+			if (cache_write(i) != FR_OK) return FR_DISK_ERR;
+		}
+	}
+
+	return FR_OK;
+}
+#endif
+
+
+static
+FRESULT cache_load (	/* Bring a FAT sector into the window */
+	FATFS *fs,
+	DWORD sect
+)
+{
+	int i;
+
+
+	i = cache_find(fs, sect);
+	if (i < 0) {
+		if (disk_read(fs->drv, fs->win, sect, 1) != RES_OK)
+			return FR_DISK_ERR;
+		if ((i = cache_alloc(fs, sect)) < 0)
+			return FR_DISK_ERR;
+		mem_cpy(FatCacheBuf[i], fs->win, SS(fs));
+	} else {
+		mem_cpy(fs->win, FatCacheBuf[i], SS(fs));
+	}
+	FatCache[i].age = ++FatCacheAge;
+
+	return FR_OK;
+}
+
+
+static
+void cache_invalidate (	/* Forget everything cached for the volume */
+	FATFS *fs
+)
+{
+	int i;
+
+
+	for (i = 0; i < _FAT_CACHE; i++) {
+		if (FatCache[i].fs == fs) FatCache[i].fs = 0;
+	}
+}
+
+#endif /* _FAT_CACHE */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Change window offset                                                  */
 /*-----------------------------------------------------------------------*/
@@ -517,19 +699,33 @@ FRESULT move_window (
 	if (wsect != sector) {	/* Changed current window */
 #if !_FS_READONLY
 		if (fs->wflag) {	/* Write back dirty window if needed */
-			if (disk_write(fs->drv, fs->win, wsect, 1) != RES_OK)
-				return FR_DISK_ERR;
-			fs->wflag = 0;
-			if (wsect < (fs->fatbase + fs->fsize)) {	/* In FAT area */
-				BYTE nf;
-				for (nf = fs->n_fats; nf > 1; nf--) {	/* Reflect the change to all FAT copies */
-					wsect += fs->fsize;
-					disk_write(fs->drv, fs->win, wsect, 1);
+#if _FAT_CACHE
+			if (IS_FAT_SECT(fs, wsect)) {	/* FAT sectors are written back on eviction or sync */
+				if (cache_store(fs, wsect) != FR_OK)
+					return FR_DISK_ERR;
+			} else
+#endif
+			{
+				if (disk_write(fs->drv, fs->win, wsect, 1) != RES_OK)
+					return FR_DISK_ERR;
+				if (wsect < (fs->fatbase + fs->fsize)) {	/* In FAT area */
+					BYTE nf;
+					for (nf = fs->n_fats; nf > 1; nf--) {	/* Reflect the change to all FAT copies */
+						wsect += fs->fsize;
+						disk_write(fs->drv, fs->win, wsect, 1);
+					}
 				}
 			}
+			fs->wflag = 0;
 		}
 #endif
 		if (sector) {
+#if _FAT_CACHE
+			if (IS_FAT_SECT(fs, sector)) {
+				if (cache_load(fs, sector) != FR_OK)
+					return FR_DISK_ERR;
+			} else
+#endif
 			if (disk_read(fs->drv, fs->win, sector, 1) != RES_OK)
 				return FR_DISK_ERR;
 			fs->winsect = sector;
@@ -555,6 +751,10 @@ FRESULT sync (	/* FR_OK: successful, FR_DISK_ERR: failed */
 
 
 	res = move_window(fs, 0);
+#if _FAT_CACHE
+	if (res == FR_OK)
+		res = cache_flush(fs);
+#endif
 	if (res == FR_OK) {
 		/* Update FSInfo sector if needed */
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag) {
@@ -1911,6 +2111,9 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occurred */
 	fs->id = ++Fsid;		/* File system mount ID */
 	fs->winsect = 0;		/* Invalidate sector cache */
 	fs->wflag = 0;
+#if _FAT_CACHE
+	cache_invalidate(fs);
+#endif
 #if _FS_RPATH
 	fs->cdir = 0;			/* Current directory (root dir) */
 #endif
@@ -2114,6 +2317,9 @@ FRESULT f_open (
 		fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
 		fp->fptr = 0;						/* File pointer */
 		fp->dsect = 0;
+#if _USE_EXPAND && !_FS_READONLY
+		fp->last_clust = 0;
+#endif
 #if _USE_FASTSEEK
 		fp->cltbl = 0;						/* No cluster link map table */
 #endif
@@ -2888,54 +3094,6 @@ FRESULT f_getfree (
 
 
 
-/*-----------------------------------------------------------------------*/
-/* Truncate File                                                         */
-/*-----------------------------------------------------------------------*/
-
-FRESULT f_truncate (
-	FIL *fp		/* Pointer to the file object */
-)
-{
-	FRESULT res;
-	DWORD ncl;
-
-
-	res = validate(fp->fs, fp->id);		/* Check validity of the object */
-	if (res == FR_OK) {
-		if (fp->flag & FA__ERROR) {			/* Check abort flag */
-			res = FR_INT_ERR;
-		} else {
-			if (!(fp->flag & FA_WRITE))		/* Check access mode */
-				res = FR_DENIED;
-		}
-	}
-	if (res == FR_OK) {
-		if (fp->fsize > fp->fptr) {
-			fp->fsize = fp->fptr;	/* Set file size to current R/W point */
-			fp->flag |= FA__WRITTEN;
-			if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
-				res = remove_chain(fp->fs, fp->org_clust);
-				fp->org_clust = 0;
-			} else {				/* When truncate a part of the file, remove remaining clusters */
-				ncl = get_fat(fp->fs, fp->curr_clust);
-				res = FR_OK;
-				if (ncl == 0xFFFFFFFF) res = FR_DISK_ERR;
-				if (ncl == 1) res = FR_INT_ERR;
-				if (res == FR_OK && ncl < fp->fs->n_fatent) {
-					res = put_fat(fp->fs, fp->curr_clust, 0x0FFFFFFF);
-					if (res == FR_OK) res = remove_chain(fp->fs, ncl);
-				}
-			}
-		}
-		if (res != FR_OK) fp->flag |= FA__ERROR;
-	}
-
-	LEAVE_FF(fp->fs, res);
-}
-
-
-
-
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
@@ -3238,6 +3396,148 @@ FRESULT f_rename (
 
 
 
+#if !_FS_READONLY && (_FS_MINIMIZE == 0 || _USE_EXPAND)
+/*-----------------------------------------------------------------------*/
+/* Truncate File                                                         */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_truncate (
+	FIL *fp		/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	DWORD ncl;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res == FR_OK) {
+		if (fp->flag & FA__ERROR) {			/* Check abort flag */
+			res = FR_INT_ERR;
+		} else {
+			if (!(fp->flag & FA_WRITE))		/* Check access mode */
+				res = FR_DENIED;
+		}
+	}
+	if (res == FR_OK) {
+		if (fp->fsize > fp->fptr) {
+			fp->fsize = fp->fptr;	/* Set file size to current R/W point */
+			fp->flag |= FA__WRITTEN;
+#if _USE_EXPAND
+			fp->last_clust = 0;		/* The remembered chain end may be freed */
+#endif
+			if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
+				res = remove_chain(fp->fs, fp->org_clust);
+				fp->org_clust = 0;
+			} else {				/* When truncate a part of the file, remove remaining clusters */
+				ncl = get_fat(fp->fs, fp->curr_clust);
+				res = FR_OK;
+				if (ncl == 0xFFFFFFFF) res = FR_DISK_ERR;
+				if (ncl == 1) res = FR_INT_ERR;
+				if (res == FR_OK && ncl < fp->fs->n_fatent) {
+					res = put_fat(fp->fs, fp->curr_clust, 0x0FFFFFFF);
+					if (res == FR_OK) res = remove_chain(fp->fs, ncl);
+				}
+			}
+		}
+		if (res != FR_OK) fp->flag |= FA__ERROR;
+	}
+
+	LEAVE_FF(fp->fs, res);
+}
+#endif
+
+
+
+#if _USE_EXPAND && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Block to the File                               */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_expand (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD fsz,		/* Number of bytes to add to the cluster chain */
+	DWORD *sect		/* Pointer to return the first sector of the block (can be null) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD n, clst, ncl, lcl, scl, stcl, tcl;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR) LEAVE_FF(fp->fs, FR_INT_ERR);	/* Check abort flag */
+	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fp->fs, FR_DENIED);	/* Check access mode */
+	fs = fp->fs;
+
+	n = (fsz + (DWORD)fs->csize * SS(fs) - 1) / ((DWORD)fs->csize * SS(fs));	/* Number of clusters required */
+	if (n == 0 || n > fs->n_fatent - 2) LEAVE_FF(fs, FR_DENIED);
+
+	/* Find the last cluster of the current chain, from where the previous expansion ended it */
+	lcl = 0;
+	if (fp->org_clust) {
+		clst = fp->last_clust ? fp->last_clust : fp->org_clust;
+		for (;;) {
+			ncl = get_fat(fs, clst);
+			if (ncl == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+			if (ncl < 2) LEAVE_FF(fs, FR_INT_ERR);
+			if (ncl >= fs->n_fatent) break;		/* Last link */
+			clst = ncl;
+		}
+		lcl = clst;
+	}
+
+	/* Search a contiguous free block, following the chain if possible */
+	stcl = lcl ? lcl : fs->last_clust;
+	if (stcl < 2 || stcl >= fs->n_fatent) stcl = fs->n_fatent - 1;
+	clst = stcl; scl = tcl = 0;
+	for (;;) {
+		clst++;
+		if (clst >= fs->n_fatent) {		/* Wrap around, a block cannot span the end */
+			clst = 2; tcl = 0;
+		}
+		ncl = get_fat(fs, clst);
+		if (ncl == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+		if (ncl == 1) LEAVE_FF(fs, FR_INT_ERR);
+		if (ncl == 0) {
+			if (tcl++ == 0) scl = clst;
+			if (tcl == n) break;		/* Found */
+		} else {
+			tcl = 0;
+		}
+		if (clst == stcl) LEAVE_FF(fs, FR_DENIED);	/* No contiguous space */
+	}
+
+	/* Create the chain and link it to the file */
+	for (clst = scl; res == FR_OK && clst < scl + n - 1; clst++)
+		res = put_fat(fs, clst, clst + 1);
+	if (res == FR_OK)
+		res = put_fat(fs, scl + n - 1, 0x0FFFFFFF);
+	if (res == FR_OK) {
+		if (lcl) {
+			res = put_fat(fs, lcl, scl);
+		} else {
+			fp->org_clust = scl;
+			fp->flag |= FA__WRITTEN;
+		}
+	}
+	if (res == FR_OK) {
+		fs->last_clust = fp->last_clust = scl + n - 1;	/* Update FSINFO */
+		if (fs->free_clust != 0xFFFFFFFF) {
+			fs->free_clust -= n;
+			fs->fsi_flag = 1;
+		}
+		if (sect) *sect = clust2sect(fs, scl);
+	} else {
+		fp->flag |= FA__ERROR;
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif /* _USE_EXPAND && !_FS_READONLY */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Forward data to the stream directly (available on only tiny cfg)      */
 /*-----------------------------------------------------------------------*/
@@ -314,6 +314,9 @@ typedef struct {
 	DWORD	org_clust;		/* File start cluster (0 when fsize==0) */
 	DWORD	curr_clust;		/* Current cluster */
 	DWORD	dsect;			/* Current data sector */
+#if _USE_EXPAND && !_FS_READONLY
+	DWORD	last_clust;		/* Chain end left by f_expand (0:walk from org_clust) */
+#endif
 #if !_FS_READONLY
 	DWORD	dir_sect;		/* Sector containing the directory entry */
 	BYTE*	dir_ptr;		/* Ponter to the directory entry in the window */
@@ -416,6 +419,10 @@ FRESULT f_utime (const TCHAR*, const FILINFO*);		/* Change timestamp of the file
 FRESULT f_rename (const TCHAR*, const TCHAR*);		/* Rename/Move a file or directory */
 #endif
 
+#if _USE_EXPAND && !_FS_READONLY
+FRESULT f_expand (FIL*, DWORD, DWORD*);				/* Allocate a contiguous block to the file */
+#endif
+
 #if _USE_FORWARD
 FRESULT f_forward (FIL*, UINT(*)(const BYTE*,UINT), UINT, UINT*);	/* Forward data to the stream */
 #endif
@@ -52,6 +52,22 @@
 /* To enable fast seek feature, set _USE_FASTSEEK to 1. */
 
 
+#define	_USE_EXPAND	1	/* 0:Disable or 1:Enable */
+/* To enable f_expand function, set _USE_EXPAND to 1 and set _FS_READONLY to 0.
+/  This also enables f_truncate regardless of _FS_MINIMIZE. */
+
+
+#define	_FAT_CACHE	8	/* 0:Disable or number of FAT sectors to cache */
+/* To keep recently used FAT sectors in memory, set _FAT_CACHE to the number
+/  of sector buffers. Least recently used sectors are replaced first and dirty
+/  sectors are only written back (to all FAT copies) on eviction or sync.
+/  Sectors are copied to and from the window, and through a bounce buffer on
+/  write back, so the buffers are never handed to disk_read/disk_write and may
+/  be placed in memory the disk driver cannot DMA to with _FAT_CACHE_ATTR. */
+
+#define	_FAT_CACHE_ATTR	__attribute__((section(".ccm")))
+
+
 
 /*---------------------------------------------------------------------------/
 / Locale and Namespace Configurations
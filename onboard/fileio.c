@@ -0,0 +1,405 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+
+#include "aq.h"
+#include "fileio.h"
+#include "filer.h"
+#include "comm.h"
+#include "util.h"
+#include <string.h>
+
+fileioStruct_t fileioData __attribute__((section(".ccm")));
+
+static uint8_t fileioSend(uint8_t seq, uint8_t op, const void *hdr, uint16_t hdrLen, const uint8_t *data, uint16_t dataLen) {
+    commTxBuf_t *txBuf;
+    uint8_t *ptr, *c;
+    uint8_t ckA, ckB;
+    uint16_t len = hdrLen + dataLen;
+
+    txBuf = commGetTxBuf(COMM_STREAM_TYPE_FILEIO, len + FILEIO_OVERHEAD);
+    if (txBuf == 0)
+	return 0;
+
+    ptr = &txBuf->buf;
+
+    *ptr++ = FILEIO_SYNC1;
+    *ptr++ = FILEIO_SYNC2;
+    *ptr++ = FILEIO_SYNC3;
+
+    c = ptr;
+    *ptr++ = seq;
+    *ptr++ = op;
+    *ptr++ = len;
+    *ptr++ = len >> 8;
+    memcpy(ptr, hdr, hdrLen);
+    ptr += hdrLen;
+    memcpy(ptr, data, dataLen);
+    ptr += dataLen;
+
+    ckA = ckB = 0;
+    while (c < ptr) {
+	ckA += *c++;
+	ckB += ckA;
+    }
+    *ptr++ = ckA;
+    *ptr++ = ckB;
+
+    commSendTxBuf(txBuf, ptr - &txBuf->buf);
+
+    return 1;
+}
+
+static uint8_t fileioReply(uint8_t op, const void *hdr, uint16_t hdrLen) {
+    return fileioSend(fileioData.seq, op, hdr, hdrLen, 0, 0);
+}
+
+// filer task context
+static void fileioReadDone(int32_t status, void *param) {
+    fileioBlock_t *b = (fileioBlock_t *)param;
+
+    b->bytes = status;
+    b->state = FILEIO_BLOCK_READY;
+}
+
+static void fileioOpenDone(int32_t status, void *param) {
+    fileioData.openStatus = (status < 0) ? -1 : 0;
+}
+
+// keep the filer busy on the rest of the burst
+static void fileioFetch(void) {
+    fileioBlock_t *b;
+
+    while (fileioData.readOffset < fileioData.readEnd) {
+	b = &fileioData.blocks[fileioData.fetchBlock];
+	if (b->state != FILEIO_BLOCK_FREE)
+	    break;
+
+	b->offset = fileioData.readOffset;
+	b->length = fileioData.readEnd - fileioData.readOffset;
+	if (b->length > FILEIO_BLOCK_SIZE)
+	    b->length = FILEIO_BLOCK_SIZE;
+	b->sent = 0;
+	b->state = FILEIO_BLOCK_READING;
+
+	// queue full, try again next time around
+	if (filerSubmit(fileioData.handle, FILER_FUNC_READ, b->buf, b->offset, b->length, FILER_PRIO_LOW, fileioReadDone, b) < 0) {
+	    b->state = FILEIO_BLOCK_FREE;
+	    break;
+	}
+
+	fileioData.readOffset += b->length;
+	fileioData.fetchBlock = (fileioData.fetchBlock + 1) % FILEIO_BLOCKS;
+    }
+}
+
+static uint8_t fileioBlocksState(uint8_t state) {
+    int i;
+
+    for (i = 0; i < FILEIO_BLOCKS; i++)
+	if (fileioData.blocks[i].state == state)
+	    return 1;
+
+    return 0;
+}
+
+static void fileioBurst(void) {
+    fileioBlock_t *b;
+    uint32_t hdr[3];
+    uint16_t n;
+
+    while ((b = &fileioData.blocks[fileioData.sendBlock])->state == FILEIO_BLOCK_READY) {
+	if (b->bytes < 0) {
+	    fileioData.readErrors++;
+	    fileioData.state = FILEIO_STATE_ABORT;
+	    return;
+	}
+
+	while (b->sent < b->bytes) {
+	    n = b->bytes - b->sent;
+	    if (n > FILEIO_DATA_SIZE)
+		n = FILEIO_DATA_SIZE;
+
+	    hdr[0] = b->offset + b->sent;
+	    if (!fileioSend(fileioData.seq, FILEIO_OP_DATA, hdr, sizeof(uint32_t), b->buf + b->sent, n))
+		return;
+
+	    fileioData.crc = utilCrc32(fileioData.crc, b->buf + b->sent, n);
+	    fileioData.sendOffset += n;
+	    fileioData.bytesSent += n;
+	    b->sent += n;
+	}
+
+	// short read, end of file
+	if (b->bytes < b->length)
+	    fileioData.readOffset = fileioData.readEnd = b->offset + b->bytes;
+
+	b->state = FILEIO_BLOCK_FREE;
+	fileioData.sendBlock = (fileioData.sendBlock + 1) % FILEIO_BLOCKS;
+    }
+
+    fileioFetch();
+
+    if (fileioData.readOffset >= fileioData.readEnd && !fileioBlocksState(FILEIO_BLOCK_READING) && !fileioBlocksState(FILEIO_BLOCK_READY)) {
+	hdr[0] = fileioData.burstStart;
+	hdr[1] = fileioData.sendOffset - fileioData.burstStart;
+	hdr[2] = fileioData.crc;
+
+	if (fileioReply(FILEIO_OP_END, hdr, sizeof(hdr)))
+	    fileioData.state = FILEIO_STATE_IDLE;
+    }
+}
+
+static void fileioBurstStart(uint32_t offset, uint32_t length) {
+    fileioData.burstStart = offset;
+    fileioData.sendOffset = offset;
+    fileioData.readOffset = offset;
+    fileioData.readEnd = offset + length;
+    fileioData.sendBlock = fileioData.fetchBlock;
+    fileioData.crc = 0;
+    fileioData.state = FILEIO_STATE_BURST;
+}
+
+// comm task, every run loop
+static void fileioDo(void) {
+    uint32_t size;
+    int i;
+
+    switch (fileioData.state) {
+    case FILEIO_STATE_OPEN:
+	if (fileioData.openStatus > 0)
+	    break;
+
+	if (fileioData.openStatus < 0) {
+	    if (fileioReply(FILEIO_OP_NACK, 0, 0))
+		fileioData.state = FILEIO_STATE_IDLE;
+	}
+	else {
+	    size = filerGetSize(fileioData.handle);
+	    if (fileioReply(FILEIO_OP_ACK, &size, sizeof(size))) {
+		fileioData.opened = 1;
+		fileioData.state = FILEIO_STATE_IDLE;
+	    }
+	}
+	break;
+
+    case FILEIO_STATE_BURST:
+	// card gone, requests would never be queued
+	if (!filerAvailable())
+	    fileioData.state = FILEIO_STATE_ABORT;
+	else
+	    fileioBurst();
+	break;
+
+    case FILEIO_STATE_ABORT:
+	if (!fileioBlocksState(FILEIO_BLOCK_READING) && fileioReply(FILEIO_OP_NACK, 0, 0)) {
+	    for (i = 0; i < FILEIO_BLOCKS; i++)
+		fileioData.blocks[i].state = FILEIO_BLOCK_FREE;
+	    fileioData.state = FILEIO_STATE_IDLE;
+	}
+	break;
+    }
+}
+
+static int8_t fileioOpen(char *fileName) {
+    if (filerSubmit(fileioData.handle, FILER_FUNC_CLOSE, 0, -1, 0, FILER_PRIO_LOW, 0, 0) < 0)
+	return -1;
+
+    fileioData.opened = 0;
+    filerSetName(fileioData.handle, fileName);
+
+    // a zero length read opens the file
+    fileioData.openStatus = 1;
+    if (filerSubmit(fileioData.handle, FILER_FUNC_READ, fileioData.blocks[0].buf, 0, 0, FILER_PRIO_LOW, fileioOpenDone, 0) < 0)
+	return -1;
+
+    fileioData.state = FILEIO_STATE_OPEN;
+
+    return 0;
+}
+
+static void fileioExecute(void) {
+    fileioBlock_t *b;
+    uint32_t offset, length;
+    int i;
+
+    // one request at a time
+    if (fileioData.state != FILEIO_STATE_IDLE) {
+	fileioSend(fileioData.rxSeq, FILEIO_OP_NACK, 0, 0, 0, 0);
+	return;
+    }
+
+    fileioData.seq = fileioData.rxSeq;
+
+    // buffers & handle are only taken once the service is used
+    if (!fileioData.blocks[0].buf) {
+	for (i = 0; i < FILEIO_BLOCKS; i++)
+	    fileioData.blocks[i].buf = (uint8_t *)aqCalloc(FILEIO_BLOCK_SIZE, sizeof(uint8_t));
+	fileioData.handle = filerGetHandle(FILEIO_FNAME);
+    }
+
+    if (fileioData.handle < 0 || !filerAvailable()) {
+	fileioReply(FILEIO_OP_NACK, 0, 0);
+	return;
+    }
+
+    switch (fileioData.rxOp) {
+    case FILEIO_OP_LIST:
+	if (fileioData.rxLen < 2)
+	    break;
+
+	fileioBurstStart(0, 0);
+	b = &fileioData.blocks[fileioData.fetchBlock];
+	b->offset = 0;
+	b->length = FILEIO_BLOCK_SIZE;
+	b->sent = 0;
+	b->state = FILEIO_BLOCK_READING;
+	if (filerSubmit(fileioData.handle, FILER_FUNC_LIST, b->buf, fileioData.rxBuf[0] | (fileioData.rxBuf[1]<<8), FILEIO_BLOCK_SIZE, FILER_PRIO_LOW, fileioReadDone, b) < 0) {
+	    b->state = FILEIO_BLOCK_FREE;
+	    fileioData.state = FILEIO_STATE_IDLE;
+	    break;
+	}
+	fileioData.fetchBlock = (fileioData.fetchBlock + 1) % FILEIO_BLOCKS;
+	return;
+
+    case FILEIO_OP_OPEN:
+	if (fileioData.rxLen == 0 || fileioData.rxLen >= sizeof(filerData.files[0].fileName))
+	    break;
+
+	fileioData.rxBuf[fileioData.rxLen] = 0;
+	if (fileioOpen((char *)fileioData.rxBuf) < 0)
+	    break;
+	return;
+
+    case FILEIO_OP_READ:
+	if (fileioData.rxLen < 8 || !fileioData.opened)
+	    break;
+
+	memcpy(&offset, &fileioData.rxBuf[0], sizeof(offset));
+	memcpy(&length, &fileioData.rxBuf[4], sizeof(length));
+	if (length > FILEIO_WINDOW)
+	    length = FILEIO_WINDOW;
+
+	fileioBurstStart(offset, length);
+	fileioFetch();
+	return;
+
+    case FILEIO_OP_CLOSE:
+	filerSubmit(fileioData.handle, FILER_FUNC_CLOSE, 0, -1, 0, FILER_PRIO_LOW, 0, 0);
+	fileioData.opened = 0;
+	fileioReply(FILEIO_OP_ACK, 0, 0);
+	return;
+    }
+
+    fileioReply(FILEIO_OP_NACK, 0, 0);
+}
+
+static void fileioChecksum(uint8_t c) {
+    fileioData.checkA += c;
+    fileioData.checkB += fileioData.checkA;
+}
+
+static void fileioCharIn(uint8_t ch) {
+    switch (fileioData.rxState) {
+    case FILEIO_WAIT_SYNC1:
+	if (ch == FILEIO_SYNC1)
+	    fileioData.rxState = FILEIO_WAIT_SYNC2;
+	break;
+
+    case FILEIO_WAIT_SYNC2:
+	if (ch == FILEIO_SYNC2)
+	    fileioData.rxState = FILEIO_WAIT_SYNC3;
+	else
+	    fileioData.rxState = FILEIO_WAIT_SYNC1;
+	break;
+
+    case FILEIO_WAIT_SYNC3:
+	if (ch == FILEIO_SYNC3) {
+	    fileioData.checkA = fileioData.checkB = 0;
+	    fileioData.rxState = FILEIO_WAIT_SEQ;
+	}
+	else {
+	    fileioData.rxState = FILEIO_WAIT_SYNC1;
+	}
+	break;
+
+    case FILEIO_WAIT_SEQ:
+	fileioChecksum(ch);
+	fileioData.rxSeq = ch;
+	fileioData.rxState = FILEIO_WAIT_OP;
+	break;
+
+    case FILEIO_WAIT_OP:
+	fileioChecksum(ch);
+	fileioData.rxOp = ch;
+	fileioData.rxState = FILEIO_WAIT_LEN;
+	break;
+
+    case FILEIO_WAIT_LEN:
+	fileioChecksum(ch);
+	fileioData.rxLen = ch;
+	fileioData.rxPoint = 0;
+	if (ch >= FILEIO_RX_SIZE)
+	    fileioData.rxState = FILEIO_WAIT_SYNC1;
+	else if (ch == 0)
+	    fileioData.rxState = FILEIO_CHECK1;
+	else
+	    fileioData.rxState = FILEIO_PAYLOAD;
+	break;
+
+    case FILEIO_PAYLOAD:
+	fileioChecksum(ch);
+	fileioData.rxBuf[fileioData.rxPoint++] = ch;
+	if (fileioData.rxPoint == fileioData.rxLen)
+	    fileioData.rxState = FILEIO_CHECK1;
+	break;
+
+    case FILEIO_CHECK1:
+	if (ch == fileioData.checkA) {
+	    fileioData.rxState = FILEIO_CHECK2;
+	}
+	else {
+	    fileioData.rxState = FILEIO_WAIT_SYNC1;
+	    fileioData.checksumErrors++;
+	}
+	break;
+
+    case FILEIO_CHECK2:
+	fileioData.rxState = FILEIO_WAIT_SYNC1;
+	if (ch == fileioData.checkB)
+	    fileioExecute();
+	else
+	    fileioData.checksumErrors++;
+	break;
+    }
+}
+
+static void fileioRecvTaskCode(commRcvrStruct_t *r) {
+    while (commAvailable(r))
+	fileioCharIn(commReadChar(r));
+}
+
+void fileioInit(void) {
+    memset((void *)&fileioData, 0, sizeof(fileioData));
+
+    fileioData.handle = -1;
+    fileioData.rxState = FILEIO_WAIT_SYNC1;
+
+    commRegisterRcvrFunc(COMM_STREAM_TYPE_FILEIO, fileioRecvTaskCode);
+    commRegisterTelemFunc(fileioDo);
+}
@@ -0,0 +1,122 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+
+#ifndef _fileio_h
+#define _fileio_h
+
+#include "comm.h"
+
+// file transfer service on COMM_STREAM_TYPE_FILEIO, works alongside logging
+//
+// request:	'A' 'q' 'F' seq op len(u8) payload ckA ckB
+// reply:	'A' 'q' 'F' seq op len(u16) payload ckA ckB
+// Fletcher checksum covers seq through payload, replies echo the request's seq
+//
+// LIST  u16 first entry	-> DATA..., END (listing text, one "name\tsize\n" per entry)
+// OPEN  file name		-> ACK u32 size | NACK
+// READ  u32 offset, u32 length	-> DATA..., END | NACK
+// CLOSE			-> ACK
+//
+// DATA carries u32 offset + bytes, END carries u32 start, u32 bytes, u32 CRC-32 of the whole burst
+
+#define FILEIO_SYNC1		'A'
+#define FILEIO_SYNC2		'q'
+#define FILEIO_SYNC3		'F'
+
+#define FILEIO_FNAME		"FILEIO"	// placeholder until a file is opened
+#define FILEIO_RX_SIZE		64		// largest request payload
+#define FILEIO_DATA_SIZE	256		// file bytes per DATA reply
+#define FILEIO_BLOCK_SIZE	2048		// bytes per filer read
+#define FILEIO_BLOCKS		2		// filer reads kept in flight
+#define FILEIO_WINDOW		(32*1024)	// most bytes per READ request
+#define FILEIO_OVERHEAD		(3+1+1+2+2)
+
+#define FILEIO_OP_LIST		0x01
+#define FILEIO_OP_OPEN		0x02
+#define FILEIO_OP_READ		0x03
+#define FILEIO_OP_CLOSE		0x04
+#define FILEIO_OP_DATA		0x10
+#define FILEIO_OP_END		0x11
+#define FILEIO_OP_ACK		0xfe
+#define FILEIO_OP_NACK		0xff
+
+#define FILEIO_WAIT_SYNC1	0x00
+#define FILEIO_WAIT_SYNC2	0x01
+#define FILEIO_WAIT_SYNC3	0x02
+#define FILEIO_WAIT_SEQ		0x03
+#define FILEIO_WAIT_OP		0x04
+#define FILEIO_WAIT_LEN		0x05
+#define FILEIO_PAYLOAD		0x06
+#define FILEIO_CHECK1		0xfe
+#define FILEIO_CHECK2		0xff
+
+enum {
+    FILEIO_STATE_IDLE = 0,
+    FILEIO_STATE_OPEN,			// waiting for the filer to open the file
+    FILEIO_STATE_BURST,			// sending DATA replies
+    FILEIO_STATE_ABORT			// waiting for outstanding reads before a NACK
+};
+
+enum {
+    FILEIO_BLOCK_FREE = 0,
+    FILEIO_BLOCK_READING,
+    FILEIO_BLOCK_READY
+};
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t offset;			// file offset of buf[0]
+    uint32_t length;			// bytes asked for
+    volatile int32_t bytes;		// bytes read, < 0 on error
+    uint16_t sent;
+    volatile uint8_t state;
+} fileioBlock_t;
+
+typedef struct {
+    fileioBlock_t blocks[FILEIO_BLOCKS];
+    uint8_t rxBuf[FILEIO_RX_SIZE];
+
+    uint32_t readOffset;		// next offset to ask the filer for
+    uint32_t readEnd;
+    uint32_t sendOffset;		// next offset to send
+    uint32_t burstStart;
+    uint32_t crc;
+    volatile int32_t openStatus;
+
+    uint32_t bytesSent;
+    uint32_t checksumErrors;
+    uint32_t readErrors;
+
+    int8_t handle;
+    uint8_t state;
+    uint8_t opened;
+    uint8_t sendBlock;			// next block to send
+    uint8_t fetchBlock;			// next block to read into
+    uint8_t seq;			// request being served
+
+    uint8_t rxState;
+    uint8_t rxSeq, rxOp, rxLen, rxPoint;
+    uint8_t checkA, checkB;
+} fileioStruct_t;
+
+extern fileioStruct_t fileioData;
+
+extern void fileioInit(void);
+
+#endif
@@ -25,6 +25,7 @@
 #include "supervisor.h"
 #include "sdio.h"
 #include "usb.h"
+#include "aq_timer.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -33,7 +34,7 @@ OS_STK *filerTaskStack;
 // buffer used by logger and USB MSC drivers
 uint8_t filerBuf[FILER_BUF_SIZE] __attribute__ ((aligned (16)));
 
-static int32_t filerProcessWrite(filerFileStruct_t *f) {
+static int32_t filerProcessWrite(filerFileStruct_t *f, filerRequest_t *r) {
     uint32_t res;
     UINT bytes;
 
@@ -45,15 +46,15 @@ static int32_t filerProcessWrite(filerFileStruct_t *f) {
 	f->open = 1;
     }
 
-    if (f->seek >= 0) {
-	res = f_lseek(&f->fp, f->seek);
+    if (r->seek >= 0) {
+	res = f_lseek(&f->fp, r->seek);
 	if (res != FR_OK) {
 	    f->open = 0;
 	    return -1;
 	}
     }
 
-    res = f_write(&f->fp, f->buf, f->length, &bytes);
+    res = f_write(&f->fp, r->buf, r->length, &bytes);
     if (res != FR_OK) {
 	f->open = 0;
 	return -1;
@@ -62,7 +63,7 @@ static int32_t filerProcessWrite(filerFileStruct_t *f) {
     return bytes;
 }
 
-static int32_t filerProcessRead(filerFileStruct_t *f) {
+static int32_t filerProcessRead(filerFileStruct_t *f, filerRequest_t *r) {
     uint32_t res;
     UINT bytes;
 
@@ -74,15 +75,15 @@ static int32_t filerProcessRead(filerFileStruct_t *f) {
 	f->open = 1;
     }
 
-    if (f->seek >= 0) {
-	res = f_lseek(&f->fp, f->seek);
+    if (r->seek >= 0) {
+	res = f_lseek(&f->fp, r->seek);
 	if (res != FR_OK) {
 	    f->open = 0;
 	    return -1;
 	}
     }
 
-    res = f_read(&f->fp, f->buf, f->length, &bytes);
+    res = f_read(&f->fp, r->buf, r->length, &bytes);
     if (res != FR_OK) {
 	f->open = 0;
 	return -1;
@@ -91,14 +92,47 @@ static int32_t filerProcessRead(filerFileStruct_t *f) {
     return bytes;
 }
 
+static int32_t filerProcessList(filerRequest_t *r) {
+    FILINFO fno;
+    char *buf = r->buf;
+    uint32_t bytes = 0;
+    int32_t i = 0;
+
+    if (f_opendir(&filerData.dir, "/") != FR_OK)
+	return -1;
+
+    while (f_readdir(&filerData.dir, &fno) == FR_OK && fno.fname[0]) {
+	if (i++ < r->seek)
+	    continue;
+
+	// 8.3 name, '/', tab, 10 digits, newline & null
+	if (bytes + 26 > r->length)
+	    break;
+
+	bytes += sprintf(buf + bytes, "%s%s\t%u\n", fno.fname, (fno.fattrib & AM_DIR) ? "/" : "", (unsigned int)fno.fsize);
+    }
+
+    return bytes;
+}
+
 static int32_t filerProcessSync(filerFileStruct_t *f) {
     uint32_t res;
+    uint32_t start;
 
     if (!f->open) {
 	return -1;
     }
 
+    start = timerMicros();
+
+    // only the directory entry needs updating for raw streams
+    if (f->sect) {
+	f->fp.fsize = f->size;
+	f->fp.flag |= FA__WRITTEN;
+    }
+
     res = f_sync(&f->fp);
+    utilLatencyAdd(&filerData.diskStats.sync, timerMicros() - start);
     if (res != FR_OK) {
 	f->open = 0;
 	return -1;
@@ -107,10 +141,110 @@ static int32_t filerProcessSync(filerFileStruct_t *f) {
     return 0;
 }
 
+// reserve another contiguous block for a raw stream
+static int32_t filerStreamExpand(filerFileStruct_t *f) {
+    DWORD sect;
+
+    // a FAT32 file stays under 4GB, the last few MB go through FatFs
+    if (f->sects > (0xffffffff - FILER_STREAM_PREALLOC) / FILER_SECTOR_SIZE)
+	return -1;
+
+    if (f_expand(&f->fp, FILER_STREAM_PREALLOC, &sect) != FR_OK || f_sync(&f->fp) != FR_OK)
+	return -1;
+
+    f->sect = sect;
+    f->sects += FILER_STREAM_PREALLOC / FILER_SECTOR_SIZE;
+
+    return 0;
+}
+
+// position the FatFs file object at the end of the streamed data
+static int32_t filerStreamSeek(filerFileStruct_t *f) {
+    // f_truncate marks the entry only when it shortens the file, a block filled to the end still needs its size written
+    f->fp.fsize = f->sects * FILER_SECTOR_SIZE;
+    f->fp.flag |= FA__WRITTEN;
+
+    return (f_lseek(&f->fp, f->size) == FR_OK) ? 0 : -1;
+}
+
+// whole sectors straight into the reserved blocks, FAT is only touched when a block runs out
+static int32_t filerProcessStreamRaw(filerFileStruct_t *f, uint8_t final) {
+    int32_t head = f->head;
+    uint32_t count, avail, left;
+    int32_t bytes = 0;
+
+    while (1) {
+	if (head >= f->tail) {
+	    avail = head - f->tail;
+	    if (avail < f->length/FILER_FLUSH_THRESHOLD && !final)
+		break;
+	}
+	else {
+	    avail = f->length - f->tail;
+	}
+
+	count = avail / FILER_SECTOR_SIZE;
+	if (!count)
+	    break;
+	if (count > FILER_MAX_SECTORS)
+	    count = FILER_MAX_SECTORS;
+
+	left = f->sects - f->size / FILER_SECTOR_SIZE;
+	if (!left) {
+	    if (filerStreamExpand(f) < 0) {
+		// no contiguous space left, carry on through FatFs
+		f->sect = 0;
+		if (filerStreamSeek(f) < 0)
+		    return -1;
+		return bytes;
+	    }
+	    left = FILER_STREAM_PREALLOC / FILER_SECTOR_SIZE;
+	}
+	if (count > left)
+	    count = left;
+
+	if (disk_write(0, (BYTE *)f->buf + f->tail, f->sect + (FILER_STREAM_PREALLOC / FILER_SECTOR_SIZE - left), count) != RES_OK)
+	    return -1;
+
+	f->size += count * FILER_SECTOR_SIZE;
+	f->tail = (f->tail + count * FILER_SECTOR_SIZE) % f->length;
+	bytes += count * FILER_SECTOR_SIZE;
+    }
+
+    // partial last sector, only when closing
+    if (final && head != f->tail) {
+	avail = head - f->tail;
+	left = f->sects - f->size / FILER_SECTOR_SIZE;
+	if (!left) {
+	    if (filerStreamExpand(f) < 0)
+		return -1;
+	    left = FILER_STREAM_PREALLOC / FILER_SECTOR_SIZE;
+	}
+
+	memset(f->fp.buf, 0, FILER_SECTOR_SIZE);
+	memcpy(f->fp.buf, (uint8_t *)f->buf + f->tail, avail);
+	if (disk_write(0, f->fp.buf, f->sect + (FILER_STREAM_PREALLOC / FILER_SECTOR_SIZE - left), 1) != RES_OK)
+	    return -1;
+
+	f->size += avail;
+	f->tail = head;
+	bytes += avail;
+    }
+
+    return bytes;
+}
+
 static int32_t filerProcessStream(filerFileStruct_t *f, uint8_t final) {
     uint32_t res;
     UINT bytes = 0;
     uint32_t size;
+    int32_t gap;
+
+    gap = f->head - f->tail;
+    if (gap < 0)
+	gap += f->length;
+    if ((uint32_t)gap > f->gapMax)
+	f->gapMax = gap;
 
     if (!f->open) {
 	sprintf(filerData.buf, "%03d-%s.LOG", filerData.session, f->fileName);
@@ -119,8 +253,18 @@ static int32_t filerProcessStream(filerFileStruct_t *f, uint8_t final) {
 	    return -1;
 
 	f->open = 1;
+	f->sect = 0;
+	f->sects = 0;
+	f->size = 0;
+
+	// sector aligned ring buffers can bypass FatFs
+	if (!(f->length % FILER_SECTOR_SIZE) && !((uint32_t)f->buf & 0x03))
+	    filerStreamExpand(f);
     }
 
+    if (f->sect)
+	return filerProcessStreamRaw(f, final);
+
     // enough new to write?
     while (f->tail > f->head || (f->head - f->tail) >= f->length/FILER_FLUSH_THRESHOLD || ((f->length <= 512 || final) && f->head != f->tail)) {
 	if (f->head > f->tail)
@@ -131,7 +275,8 @@ static int32_t filerProcessStream(filerFileStruct_t *f, uint8_t final) {
 	res = f_write(&f->fp, f->buf + f->tail, size, &bytes);
 	f->tail = (f->tail + bytes) % f->length;
 
-	if (res != FR_OK)
+	// nothing taken when the card or the file is full
+	if (res != FR_OK || !bytes)
 	    return -1;
     }
 
@@ -142,6 +287,13 @@ static int32_t filerProcessClose(filerFileStruct_t *f) {
     uint32_t res = 0;;
 
     if (f->open) {
+	// give back what was reserved but not written
+	if (f->sect) {
+	    f->sect = 0;
+	    if (filerStreamSeek(f) == 0)
+		f_truncate(&f->fp);
+	}
+
 	res = f_close(&f->fp);
 	f->open = 0;
     }
@@ -152,24 +304,157 @@ static int32_t filerProcessClose(filerFileStruct_t *f) {
 	return 0;
 }
 
-static void filerProcessRequest(filerFileStruct_t *f) {
-    if (f->function == FILER_FUNC_STREAM)
-	f->status = filerProcessStream(f, 0);
-    else if (f->function == FILER_FUNC_READ)
-	f->status = filerProcessRead(f);
-    else if (f->function == FILER_FUNC_WRITE)
-	f->status = filerProcessWrite(f);
-    else if (f->function == FILER_FUNC_SYNC)
-	f->status = filerProcessSync(f);
-    else if (f->function == FILER_FUNC_CLOSE)
-	f->status = filerProcessClose(f);
+// highest priority first, FIFO within a class
+static filerRequest_t *filerDequeue(void) {
+    filerRequest_t *r = 0;
+    int i;
+
+    CoEnterMutexSection(filerData.queueMutex);
+
+    for (i = 0; i < FILER_NUM_PRIO; i++) {
+	if ((r = filerData.queueHead[i]) != 0) {
+	    if ((filerData.queueHead[i] = r->next) == 0)
+		filerData.queueTail[i] = 0;
+	    filerData.queueStats.depth--;
+	    break;
+	}
+    }
+
+    CoLeaveMutexSection(filerData.queueMutex);
+
+    return r;
+}
+
+static void filerRelease(filerRequest_t *r) {
+    CoEnterMutexSection(filerData.queueMutex);
+    r->next = filerData.freeList;
+    filerData.freeList = r;
+    CoLeaveMutexSection(filerData.queueMutex);
+}
+
+static void filerComplete(filerRequest_t *r, int32_t status) {
+    filerQueueStats_t *s = &filerData.queueStats;
+    filerCallback_t *callback = r->callback;
+    void *param = r->param;
+    uint32_t latency;
+
+    latency = timerMicros() - r->queued;
+    s->count[r->prio]++;
+    s->latencySum[r->prio] += latency;
+    if (latency > s->latencyMax[r->prio])
+	s->latencyMax[r->prio] = latency;
+
+    // free the slot first so the callback may queue again
+    filerRelease(r);
+
+    if (callback)
+	callback(status, param);
+}
+
+static void filerProcessRequest(filerRequest_t *r) {
+    filerFileStruct_t *f = &filerData.files[r->handle];
+    int32_t status = -1;
+
+    if (r->function == FILER_FUNC_READ)
+	status = filerProcessRead(f, r);
+    else if (r->function == FILER_FUNC_WRITE)
+	status = filerProcessWrite(f, r);
+    else if (r->function == FILER_FUNC_SYNC)
+	status = filerProcessSync(f);
+    else if (r->function == FILER_FUNC_CLOSE)
+	status = filerProcessClose(f);
+    else if (r->function == FILER_FUNC_LIST)
+	status = filerProcessList(r);
+
+    filerComplete(r, status);
+}
+
+// fail everything outstanding, the card has gone away
+static void filerFlushQueue(void) {
+    filerRequest_t *r;
 
-    if (f->function != FILER_FUNC_STREAM) {
-	f->function = FILER_FUNC_NONE;
-	CoSetFlag(f->completeFlag);
+    while ((r = filerDequeue()) != 0)
+	filerComplete(r, -1);
+}
+
+static int32_t filerProcessStreams(void) {
+    uint32_t start;
+    int i;
+
+    for (i = 0; i < FILER_MAX_FILES; i++) {
+	if (filerData.files[i].function == FILER_FUNC_STREAM) {
+	    start = timerMicros();
+	    filerData.files[i].status = filerProcessStream(&filerData.files[i], 0);
+	    if (filerData.files[i].status > 0)
+		utilLatencyAdd(&filerData.diskStats.stream, timerMicros() - start);
+
+	    if (filerData.files[i].status < 0)
+		return filerData.files[i].status;
+	    else if (!((filerData.loops+i) % FILER_STREAM_SYNC))
+		filerProcessSync(&filerData.files[i]);
+	}
+    }
+
+    return 0;
+}
+
+static void filerUpdateRate(void) {
+    filerDiskStats_t *s = &filerData.diskStats;
+    uint32_t now = timerMicros();
+
+    if (now - s->rateMicros >= FILER_RATE_PERIOD) {
+	s->writeRate = (uint64_t)(sdioData.writeStats.sectors - s->rateSectors) * FILER_SECTOR_SIZE * 1000000 / (now - s->rateMicros);
+	s->rateSectors = sdioData.writeStats.sectors;
+	s->rateMicros = now;
     }
 }
 
+static void filerPrintLatency(FIL *fp, char *name, utilLatency_t *l) {
+    UINT bytes;
+    int i;
+
+    sprintf(filerData.buf, "%s ops %u max %uus\n", name, (unsigned int)l->count, (unsigned int)l->max);
+    f_write(fp, filerData.buf, strlen(filerData.buf), &bytes);
+
+    for (i = 0; i < UTIL_LATENCY_BINS; i++) {
+	sprintf(filerData.buf, " %s%dms %u\n", (i < UTIL_LATENCY_BINS-1) ? "<" : ">=", 1<<((i < UTIL_LATENCY_BINS-1) ? i : i-1), (unsigned int)l->hist[i]);
+	f_write(fp, filerData.buf, strlen(filerData.buf), &bytes);
+    }
+}
+
+// summary of this session's SD card performance, rewritten periodically and once all files are closed
+static void filerWriteStats(void) {
+    sdioOpStats_t *s;
+    UINT bytes;
+    int i;
+
+    sprintf(filerData.buf, FILER_STATS_FNAME, filerData.session);
+    if (f_open(&filerData.sess, filerData.buf, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+	return;
+
+    s = &sdioData.writeStats;
+    sprintf(filerData.buf, "write sectors %u retries %u errors %u busy %uus\n", (unsigned int)s->sectors, (unsigned int)s->retries, (unsigned int)s->errors, (unsigned int)s->busyWait);
+    f_write(&filerData.sess, filerData.buf, strlen(filerData.buf), &bytes);
+    filerPrintLatency(&filerData.sess, "write", &s->latency);
+
+    s = &sdioData.readStats;
+    sprintf(filerData.buf, "read sectors %u retries %u errors %u busy %uus\n", (unsigned int)s->sectors, (unsigned int)s->retries, (unsigned int)s->errors, (unsigned int)s->busyWait);
+    f_write(&filerData.sess, filerData.buf, strlen(filerData.buf), &bytes);
+    filerPrintLatency(&filerData.sess, "read", &s->latency);
+
+    filerPrintLatency(&filerData.sess, "stream", &filerData.diskStats.stream);
+    filerPrintLatency(&filerData.sess, "sync", &filerData.diskStats.sync);
+
+    for (i = 0; i < FILER_MAX_FILES; i++) {
+	if (filerData.files[i].function == FILER_FUNC_STREAM) {
+	    sprintf(filerData.buf, "%s gap max %u/%u\n", filerData.files[i].fileName, (unsigned int)filerData.files[i].gapMax, (unsigned int)filerData.files[i].length);
+	    f_write(&filerData.sess, filerData.buf, strlen(filerData.buf), &bytes);
+	}
+    }
+
+    f_close(&filerData.sess);
+}
+
 void filerDebug(char *s, int r) {
     AQ_PRINTF("filer: %s [%d]\n", s, r);
 }
@@ -226,13 +511,17 @@ int32_t filerInitFS(void) {
 }
 
 void filerTaskCode(void *p) {
+    filerRequest_t *r;
     uint32_t res;
+    int32_t ret;
     int i;
 
     AQ_NOTICE("Filer task started\n");
 
     filerRestart:
 
+    filerFlushQueue();
+
 #ifdef HAS_USB
     // does USB MSC want or have the uSD card?
     if (filerData.mscState >= FILER_STATE_MSC_REQUEST) {
@@ -251,6 +540,11 @@ void filerTaskCode(void *p) {
 	    // reset MSC state
 	    filerData.mscState = FILER_STATE_MSC_DISABLE;
 
+	if (usbMscBytes() != filerData.mscBytes) {
+	    filerData.mscBytes = usbMscBytes();
+	    AQ_PRINTF("filer: MSC read %u KB/s, write %u KB/s, read ahead %d%%\n", usbMscReadRate() / 1024, usbMscWriteRate() / 1024, usbMscReadAhead());
+	}
+
 	yield(1000);
 	goto filerRestart;
     }
@@ -295,6 +589,8 @@ void filerTaskCode(void *p) {
 		    filerData.files[i].tail = 0;
 		}
 
+		filerWriteStats();
+
 		supervisorDiskWait(0);
 		filerData.initialized = 0;
 	    }
@@ -321,20 +617,24 @@ void filerTaskCode(void *p) {
 
 	filerData.loops++;
 
-	for (i = 0; i < FILER_MAX_FILES; i++) {
-	    if (filerData.files[i].function > FILER_FUNC_NONE) {
-		filerProcessRequest(&filerData.files[i]);
-
-		if (filerData.files[i].function == FILER_FUNC_STREAM) {
-		    if (filerData.files[i].status < 0) {
-			filerDebug("session write error, aborting", filerData.files[i].status);
-			goto filerRestart;
-		    }
-		    else if (!((filerData.loops+i) % FILER_STREAM_SYNC)) {
-			filerProcessSync(&filerData.files[i]);
-		    }
-		}
-	    }
+	// streams get a pass before every queued request
+	ret = filerProcessStreams();
+	while (ret >= 0 && (r = filerDequeue()) != 0) {
+	    filerProcessRequest(r);
+	    ret = filerProcessStreams();
+	}
+
+	filerUpdateRate();
+
+	// logs usually end at power off, so keep the stats file current
+	if (ret >= 0 && timerMicros() - filerData.statsMicros >= FILER_STATS_PERIOD) {
+	    filerWriteStats();
+	    filerData.statsMicros = timerMicros();
+	}
+
+	if (ret < 0) {
+	    filerDebug("session write error, aborting", ret);
+	    goto filerRestart;
 	}
 
 	CoClearFlag(filerData.filerFlag);
@@ -343,9 +643,17 @@ void filerTaskCode(void *p) {
 }
 
 void filerInit(void) {
+    int i;
+
     memset((void *)&filerData, 0, sizeof(filerData));
 
     filerData.filerFlag = CoCreateFlag(0, 0);   // manual reset
+    filerData.queueMutex = CoCreateMutex();
+
+    for (i = 0; i < FILER_QUEUE_SIZE; i++) {
+	filerData.requests[i].next = filerData.freeList;
+	filerData.freeList = &filerData.requests[i];
+    }
     filerTaskStack = aqStackInit(FILER_STACK_SIZE, "FILER");
 
     filerData.filerTask = CoCreateTask(filerTaskCode, (void *)0, FILER_PRIORITY, &filerTaskStack[FILER_STACK_SIZE-1], FILER_STACK_SIZE);
@@ -372,18 +680,69 @@ int8_t filerGetHandle(char *fileName) {
     return -1;
 }
 
-int32_t filerReadWrite(filerFileStruct_t *f, void *buf, int32_t seek, uint32_t length, uint8_t function) {
-    // handle allocated yet?
-    if (!f->allocated || !filerData.initialized)
+// returns 0 once queued or -1 if the handle is invalid or the queue is full
+int8_t filerSubmit(int8_t handle, uint8_t function, void *buf, int32_t seek, uint32_t length, uint8_t prio, filerCallback_t *callback, void *param) {
+    filerRequest_t *r;
+
+    if (handle < 0 || handle >= FILER_MAX_FILES || !filerData.files[handle].allocated || !filerData.initialized || prio >= FILER_NUM_PRIO)
 	return -1;
 
-    f->buf = buf;
-    f->function = function;
-    f->seek = seek;
-    f->length = length;
+    CoEnterMutexSection(filerData.queueMutex);
+
+    if ((r = filerData.freeList) != 0) {
+	filerData.freeList = r->next;
+
+	r->next = 0;
+	r->callback = callback;
+	r->param = param;
+	r->buf = buf;
+	r->seek = seek;
+	r->length = length;
+	r->queued = timerMicros();
+	r->handle = handle;
+	r->function = function;
+	r->prio = prio;
+
+	if (filerData.queueTail[prio])
+	    filerData.queueTail[prio]->next = r;
+	else
+	    filerData.queueHead[prio] = r;
+	filerData.queueTail[prio] = r;
+
+	filerData.queueStats.requests++;
+	if (++filerData.queueStats.depth > filerData.queueStats.depthMax)
+	    filerData.queueStats.depthMax = filerData.queueStats.depth;
+    }
+    else {
+	filerData.queueStats.rejects++;
+    }
+
+    CoLeaveMutexSection(filerData.queueMutex);
+
+    if (!r)
+	return -1;
 
     CoSetFlag(filerData.filerFlag);
+
+    return 0;
+}
+
+static void filerWaitComplete(int32_t status, void *param) {
+    filerFileStruct_t *f = (filerFileStruct_t *)param;
+
+    f->status = status;
+    CoSetFlag(f->completeFlag);
+}
+
+// blocking wrapper, one waiter per handle
+static int32_t filerWait(int8_t handle, uint8_t function, void *buf, int32_t seek, uint32_t length, uint8_t prio) {
+    filerFileStruct_t *f = &filerData.files[handle];
+
     CoClearFlag(f->completeFlag);
+
+    if (filerSubmit(handle, function, buf, seek, length, prio, filerWaitComplete, f) < 0)
+	return -1;
+
     CoWaitForSingleFlag(f->completeFlag, 0);
 
     return f->status;
@@ -391,12 +750,12 @@ int32_t filerReadWrite(filerFileStruct_t *f, void *buf, int32_t seek, uint32_t l
 
 // no seek if seek == -1
 int32_t filerRead(int8_t handle, void *buf, int32_t seek, uint32_t length) {
-    return filerReadWrite(&filerData.files[handle], buf, seek, length, FILER_FUNC_READ);
+    return filerWait(handle, FILER_FUNC_READ, buf, seek, length, FILER_PRIO_LOW);
 }
 
 // no seek if seek == -1
 int32_t filerWrite(int8_t handle, void *buf, int32_t seek, uint32_t length) {
-    return filerReadWrite(&filerData.files[handle], buf, seek, length, FILER_FUNC_WRITE);
+    return filerWait(handle, FILER_FUNC_WRITE, buf, seek, length, FILER_PRIO_LOW);
 }
 
 int32_t filerSync(int8_t handle) {
@@ -406,13 +765,8 @@ int32_t filerSync(int8_t handle) {
     if (!f->allocated)
 	    return -1;
 
-    if (f->open) {
-	f->function = FILER_FUNC_SYNC;
-
-	CoSetFlag(filerData.filerFlag);
-	CoClearFlag(f->completeFlag);
-	CoWaitForSingleFlag(f->completeFlag, 0);
-    }
+    if (f->open)
+	filerWait(handle, FILER_FUNC_SYNC, 0, -1, 0, FILER_PRIO_HIGH);
 
     return f->status;
 }
@@ -424,13 +778,8 @@ int32_t filerClose(int8_t handle) {
     if (!f->allocated)
 	    return -1;
 
-    if (f->open) {
-	f->function = FILER_FUNC_CLOSE;
-
-	CoSetFlag(filerData.filerFlag);
-	CoClearFlag(f->completeFlag);
-	CoWaitForSingleFlag(f->completeFlag, 0);
-    }
+    if (f->open)
+	filerWait(handle, FILER_FUNC_CLOSE, 0, -1, 0, FILER_PRIO_HIGH);
 
     f->allocated = 0;
 
@@ -441,6 +790,10 @@ int32_t filerGetHead(int8_t handle) {
     return filerData.files[handle].head;
 }
 
+int32_t filerGetTail(int8_t handle) {
+    return filerData.files[handle].tail;
+}
+
 void filerSetHead(int8_t handle, int32_t head) {
     filerData.files[handle].head = head;
 }
@@ -463,3 +816,31 @@ int32_t filerStream(int8_t handle, void *buf, uint32_t length) {
 int8_t filerAvailable(void) {
     return filerData.initialized;
 }
+
+// takes effect the next time the handle's file is opened
+void filerSetName(int8_t handle, char *fileName) {
+    strncpy(filerData.files[handle].fileName, fileName, sizeof(filerData.files[handle].fileName)-1);
+    filerData.files[handle].fileName[sizeof(filerData.files[handle].fileName)-1] = 0;
+}
+
+int32_t filerGetSize(int8_t handle) {
+    filerFileStruct_t *f = &filerData.files[handle];
+
+    return f->open ? (int32_t)f->fp.fsize : -1;
+}
+
+// worst stream ring buffer fill seen so far, percent
+uint8_t filerGetGapMax(void) {
+    uint32_t pct, max = 0;
+    int i;
+
+    for (i = 0; i < FILER_MAX_FILES; i++) {
+	if (filerData.files[i].function == FILER_FUNC_STREAM && filerData.files[i].length) {
+	    pct = (uint64_t)filerData.files[i].gapMax * 100 / filerData.files[i].length;
+	    if (pct > max)
+		max = pct;
+	}
+    }
+
+    return max;
+}
@@ -20,16 +20,24 @@
 #define _filer_h
 
 #include "ff.h"
+#include "util.h"
 #include <CoOS.h>
 
 #define FILER_PRIORITY		62
 #define FILER_STACK_SIZE	200
 
 #define FILER_SESS_FNAME	"session.txt"
-#define FILER_MAX_FILES		5
+#define FILER_STATS_FNAME	"%03d-STATS.TXT"
+#define FILER_RATE_PERIOD	1000000		// us between write throughput updates
+#define FILER_STATS_PERIOD	10000000	// us between rewrites of the session stats file
+#define FILER_MAX_FILES		8
+#define FILER_QUEUE_SIZE	8		// outstanding requests across all handles
 #define FILER_STREAM_SYNC	200		// ~ 1s
 #define FILER_BUF_SIZE		((1<<16)-512)	// <64KB
 #define FILER_FLUSH_THRESHOLD	4
+#define FILER_SECTOR_SIZE	512
+#define FILER_MAX_SECTORS	128		// per SD multi block write
+#define FILER_STREAM_PREALLOC	(32<<20)	// contiguous bytes reserved per stream extension
 
 #define FILER_FUNC_NONE		0x00
 #define FILER_FUNC_READ		0x01
@@ -37,6 +45,14 @@
 #define FILER_FUNC_STREAM	0x03
 #define FILER_FUNC_SYNC		0x04
 #define FILER_FUNC_CLOSE	0x05
+#define FILER_FUNC_LIST		0x06		// root directory as "name\tsize\n" lines, seek = first entry
+
+// request priority classes, streams are always serviced first
+enum {
+    FILER_PRIO_HIGH = 0,
+    FILER_PRIO_LOW,
+    FILER_NUM_PRIO
+};
 
 enum {
     FILER_STATE_MSC_DISABLE = 0,
@@ -49,16 +65,52 @@ enum {
 #define filerEjectMSC()		{filerData.mscState = FILER_STATE_MSC_EJECT;}
 #define filerGetMSCState()	(filerData.mscState)
 
+typedef void filerCallback_t(int32_t status, void *param);
+
+typedef struct filerRequest {
+    struct filerRequest *next;
+    filerCallback_t *callback;		// called from the filer task on completion
+    void *param;
+    void *buf;
+    int32_t seek;
+    uint32_t length;
+    uint32_t queued;			// us
+    int8_t handle;
+    uint8_t function;
+    uint8_t prio;
+} filerRequest_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t rejects;			// queue full
+    uint32_t count[FILER_NUM_PRIO];
+    uint32_t latencySum[FILER_NUM_PRIO];	// us, queued to completed
+    uint32_t latencyMax[FILER_NUM_PRIO];
+    uint8_t depth;
+    uint8_t depthMax;
+} filerQueueStats_t;
+
+typedef struct {
+    utilLatency_t stream;		// stream flushes which wrote something
+    utilLatency_t sync;
+    uint32_t writeRate;			// B/s over the last rate period
+    uint32_t rateSectors;
+    uint32_t rateMicros;
+} filerDiskStats_t;
+
 typedef struct {
     OS_FlagID completeFlag;
 
     char fileName[32];
     FIL fp;
     void *buf;
-    int32_t seek;
     uint32_t length;
     int32_t status;
     volatile int32_t head, tail;
+    uint32_t sect;			// first sector of the current reserved block, 0 if streaming through FatFs
+    uint32_t sects;			// sectors reserved so far
+    uint32_t size;			// bytes streamed
+    uint32_t gapMax;			// most bytes ever waiting between tail and head
     uint8_t open;
     uint8_t function;
     uint8_t allocated;
@@ -67,6 +119,14 @@ typedef struct {
 typedef struct {
     OS_TID filerTask;
     OS_FlagID filerFlag;
+    OS_MutexID queueMutex;
+
+    filerRequest_t requests[FILER_QUEUE_SIZE];
+    filerRequest_t *freeList;
+    filerRequest_t *queueHead[FILER_NUM_PRIO];
+    filerRequest_t *queueTail[FILER_NUM_PRIO];
+    filerQueueStats_t queueStats;
+    filerDiskStats_t diskStats;
 
     filerFileStruct_t files[FILER_MAX_FILES];
     FATFS fs;
@@ -75,6 +135,8 @@ typedef struct {
     char buf[64];
     uint32_t session;
     uint32_t loops;
+    uint32_t mscBytes;			// USB MSC traffic at the last report
+    uint32_t statsMicros;		// last stats file rewrite
     uint8_t initialized;
     volatile uint8_t mscState;
 } filerStruct_t;
@@ -84,13 +146,18 @@ extern uint8_t filerBuf[FILER_BUF_SIZE] ;
 
 extern void filerInit(void);
 extern int8_t filerGetHandle(char *fileName);
+extern int8_t filerSubmit(int8_t handle, uint8_t function, void *buf, int32_t seek, uint32_t length, uint8_t prio, filerCallback_t *callback, void *param);
 extern int32_t filerRead(int8_t handle, void *buf, int32_t seek, uint32_t length);
 extern int32_t filerWrite(int8_t handle, void *buf, int32_t seek, uint32_t length);
 extern int32_t filerStream(int8_t handle, void *buf, uint32_t length);
 extern int32_t filerGetHead(int8_t handle);
+extern int32_t filerGetTail(int8_t handle);
 extern void filerSetHead(int8_t handle, int32_t head);
 extern int32_t filerSync(int8_t handle);
 extern int32_t filerClose(int8_t handle);
 extern int8_t filerAvailable(void);
+extern uint8_t filerGetGapMax(void);
+extern void filerSetName(int8_t handle, char *fileName);
+extern int32_t filerGetSize(int8_t handle);
 
 #endif
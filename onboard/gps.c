@@ -60,10 +60,12 @@ void gpsCheckBaud(serialPort_t *s) {
 
 void gpsTaskCode(void *p) {
     serialPort_t *s = gpsData.gpsPort;
-    char c;
+    unsigned char *buf;
+    unsigned int n;
     char ledOn;
 #ifdef GPS_LOG_BUF
-    int logPointer = 0;
+    unsigned int logPointer = 0;
+    unsigned int i, k;
 #endif
     unsigned int ret = 0;
 
@@ -72,36 +74,45 @@ void gpsTaskCode(void *p) {
     ubloxInit();
 
     while (1) {
-	yield(1);
+	// woken at the end of each burst from the receiver
+	CoWaitForSingleFlag(s->waitFlag, 1);
+	CoClearFlag(s->waitFlag);
 	gpsCheckBaud(s);
 
 	ledOn = digitalGet(supervisorData.gpsLed);
 	if (!ledOn && !(supervisorData.state & STATE_CALIBRATION))
 	    digitalHi(supervisorData.gpsLed);
 
-	while (serialAvailable(s)) {
-	    c = serialRead(s);
-	    ret = ubloxCharIn(c);
+	while ((n = serialReadSpan(s, &buf)) > 0) {
+	    ret = ubloxSpanIn(buf, n);
 
 	    // position update
-	    if (ret == 1) {
+	    if (ret & UBLOX_SPAN_POS) {
 		// notify world of new data
 		CoSetFlag(gpsData.gpsPosFlag);
 	    }
 	    // velocity update
-	    else if (ret == 2) {
+	    if (ret & UBLOX_SPAN_VEL) {
 		// notify world of new data
 		CoSetFlag(gpsData.gpsVelFlag);
 	    }
 	    // lost sync
-	    else if (ret == 3) {
+	    if (ret & UBLOX_SPAN_SYNC) {
 		gpsCheckBaud(s);
 	    }
 
 #ifdef GPS_LOG_BUF
-	    gpsLog[logPointer] = c;
-	    logPointer = (logPointer + 1) % GPS_LOG_BUF;
+	    for (i = 0; i < n; i += k) {
+		k = GPS_LOG_BUF - logPointer;
+		if (k > n - i)
+		    k = n - i;
+
+		memcpy(&gpsLog[logPointer], buf + i, k);
+		logPointer = (logPointer + k) % GPS_LOG_BUF;
+	    }
 #endif
+
+	    serialConsume(s, n);
 	}
 
 #ifdef GPS_LOG_BUF
@@ -139,7 +150,7 @@ void gpsInit(void) {
 
     gpsData.baudSlot = 0;
 
-    gpsData.gpsPort = serialOpen(GPS_USART, GPS_BAUD_RATE, USART_HardwareFlowControl_None, 512, 512);
+    gpsData.gpsPort = serialOpen(GPS_USART, GPS_BAUD_RATE, USART_HardwareFlowControl_None, GPS_RX_BUF_SIZE, 512);
 
     // manual reset flags
     gpsData.gpsVelFlag = CoCreateFlag(0, 0);
@@ -161,6 +172,24 @@ void gpsInit(void) {
     filerStream(gpsData.logHandle, gpsLog, GPS_LOG_BUF);
 #endif
 
+#ifdef GPS_DO_RTK
+    {
+	uint8_t *buf;
+
+	// SDIO DMA cannot reach CCM
+	gpsData.rawHandle = filerGetHandle(GPS_RAW_FNAME);
+	if (gpsData.rawHandle >= 0 && (buf = (uint8_t *)aqCalloc(GPS_RAW_BUF_SIZE, sizeof(uint8_t)))) {
+	    filerStream(gpsData.rawHandle, buf, GPS_RAW_BUF_SIZE);
+
+	    // enables the producer
+	    gpsData.rawBuf = buf;
+	}
+	else {
+	    AQ_NOTICE("GPS: cannot start raw stream\n");
+	}
+    }
+#endif
+
     commRegisterRcvrFunc(COMM_STREAM_TYPE_GPS, gpsPassThrough);
 }
 
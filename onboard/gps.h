@@ -32,9 +32,19 @@
 
 #define GPS_LATENCY             75000       // us (comment out to use uBlox timepulse)
 
+//#define GPS_PVT_RATE            100         // ms, uncomment to use NAV-PVT at this solution rate on uBlox 7+ instead of POSLLH/VELNED
+
 //#define GPS_LOG_BUF             2048        // comment out to disable logging
 //#define GPS_FNAME               "GPS"
-//#define GPS_DO_RTK                          // comment out to disable GPS Raw data reports
+//#define GPS_DO_RTK                          // uncomment to log raw GNSS measurements for post processing
+#define GPS_RAW_FNAME           "GNSS"
+#define GPS_RAW_BUF_SIZE        (32*512)    // whole sectors, > 1s of RXM-RAWX/SFRBX at 10Hz
+
+#ifdef GPS_DO_RTK
+#define GPS_RX_BUF_SIZE         2048
+#else
+#define GPS_RX_BUF_SIZE         512
+#endif
 //#define GPS_DEBUG                           // uncomment to enable extra GPS messages
 
 typedef struct {
@@ -46,6 +56,10 @@ typedef struct {
     unsigned int baudCycle[7];
     int8_t baudSlot;
     uint8_t logHandle;
+    int8_t rawHandle;
+    uint8_t *rawBuf;		// raw stream ring, only the GPS task advances its head
+    uint32_t rawFrames;
+    uint32_t rawDrops;
 
     digitalPin *gpsEnable;
 
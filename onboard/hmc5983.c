@@ -31,6 +31,7 @@
 hmc5983Struct_t hmc5983Data;
 
 static void hmc5983TransferComplete(int unused) {
+    hmc5983Data.sampleTime = hmc5983Data.drdyTime;
     hmc5983Data.slot = (hmc5983Data.slot + 1) % HMC5983_SLOTS;
 }
 
@@ -144,8 +145,10 @@ static void hmc5983ReliablySetReg(uint8_t reg, uint8_t val) {
 }
 
 void hmc5983IntHandler(void) {
-    if (hmc5983Data.enabled)
+    if (hmc5983Data.enabled) {
+        hmc5983Data.drdyTime = timerMicros();
         spiTransaction(hmc5983Data.spi, &hmc5983Data.rxBuf[hmc5983Data.slot*HMC5983_SLOT_SIZE], &hmc5983Data.readCmd, HMC5983_BYTES);
+    }
 }
 
 inline void hmc5983Enable(void) {
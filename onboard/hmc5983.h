@@ -42,6 +42,8 @@ typedef struct {
     float mag[3];
     float magSign[3];
     volatile uint32_t lastUpdate;
+    volatile uint32_t drdyTime;		// DRDY timestamp of the transfer in progress
+    volatile uint32_t sampleTime;	// DRDY timestamp of the newest completed slot
     uint8_t readCmd;
     uint8_t enabled;
     uint8_t initialized;
@@ -26,28 +26,31 @@ imuStruct_t imuData __attribute__((section(".ccm")));
 // wait for lack of movement
 void imuQuasiStatic(int n) {
     uint32_t lastUpdate;
+    utilStats_t sX, sY, sZ;
     float stdX, stdY, stdZ;
     float vX[n];
     float vY[n];
     float vZ[n];
-    int i, j;
+    int i;
+
+    utilStatsInit(&sX, vX, n);
+    utilStatsInit(&sY, vY, n);
+    utilStatsInit(&sZ, vZ, n);
 
     i = 0;
-    j = 0;
     do {
 	lastUpdate = IMU_LASTUPD;
 	while (lastUpdate == IMU_LASTUPD)
 	    ;
 
-	vX[j] = IMU_ACCX;
-	vY[j] = IMU_ACCY;
-	vZ[j] = IMU_ACCZ;
-	j = (j + 1) % n;
+	utilStatsAdd(&sX, IMU_ACCX);
+	utilStatsAdd(&sY, IMU_ACCY);
+	utilStatsAdd(&sZ, IMU_ACCZ);
 
 	if (i >= n) {
-	    arm_std_f32(vX, n, &stdX);
-	    arm_std_f32(vY, n, &stdY);
-	    arm_std_f32(vZ, n, &stdZ);
+	    stdX = utilStatsStd(&sX);
+	    stdY = utilStatsStd(&sY);
+	    stdZ = utilStatsStd(&sZ);
 	}
 
 	i++;
@@ -63,9 +66,24 @@ void imuCalcRot(void) {
     imuData.cosRot = cosf(rotAngle);
 }
 
+// measured time between two sensor samples, falls back to nominal if out of bounds (startup, sensor disabled, etc)
+static float imuMeasureDt(uint32_t *lastTime, uint32_t sampleTime, float nominal) {
+    float dt;
+
+    dt = (float)(sampleTime - *lastTime) * (1.0f / (float)AQ_US_PER_SEC);
+    *lastTime = sampleTime;
+
+    if (dt < nominal * IMU_DT_MIN || dt > nominal * IMU_DT_MAX)
+	dt = nominal;
+
+    return dt;
+}
+
 void imuInit(void) {
     memset((void *)&imuData, 0, sizeof(imuData));
 
+    imuData.dt = AQ_OUTER_TIMESTEP;
+
     imuData.dRateFlag = CoCreateFlag(1, 0);
     imuData.sensorFlag = CoCreateFlag(1, 0);
 
@@ -83,6 +101,7 @@ void imuInit(void) {
 
 void imuAdcDRateReady(void) {
 #ifndef USE_DIGITAL_IMU
+    imuData.dRateTime = adcData.lastSample;
     imuData.halfUpdates++;
     CoSetFlag(imuData.dRateFlag);
 #endif
@@ -90,6 +109,10 @@ void imuAdcDRateReady(void) {
 
 void imuAdcSensorReady(void) {
 #ifndef USE_DIGITAL_IMU
+    // ADC already measures its own sample period
+    imuData.sensorTime = IMU_SAMPLE_TIME;
+    imuData.presTime = AQ_PRESSURE_TIME;
+    imuData.dt = AQ_OUTER_TIMESTEP;
     imuData.fullUpdates++;
     CoSetFlag(imuData.sensorFlag);
 #endif
@@ -97,6 +120,7 @@ void imuAdcSensorReady(void) {
 
 void imuDImuDRateReady(void) {
 #ifdef USE_DIGITAL_IMU
+    imuData.dRateTime = IMU_SAMPLE_TIME;
     imuData.halfUpdates++;
     CoSetFlag(imuData.dRateFlag);
 #endif	// USE_DIGITAL_IMU
@@ -104,6 +128,8 @@ void imuDImuDRateReady(void) {
 
 void imuDImuSensorReady(void) {
 #ifdef USE_DIGITAL_IMU
+    imuData.dt = imuMeasureDt(&imuData.sensorTime, IMU_SAMPLE_TIME, AQ_OUTER_TIMESTEP);
+    imuData.presTime = AQ_PRESSURE_TIME;
     imuData.fullUpdates++;
     CoSetFlag(imuData.sensorFlag);
 #endif	// USE_DIGITAL_IMU
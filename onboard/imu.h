@@ -26,6 +26,8 @@
 #define IMU_ROOM_TEMP		20.0f
 #define IMU_STATIC_STD		0.05f
 #define IMU_STATIC_TIMEOUT	5	// seconds
+#define IMU_DT_MIN		0.5f	// measured timesteps outside these multiples of nominal are rejected
+#define IMU_DT_MAX		4.0f
 
 // these define where to get certain data
 #define AQ_YAW			navUkfData.yaw
@@ -45,12 +47,16 @@
 #define IMU_RAW_RATEX   max21100Data.rawGyo[0]
 #define IMU_RAW_RATEY   max21100Data.rawGyo[1]
 #define IMU_RAW_RATEZ   max21100Data.rawGyo[2]
+#define IMU_RAW_DRATEX  max21100Data.dRateRawGyo[0]
+#define IMU_RAW_DRATEY  max21100Data.dRateRawGyo[1]
+#define IMU_RAW_DRATEZ  max21100Data.dRateRawGyo[2]
 #define IMU_ACCX		max21100Data.acc[0]
 #define IMU_ACCY		max21100Data.acc[1]
 #define IMU_ACCZ		max21100Data.acc[2]
 #define IMU_RAW_ACCX    max21100Data.rawAcc[0]
 #define IMU_RAW_ACCY    max21100Data.rawAcc[1]
 #define IMU_RAW_ACCZ    max21100Data.rawAcc[2]
+#define IMU_SAMPLE_TIME		max21100Data.sampleTime
 #else
 #define IMU_DRATEX		mpu6000Data.dRateGyo[0]
 #define IMU_DRATEY		mpu6000Data.dRateGyo[1]
@@ -61,12 +67,16 @@
 #define IMU_RAW_RATEX   mpu6000Data.rawGyo[0]
 #define IMU_RAW_RATEY   mpu6000Data.rawGyo[1]
 #define IMU_RAW_RATEZ   mpu6000Data.rawGyo[2]
+#define IMU_RAW_DRATEX  mpu6000Data.dRateRawGyo[0]
+#define IMU_RAW_DRATEY  mpu6000Data.dRateRawGyo[1]
+#define IMU_RAW_DRATEZ  mpu6000Data.dRateRawGyo[2]
 #define IMU_ACCX		mpu6000Data.acc[0]
 #define IMU_ACCY		mpu6000Data.acc[1]
 #define IMU_ACCZ		mpu6000Data.acc[2]
 #define IMU_RAW_ACCX    mpu6000Data.rawAcc[0]
 #define IMU_RAW_ACCY    mpu6000Data.rawAcc[1]
 #define IMU_RAW_ACCZ    mpu6000Data.rawAcc[2]
+#define IMU_SAMPLE_TIME		mpu6000Data.sampleTime
 #endif
 #define IMU_MAGX		hmc5983Data.mag[0]
 #define IMU_MAGY		hmc5983Data.mag[1]
@@ -74,11 +84,13 @@
 #define IMU_RAW_MAGX    hmc5983Data.rawMag[0]
 #define IMU_RAW_MAGY    hmc5983Data.rawMag[1]
 #define IMU_RAW_MAGZ    hmc5983Data.rawMag[2]
+#define IMU_MAG_TIME		hmc5983Data.sampleTime
 #define IMU_TEMP		dImuData.temp
 #define IMU_LASTUPD		dImuData.lastUpdate
 #define AQ_OUTER_TIMESTEP	DIMU_OUTER_DT
 #define AQ_INNER_TIMESTEP	DIMU_INNER_DT
 #define AQ_PRESSURE		ms5611Data.pres
+#define AQ_PRESSURE_TIME	ms5611Data.sampleTime
 #define AQ_MAG_ENABLED          hmc5983Data.enabled
 #endif	// USE_DIGITAL_IMU
 
@@ -99,17 +111,20 @@
 #define IMU_RAW_ACCX    adcData.voltages[ADC_VOLTS_ACCX]
 #define IMU_RAW_ACCY    adcData.voltages[ADC_VOLTS_ACCY]
 #define IMU_RAW_ACCZ    adcData.voltages[ADC_VOLTS_ACCZ]
+#define IMU_SAMPLE_TIME		adcData.lastSample
 #define IMU_MAGX		adcData.magX
 #define IMU_MAGY		adcData.magY
 #define IMU_MAGZ		adcData.magZ
 #define IMU_RAW_MAGX    adcData.voltages[ADC_VOLTS_MAGX]
 #define IMU_RAW_MAGY    adcData.voltages[ADC_VOLTS_MAGY]
 #define IMU_RAW_MAGZ    adcData.voltages[ADC_VOLTS_MAGZ]
+#define IMU_MAG_TIME		adcData.lastSample
 #define IMU_TEMP		adcData.temperature
 #define IMU_LASTUPD		adcData.lastUpdate
 #define AQ_OUTER_TIMESTEP	adcData.dt
 #define AQ_INNER_TIMESTEP	(adcData.dt * 0.5f)
 #define AQ_PRESSURE		adcData.pressure
+#define AQ_PRESSURE_TIME	adcData.lastSample
 #define AQ_MAG_ENABLED          1
 #endif
 
@@ -119,6 +134,12 @@ typedef struct {
     float sinRot, cosRot;
     uint32_t fullUpdates;
     uint32_t halfUpdates;
+
+    // sensor sample timestamps (us) and measured outer timestep (s) of the published data
+    uint32_t sensorTime;
+    uint32_t dRateTime;
+    uint32_t presTime;
+    float dt;
 } imuStruct_t;
 
 extern imuStruct_t imuData;
@@ -42,7 +42,7 @@
 
 loggerStruct_t loggerData __attribute__((section(".ccm")));
 
-loggerFields_t loggerFields[] = {
+loggerFields_t loggerFieldsMain[] = {
     {LOG_LASTUPDATE, LOG_TYPE_U32},
     {LOG_VOLTAGE0, LOG_TYPE_FLOAT},
     {LOG_VOLTAGE1, LOG_TYPE_FLOAT},
@@ -70,31 +70,9 @@ loggerFields_t loggerFields[] = {
     {LOG_IMU_MAGX, LOG_TYPE_FLOAT},
     {LOG_IMU_MAGY, LOG_TYPE_FLOAT},
     {LOG_IMU_MAGZ, LOG_TYPE_FLOAT},
-    {LOG_GPS_PDOP, LOG_TYPE_FLOAT},
-    {LOG_GPS_HDOP, LOG_TYPE_FLOAT},
-    {LOG_GPS_VDOP, LOG_TYPE_FLOAT},
-    {LOG_GPS_TDOP, LOG_TYPE_FLOAT},
-    {LOG_GPS_NDOP, LOG_TYPE_FLOAT},
-    {LOG_GPS_EDOP, LOG_TYPE_FLOAT},
-    {LOG_GPS_ITOW, LOG_TYPE_U32},
-    {LOG_GPS_POS_UPDATE, LOG_TYPE_U32},
-    {LOG_GPS_LAT, LOG_TYPE_DOUBLE},
-    {LOG_GPS_LON, LOG_TYPE_DOUBLE},
-    {LOG_GPS_HEIGHT, LOG_TYPE_FLOAT},
-    {LOG_GPS_HACC, LOG_TYPE_FLOAT},
-    {LOG_GPS_VACC, LOG_TYPE_FLOAT},
-    {LOG_GPS_VEL_UPDATE, LOG_TYPE_U32},
-    {LOG_GPS_VELN, LOG_TYPE_FLOAT},
-    {LOG_GPS_VELE, LOG_TYPE_FLOAT},
-    {LOG_GPS_VELD, LOG_TYPE_FLOAT},
-    {LOG_GPS_SACC, LOG_TYPE_FLOAT},
     {LOG_ADC_PRESSURE1, LOG_TYPE_FLOAT},
 #ifdef HAS_AIMU
     {LOG_ADC_PRESSURE2, LOG_TYPE_FLOAT},
-#endif
-    {LOG_ADC_TEMP0, LOG_TYPE_FLOAT},
-    {LOG_ADC_VIN, LOG_TYPE_FLOAT},
-#ifdef HAS_AIMU
     {LOG_ADC_MAG_SIGN, LOG_TYPE_S8},
 #endif
     {LOG_UKF_Q1, LOG_TYPE_FLOAT},
@@ -128,6 +106,39 @@ loggerFields_t loggerFields[] = {
     {LOG_MOT_PITCH, LOG_TYPE_FLOAT},
     {LOG_MOT_ROLL, LOG_TYPE_FLOAT},
     {LOG_MOT_YAW, LOG_TYPE_FLOAT},
+    {LOG_GMBL_TRIGGER, LOG_TYPE_U16},
+    {LOG_ACC_BIAS_X, LOG_TYPE_FLOAT},
+    {LOG_ACC_BIAS_Y, LOG_TYPE_FLOAT},
+    {LOG_ACC_BIAS_Z, LOG_TYPE_FLOAT},
+    {LOG_IMU_TIME, LOG_TYPE_U32},
+    {LOG_IMU_DT, LOG_TYPE_FLOAT},
+};
+
+loggerFields_t loggerFieldsGps[] = {
+    {LOG_LASTUPDATE, LOG_TYPE_U32},
+    {LOG_GPS_PDOP, LOG_TYPE_FLOAT},
+    {LOG_GPS_HDOP, LOG_TYPE_FLOAT},
+    {LOG_GPS_VDOP, LOG_TYPE_FLOAT},
+    {LOG_GPS_TDOP, LOG_TYPE_FLOAT},
+    {LOG_GPS_NDOP, LOG_TYPE_FLOAT},
+    {LOG_GPS_EDOP, LOG_TYPE_FLOAT},
+    {LOG_GPS_ITOW, LOG_TYPE_U32},
+    {LOG_GPS_POS_UPDATE, LOG_TYPE_U32},
+    {LOG_GPS_LAT, LOG_TYPE_DOUBLE},
+    {LOG_GPS_LON, LOG_TYPE_DOUBLE},
+    {LOG_GPS_HEIGHT, LOG_TYPE_FLOAT},
+    {LOG_GPS_HACC, LOG_TYPE_FLOAT},
+    {LOG_GPS_VACC, LOG_TYPE_FLOAT},
+    {LOG_GPS_VEL_UPDATE, LOG_TYPE_U32},
+    {LOG_GPS_VELN, LOG_TYPE_FLOAT},
+    {LOG_GPS_VELE, LOG_TYPE_FLOAT},
+    {LOG_GPS_VELD, LOG_TYPE_FLOAT},
+    {LOG_GPS_SACC, LOG_TYPE_FLOAT},
+    {LOG_GPS_LAG, LOG_TYPE_FLOAT},
+};
+
+loggerFields_t loggerFieldsRadio[] = {
+    {LOG_LASTUPDATE, LOG_TYPE_U32},
     {LOG_RADIO_QUALITY, LOG_TYPE_FLOAT},
     {LOG_RADIO_CHANNEL0, LOG_TYPE_S16},
     {LOG_RADIO_CHANNEL1, LOG_TYPE_S16},
@@ -148,10 +159,12 @@ loggerFields_t loggerFields[] = {
     {LOG_RADIO_CHANNEL16, LOG_TYPE_S16},
     {LOG_RADIO_CHANNEL17, LOG_TYPE_S16},
     {LOG_RADIO_ERRORS, LOG_TYPE_U16},
-    {LOG_GMBL_TRIGGER, LOG_TYPE_U16},
-    {LOG_ACC_BIAS_X, LOG_TYPE_FLOAT},
-    {LOG_ACC_BIAS_Y, LOG_TYPE_FLOAT},
-    {LOG_ACC_BIAS_Z, LOG_TYPE_FLOAT},
+};
+
+loggerFields_t loggerFieldsPower[] = {
+    {LOG_LASTUPDATE, LOG_TYPE_U32},
+    {LOG_ADC_TEMP0, LOG_TYPE_FLOAT},
+    {LOG_ADC_VIN, LOG_TYPE_FLOAT},
     {LOG_CURRENT_PDB, LOG_TYPE_FLOAT},
 #ifdef ANALOG_CHANNEL_EXT_AMP
     {LOG_CURRENT_EXT, LOG_TYPE_FLOAT},
@@ -159,478 +172,744 @@ loggerFields_t loggerFields[] = {
     {LOG_VIN_PDB, LOG_TYPE_FLOAT},
 };
 
-int loggerCopy8(void *to, void *from) {
-    *(uint32_t *)(to + 0) = *(uint32_t *)(from + 0);
-    *(uint32_t *)(to + 4) = *(uint32_t *)(from + 4);
+// AQL Fletcher checksum, a word at a time once aligned
+void loggerChecksum(const uint8_t *buf, int len, uint8_t *ckA, uint8_t *ckB) {
+    uint32_t a, b, w;
+
+    a = b = 0;
+
+    while (len > 0 && ((uint32_t)buf & 0x03)) {
+	a += *buf++;
+	b += a;
+	len--;
+    }
+
+    // b advances by 4a plus the bytes weighted by how many sums they feed
+    while (len >= 4) {
+	w = *(uint32_t *)buf;
+	b += 4*a + 4*(w & 0xff) + 3*((w>>8) & 0xff) + 2*((w>>16) & 0xff) + (w>>24);
+	a += (w & 0xff) + ((w>>8) & 0xff) + ((w>>16) & 0xff) + (w>>24);
+	buf += 4;
+	len -= 4;
+    }
+
+    while (len-- > 0) {
+	a += *buf++;
+	b += a;
+    }
 
-    return 8;
+    *ckA = a;
+    *ckB = b;
 }
 
-int loggerCopy4(void *to, void *from) {
-    *(uint32_t *)to = *(uint32_t *)from;
+// reserve a record at the stream head, staging it if it would wrap the buffer
+static char *loggerBegin(uint16_t size) {
+    loggerData.recHead = filerGetHead(loggerData.logHandle);
+    loggerData.recSize = size;
 
-    return 4;
+    if (loggerData.recHead + size <= loggerData.bufSize)
+	return loggerData.loggerBuf + loggerData.recHead;
+    else
+	return loggerData.recBuf;
 }
 
-int loggerCopy2(void *to, void *from) {
-    *(uint16_t *)to = *(uint16_t *)from;
+static void loggerCommit(char *buf) {
+    uint32_t n;
 
-    return 2;
+    if (buf == loggerData.recBuf) {
+	n = loggerData.bufSize - loggerData.recHead;
+	memcpy(loggerData.loggerBuf + loggerData.recHead, buf, n);
+	memcpy(loggerData.loggerBuf, buf + n, loggerData.recSize - n);
+    }
+
+    filerSetHead(loggerData.logHandle, (loggerData.recHead + loggerData.recSize) % loggerData.bufSize);
 }
 
-int loggerCopy1(void *to, void *from) {
-    *(uint8_t *)to = *(uint8_t *)from;
+// main group keeps the original AqH layout, others add group id and rate
+static void loggerGroupHeader(uint8_t g) {
+    loggerGroup_t *grp = &loggerData.groups[g];
+    uint16_t len = grp->numFields * sizeof(loggerFields_t);
+    char *rec, *buf;
+
+    if (g == LOGGER_GROUP_MAIN) {
+	rec = buf = loggerBegin(3 + 1 + len + 2);
+
+	*buf++ = 'A';
+	*buf++ = 'q';
+	*buf++ = 'H';
+    }
+    else {
+	rec = buf = loggerBegin(3 + 4 + len + 2);
+
+	*buf++ = 'A';
+	*buf++ = 'q';
+	*buf++ = 'G';
+	*buf++ = g;
+	*buf++ = grp->rate;
+	*buf++ = grp->rate>>8;
+    }
+
+    // number of fields
+    *buf++ = grp->numFields;
+
+    // fields and types
+    memcpy(buf, grp->fields, len);
+    buf += len;
+
+    loggerChecksum((uint8_t *)rec + 3, buf - rec - 3, (uint8_t *)buf, (uint8_t *)buf + 1);
 
-    return 1;
+    loggerCommit(rec);
 }
 
-void loggerDoHeader(void) {
-    int32_t head;
-    char *buf;
-    char ckA, ckB;
+#ifndef USE_LOG_COMPRESS
+static void loggerGroupRecord(uint8_t g) {
+    loggerGroup_t *grp = &loggerData.groups[g];
+    loggerRun_t *run;
+    char *rec, *buf;
     int i;
 
-    // make sure we can proceed
-    if (!filerAvailable())
+    rec = buf = loggerBegin(grp->packetSize);
+
+    *buf++ = 'A';
+    *buf++ = 'q';
+    if (g == LOGGER_GROUP_MAIN) {
+	*buf++ = 'M';
+    }
+    else {
+	*buf++ = 'D';
+	*buf++ = g;
+    }
+
+    // copy program, single field runs skip the memcpy call
+    run = grp->runs;
+    for (i = 0; i < grp->numRuns; i++, run++) {
+	if (run->len == 4)
+	    *(uint32_t *)buf = *(uint32_t *)run->src;
+	else if (run->len == 2)
+	    *(uint16_t *)buf = *(uint16_t *)run->src;
+	else
+	    memcpy(buf, run->src, run->len);
+	buf += run->len;
+    }
+
+    loggerChecksum((uint8_t *)rec + 3, buf - rec - 3, (uint8_t *)buf, (uint8_t *)buf + 1);
+
+    loggerCommit(rec);
+}
+#endif
+
+#ifdef USE_LOG_COMPRESS
+static uint8_t *loggerVarint(uint8_t *buf, uint32_t v) {
+    while (v >= 0x80) {
+	*buf++ = v | 0x80;
+	v >>= 7;
+    }
+    *buf++ = v;
+
+    return buf;
+}
+
+static uint8_t *loggerVarint64(uint8_t *buf, uint64_t v) {
+    while (v > 0xffffffff) {
+	*buf++ = v | 0x80;
+	v >>= 7;
+    }
+
+    return loggerVarint(buf, v);
+}
+
+// zigzag so small negative deltas stay short
+static uint8_t *loggerDelta(uint8_t *buf, int32_t v, uint64_t *prev) {
+    int32_t d = (uint32_t)v - (uint32_t)*prev;
+
+    *prev = v;
+
+    return loggerVarint(buf, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+}
+
+// worst case encoded size of one frame
+static uint16_t loggerFrameMax(loggerGroup_t *grp) {
+    uint16_t size = 0;
+    int i;
+
+    for (i = 0; i < grp->numFields; i++)
+	size += (grp->fields[i].fieldType == LOG_TYPE_DOUBLE) ? 10 : 5;
+
+    return size;
+}
+
+// AqC block: group id, payload length, frames, checksum
+static void loggerFlushBlock(uint8_t g) {
+    loggerGroup_t *grp = &loggerData.groups[g];
+    char *rec, *buf;
+
+    if (!grp->blockLen)
 	return;
 
-    head = filerGetHead(loggerData.logHandle);
-    buf = loggerData.loggerBuf + head;
+    rec = buf = loggerBegin(3 + 3 + grp->blockLen + 2);
 
-    // log header signature
     *buf++ = 'A';
     *buf++ = 'q';
-    *buf++ = 'H';
+    *buf++ = 'C';
+    *buf++ = g;
+    *buf++ = grp->blockLen;
+    *buf++ = grp->blockLen>>8;
 
-    // number of fields
-    *buf++ = loggerData.numFields;
+    memcpy(buf, grp->block, grp->blockLen);
+    buf += grp->blockLen;
 
-    // fields and types
-    memcpy(buf, loggerFields, sizeof(loggerFields));
-
-    // calc checksum
-    ckA = ckB = 0;
-    buf = loggerData.loggerBuf + head + 3;
-    for (i = 0; i < (1 + sizeof(loggerFields)); i++) {
-	ckA += buf[i];
-	ckB += ckA;
+    loggerChecksum((uint8_t *)rec + 3, buf - rec - 3, (uint8_t *)buf, (uint8_t *)buf + 1);
+
+    loggerCommit(rec);
+
+    // each block decodes on its own
+    grp->blockLen = 0;
+    memset(grp->prev, 0, grp->numFields * sizeof(uint64_t));
+}
+
+// floats are XOR'd with their last value, integers delta coded, both as varints
+static void loggerGroupCompress(uint8_t g) {
+    loggerGroup_t *grp = &loggerData.groups[g];
+    uint8_t *buf;
+    uint64_t v64;
+    uint32_t v32;
+    uint16_t v16;
+    uint8_t v8;
+    int i;
+
+    buf = grp->block + grp->blockLen;
+
+    for (i = 0; i < grp->numFields; i++) {
+	switch (grp->fields[i].fieldType) {
+	    case LOG_TYPE_DOUBLE:
+		memcpy(&v64, grp->fp[i].fieldPointer, 8);
+		buf = loggerVarint64(buf, v64 ^ grp->prev[i]);
+		grp->prev[i] = v64;
+		break;
+	    case LOG_TYPE_FLOAT:
+		memcpy(&v32, grp->fp[i].fieldPointer, 4);
+		buf = loggerVarint(buf, v32 ^ (uint32_t)grp->prev[i]);
+		grp->prev[i] = v32;
+		break;
+	    case LOG_TYPE_U32:
+	    case LOG_TYPE_S32:
+		memcpy(&v32, grp->fp[i].fieldPointer, 4);
+		buf = loggerDelta(buf, v32, &grp->prev[i]);
+		break;
+	    case LOG_TYPE_U16:
+		memcpy(&v16, grp->fp[i].fieldPointer, 2);
+		buf = loggerDelta(buf, v16, &grp->prev[i]);
+		break;
+	    case LOG_TYPE_S16:
+		memcpy(&v16, grp->fp[i].fieldPointer, 2);
+		buf = loggerDelta(buf, (int16_t)v16, &grp->prev[i]);
+		break;
+	    case LOG_TYPE_U8:
+		v8 = *(uint8_t *)grp->fp[i].fieldPointer;
+		buf = loggerDelta(buf, v8, &grp->prev[i]);
+		break;
+	    case LOG_TYPE_S8:
+		v8 = *(uint8_t *)grp->fp[i].fieldPointer;
+		buf = loggerDelta(buf, (int8_t)v8, &grp->prev[i]);
+		break;
+	}
     }
-    buf[i++] = ckA;
-    buf[i++] = ckB;
 
-    // block size is the actual data packet size
-    filerSetHead(loggerData.logHandle, (head + loggerData.packetSize) % loggerData.bufSize);
+    grp->blockLen = buf - grp->block;
+
+    if (grp->blockLen >= LOGGER_BLOCK_SIZE)
+	loggerFlushBlock(g);
+}
+#endif
+
+void loggerDoHeader(void) {
+    int g;
+
+    // make sure we can proceed
+    if (!filerAvailable())
+	return;
+
+    for (g = 0; g < LOGGER_NUM_GROUPS; g++) {
+#ifdef USE_LOG_COMPRESS
+	// bounds the latency of slow groups
+	loggerFlushBlock(g);
+#endif
+	loggerGroupHeader(g);
+    }
 }
 
 void loggerDo(void) {
-    int32_t head;
-    char *buf;
-    char ckA, ckB;
-    int i;
+    loggerGroup_t *grp;
+    int g;
 
     // make sure we can proceed
     if (!filerAvailable())
 	return;
 
-    head = filerGetHead(loggerData.logHandle);
-    buf = loggerData.loggerBuf + head;
+    for (g = 0; g < LOGGER_NUM_GROUPS; g++) {
+	grp = &loggerData.groups[g];
 
-    // log header signature
-    *buf++ = 'A';
-    *buf++ = 'q';
-    *buf++ = 'M';
+	if (grp->trigger) {
+	    if (*grp->trigger == grp->lastTrigger)
+		continue;
+	    grp->lastTrigger = *grp->trigger;
+	}
+	else if (loggerData.loops % grp->rate) {
+	    continue;
+	}
 
-    // number of fields
-    for (i = 0; i < loggerData.numFields; i++)
-	buf += loggerData.fp[i].copyFunc(buf, loggerData.fp[i].fieldPointer);
-
-    ckA = ckB = 0;
-    buf = loggerData.loggerBuf + head;
-    for (i = 3; i < loggerData.packetSize - 2; i++) {
-	ckA += buf[i];
-	ckB += ckA;
+#ifdef USE_LOG_COMPRESS
+	loggerGroupCompress(g);
+#else
+	loggerGroupRecord(g);
+#endif
     }
-    buf[i++] = ckA;
-    buf[i++] = ckB;
 
-    filerSetHead(loggerData.logHandle, (head + loggerData.packetSize) % loggerData.bufSize);
+    loggerData.loops++;
 }
 
-void loggerSetup(void) {
+// merge fields with contiguous sources into single copy runs
+static void loggerCompile(loggerGroup_t *grp) {
+    loggerRun_t *run;
     int i;
 
-    loggerData.numFields = sizeof(loggerFields) / sizeof(loggerFields_t);
-    loggerData.packetSize = 3 + 2;  // signature + checksum
+    grp->runs = (loggerRun_t *)aqDataCalloc(grp->numFields, sizeof(loggerRun_t));
+    grp->numRuns = 0;
+
+    run = 0;
+    for (i = 0; i < grp->numFields; i++) {
+	if (run && (uint8_t *)run->src + run->len == (uint8_t *)grp->fp[i].fieldPointer) {
+	    run->len += grp->fp[i].size;
+	}
+	else {
+	    run = &grp->runs[grp->numRuns++];
+	    run->src = grp->fp[i].fieldPointer;
+	    run->len = grp->fp[i].size;
+	}
+    }
+}
+
+// rate in Hz, 0 for every run loop; a trigger overrides the rate
+static void loggerSetupGroup(uint8_t g, loggerFields_t *fields, uint8_t numFields, float rate, unsigned long *trigger) {
+    loggerGroup_t *grp = &loggerData.groups[g];
+    fieldData_t *fp;
+    int i;
+
+    grp->fields = fields;
+    grp->numFields = numFields;
+    grp->trigger = trigger;
+    grp->packetSize = (g == LOGGER_GROUP_MAIN) ? (3 + 2) : (4 + 2);  // signature + checksum
+
+    if (trigger)
+	grp->rate = 0;
+    else if (rate > 0.0f && (i = (int)(1.0f / (AQ_OUTER_TIMESTEP * rate) + 0.5f)) > 1)
+	grp->rate = i;
+    else
+	grp->rate = 1;
 
-    loggerData.fp = (fieldData_t *)aqDataCalloc(loggerData.numFields, sizeof(fieldData_t));
+    grp->fp = fp = (fieldData_t *)aqDataCalloc(numFields, sizeof(fieldData_t));
 
-    for (i = 0; i < loggerData.numFields; i++) {
-	switch (loggerFields[i].fieldId) {
+    for (i = 0; i < numFields; i++) {
+	switch (fields[i].fieldId) {
 	    case LOG_LASTUPDATE:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_LASTUPD;
+		fp[i].fieldPointer = (void *)&IMU_LASTUPD;
 		break;
 	    case LOG_VOLTAGE0:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_RATEX;
+		fp[i].fieldPointer = (void *)&IMU_RAW_RATEX;
 		break;
 	    case LOG_VOLTAGE1:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_RATEY;
+		fp[i].fieldPointer = (void *)&IMU_RAW_RATEY;
 		break;
 	    case LOG_VOLTAGE2:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_RATEZ;
+		fp[i].fieldPointer = (void *)&IMU_RAW_RATEZ;
 		break;
 	    case LOG_VOLTAGE3:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_MAGX;
+		fp[i].fieldPointer = (void *)&IMU_RAW_MAGX;
 		break;
 	    case LOG_VOLTAGE4:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_MAGY;
+		fp[i].fieldPointer = (void *)&IMU_RAW_MAGY;
 		break;
 	    case LOG_VOLTAGE5:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_MAGZ;
+		fp[i].fieldPointer = (void *)&IMU_RAW_MAGZ;
 		break;
 	    case LOG_VOLTAGE6:
 #ifdef HAS_AIMU
-		loggerData.fp[i].fieldPointer = (void *)&adcData.voltages[6];
+		fp[i].fieldPointer = (void *)&adcData.voltages[6];
 #endif
 		break;
 	    case LOG_VOLTAGE7:
 #ifdef HAS_AIMU
-		loggerData.fp[i].fieldPointer = (void *)&adcData.voltages[7];
+		fp[i].fieldPointer = (void *)&adcData.voltages[7];
 #else
-		loggerData.fp[i].fieldPointer = (void *)&analogData.voltages[ANALOG_VOLTS_VIN];
+		fp[i].fieldPointer = (void *)&analogData.voltages[ANALOG_VOLTS_VIN];
 #endif
 		break;
 	    case LOG_VOLTAGE8:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_ACCX;
+		fp[i].fieldPointer = (void *)&IMU_RAW_ACCX;
 		break;
 	    case LOG_VOLTAGE9:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_ACCY;
+		fp[i].fieldPointer = (void *)&IMU_RAW_ACCY;
 		break;
 	    case LOG_VOLTAGE10:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RAW_ACCZ;
+		fp[i].fieldPointer = (void *)&IMU_RAW_ACCZ;
 		break;
 #ifdef HAS_AIMU
 	    case LOG_VOLTAGE11:
-		loggerData.fp[i].fieldPointer = (void *)&adcData.voltages[11];
+		fp[i].fieldPointer = (void *)&adcData.voltages[11];
 		break;
 	    case LOG_VOLTAGE12:
-		loggerData.fp[i].fieldPointer = (void *)&adcData.voltages[12];
+		fp[i].fieldPointer = (void *)&adcData.voltages[12];
 		break;
 	    case LOG_VOLTAGE13:
-		loggerData.fp[i].fieldPointer = (void *)&adcData.voltages[13];
+		fp[i].fieldPointer = (void *)&adcData.voltages[13];
 		break;
 	    case LOG_VOLTAGE14:
-		loggerData.fp[i].fieldPointer = (void *)&adcData.voltages[14];
+		fp[i].fieldPointer = (void *)&adcData.voltages[14];
 		break;
 #endif
 	    case LOG_IMU_RATEX:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RATEX;
+		fp[i].fieldPointer = (void *)&IMU_RATEX;
 		break;
 	    case LOG_IMU_RATEY:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RATEY;
+		fp[i].fieldPointer = (void *)&IMU_RATEY;
 		break;
 	    case LOG_IMU_RATEZ:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_RATEZ;
+		fp[i].fieldPointer = (void *)&IMU_RATEZ;
 		break;
 	    case LOG_IMU_ACCX:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_ACCX;
+		fp[i].fieldPointer = (void *)&IMU_ACCX;
 		break;
 	    case LOG_IMU_ACCY:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_ACCY;
+		fp[i].fieldPointer = (void *)&IMU_ACCY;
 		break;
 	    case LOG_IMU_ACCZ:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_ACCZ;
+		fp[i].fieldPointer = (void *)&IMU_ACCZ;
 		break;
 	    case LOG_IMU_MAGX:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_MAGX;
+		fp[i].fieldPointer = (void *)&IMU_MAGX;
 		break;
 	    case LOG_IMU_MAGY:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_MAGY;
+		fp[i].fieldPointer = (void *)&IMU_MAGY;
 		break;
 	    case LOG_IMU_MAGZ:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_MAGZ;
+		fp[i].fieldPointer = (void *)&IMU_MAGZ;
 		break;
 	    case LOG_GPS_PDOP:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.pDOP;
+		fp[i].fieldPointer = (void *)&gpsData.pDOP;
 		break;
 	    case LOG_GPS_HDOP:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.hDOP;
+		fp[i].fieldPointer = (void *)&gpsData.hDOP;
 		break;
 	    case LOG_GPS_VDOP:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.vDOP;
+		fp[i].fieldPointer = (void *)&gpsData.vDOP;
 		break;
 	    case LOG_GPS_TDOP:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.tDOP;
+		fp[i].fieldPointer = (void *)&gpsData.tDOP;
 		break;
 	    case LOG_GPS_NDOP:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.nDOP;
+		fp[i].fieldPointer = (void *)&gpsData.nDOP;
 		break;
 	    case LOG_GPS_EDOP:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.eDOP;
+		fp[i].fieldPointer = (void *)&gpsData.eDOP;
 		break;
 	    case LOG_GPS_ITOW:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.iTOW;
+		fp[i].fieldPointer = (void *)&gpsData.iTOW;
 		break;
 	    case LOG_GPS_POS_UPDATE:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.lastPosUpdate;
+		fp[i].fieldPointer = (void *)&gpsData.lastPosUpdate;
 		break;
 	    case LOG_GPS_LAT:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.lat;
+		fp[i].fieldPointer = (void *)&gpsData.lat;
 		break;
 	    case LOG_GPS_LON:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.lon;
+		fp[i].fieldPointer = (void *)&gpsData.lon;
 		break;
 	    case LOG_GPS_HEIGHT:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.height;
+		fp[i].fieldPointer = (void *)&gpsData.height;
 		break;
 	    case LOG_GPS_HACC:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.hAcc;
+		fp[i].fieldPointer = (void *)&gpsData.hAcc;
 		break;
 	    case LOG_GPS_VACC:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.vAcc;
+		fp[i].fieldPointer = (void *)&gpsData.vAcc;
 		break;
 	    case LOG_GPS_VEL_UPDATE:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.lastVelUpdate;
+		fp[i].fieldPointer = (void *)&gpsData.lastVelUpdate;
 		break;
 	    case LOG_GPS_VELN:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.velN;
+		fp[i].fieldPointer = (void *)&gpsData.velN;
 		break;
 	    case LOG_GPS_VELE:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.velE;
+		fp[i].fieldPointer = (void *)&gpsData.velE;
 		break;
 	    case LOG_GPS_VELD:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.velD;
+		fp[i].fieldPointer = (void *)&gpsData.velD;
 		break;
 	    case LOG_GPS_SACC:
-		loggerData.fp[i].fieldPointer = (void *)&gpsData.sAcc;
+		fp[i].fieldPointer = (void *)&gpsData.sAcc;
 		break;
 	    case LOG_ADC_PRESSURE1:
-		loggerData.fp[i].fieldPointer = (void *)&AQ_PRESSURE;
+		fp[i].fieldPointer = (void *)&AQ_PRESSURE;
 		break;
 #ifdef HAS_AIMU
 	    case LOG_ADC_PRESSURE2:
-		loggerData.fp[i].fieldPointer = (void *)&adcData.pressure2;
+		fp[i].fieldPointer = (void *)&adcData.pressure2;
 		break;
 #endif
 	    case LOG_ADC_TEMP0:
-		loggerData.fp[i].fieldPointer = (void *)&IMU_TEMP;
+		fp[i].fieldPointer = (void *)&IMU_TEMP;
 		break;
 	    case LOG_ADC_VIN:
-		loggerData.fp[i].fieldPointer = (void *)&analogData.vIn;
+		fp[i].fieldPointer = (void *)&analogData.vIn;
 		break;
 #ifdef HAS_AIMU
 	    case LOG_ADC_MAG_SIGN:
-		loggerData.fp[i].fieldPointer = (void *)&adcData.magSign;
+		fp[i].fieldPointer = (void *)&adcData.magSign;
 		break;
 #endif
 	    case LOG_UKF_Q1:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_Q1;
+		fp[i].fieldPointer = (void *)&UKF_Q1;
 		break;
 	    case LOG_UKF_Q2:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_Q2;
+		fp[i].fieldPointer = (void *)&UKF_Q2;
 		break;
 	    case LOG_UKF_Q3:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_Q3;
+		fp[i].fieldPointer = (void *)&UKF_Q3;
 		break;
 	    case LOG_UKF_Q4:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_Q4;
+		fp[i].fieldPointer = (void *)&UKF_Q4;
 		break;
 	    case LOG_UKF_POSN:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_POSN;
+		fp[i].fieldPointer = (void *)&UKF_POSN;
 		break;
 	    case LOG_UKF_POSE:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_POSE;
+		fp[i].fieldPointer = (void *)&UKF_POSE;
 		break;
 	    case LOG_UKF_POSD:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_POSD;
+		fp[i].fieldPointer = (void *)&UKF_POSD;
 		break;
 	    case LOG_UKF_PRES_ALT:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_PRES_ALT;
+		fp[i].fieldPointer = (void *)&UKF_PRES_ALT;
 		break;
 	    case LOG_UKF_ALT:
-		loggerData.fp[i].fieldPointer = (void *)&ALT_POS;
+		fp[i].fieldPointer = (void *)&ALT_POS;
 		break;
 	    case LOG_UKF_ALT_VEL:
-		loggerData.fp[i].fieldPointer = (void *)&ALT_VEL;
+		fp[i].fieldPointer = (void *)&ALT_VEL;
 		break;
 	    case LOG_UKF_VELN:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_VELN;
+		fp[i].fieldPointer = (void *)&UKF_VELN;
 		break;
 	    case LOG_UKF_VELE:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_VELE;
+		fp[i].fieldPointer = (void *)&UKF_VELE;
 		break;
 	    case LOG_UKF_VELD:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_VELD;
+		fp[i].fieldPointer = (void *)&UKF_VELD;
 		break;
 	    case LOG_MOT_MOTOR0:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[0];
+		fp[i].fieldPointer = (void *)&motorsData.value[0];
 		break;
 	    case LOG_MOT_MOTOR1:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[1];
+		fp[i].fieldPointer = (void *)&motorsData.value[1];
 		break;
 	    case LOG_MOT_MOTOR2:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[2];
+		fp[i].fieldPointer = (void *)&motorsData.value[2];
 		break;
 	    case LOG_MOT_MOTOR3:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[3];
+		fp[i].fieldPointer = (void *)&motorsData.value[3];
 		break;
 	    case LOG_MOT_MOTOR4:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[4];
+		fp[i].fieldPointer = (void *)&motorsData.value[4];
 		break;
 	    case LOG_MOT_MOTOR5:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[5];
+		fp[i].fieldPointer = (void *)&motorsData.value[5];
 		break;
 	    case LOG_MOT_MOTOR6:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[6];
+		fp[i].fieldPointer = (void *)&motorsData.value[6];
 		break;
 	    case LOG_MOT_MOTOR7:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[7];
+		fp[i].fieldPointer = (void *)&motorsData.value[7];
 		break;
 	    case LOG_MOT_MOTOR8:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[8];
+		fp[i].fieldPointer = (void *)&motorsData.value[8];
 		break;
 	    case LOG_MOT_MOTOR9:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[9];
+		fp[i].fieldPointer = (void *)&motorsData.value[9];
 		break;
 	    case LOG_MOT_MOTOR10:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[10];
+		fp[i].fieldPointer = (void *)&motorsData.value[10];
 		break;
 	    case LOG_MOT_MOTOR11:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[11];
+		fp[i].fieldPointer = (void *)&motorsData.value[11];
 		break;
 	    case LOG_MOT_MOTOR12:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[12];
+		fp[i].fieldPointer = (void *)&motorsData.value[12];
 		break;
 	    case LOG_MOT_MOTOR13:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.value[13];
+		fp[i].fieldPointer = (void *)&motorsData.value[13];
 		break;
 	    case LOG_MOT_THROTTLE:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.throttle;
+		fp[i].fieldPointer = (void *)&motorsData.throttle;
 		break;
 	    case LOG_MOT_PITCH:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.pitch;
+		fp[i].fieldPointer = (void *)&motorsData.pitch;
 		break;
 	    case LOG_MOT_ROLL:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.roll;
+		fp[i].fieldPointer = (void *)&motorsData.roll;
 		break;
 	    case LOG_MOT_YAW:
-		loggerData.fp[i].fieldPointer = (void *)&motorsData.yaw;
+		fp[i].fieldPointer = (void *)&motorsData.yaw;
 		break;
 	    case LOG_RADIO_QUALITY:
-		loggerData.fp[i].fieldPointer = (void *)&RADIO_QUALITY;
+		fp[i].fieldPointer = (void *)&RADIO_QUALITY;
 		break;
 	    case LOG_RADIO_CHANNEL0:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[0];
+		fp[i].fieldPointer = (void *)&radioData.channels[0];
 		break;
 	    case LOG_RADIO_CHANNEL1:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[1];
+		fp[i].fieldPointer = (void *)&radioData.channels[1];
 		break;
 	    case LOG_RADIO_CHANNEL2:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[2];
+		fp[i].fieldPointer = (void *)&radioData.channels[2];
 		break;
 	    case LOG_RADIO_CHANNEL3:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[3];
+		fp[i].fieldPointer = (void *)&radioData.channels[3];
 		break;
 	    case LOG_RADIO_CHANNEL4:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[4];
+		fp[i].fieldPointer = (void *)&radioData.channels[4];
 		break;
 	    case LOG_RADIO_CHANNEL5:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[5];
+		fp[i].fieldPointer = (void *)&radioData.channels[5];
 		break;
 	    case LOG_RADIO_CHANNEL6:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[6];
+		fp[i].fieldPointer = (void *)&radioData.channels[6];
 		break;
 	    case LOG_RADIO_CHANNEL7:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[7];
+		fp[i].fieldPointer = (void *)&radioData.channels[7];
 		break;
 	    case LOG_RADIO_CHANNEL8:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[8];
+		fp[i].fieldPointer = (void *)&radioData.channels[8];
 		break;
 	    case LOG_RADIO_CHANNEL9:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[9];
+		fp[i].fieldPointer = (void *)&radioData.channels[9];
 		break;
 	    case LOG_RADIO_CHANNEL10:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[10];
+		fp[i].fieldPointer = (void *)&radioData.channels[10];
 		break;
 	    case LOG_RADIO_CHANNEL11:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[11];
+		fp[i].fieldPointer = (void *)&radioData.channels[11];
 		break;
 	    case LOG_RADIO_CHANNEL12:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[12];
+		fp[i].fieldPointer = (void *)&radioData.channels[12];
 		break;
 	    case LOG_RADIO_CHANNEL13:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[13];
+		fp[i].fieldPointer = (void *)&radioData.channels[13];
 		break;
 	    case LOG_RADIO_CHANNEL14:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[14];
+		fp[i].fieldPointer = (void *)&radioData.channels[14];
 		break;
 	    case LOG_RADIO_CHANNEL15:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[15];
+		fp[i].fieldPointer = (void *)&radioData.channels[15];
 		break;
 	    case LOG_RADIO_CHANNEL16:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[16];
+		fp[i].fieldPointer = (void *)&radioData.channels[16];
 		break;
 	    case LOG_RADIO_CHANNEL17:
-		loggerData.fp[i].fieldPointer = (void *)&radioData.channels[17];
+		fp[i].fieldPointer = (void *)&radioData.channels[17];
 		break;
 	    case LOG_RADIO_ERRORS:
-		loggerData.fp[i].fieldPointer = (void *)&RADIO_ERROR_COUNT;
+		fp[i].fieldPointer = (void *)&RADIO_ERROR_COUNT;
 		break;
 	    case LOG_GMBL_TRIGGER:
-		loggerData.fp[i].fieldPointer = (void *)&gimbalData.triggerLogVal;
+		fp[i].fieldPointer = (void *)&gimbalData.triggerLogVal;
 		break;
 	    case LOG_ACC_BIAS_X:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_ACC_BIAS_X;
+		fp[i].fieldPointer = (void *)&UKF_ACC_BIAS_X;
 		break;
 	    case LOG_ACC_BIAS_Y:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_ACC_BIAS_Y;
+		fp[i].fieldPointer = (void *)&UKF_ACC_BIAS_Y;
 		break;
 	    case LOG_ACC_BIAS_Z:
-		loggerData.fp[i].fieldPointer = (void *)&UKF_ACC_BIAS_Z;
+		fp[i].fieldPointer = (void *)&UKF_ACC_BIAS_Z;
 		break;
 	    case LOG_CURRENT_PDB:
-		loggerData.fp[i].fieldPointer = (void *)&canSensorsData.values[CAN_SENSORS_PDB_BATA];
+		fp[i].fieldPointer = (void *)&canSensorsData.values[CAN_SENSORS_PDB_BATA];
 		break;
 	    case LOG_CURRENT_EXT:
-		loggerData.fp[i].fieldPointer = (void *)&analogData.extAmp;
+		fp[i].fieldPointer = (void *)&analogData.extAmp;
 		break;
 	    case LOG_VIN_PDB:
-		loggerData.fp[i].fieldPointer = (void *)&canSensorsData.values[CAN_SENSORS_PDB_BATV];
+		fp[i].fieldPointer = (void *)&canSensorsData.values[CAN_SENSORS_PDB_BATV];
+		break;
+	    case LOG_IMU_TIME:
+		fp[i].fieldPointer = (void *)&imuData.sensorTime;
+		break;
+	    case LOG_IMU_DT:
+		fp[i].fieldPointer = (void *)&imuData.dt;
+		break;
+	    case LOG_GPS_LAG:
+		fp[i].fieldPointer = (void *)&navUkfData.gpsLag;
 		break;
 	}
 
-	switch (loggerFields[i].fieldType) {
+	switch (fields[i].fieldType) {
 	    case LOG_TYPE_DOUBLE:
-		loggerData.fp[i].copyFunc = loggerCopy8;
-		loggerData.packetSize += 8;
+		fp[i].size = 8;
 		break;
 	    case LOG_TYPE_FLOAT:
 	    case LOG_TYPE_U32:
 	    case LOG_TYPE_S32:
-		loggerData.fp[i].copyFunc = loggerCopy4;
-		loggerData.packetSize += 4;
+		fp[i].size = 4;
 		break;
 	    case LOG_TYPE_U16:
 	    case LOG_TYPE_S16:
-		loggerData.fp[i].copyFunc = loggerCopy2;
-		loggerData.packetSize += 2;
+		fp[i].size = 2;
 		break;
 	    case LOG_TYPE_U8:
 	    case LOG_TYPE_S8:
-		loggerData.fp[i].copyFunc = loggerCopy1;
-		loggerData.packetSize += 1;
+		fp[i].size = 1;
 		break;
 	}
+	grp->packetSize += fp[i].size;
     }
+
+    loggerCompile(grp);
+}
+
+void loggerSetup(void) {
+    loggerSetupGroup(LOGGER_GROUP_MAIN, loggerFieldsMain, sizeof(loggerFieldsMain) / sizeof(loggerFields_t), 0.0f, 0);
+    loggerSetupGroup(LOGGER_GROUP_GPS, loggerFieldsGps, sizeof(loggerFieldsGps) / sizeof(loggerFields_t), 0.0f, &gpsData.lastVelUpdate);
+    loggerSetupGroup(LOGGER_GROUP_RADIO, loggerFieldsRadio, sizeof(loggerFieldsRadio) / sizeof(loggerFields_t), LOGGER_RATE_RADIO, 0);
+    loggerSetupGroup(LOGGER_GROUP_POWER, loggerFieldsPower, sizeof(loggerFieldsPower) / sizeof(loggerFields_t), LOGGER_RATE_POWER, 0);
 }
 
 void loggerInit(void) {
+    int i, size;
+
     memset((void *)&loggerData, 0, sizeof(loggerData));
 
     loggerSetup();
 
+    // staging for records which wrap the stream buffer, largest of any data or header record
+    size = 0;
+    for (i = 0; i < LOGGER_NUM_GROUPS; i++) {
+	if (loggerData.groups[i].packetSize > size)
+	    size = loggerData.groups[i].packetSize;
+	if (3 + 4 + loggerData.groups[i].numFields * sizeof(loggerFields_t) + 2 > size)
+	    size = 3 + 4 + loggerData.groups[i].numFields * sizeof(loggerFields_t) + 2;
+#ifdef USE_LOG_COMPRESS
+	// a block holds up to one frame past the flush threshold
+	loggerData.groups[i].prev = (uint64_t *)aqDataCalloc(loggerData.groups[i].numFields, sizeof(uint64_t));
+	loggerData.groups[i].block = (uint8_t *)aqDataCalloc(LOGGER_BLOCK_SIZE + loggerFrameMax(&loggerData.groups[i]), sizeof(uint8_t));
+	if (3 + 3 + LOGGER_BLOCK_SIZE + loggerFrameMax(&loggerData.groups[i]) + 2 > size)
+	    size = 3 + 3 + LOGGER_BLOCK_SIZE + loggerFrameMax(&loggerData.groups[i]) + 2;
+#endif
+    }
+    loggerData.recBuf = (TCHAR *)aqDataCalloc(size, sizeof(TCHAR));
+
     // skip the first 512 bytes (used exclusively by the USB MSC driver)
     loggerData.loggerBuf = (TCHAR *)(filerBuf + 512);
-    loggerData.bufSize = ((FILER_BUF_SIZE-512) / loggerData.packetSize / FILER_FLUSH_THRESHOLD) * loggerData.packetSize * FILER_FLUSH_THRESHOLD;
+    loggerData.bufSize = FILER_BUF_SIZE-512;
 
     loggerData.logHandle = filerGetHandle(LOGGER_FNAME);
     filerStream(loggerData.logHandle, loggerData.loggerBuf, loggerData.bufSize);
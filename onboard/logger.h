@@ -23,6 +23,18 @@
 #include <CoOS.h>
 
 #define LOGGER_FNAME			"AQL"
+#define LOGGER_RATE_RADIO		50	// Hz
+#define LOGGER_RATE_POWER		10	// Hz
+#define LOGGER_BLOCK_SIZE		512	// compressed payload bytes per AqC block
+
+// field groups, each with its own record rate
+enum {
+    LOGGER_GROUP_MAIN = 0,		// every run loop, original AqH/AqM records
+    LOGGER_GROUP_GPS,			// on each GPS velocity update
+    LOGGER_GROUP_RADIO,
+    LOGGER_GROUP_POWER,
+    LOGGER_NUM_GROUPS
+};
 
 enum {
     LOG_LASTUPDATE = 0,
@@ -133,6 +145,9 @@ enum {
     LOG_CURRENT_EXT,
     LOG_VIN_PDB,
     LOG_UKF_ALT_VEL,
+    LOG_IMU_TIME,
+    LOG_IMU_DT,
+    LOG_GPS_LAG,
     LOG_NUM_IDS
 };
 
@@ -154,15 +169,39 @@ typedef struct {
 
 typedef struct {
     void *fieldPointer;
-    int (*copyFunc)(void *, void *);
+    uint8_t size;
 } fieldData_t;
 
 typedef struct {
-    TCHAR *loggerBuf;
-    uint32_t bufSize;
+    void *src;
+    uint16_t len;
+} loggerRun_t;
+
+typedef struct {
+    loggerFields_t *fields;
     fieldData_t *fp;
+    loggerRun_t *runs;
+    unsigned long *trigger;		// record whenever this changes
+    unsigned long lastTrigger;
     uint16_t packetSize;
+    uint16_t rate;			// run loops per record
+#ifdef USE_LOG_COMPRESS
+    uint64_t *prev;			// predictors, reset at each block
+    uint8_t *block;
+    uint16_t blockLen;
+#endif
     uint8_t numFields;
+    uint8_t numRuns;
+} loggerGroup_t;
+
+typedef struct {
+    TCHAR *loggerBuf;
+    TCHAR *recBuf;
+    uint32_t bufSize;
+    loggerGroup_t groups[LOGGER_NUM_GROUPS];
+    uint32_t loops;
+    int32_t recHead;
+    uint16_t recSize;
     uint8_t logHandle;
 } loggerStruct_t;
 
@@ -170,5 +209,6 @@ extern loggerStruct_t loggerData;
 extern void loggerInit(void);
 extern void loggerDo(void);
 extern void loggerDoHeader(void);
+extern void loggerChecksum(const uint8_t *buf, int len, uint8_t *ckA, uint8_t *ckB);
 
 #endif
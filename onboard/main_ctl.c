@@ -33,6 +33,10 @@ int main(void) {
 
     rccConfiguration();
 
+#if CFG_TASK_STATS_EN > 0
+    utilTaskStatsInit();
+#endif
+
     NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
 
     CoInitOS();
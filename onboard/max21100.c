@@ -31,6 +31,7 @@
 max21100Struct_t max21100Data;
 
 static void max21100TransferComplete(int unused) {
+    max21100Data.sampleTime = max21100Data.drdyTime;
     max21100Data.slot = (max21100Data.slot + 1) % MAX21100_SLOTS;
 }
 
@@ -244,8 +245,10 @@ static void max21100ReliablySetReg(uint8_t reg, uint8_t val) {
 }
 
 void max21100IntHandler(void) {
-    if (max21100Data.enabled)
+    if (max21100Data.enabled) {
+        max21100Data.drdyTime = timerMicros();
         spiTransaction(max21100Data.spi, &max21100Data.rxBuf[max21100Data.slot*MAX21100_SLOT_SIZE], &max21100Data.readReg, MAX21100_BYTES);
+    }
 }
 
 inline void max21100Enable(void) {
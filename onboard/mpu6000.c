@@ -31,6 +31,7 @@
 mpu6000Struct_t mpu6000Data;
 
 static void mpu6000TransferComplete(int unused) {
+    mpu6000Data.sampleTime = mpu6000Data.drdyTime;
     mpu6000Data.slot = (mpu6000Data.slot + 1) % MPU6000_SLOTS;
 }
 
@@ -244,8 +245,10 @@ static void mpu6000ReliablySetReg(uint8_t reg, uint8_t val) {
 }
 
 static void mpu6000IntHandler(void) {
-    if (mpu6000Data.enabled)
+    if (mpu6000Data.enabled) {
+        mpu6000Data.drdyTime = timerMicros();
         spiTransaction(mpu6000Data.spi, &mpu6000Data.rxBuf[mpu6000Data.slot*MPU6000_SLOT_SIZE], &mpu6000Data.readReg, MPU6000_BYTES);
+    }
 }
 
 inline void mpu6000Enable(void) {
@@ -55,6 +55,8 @@ typedef struct {
     volatile float gyo[3];
     volatile float dRateGyo[3];
     volatile uint32_t lastUpdate;
+    volatile uint32_t drdyTime;		// DRDY timestamp of the transfer in progress
+    volatile uint32_t sampleTime;	// DRDY timestamp of the newest completed slot
     float accSign[3];
     float gyoSign[3];
     uint8_t readReg;
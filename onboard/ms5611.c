@@ -79,94 +79,136 @@ void ms5611InitialBias(void) {
 
 static void ms5611Callback(int unused) {
     static uint8_t rxBuf[1];
+    uint8_t *ptr;
+    uint32_t val;
+    uint8_t i;
 
     if (ms5611Data.enabled) {
 	switch (ms5611Data.step) {
+	    case 3:
+		// conversion result
+		ptr = (uint8_t *)&ms5611Data.rxBuf;
+		val = (ptr[1]<<16 | ptr[2]<<8 | ptr[3]);
+
+		if (ms5611Data.convTemp) {
+		    ms5611Data.d2 = val;
+		    ms5611Data.d2Seq++;
+		}
+		else {
+		    i = ms5611Data.d1Head & (MS5611_SLOTS-1);
+		    ms5611Data.d1[i] = val;
+		    ms5611Data.d1Time[i] = ms5611Data.convTime;
+		    ms5611Data.d1Head++;
+		}
+		// start the next conversion right away
+
 	    case 0:
-		// temp conversion
-		spiTransaction(ms5611Data.spi, &rxBuf[0], &ms5611Data.startTempConv, 1);
-		dIMUSetAlarm1(9040, ms5611Callback, 0);
-//		dIMUSetAlarm1(600, ms5611Callback, 0);
+		// temperature every MS5611_TEMP_RATE pressure conversions
+		ms5611Data.convTemp = (ms5611Data.presCount >= MS5611_TEMP_RATE);
+		if (ms5611Data.convTemp)
+		    ms5611Data.presCount = 0;
+		else
+		    ms5611Data.presCount++;
+
+		ms5611Data.convTime = timerMicros();
+		spiTransaction(ms5611Data.spi, &rxBuf[0], ms5611Data.convTemp ? &ms5611Data.startTempConv : &ms5611Data.startPresConv, 1);
+		dIMUSetAlarm1(MS5611_CONV_TIME, ms5611Callback, 0);
+		ms5611Data.step = 1;
 		break;
 
 	    case 1:
-		ms5611Data.slot = (ms5611Data.slot + 1) % MS5611_SLOTS;
+		// command sent, wait for conversion alarm
+		ms5611Data.step = 2;
 		break;
 
 	    case 2:
-		// temp result
-		spiTransaction(ms5611Data.spi, &ms5611Data.d2[ms5611Data.slot], &ms5611Data.adcRead, 4);
+		// read result
+		spiTransaction(ms5611Data.spi, &ms5611Data.rxBuf, &ms5611Data.adcRead, 4);
+		ms5611Data.step = 3;
 		break;
+	}
+    }
+}
 
-	    case 3:
-		// pres conversion
-		spiTransaction(ms5611Data.spi, &rxBuf[0], &ms5611Data.startPresConv, 1);
-		dIMUSetAlarm1(9040, ms5611Callback, 0);
-//		dIMUSetAlarm1(600, ms5611Callback, 0);
-		break;
+// freshest compensated sample, or the median of the last MS5611_MEDIAN
+static void ms5611Output(void) {
+    ms5611Sample_t *s[MS5611_MEDIAN], *t;
+    int n, i, j;
 
-	    case 4:
-		break;
+    n = (ms5611Data.sampleCount < MS5611_MEDIAN) ? ms5611Data.sampleCount : MS5611_MEDIAN;
 
-	    case 5:
-		// press result
-		spiTransaction(ms5611Data.spi, &ms5611Data.d1[ms5611Data.slot], &ms5611Data.adcRead, 4);
-		break;
-	}
+    for (i = 0; i < n; i++)
+	s[i] = &ms5611Data.samples[(ms5611Data.sampleHead - 1 - i) & (MS5611_SLOTS-1)];
 
-	ms5611Data.step = (ms5611Data.step + 1) % 6;
+    for (i = 1; i < n; i++) {
+	t = s[i];
+	for (j = i; j > 0 && s[j-1]->pres > t->pres; j--)
+	    s[j] = s[j-1];
+	s[j] = t;
     }
+
+    ms5611Data.pres = s[n/2]->pres;
+    ms5611Data.sampleTime = s[n/2]->time;
 }
 
 void ms5611Decode(void) {
-    uint32_t rawTemp, rawPres;
-    uint8_t *ptr;
-    int32_t dT;
+    ms5611Sample_t *s;
+    uint32_t rawPres;
     int32_t temp;
     int64_t off;
     int64_t sens;
-    int divisor;
-    int i;
+    uint8_t head;
 
-    if (ms5611Data.enabled) {
-      rawTemp = 0;
-      rawPres = 0;
-      divisor = MS5611_SLOTS;
-      for (i = 0; i < MS5611_SLOTS; i++) {
-          // check if we are in the middle of a transaction for this slot
-          if (i == ms5611Data.slot && ms5611Data.spiFlag == 0) {
-              divisor--;
-          }
-          else {
-              ptr = (uint8_t *)&ms5611Data.d2[i];
-              rawTemp += (ptr[1]<<16 | ptr[2]<<8 | ptr[3]);
-
-              ptr = (uint8_t *)&ms5611Data.d1[i];
-              rawPres += (ptr[1]<<16 | ptr[2]<<8 | ptr[3]);
-          }
+    if (ms5611Data.enabled && ms5611Data.d2) {
+      // temperature
+      if (ms5611Data.d2Seq != ms5611Data.d2Last) {
+          ms5611Data.d2Last = ms5611Data.d2Seq;
+
+          ms5611Data.dT = ms5611Data.d2 - (ms5611Data.p[5]<<8);
+          temp = (int64_t)ms5611Data.dT * ms5611Data.p[6] / (1<<23) + 2000;
+          ms5611Data.rawTemp = temp / 100.0f;
+
+          ms5611Data.temp = utilFilter(&ms5611Data.tempFilter, ms5611Data.rawTemp);
       }
 
-      // temperature
-      dT = rawTemp / divisor - (ms5611Data.p[5]<<8);
-      temp = (int64_t)dT * ms5611Data.p[6] / (1<<23) + 2000;
-      ms5611Data.rawTemp = temp / 100.0f;
+      head = ms5611Data.d1Head;
+      if (head == ms5611Data.d1Tail)
+          return;
 
-      ms5611Data.temp = utilFilter(&ms5611Data.tempFilter, ms5611Data.rawTemp);
+      if ((uint8_t)(head - ms5611Data.d1Tail) > MS5611_SLOTS) {
+          ms5611Data.d1Tail = head - MS5611_SLOTS;
+          ms5611Data.overruns++;
+      }
 
       // pressure
-      off = ((int64_t)ms5611Data.p[2]<<16) + (((int64_t)dT * ms5611Data.p[4])>>7);
+      off = ((int64_t)ms5611Data.p[2]<<16) + (((int64_t)ms5611Data.dT * ms5611Data.p[4])>>7);
       if (off < -8589672450)
           off = -8589672450;
       else if (off > 12884705280)
           off = 12884705280;
 
-      sens = ((int64_t)ms5611Data.p[1]<<15) + (((int64_t)dT * ms5611Data.p[3])>>8);
+      sens = ((int64_t)ms5611Data.p[1]<<15) + (((int64_t)ms5611Data.dT * ms5611Data.p[3])>>8);
       if (sens < -4294836225)
           sens = -4294836225;
       else if (sens > 6442352640)
           sens = 6442352640;
 
-      ms5611Data.pres = ((int64_t)rawPres * sens / (1<<21) / divisor - off) * (1.0f / (1<<15));
+      // compensate each new sample into the output ring
+      while (ms5611Data.d1Tail != head) {
+          rawPres = ms5611Data.d1[ms5611Data.d1Tail & (MS5611_SLOTS-1)];
+
+          s = &ms5611Data.samples[ms5611Data.sampleHead];
+          s->pres = ((int64_t)rawPres * sens / (1<<21) - off) * (1.0f / (1<<15));
+          s->time = ms5611Data.d1Time[ms5611Data.d1Tail & (MS5611_SLOTS-1)];
+
+          ms5611Data.sampleHead = (ms5611Data.sampleHead + 1) & (MS5611_SLOTS-1);
+          if (ms5611Data.sampleCount < MS5611_SLOTS)
+              ms5611Data.sampleCount++;
+
+          ms5611Data.d1Tail++;
+      }
+
+      ms5611Output();
 
       ms5611Data.lastUpdate = timerMicros();
     }
@@ -176,6 +218,7 @@ void ms5611Enable(void) {
     if (ms5611Data.initialized && !ms5611Data.enabled) {
 	ms5611Data.enabled = 1;
 	ms5611Data.step = 0;
+	ms5611Data.presCount = MS5611_TEMP_RATE;	// start with a temperature conversion
 	ms5611Callback(0);
     }
 }
@@ -222,7 +265,7 @@ static uint8_t ms5611CheckSum(void) {
 uint8_t ms5611Init(void) {
     int i, j;
 
-    utilFilterInit(&ms5611Data.tempFilter, (1.0f / 13.0f), DIMU_TEMP_TAU, IMU_ROOM_TEMP);
+    utilFilterInit(&ms5611Data.tempFilter, (MS5611_CONV_TIME * (MS5611_TEMP_RATE + 1)) * (1.0f / AQ_US_PER_SEC), DIMU_TEMP_TAU, IMU_ROOM_TEMP);
 
     j = MS5611_RETRIES;
     do {
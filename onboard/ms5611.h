@@ -25,27 +25,50 @@
 
 #define MS5611_SPI_BAUD		    SPI_BaudRatePrescaler_4	// 10.5Mhz
 
-#define MS5611_SLOTS		    8				// ~13 Hz
+#define MS5611_SLOTS		    8				// raw & compensated sample rings, power of 2
 #define MS5611_RETRIES              5
 
+#define MS5611_CONV_TIME	    9040			// us, 4096 OSR
+#define MS5611_TEMP_RATE	    8				// pressure conversions per temperature conversion (~12 Hz temp, ~98 Hz pres)
+#define MS5611_MEDIAN		    3				// samples in the output median, 1 = freshest sample only
+
+typedef struct {
+    float pres;
+    uint32_t time;
+} ms5611Sample_t;
+
 typedef struct {
     utilFilter_t tempFilter;
     spiClient_t *spi;
     volatile uint32_t spiFlag;
-    volatile uint32_t d1[MS5611_SLOTS];
-    volatile uint32_t d2[MS5611_SLOTS];
+    volatile uint32_t rxBuf;
+    volatile uint32_t d1[MS5611_SLOTS];		// raw pressure ring, filled by the conversion callback
+    volatile uint32_t d1Time[MS5611_SLOTS];
+    volatile uint32_t d2;			// newest raw temperature
+    volatile uint8_t d1Head;
+    volatile uint8_t d2Seq;
+    uint8_t d1Tail;
+    uint8_t d2Last;
+    ms5611Sample_t samples[MS5611_SLOTS];	// compensated pressure ring
+    uint8_t sampleHead;
+    uint8_t sampleCount;
     uint16_t p[8];
-    volatile uint8_t slot;
     uint8_t step;
+    uint8_t presCount;
+    uint8_t convTemp;
     uint8_t enabled;
     uint8_t startTempConv;
     uint8_t startPresConv;
     uint8_t adcRead;
     uint8_t initialized;
+    int32_t dT;
     float rawTemp;
     volatile float temp;
     volatile float pres;
     volatile uint32_t lastUpdate;
+    uint32_t convTime;			// start of the conversion in progress
+    volatile uint32_t sampleTime;	// start of the conversion behind pres
+    uint32_t overruns;
 } ms5611Struct_t;
 
 extern ms5611Struct_t ms5611Data;
@@ -29,6 +29,7 @@
 #ifndef __CC_ARM
 #include <intrinsics.h>
 #endif
+#include <string.h>
 
 navUkfStruct_t navUkfData;
 
@@ -404,7 +405,8 @@ void navUkfInertialUpdate(void) {
     u[4] = IMU_RATEY;
     u[5] = IMU_RATEZ;
 
-    srcdkfTimeUpdate(navUkfData.kf, u, AQ_OUTER_TIMESTEP);
+    // integrate over the measured sensor timestep
+    srcdkfTimeUpdate(navUkfData.kf, u, imuData.dt);
 
     // store history
     navUkfData.posN[navUkfData.navHistIndex] = UKF_POSN;
@@ -415,6 +417,10 @@ void navUkfInertialUpdate(void) {
     navUkfData.velE[navUkfData.navHistIndex] = UKF_VELE;
     navUkfData.velD[navUkfData.navHistIndex] = UKF_VELD;
 
+    navUkfData.presAlt[navUkfData.navHistIndex] = UKF_PRES_ALT;
+
+    navUkfData.histTime[navUkfData.navHistIndex] = imuData.sensorTime;
+
     navUkfData.navHistIndex = (navUkfData.navHistIndex + 1) % UKF_HIST;
 }
 
@@ -430,9 +436,29 @@ void navUkfZeroRate(float rate, int axis) {
     srcdkfMeasurementUpdate(navUkfData.kf, u, y, 1, 1, noise, navUkfRateUpdate);
 }
 
-void simDoPresUpdate(float pres) {
+// find the newest history entry sampled at or before the given time
+static int navUkfHistIndex(uint32_t micros) {
+    int histIndex;
+    int i;
+
+    histIndex = navUkfData.navHistIndex;
+    for (i = 0; i < UKF_HIST; i++) {
+	if (--histIndex < 0)
+	    histIndex = UKF_HIST - 1;
+
+	if ((int32_t)(micros - navUkfData.histTime[histIndex]) >= 0)
+	    break;
+    }
+
+    // falls through to the oldest entry if none is old enough
+    return histIndex;
+}
+
+void simDoPresUpdate(uint32_t presMicros, float pres) {
     float noise[2];        // measurement variance
     float y[2];            // measurment(s)
+    float altDelta[2];
+    int histIndex;
 
     noise[0] = UKF_ALT_N;
 
@@ -441,12 +467,24 @@ void simDoPresUpdate(float pres) {
     y[0] = navUkfPresToAlt(pres);
     y[1] = y[0];
 
+    // the pressure sample is older than the current state, update the altitudes it saw
+    histIndex = navUkfHistIndex(presMicros);
+
+    altDelta[0] = UKF_PRES_ALT - navUkfData.presAlt[histIndex];
+    altDelta[1] = UKF_POSD - navUkfData.posD[histIndex];
+
+    UKF_PRES_ALT = navUkfData.presAlt[histIndex];
+    UKF_POSD = navUkfData.posD[histIndex];
+
     // if GPS altitude data has been available, only update pressure altitude
     if (navData.presAltOffset != 0.0f)
 	srcdkfMeasurementUpdate(navUkfData.kf, 0, y, 1, 1, noise, navUkfPresUpdate);
     // otherwise update pressure and GPS altitude from the single pressure reading
     else
 	srcdkfMeasurementUpdate(navUkfData.kf, 0, y, 2, 2, noise, navUkfPresGPSAltUpdate);
+
+    UKF_PRES_ALT += altDelta[0];
+    UKF_POSD += altDelta[1];
 }
 
 void simDoAccUpdate(float accX, float accY, float accZ) {
@@ -539,12 +577,7 @@ void navUkfGpsPosUpdate(uint32_t gpsMicros, double lat, double lon, float alt, f
 	y[2] = alt;
 
 	// determine how far back this GPS position update came from
-	histIndex = (timerMicros() - (gpsMicros + UKF_POS_DELAY)) / (int)(1e6f * AQ_OUTER_TIMESTEP);
-	histIndex = navUkfData.navHistIndex - histIndex;
-	if (histIndex < 0)
-	    histIndex += UKF_HIST;
-	if (histIndex < 0 || histIndex >= UKF_HIST)
-	    histIndex = 0;
+	histIndex = navUkfHistIndex(gpsMicros + (int32_t)UKF_POS_DELAY + (int32_t)navUkfData.gpsLag);
 
 	// calculate delta from current position
 	posDelta[0] = UKF_POSN - navUkfData.posN[histIndex];
@@ -612,23 +645,92 @@ void navUkfZeroVel(void) {
     srcdkfMeasurementUpdate(navUkfData.kf, 0, y, 3, 3, noise, navUkfVelUpdate);
 }
 
+/*
+    Estimate the real GPS delay by cross correlating horizontal GPS
+    acceleration (differenced velocity) with UKF acceleration taken
+    from the history at each candidate delay.  Only maneuvering samples
+    enter the window, the correlation peak (refined by a parabolic fit)
+    is filtered into gpsLag which shifts both history lookups.
+*/
+static void navUkfGpsLagUpdate(uint32_t gpsMicros, float velN, float velE) {
+    float ukfVel[UKF_LAG_NUM][2];
+    float r[UKF_LAG_NUM];
+    float dt, gN, gE, uN, uE;
+    float lag, d;
+    uint32_t micros;
+    int histIndex, best;
+    int i;
+
+    for (i = 0; i < UKF_LAG_NUM; i++) {
+	micros = gpsMicros + (int32_t)UKF_VEL_DELAY + (i - UKF_LAG_NUM/2) * UKF_LAG_STEP;
+	histIndex = navUkfHistIndex(micros);
+
+	// history does not reach back far enough
+	if ((int32_t)(micros - navUkfData.histTime[histIndex]) < 0) {
+	    navUkfData.lagMicros = 0;
+	    return;
+	}
+
+	ukfVel[i][0] = navUkfData.velN[histIndex];
+	ukfVel[i][1] = navUkfData.velE[histIndex];
+    }
+
+    dt = (gpsMicros - navUkfData.lagMicros) * 1e-6f;
+
+    if (navUkfData.lagMicros && dt > 0.0f && dt < 0.5f && (supervisorData.state & STATE_FLYING)) {
+	gN = (velN - navUkfData.lagGpsVel[0]) / dt;
+	gE = (velE - navUkfData.lagGpsVel[1]) / dt;
+
+	if ((gN*gN + gE*gE) > (UKF_LAG_MIN_ACC*UKF_LAG_MIN_ACC)) {
+	    navUkfData.lagGpsEnergy = navUkfData.lagGpsEnergy * UKF_LAG_DECAY + gN*gN + gE*gE;
+
+	    best = 0;
+	    for (i = 0; i < UKF_LAG_NUM; i++) {
+		uN = (ukfVel[i][0] - navUkfData.lagUkfVel[i][0]) / dt;
+		uE = (ukfVel[i][1] - navUkfData.lagUkfVel[i][1]) / dt;
+
+		navUkfData.lagCorr[i] = navUkfData.lagCorr[i] * UKF_LAG_DECAY + gN*uN + gE*uE;
+		navUkfData.lagUkfEnergy[i] = navUkfData.lagUkfEnergy[i] * UKF_LAG_DECAY + uN*uN + uE*uE;
+
+		r[i] = navUkfData.lagCorr[i] / __sqrtf(navUkfData.lagGpsEnergy * navUkfData.lagUkfEnergy[i] + 1e-6f);
+		if (r[i] > r[best])
+		    best = i;
+	    }
+
+	    if (navUkfData.lagGpsEnergy > UKF_LAG_MIN_ENERGY && r[best] > UKF_LAG_MIN_CORR) {
+		lag = best - UKF_LAG_NUM/2;
+
+		if (best > 0 && best < UKF_LAG_NUM-1) {
+		    d = r[best-1] - 2.0f*r[best] + r[best+1];
+		    if (d < 0.0f)
+			lag += 0.5f * (r[best-1] - r[best+1]) / d;
+		}
+
+		navUkfData.gpsLag += (lag * UKF_LAG_STEP - navUkfData.gpsLag) * UKF_LAG_GAIN;
+	    }
+	}
+    }
+
+    navUkfData.lagMicros = gpsMicros;
+    navUkfData.lagGpsVel[0] = velN;
+    navUkfData.lagGpsVel[1] = velE;
+    memcpy(navUkfData.lagUkfVel, ukfVel, sizeof(ukfVel));
+}
+
 void navUkfGpsVelUpdate(uint32_t gpsMicros, float velN, float velE, float velD, float sAcc) {
     float y[3];
     float noise[3];
     float velDelta[3];
     int histIndex;
 
+    navUkfGpsLagUpdate(gpsMicros, velN, velE);
+
     y[0] = velN;
     y[1] = velE;
     y[2] = velD;
 
     // determine how far back this GPS velocity update came from
-    histIndex = (timerMicros() - (gpsMicros + UKF_VEL_DELAY)) / (int)(1e6f * AQ_OUTER_TIMESTEP);
-    histIndex = navUkfData.navHistIndex - histIndex;
-    if (histIndex < 0)
-	histIndex += UKF_HIST;
-    if (histIndex < 0 || histIndex >= UKF_HIST)
-	histIndex = 0;
+    histIndex = navUkfHistIndex(gpsMicros + (int32_t)UKF_VEL_DELAY + (int32_t)navUkfData.gpsLag);
 
     // calculate delta from current position
     velDelta[0] = UKF_VELN - navUkfData.velN[histIndex];
@@ -865,6 +967,12 @@ void navUkfInitState(void) {
 
     UKF_PRES_ALT = navUkfPresToAlt(AQ_PRESSURE);
 
+    // pressure updates look back from the first loop
+    for (i = 0; i < UKF_HIST; i++) {
+	navUkfData.posD[i] = UKF_POSD;
+	navUkfData.presAlt[i] = UKF_PRES_ALT;
+    }
+
     // wait for lack of movement
     imuQuasiStatic(UKF_GYO_AVG_NUM);
 
@@ -88,7 +88,15 @@
 #define UKF_ALTITUDE	UKF_POSD
 #endif
 
-#define UKF_HIST		40
+#define UKF_HIST		64				    // must cover GPS_LATENCY + UKF_VEL_DELAY + the lag search span
+
+#define UKF_LAG_NUM		17				    // candidate GPS delays, centred on UKF_VEL_DELAY
+#define UKF_LAG_STEP		10000				    // us between candidates
+#define UKF_LAG_DECAY		0.98f				    // correlation window decay per maneuvering GPS sample
+#define UKF_LAG_MIN_ACC		0.5f				    // m/s^2 horizontal GPS acceleration to count as maneuvering
+#define UKF_LAG_MIN_ENERGY	50.0f				    // (m/s^2)^2 of GPS acceleration in the window before trusting it
+#define UKF_LAG_MIN_CORR	0.8f				    // normalized correlation of the peak
+#define UKF_LAG_GAIN		0.05f				    // estimate filter gain
 #define UKF_P0			101325.0f			    // standard static pressure at sea level
 
 #define UKF_FLOW_ROT		-90.0f				    // optical flow mounting rotation in degrees
@@ -107,7 +115,16 @@ typedef struct {
     float velN[UKF_HIST];
     float velE[UKF_HIST];
     float velD[UKF_HIST];
+    float presAlt[UKF_HIST];
+    uint32_t histTime[UKF_HIST];	// sensor timestamp of each history entry
     int navHistIndex;
+    float lagCorr[UKF_LAG_NUM];		// windowed GPS x UKF acceleration correlation per candidate delay
+    float lagUkfEnergy[UKF_LAG_NUM];
+    float lagGpsEnergy;
+    float lagUkfVel[UKF_LAG_NUM][2];	// UKF N/E velocity at each candidate delay for the previous GPS sample
+    float lagGpsVel[2];
+    uint32_t lagMicros;			// previous GPS velocity timestamp
+    float gpsLag;			// estimated correction (us) to UKF_POS_DELAY / UKF_VEL_DELAY
     float yaw, pitch, roll;
     float yawCos, yawSin;
     float *x;			// states
@@ -130,7 +147,7 @@ extern navUkfStruct_t navUkfData;
 
 extern void navUkfInit(void);
 extern void navUkfInertialUpdate(void);
-extern void simDoPresUpdate(float pres);
+extern void simDoPresUpdate(uint32_t presMicros, float pres);
 extern void simDoAccUpdate(float accX, float accY, float accZ);
 extern void simDoMagUpdate(float magX, float magY, float magZ);
 extern void navUkfGpsPosUpdate(uint32_t gpsMicros, double lat, double lon, float alt, float hAcc, float vAcc);
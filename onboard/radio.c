@@ -107,13 +107,20 @@ static void radioProcessInstance(radioInstance_t *r) {
 }
 
 void radioTaskCode(void *unused) {
+    serialPort_t *s = radioData.radioInstances[0].serialPort;
     int i;
 
     AQ_NOTICE("Radio task started\n");
 
     while (1) {
-	// wait for data
-	yield(2); // 2ms
+	// wait for data, a serial receiver wakes us at the end of each frame
+	if (s) {
+	    CoWaitForSingleFlag(s->waitFlag, 2);
+	    CoClearFlag(s->waitFlag);
+	}
+	else {
+	    yield(2); // 2ms
+	}
 
         for (i = 0; i < RADIO_NUM; i++) {
             radioInstance_t *r = &radioData.radioInstances[i];
@@ -58,48 +58,31 @@ void runTaskCode(void *unused) {
 	navUkfInertialUpdate();
 
 	// record history for acc & mag & pressure readings for smoothing purposes
-	// acc
-	runData.sumAcc[0] -= runData.accHist[0][runData.sensorHistIndex];
-	runData.sumAcc[1] -= runData.accHist[1][runData.sensorHistIndex];
-	runData.sumAcc[2] -= runData.accHist[2][runData.sensorHistIndex];
+	utilStatsAdd(&runData.accStats[0], IMU_ACCX);
+	utilStatsAdd(&runData.accStats[1], IMU_ACCY);
+	utilStatsAdd(&runData.accStats[2], IMU_ACCZ);
 
-	runData.accHist[0][runData.sensorHistIndex] = IMU_ACCX;
-	runData.accHist[1][runData.sensorHistIndex] = IMU_ACCY;
-	runData.accHist[2][runData.sensorHistIndex] = IMU_ACCZ;
+	utilStatsAdd(&runData.magStats[0], IMU_MAGX);
+	utilStatsAdd(&runData.magStats[1], IMU_MAGY);
+	utilStatsAdd(&runData.magStats[2], IMU_MAGZ);
 
-	runData.sumAcc[0] += runData.accHist[0][runData.sensorHistIndex];
-	runData.sumAcc[1] += runData.accHist[1][runData.sensorHistIndex];
-	runData.sumAcc[2] += runData.accHist[2][runData.sensorHistIndex];
-
-	// mag
-	runData.sumMag[0] -= runData.magHist[0][runData.sensorHistIndex];
-	runData.sumMag[1] -= runData.magHist[1][runData.sensorHistIndex];
-	runData.sumMag[2] -= runData.magHist[2][runData.sensorHistIndex];
-
-	runData.magHist[0][runData.sensorHistIndex] = IMU_MAGX;
-	runData.magHist[1][runData.sensorHistIndex] = IMU_MAGY;
-	runData.magHist[2][runData.sensorHistIndex] = IMU_MAGZ;
-
-	runData.sumMag[0] += runData.magHist[0][runData.sensorHistIndex];
-	runData.sumMag[1] += runData.magHist[1][runData.sensorHistIndex];
-	runData.sumMag[2] += runData.magHist[2][runData.sensorHistIndex];
-
-	// pressure
-	runData.sumPres -= runData.presHist[runData.sensorHistIndex];
-	runData.presHist[runData.sensorHistIndex] = AQ_PRESSURE;
-	runData.sumPres += runData.presHist[runData.sensorHistIndex];
-
-	runData.sensorHistIndex = (runData.sensorHistIndex + 1) % RUN_SENSOR_HIST;
+	utilStatsAdd(&runData.presStats, AQ_PRESSURE);
 
 	if (!((loops+1) % 20)) {
-	   simDoAccUpdate(runData.sumAcc[0]*(1.0f / (float)RUN_SENSOR_HIST), runData.sumAcc[1]*(1.0f / (float)RUN_SENSOR_HIST), runData.sumAcc[2]*(1.0f / (float)RUN_SENSOR_HIST));
+	   simDoAccUpdate(runData.accStats[0].mean, runData.accStats[1].mean, runData.accStats[2].mean);
 	}
 	else if (!((loops+7) % 20)) {
-	   simDoPresUpdate(runData.sumPres*(1.0f / (float)RUN_SENSOR_HIST));
+#ifdef USE_DIGITAL_IMU
+	   // MS5611 driver already delivers a median of its freshest samples
+	   simDoPresUpdate(imuData.presTime, AQ_PRESSURE);
+#else
+	   // the window mean is as old as its middle sample
+	   simDoPresUpdate(imuData.presTime - (uint32_t)(imuData.dt * (RUN_SENSOR_HIST - 1) * 0.5f * AQ_US_PER_SEC), runData.presStats.mean);
+#endif
 	}
 #ifndef USE_DIGITAL_IMU
 	else if (!((loops+13) % 20) && AQ_MAG_ENABLED) {
-	   simDoMagUpdate(runData.sumMag[0]*(1.0f / (float)RUN_SENSOR_HIST), runData.sumMag[1]*(1.0f / (float)RUN_SENSOR_HIST), runData.sumMag[2]*(1.0f / (float)RUN_SENSOR_HIST));
+	   simDoMagUpdate(runData.magStats[0].mean, runData.magStats[1].mean, runData.magStats[2].mean);
 	}
 #endif
 	// optical flow update
@@ -130,13 +113,7 @@ void runTaskCode(void *unused) {
 	}
 	// observe that the rates are exactly 0 if not flying or moving
 	else if (!(supervisorData.state & STATE_FLYING)) {
-	    float stdX, stdY, stdZ;
-
-	    arm_std_f32(runData.accHist[0], RUN_SENSOR_HIST, &stdX);
-	    arm_std_f32(runData.accHist[1], RUN_SENSOR_HIST, &stdY);
-	    arm_std_f32(runData.accHist[2], RUN_SENSOR_HIST, &stdZ);
-
-	    if ((stdX + stdY + stdZ) < (IMU_STATIC_STD*2)) {
+	    if ((utilStatsStd(&runData.accStats[0]) + utilStatsStd(&runData.accStats[1]) + utilStatsStd(&runData.accStats[2])) < (IMU_STATIC_STD*2)) {
 		if (!((axis + 0) % 3))
 		    navUkfZeroRate(IMU_RATEX, 0);
 		else if (!((axis + 1) % 3))
@@ -148,7 +125,7 @@ void runTaskCode(void *unused) {
 	}
 
         navUkfFinish();
-        altUkfProcess(AQ_PRESSURE);
+        altUkfProcess(imuData.presTime, AQ_PRESSURE);
 
         // determine which altitude estimate to use
         if (gpsData.hAcc > 0.8f) {
@@ -181,8 +158,6 @@ void runTaskCode(void *unused) {
 }
 
 void runInit(void) {
-    float acc[3], mag[3];
-    float pres;
     int i;
 
     memset((void *)&runData, 0, sizeof(runData));
@@ -192,36 +167,22 @@ void runInit(void) {
 
     runData.runTask = CoCreateTask(runTaskCode, (void *)0, RUN_PRIORITY, &runTaskStack[RUN_TASK_SIZE-1], RUN_TASK_SIZE);
 
-    acc[0] = IMU_ACCX;
-    acc[1] = IMU_ACCY;
-    acc[2] = IMU_ACCZ;
-
-    mag[0] = IMU_MAGX;
-    mag[1] = IMU_MAGY;
-    mag[2] = IMU_MAGZ;
-
-    pres = AQ_PRESSURE;
-
     // initialize sensor history
-    for (i = 0; i < RUN_SENSOR_HIST; i++) {
-        runData.accHist[0][i] = acc[0];
-        runData.accHist[1][i] = acc[1];
-        runData.accHist[2][i] = acc[2];
-        runData.magHist[0][i] = mag[0];
-        runData.magHist[1][i] = mag[1];
-        runData.magHist[2][i] = mag[2];
-        runData.presHist[i] = pres;
-
-        runData.sumAcc[0] += acc[0];
-        runData.sumAcc[1] += acc[1];
-        runData.sumAcc[2] += acc[2];
-        runData.sumMag[0] += mag[0];
-        runData.sumMag[1] += mag[1];
-        runData.sumMag[2] += mag[2];
-        runData.sumPres += pres;
+    for (i = 0; i < 3; i++) {
+	utilStatsInit(&runData.accStats[i], runData.accHist[i], RUN_SENSOR_HIST);
+	utilStatsInit(&runData.magStats[i], runData.magHist[i], RUN_SENSOR_HIST);
     }
+    utilStatsInit(&runData.presStats, runData.presHist, RUN_SENSOR_HIST);
+
+    utilStatsFill(&runData.accStats[0], IMU_ACCX);
+    utilStatsFill(&runData.accStats[1], IMU_ACCY);
+    utilStatsFill(&runData.accStats[2], IMU_ACCZ);
+
+    utilStatsFill(&runData.magStats[0], IMU_MAGX);
+    utilStatsFill(&runData.magStats[1], IMU_MAGY);
+    utilStatsFill(&runData.magStats[2], IMU_MAGZ);
 
-    runData.sensorHistIndex = 0;
+    utilStatsFill(&runData.presStats, AQ_PRESSURE);
 
     runData.bestHacc = 1000.0f;
     runData.accMask = 1000.0f;
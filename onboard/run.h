@@ -19,6 +19,7 @@
 #ifndef _run_h
 #define _run_h
 
+#include "util.h"
 #include <CoOS.h>
 
 #define RUN_TASK_SIZE		250
@@ -38,10 +39,9 @@ typedef struct {
     float accHist[3][RUN_SENSOR_HIST];
     float magHist[3][RUN_SENSOR_HIST];
     float presHist[RUN_SENSOR_HIST];
-    float sumAcc[3];
-    float sumMag[3];
-    float sumPres;
-    int sensorHistIndex;
+    utilStats_t accStats[3];
+    utilStats_t magStats[3];
+    utilStats_t presStats;
     float *altPos;
     float *altVel;
 } runStruct_t;
@@ -1895,6 +1895,7 @@ DRESULT disk_read(
 	) {
     SD_Error error = SD_OK;
     int tries = 0;
+    uint32_t start, busy;
 
     if (drv || !count)
 	return RES_PARERR;
@@ -1905,6 +1906,8 @@ DRESULT disk_read(
     if (SD_Detect() == SD_NOT_PRESENT)
 	return RES_NOTRDY;	// No card in the socket
 
+    start = timerMicros();
+
     do {
 	if (error != SD_OK) {
 	    AQ_NOTICE("SDIO WRITE error != SD_OK\n");
@@ -1919,16 +1922,25 @@ DRESULT disk_read(
 	if (error == SD_OK)
 	    error = SD_WaitReadOperation();
 
+	busy = timerMicros();
 	while (SD_GetStatus() == SD_TRANSFER_BUSY)
 	    yield(1);
+	sdioData.readStats.busyWait += timerMicros() - busy;
 
 	tries++;
     } while (error != SD_OK  && tries < SDIO_RETRIES);
 
-    if (error != SD_OK)
+    sdioData.readStats.retries += tries - 1;
+    utilLatencyAdd(&sdioData.readStats.latency, timerMicros() - start);
+
+    if (error != SD_OK) {
+	sdioData.readStats.errors++;
 	return RES_ERROR;
-    else
+    }
+    else {
+	sdioData.readStats.sectors += count;
 	return RES_OK;
+    }
 }
 
 DRESULT disk_write (
@@ -1939,6 +1951,7 @@ DRESULT disk_write (
 	) {
     SD_Error error = SD_OK;
     int tries = 0;
+    uint32_t start, busy;
 
     if (drv || !count)
 	return RES_PARERR;
@@ -1949,6 +1962,8 @@ DRESULT disk_write (
     if (SD_Detect() == SD_NOT_PRESENT)
 	return RES_NOTRDY;	// No card in the socket
 
+    start = timerMicros();
+
     do {
 	if (error != SD_OK) {
 	    AQ_NOTICE("SDIO WRITE error != SD_OK\n");
@@ -1964,16 +1979,25 @@ DRESULT disk_write (
 	    error = SD_WaitWriteOperation();
 
 	// wait for any previous writes to finish
+	busy = timerMicros();
 	while (SD_GetStatus() == SD_TRANSFER_BUSY)
 	    yield(1);
+	sdioData.writeStats.busyWait += timerMicros() - busy;
 
 	tries++;
     } while (error != SD_OK && tries < SDIO_RETRIES);
 
-    if (error != SD_OK)
+    sdioData.writeStats.retries += tries - 1;
+    utilLatencyAdd(&sdioData.writeStats.latency, timerMicros() - start);
+
+    if (error != SD_OK) {
+	sdioData.writeStats.errors++;
 	return RES_ERROR;
-    else
+    }
+    else {
+	sdioData.writeStats.sectors += count;
 	return RES_OK;
+    }
 }
 
 DRESULT disk_ioctl (
@@ -2040,6 +2064,8 @@ void SD_ProcessDMAIRQ(void) {
 
 // Allows to process all the interrupts that are high.
 SD_Error SD_ProcessIRQSrc(void) {
+    sdioCallback_t *callback;
+
     if (SDIO_GetITStatus(SDIO_IT_DATAEND) != RESET) {
 	sdioData.TransferError = SD_OK;
 	SDIO_ClearITPendingBit(SDIO_IT_DATAEND);
@@ -2076,13 +2102,14 @@ SD_Error SD_ProcessIRQSrc(void) {
 
     sdioData.TransferEnd = 1;
 
-    if (sdioData.callbackFunc) {
+    // cleared first, the callback may start another transfer
+    if ((callback = sdioData.callbackFunc) != 0) {
+	sdioData.callbackFunc = 0;
+
 	if (sdioData.TransferError == SD_OK)
-	    sdioData.callbackFunc(sdioData.callbackParam);
+	    callback(sdioData.callbackParam);
 	else
-	    sdioData.callbackFunc(0);
-
-	sdioData.callbackFunc = 0;
+	    callback(0);
     }
 
     return (sdioData.TransferError);
@@ -21,6 +21,7 @@
 
 #include "digital.h"
 #include "diskio.h"
+#include "util.h"
 
 #define SDIO_FIFO_ADDRESS                ((uint32_t)0x40012c80)
 #define SDIO_INIT_CLK_DIV                ((uint8_t)0xB2)	// SDIO Intialization Frequency (400KHz max)
@@ -330,6 +331,14 @@ typedef struct {
 
 typedef void sdioCallback_t(uint32_t);
 
+typedef struct {
+    utilLatency_t latency;
+    uint32_t sectors;
+    uint32_t retries;
+    uint32_t errors;
+    uint32_t busyWait;			// us waiting on the card after the DMA finished
+} sdioOpStats_t;
+
 typedef struct {
     volatile unsigned char initialized;
     unsigned long cardRemovalMicros;
@@ -343,10 +352,14 @@ typedef struct {
     SD_CardInfo SDCardInfo;
     SD_CardStatus SDCardStatus;
     uint32_t errCount;
+    sdioOpStats_t writeStats;
+    sdioOpStats_t readStats;
     sdioCallback_t *callbackFunc;
     uint32_t callbackParam;
 } sdioStruct_t;
 
+extern sdioStruct_t sdioData;
+
 extern void sdioLowLevelInit(void);
 extern void sdioSetCallback(sdioCallback_t *func, uint32_t param);
 extern DSTATUS disk_initialize(BYTE drv);
@@ -128,14 +128,14 @@ serialPort_t *serialUSART1(unsigned int flowControl, unsigned int rxBufSize, uns
     s->rxDMAStream = SERIAL_UART1_RX_DMA_ST;
     s->rxDMAChannel = SERIAL_UART1_RX_DMA_CH;
     s->rxDmaFlags = SERIAL_UART1_RX_TC_FLAG | SERIAL_UART1_RX_HT_FLAG | SERIAL_UART1_RX_TE_FLAG | SERIAL_UART1_RX_DM_FLAG | SERIAL_UART1_RX_FE_FLAG;
-#else
-    // otherwise use interrupts
+#endif	// SERIAL_UART1_RX_DMA_ST
+
+    // rx ISR, or idle line detection with DMA
     NVIC_InitStructure.NVIC_IRQChannel = USART1_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif	// SERIAL_UART1_RX_DMA_ST
 #endif	// SERIAL_UART1_RX_PIN
 
 #ifdef SERIAL_UART1_TX_PIN
@@ -213,14 +213,14 @@ serialPort_t *serialUSART2(unsigned int flowControl, unsigned int rxBufSize, uns
     s->rxDMAStream = SERIAL_UART2_RX_DMA_ST;
     s->rxDMAChannel = SERIAL_UART2_RX_DMA_CH;
     s->rxDmaFlags = SERIAL_UART2_RX_TC_FLAG | SERIAL_UART2_RX_HT_FLAG | SERIAL_UART2_RX_TE_FLAG | SERIAL_UART2_RX_DM_FLAG | SERIAL_UART2_RX_FE_FLAG;
-#else
-    // otherwise use interrupts
+#endif	// SERIAL_UART2_RX_DMA_ST
+
+    // rx ISR, or idle line detection with DMA
     NVIC_InitStructure.NVIC_IRQChannel = USART2_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif	// SERIAL_UART2_RX_DMA_ST
 #endif	// SERIAL_UART2_RX_PIN
 
 #ifdef SERIAL_UART2_TX_PIN
@@ -298,14 +298,14 @@ serialPort_t *serialUSART3(unsigned int flowControl, unsigned int rxBufSize, uns
     s->rxDMAStream = SERIAL_UART3_RX_DMA_ST;
     s->rxDMAChannel = SERIAL_UART3_RX_DMA_CH;
     s->rxDmaFlags = SERIAL_UART3_RX_TC_FLAG | SERIAL_UART3_RX_HT_FLAG | SERIAL_UART3_RX_TE_FLAG | SERIAL_UART3_RX_DM_FLAG | SERIAL_UART3_RX_FE_FLAG;
-#else
-    // otherwise use interrupts
+#endif	// SERIAL_UART3_RX_DMA_ST
+
+    // rx ISR, or idle line detection with DMA
     NVIC_InitStructure.NVIC_IRQChannel = USART3_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif	// SERIAL_UART3_RX_DMA_ST
 #endif	// SERIAL_UART3_RX_PIN
 
 #ifdef SERIAL_UART3_TX_PIN
@@ -383,14 +383,14 @@ serialPort_t *serialUSART4(unsigned int flowControl, unsigned int rxBufSize, uns
     s->rxDMAStream = SERIAL_UART4_RX_DMA_ST;
     s->rxDMAChannel = SERIAL_UART4_RX_DMA_CH;
     s->rxDmaFlags = SERIAL_UART4_RX_TC_FLAG | SERIAL_UART4_RX_HT_FLAG | SERIAL_UART4_RX_TE_FLAG | SERIAL_UART4_RX_DM_FLAG | SERIAL_UART4_RX_FE_FLAG;
-#else
-    // otherwise use interrupts
+#endif	// SERIAL_UART4_RX_DMA_ST
+
+    // rx ISR, or idle line detection with DMA
     NVIC_InitStructure.NVIC_IRQChannel = UART4_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif	// SERIAL_UART4_RX_DMA_ST
 #endif	// SERIAL_UART4_RX_PIN
 
 #ifdef SERIAL_UART4_TX_PIN
@@ -457,14 +457,14 @@ serialPort_t *serialUSART5(unsigned int flowControl, unsigned int rxBufSize, uns
     s->rxDMAStream = SERIAL_UART5_RX_DMA_ST;
     s->rxDMAChannel = SERIAL_UART5_RX_DMA_CH;
     s->rxDmaFlags = SERIAL_UART5_RX_TC_FLAG | SERIAL_UART5_RX_HT_FLAG | SERIAL_UART5_RX_TE_FLAG | SERIAL_UART5_RX_DM_FLAG | SERIAL_UART5_RX_FE_FLAG;
-#else
-    // otherwise use interrupts
+#endif	// SERIAL_UART5_RX_DMA_ST
+
+    // rx ISR, or idle line detection with DMA
     NVIC_InitStructure.NVIC_IRQChannel = UART5_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif	// SERIAL_UART5_RX_DMA_ST
 #endif	// SERIAL_UART5_RX_PIN
 
 #ifdef SERIAL_UART5_TX_PIN
@@ -531,14 +531,14 @@ serialPort_t *serialUSART6(unsigned int flowControl, unsigned int rxBufSize, uns
     s->rxDMAStream = SERIAL_UART6_RX_DMA_ST;
     s->rxDMAChannel = SERIAL_UART6_RX_DMA_CH;
     s->rxDmaFlags = SERIAL_UART6_RX_TC_FLAG | SERIAL_UART6_RX_HT_FLAG | SERIAL_UART6_RX_TE_FLAG | SERIAL_UART6_RX_DM_FLAG | SERIAL_UART6_RX_FE_FLAG;
-#else
-    // otherwise use interrupts
+#endif	// SERIAL_UART6_RX_DMA_ST
+
+    // rx ISR, or idle line detection with DMA
     NVIC_InitStructure.NVIC_IRQChannel = USART6_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif	// SERIAL_UART6_RX_DMA_ST
 #endif	// SERIAL_UART6_RX_PIN
 
 #ifdef SERIAL_UART6_TX_PIN
@@ -672,6 +672,10 @@ serialPort_t *serialOpen(USART_TypeDef *USARTx, unsigned int baud, uint16_t flow
 	USART_ITConfig(USARTx, USART_IT_RXNE, ENABLE);
     }
 
+    // wake readers at the end of each burst
+    if (s->rxBuf)
+	USART_ITConfig(USARTx, USART_IT_IDLE, ENABLE);
+
     // Configure DMA for tx
     if (s->txDMAStream) {
 	DMA_DeInit(s->txDMAStream);
@@ -734,6 +738,36 @@ int serialRead(serialPort_t *s) {
     return ch;
 }
 
+// contiguous run of received bytes at the read position, returns its length
+unsigned int serialReadSpan(serialPort_t *s, unsigned char **buf) {
+    unsigned int head, tail;
+
+    if (s->rxDMAStream) {
+	head = s->rxBufSize - s->rxDMAStream->NDTR;
+	tail = s->rxBufSize - s->rxPos;
+    }
+    else {
+	head = s->rxHead;
+	tail = s->rxTail;
+    }
+
+    *buf = (unsigned char *)&s->rxBuf[tail];
+
+    return (head >= tail) ? head - tail : s->rxBufSize - tail;
+}
+
+// release n bytes returned by serialReadSpan()
+void serialConsume(serialPort_t *s, unsigned int n) {
+    if (s->rxDMAStream) {
+	s->rxPos -= n;
+	if (s->rxPos == 0)
+	    s->rxPos = s->rxBufSize;
+    }
+    else {
+	s->rxTail = (s->rxTail + n) % s->rxBufSize;
+    }
+}
+
 int serialReadBlock(serialPort_t *s) {
     while (!serialAvailable(s))
 	yield(1);
@@ -831,11 +865,19 @@ void USART1_IRQHandler(void) {
     serialPort_t *s = serialPort1;
     uint16_t SR = s->USARTx->SR;
 
-    if (SR & USART_FLAG_RXNE) {
+    if ((SR & USART_FLAG_RXNE) && !s->rxDMAStream) {
 	s->rxBuf[s->rxHead] = s->USARTx->DR;
 	s->rxHead = (s->rxHead + 1) % s->rxBufSize;
     }
 
+    // end of a burst, wake the reader
+    if (SR & USART_FLAG_IDLE) {
+	(void)s->USARTx->DR;	// SR then DR read clears IDLE
+	CoEnterISR();
+	isr_SetFlag(s->waitFlag);
+	CoExitISR();
+    }
+
     if (SR & USART_FLAG_TXE) {
 	if (s->txTail != s->txHead) {
 	    s->USARTx->DR = s->txBuf[s->txTail];
@@ -868,11 +910,19 @@ void USART2_IRQHandler(void) {
     serialPort_t *s = serialPort2;
     uint16_t SR = s->USARTx->SR;
 
-    if (SR & USART_FLAG_RXNE) {
+    if ((SR & USART_FLAG_RXNE) && !s->rxDMAStream) {
 	s->rxBuf[s->rxHead] = s->USARTx->DR;
 	s->rxHead = (s->rxHead + 1) % s->rxBufSize;
     }
 
+    // end of a burst, wake the reader
+    if (SR & USART_FLAG_IDLE) {
+	(void)s->USARTx->DR;	// SR then DR read clears IDLE
+	CoEnterISR();
+	isr_SetFlag(s->waitFlag);
+	CoExitISR();
+    }
+
     if (SR & USART_FLAG_TXE) {
 	if (s->txTail != s->txHead) {
 	    s->USARTx->DR = s->txBuf[s->txTail];
@@ -905,11 +955,19 @@ void USART3_IRQHandler(void) {
     serialPort_t *s = serialPort3;
     uint16_t SR = s->USARTx->SR;
 
-    if (SR & USART_FLAG_RXNE) {
+    if ((SR & USART_FLAG_RXNE) && !s->rxDMAStream) {
 	s->rxBuf[s->rxHead] = s->USARTx->DR;
 	s->rxHead = (s->rxHead + 1) % s->rxBufSize;
     }
 
+    // end of a burst, wake the reader
+    if (SR & USART_FLAG_IDLE) {
+	(void)s->USARTx->DR;	// SR then DR read clears IDLE
+	CoEnterISR();
+	isr_SetFlag(s->waitFlag);
+	CoExitISR();
+    }
+
     if (SR & USART_FLAG_TXE) {
 	if (s->txTail != s->txHead) {
 	    s->USARTx->DR = s->txBuf[s->txTail];
@@ -942,11 +1000,19 @@ void UART4_IRQHandler(void) {
     serialPort_t *s = serialPort4;
     uint16_t SR = s->USARTx->SR;
 
-    if (SR & USART_FLAG_RXNE) {
+    if ((SR & USART_FLAG_RXNE) && !s->rxDMAStream) {
 	s->rxBuf[s->rxHead] = s->USARTx->DR;
 	s->rxHead = (s->rxHead + 1) % s->rxBufSize;
     }
 
+    // end of a burst, wake the reader
+    if (SR & USART_FLAG_IDLE) {
+	(void)s->USARTx->DR;	// SR then DR read clears IDLE
+	CoEnterISR();
+	isr_SetFlag(s->waitFlag);
+	CoExitISR();
+    }
+
     if (SR & USART_FLAG_TXE) {
 	if (s->txTail != s->txHead) {
 	    s->USARTx->DR = s->txBuf[s->txTail];
@@ -979,11 +1045,19 @@ void UART5_IRQHandler(void) {
     serialPort_t *s = serialPort5;
     uint16_t SR = s->USARTx->SR;
 
-    if (SR & USART_FLAG_RXNE) {
+    if ((SR & USART_FLAG_RXNE) && !s->rxDMAStream) {
 	s->rxBuf[s->rxHead] = s->USARTx->DR;
 	s->rxHead = (s->rxHead + 1) % s->rxBufSize;
     }
 
+    // end of a burst, wake the reader
+    if (SR & USART_FLAG_IDLE) {
+	(void)s->USARTx->DR;	// SR then DR read clears IDLE
+	CoEnterISR();
+	isr_SetFlag(s->waitFlag);
+	CoExitISR();
+    }
+
     if (SR & USART_FLAG_TXE) {
 	if (s->txTail != s->txHead) {
 	    s->USARTx->DR = s->txBuf[s->txTail];
@@ -1016,11 +1090,19 @@ void USART6_IRQHandler(void) {
     serialPort_t *s = serialPort6;
     uint16_t SR = s->USARTx->SR;
 
-    if (SR & USART_FLAG_RXNE) {
+    if ((SR & USART_FLAG_RXNE) && !s->rxDMAStream) {
 	s->rxBuf[s->rxHead] = s->USARTx->DR;
 	s->rxHead = (s->rxHead + 1) % s->rxBufSize;
     }
 
+    // end of a burst, wake the reader
+    if (SR & USART_FLAG_IDLE) {
+	(void)s->USARTx->DR;	// SR then DR read clears IDLE
+	CoEnterISR();
+	isr_SetFlag(s->waitFlag);
+	CoExitISR();
+    }
+
     if (SR & USART_FLAG_TXE) {
 	if (s->txTail != s->txHead) {
 	    s->USARTx->DR = s->txBuf[s->txTail];
@@ -51,7 +51,7 @@ typedef struct {
     serialTxDMACallback_t *txDMACallback;
     void *txDMACallbackParam;
 
-    OS_FlagID waitFlag;
+    OS_FlagID waitFlag;				// set on rx idle line, manual reset
 } serialPort_t;
 
 extern serialPort_t *serialOpen(USART_TypeDef *USARTx, unsigned int baud, uint16_t flowControl, unsigned int rxBufSize, unsigned int txBufSize);
@@ -64,6 +64,8 @@ extern void serialWatch(void);
 extern unsigned char serialAvailable(serialPort_t *s);
 extern int serialRead(serialPort_t *s);
 extern int serialReadBlock(serialPort_t *s);
+extern unsigned int serialReadSpan(serialPort_t *s, unsigned char **buf);
+extern void serialConsume(serialPort_t *s, unsigned int n);
 extern void serialPrint(serialPort_t *s, const char *str);
 extern int _serialStartTxDMA(serialPort_t *s, void *buf, int size, serialTxDMACallback_t *txDMACallback, void *txDMACallbackParam);
 extern int __putchar(int ch);
@@ -711,6 +711,9 @@ void Schedule(void)
 {
     U8  RunPrio,RdyPrio;
     P_OSTCB pRdyTcb,pCurTcb;
+#if CFG_TASK_STATS_EN > 0
+    BOOL preempted;
+#endif
 
 
     pCurTcb = TCBRunning;
@@ -722,6 +725,9 @@ void Schedule(void)
 	}
 	TaskSchedReq = Co_FALSE;
     RunPrio = pCurTcb->prio;
+#if CFG_TASK_STATS_EN > 0
+    preempted = (pCurTcb->state == TASK_RUNNING);
+#endif
     RdyPrio = pRdyTcb->prio;
 
 	/* Is Running task status was changed? */
@@ -766,6 +772,10 @@ void Schedule(void)
         CoStkOverflowHook(pCurTcb->taskID);       /* Yes,call handler         */
     }
 #endif
+
+#if CFG_TASK_STATS_EN > 0
+    CoTaskSwitchHook(pCurTcb->taskID,TCBNext->taskID,preempted);
+#endif
 __asm volatile ("cpsid f");
 
     SwitchContext();                              /* Call task context switch */
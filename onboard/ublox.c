@@ -47,6 +47,36 @@ static void ubloxRxChecksum(unsigned char c) {
     ubloxData.ubloxRxCK_B += ubloxData.ubloxRxCK_A;
 }
 
+// Fletcher checksum over a span, four bytes per step.  The sums are
+// carried in 32 bits and only reduced to 8 bits at the end.
+static void ubloxRxChecksumSpan(const unsigned char *buf, unsigned int n) {
+    uint32_t a = ubloxData.ubloxRxCK_A;
+    uint32_t b = ubloxData.ubloxRxCK_B;
+    uint32_t w, c0, c1, c2, c3;
+
+    while (n >= 4) {
+        memcpy(&w, buf, sizeof(w));
+        c0 = w & 0xff;
+        c1 = (w >> 8) & 0xff;
+        c2 = (w >> 16) & 0xff;
+        c3 = w >> 24;
+
+        b += 4*(a + c0) + 3*c1 + 2*c2 + c3;
+        a += c0 + c1 + c2 + c3;
+
+        buf += 4;
+        n -= 4;
+    }
+
+    while (n--) {
+        a += *buf++;
+        b += a;
+    }
+
+    ubloxData.ubloxRxCK_A = a;
+    ubloxData.ubloxRxCK_B = b;
+}
+
 static void ubloxTxChecksum(uint8_t c) {
     ubloxData.ubloxTxCK_A += c;
     ubloxData.ubloxTxCK_B += ubloxData.ubloxTxCK_A;
@@ -244,20 +274,43 @@ static void ubloxPollVersion(void) {
 }
 
 static void ubloxVersionSpecific(int ver) {
+#ifdef GPS_DO_RTK
+    // raw measurements at the navigation rate, ver 8 replaced RAW/SFRB with RAWX/SFRBX
+    if (ver > 7) {
+        ubloxEnableMessage(UBLOX_RXM_CLASS, UBLOX_RXM_RAWX, 1);     // RXM RAWX
+        ubloxEnableMessage(UBLOX_RXM_CLASS, UBLOX_RXM_SFRBX, 1);    // RXM SFRBX
+    }
+    else {
+        ubloxEnableMessage(UBLOX_RXM_CLASS, UBLOX_RXM_RAW, 1);      // RXM RAW
+        ubloxEnableMessage(UBLOX_RXM_CLASS, UBLOX_RXM_SFRB, 1);     // RXM SFRB
+    }
+#endif
+    uint16_t rate;
+
     if (ver > 7) {
         // 5Hz for ver 8 using multiple GNSS
-        ubloxSetRate((uint16_t)200);
+        rate = 200;
     }
     else if (ver > 6) {
         // 10Hz for ver 7
-        ubloxSetRate((uint16_t)100);
+        rate = 100;
         // SBAS screwed up on v7 modules w/ v1 firmware
         ubloxSetSBAS(0);                                        // disable SBAS
     }
     else {
         // 5Hz
-        ubloxSetRate((uint16_t)200);
+        rate = 200;
+    }
+#ifdef GPS_PVT_RATE
+    if (ver > 6) {
+        // whole solution in one message per epoch
+        ubloxEnableMessage(UBLOX_NAV_CLASS, UBLOX_NAV_PVT, 1);      // NAV PVT
+        ubloxEnableMessage(UBLOX_NAV_CLASS, UBLOX_NAV_POSLLH, 0);   // NAV POSLLH off
+        ubloxEnableMessage(UBLOX_NAV_CLASS, UBLOX_NAV_VALNED, 0);   // NAV VALNED off
+        rate = GPS_PVT_RATE;
     }
+#endif
+    ubloxSetRate(rate);
 }
 
 void ubloxSendSetup(void) {
@@ -269,10 +322,6 @@ void ubloxSendSetup(void) {
     ubloxEnableMessage(UBLOX_NAV_CLASS, UBLOX_NAV_DOP, 5);      // NAV DOP
     ubloxEnableMessage(UBLOX_AID_CLASS, UBLOX_AID_REQ, 1);      // AID REQ
     ubloxEnableMessage(UBLOX_NAV_CLASS, UBLOX_NAV_TIMEUTC, 5);  // NAV TIMEUTC
-#ifdef GPS_DO_RTK
-    ubloxEnableMessage(UBLOX_RXM_CLASS, UBLOX_RXM_RAW, 1);      // RXM RAW
-    ubloxEnableMessage(UBLOX_RXM_CLASS, UBLOX_RXM_SFRB, 1);     // RXM SFRB
-#endif
 #ifdef GPS_DEBUG
     ubloxEnableMessage(UBLOX_NAV_CLASS, UBLOX_NAV_SVINFO, 1);   // NAV SVINFO
     ubloxEnableMessage(UBLOX_NAV_CLASS, UBLOX_NAV_SBAS, 1);     // NAV SBAS
@@ -288,6 +337,7 @@ void ubloxInit(void) {
     memset((void *)&ubloxData, 0, sizeof(ubloxData));
 
     ubloxData.state = UBLOX_WAIT_SYNC1;
+    ubloxData.msg = &ubloxData.payload;
 
     ubloxSendSetup();
 }
@@ -310,7 +360,7 @@ static void ubloxSendPacket(uint8_t commType) {
         *ptr++ = ((ubloxData.length & 0xff00) >> 8);
 
         for (i = 0; i < ubloxData.length; i++)
-            *ptr++ = (*((char *)&ubloxData.payload + i));
+            *ptr++ = (*((const char *)ubloxData.msg + i));
 
         *ptr++ = (ubloxData.ubloxRxCK_A);
         *ptr++ = (ubloxData.ubloxRxCK_B);
@@ -319,77 +369,191 @@ static void ubloxSendPacket(uint8_t commType) {
     }
 }
 
-unsigned char ubloxPublish(void) {
-    unsigned char ret = 0;
+#ifdef GPS_DO_RTK
+// copy into the raw stream ring, returns the new head
+static int32_t ubloxRawCopy(int32_t head, const void *src, uint32_t n) {
+    uint32_t k = GPS_RAW_BUF_SIZE - head;
+
+    if (k > n)
+        k = n;
+
+    memcpy(gpsData.rawBuf + head, src, k);
+    memcpy(gpsData.rawBuf, (const uint8_t *)src + k, n - k);
+
+    return (head + n) % GPS_RAW_BUF_SIZE;
+}
+
+// Append the current frame verbatim to the raw stream, preceded by an
+// AQ TIME frame.  Only the GPS task advances the head and only the filer
+// task the tail, so a full ring drops the frame instead of waiting.
+static void ubloxRawLog(void) {
+    uint8_t hdr[16 + 6];
+    uint32_t micros = timerMicros();
+    uint8_t a = 0, b = 0;
+    int32_t head, space;
+    int i;
+
+    if (!gpsData.rawBuf || !filerAvailable())
+        return;
+
+    head = filerGetHead(gpsData.rawHandle);
+    space = (filerGetTail(gpsData.rawHandle) - head - 1 + GPS_RAW_BUF_SIZE) % GPS_RAW_BUF_SIZE;
+
+    if (space < (int32_t)(sizeof(hdr) + ubloxData.length + 2)) {
+        gpsData.rawDrops++;
+        return;
+    }
+
+    hdr[0] = UBLOX_SYNC1;
+    hdr[1] = UBLOX_SYNC2;
+    hdr[2] = UBLOX_AQ_CLASS;
+    hdr[3] = UBLOX_AQ_TIME;
+    hdr[4] = 8;
+    hdr[5] = 0;
+    for (i = 0; i < 4; i++) {
+        hdr[6 + i] = micros >> (i * 8);
+        hdr[10 + i] = gpsData.rawDrops >> (i * 8);
+    }
+    for (i = 2; i < 14; i++) {
+        a += hdr[i];
+        b += a;
+    }
+    hdr[14] = a;
+    hdr[15] = b;
+
+    hdr[16] = UBLOX_SYNC1;
+    hdr[17] = UBLOX_SYNC2;
+    hdr[18] = ubloxData.class;
+    hdr[19] = ubloxData.id;
+    hdr[20] = ubloxData.length & 0xff;
+    hdr[21] = (ubloxData.length & 0xff00) >> 8;
+
+    head = ubloxRawCopy(head, hdr, sizeof(hdr));
+    head = ubloxRawCopy(head, ubloxData.msg, ubloxData.length);
+    head = ubloxRawCopy(head, &ubloxData.ubloxRxCK_A, 1);
+    head = ubloxRawCopy(head, &ubloxData.ubloxRxCK_B, 1);
+
+    filerSetHead(gpsData.rawHandle, head);
+    gpsData.rawFrames++;
+}
+#endif
+
+unsigned int ubloxPublish(void) {
+    unsigned int ret = 0;
+
+#ifdef GPS_DO_RTK
+    if (ubloxData.class == UBLOX_RXM_CLASS)
+        ubloxRawLog();
+#endif
 
     // don't allow preemption
     CoSetPriority(gpsData.gpsTask, 1);
 
-    if (ubloxData.class == UBLOX_NAV_CLASS && ubloxData.id == UBLOX_NAV_POSLLH) {
+    if (ubloxData.class == UBLOX_NAV_CLASS && ubloxData.id == UBLOX_NAV_PVT) {
+        unsigned long stamp;
+
+#ifdef GPS_LATENCY
+        stamp = timerMicros() - GPS_LATENCY;
+#else
+        stamp = gpsData.lastTimepulse + (ubloxData.msg->pvt.iTOW - gpsData.TPtowMS) * 1000;
+#endif
+
+        gpsData.iTOW = ubloxData.msg->pvt.iTOW;
+
+        // same uBlox workaround as POSLLH
+        if (ubloxData.lastLat != ubloxData.msg->pvt.lat || ubloxData.lastLon != ubloxData.msg->pvt.lon) {
+            ubloxData.lastLat = ubloxData.msg->pvt.lat;
+            ubloxData.lastLon = ubloxData.msg->pvt.lon;
+
+            gpsData.lat = (double)ubloxData.msg->pvt.lat * (double)1e-7;
+            gpsData.lon = (double)ubloxData.msg->pvt.lon * (double)1e-7;
+            gpsData.height = ubloxData.msg->pvt.hMSL * 0.001f;          // mm => m
+            gpsData.hAcc = ubloxData.msg->pvt.hAcc * 0.001f;            // mm => m
+            gpsData.vAcc = ubloxData.msg->pvt.vAcc * 0.001f;            // mm => m
+            gpsData.lastPosUpdate = stamp;
+
+            // position update
+            ret |= UBLOX_SPAN_POS;
+        }
+
+        gpsData.velN = ubloxData.msg->pvt.velN * 0.001f;                // mm => m
+        gpsData.velE = ubloxData.msg->pvt.velE * 0.001f;                // mm => m
+        gpsData.velD = ubloxData.msg->pvt.velD * 0.001f;                // mm => m
+        gpsData.speed = ubloxData.msg->pvt.gSpeed * 0.001f;             // mm/s => m/s
+        gpsData.heading = ubloxData.msg->pvt.heading * 1e-5f;
+        gpsData.sAcc = ubloxData.msg->pvt.sAcc * 0.001f;                // mm/s => m/s
+        gpsData.cAcc = ubloxData.msg->pvt.headingAcc * 1e-5f;
+        gpsData.pDOP = ubloxData.msg->pvt.pDOP * 0.01f;
+        gpsData.lastVelUpdate = stamp;
+
+        // velocity update
+        ret |= UBLOX_SPAN_VEL;
+    }
+    else if (ubloxData.class == UBLOX_NAV_CLASS && ubloxData.id == UBLOX_NAV_POSLLH) {
         // work around uBlox's inability to give new data on each report sometimes
-        if (ubloxData.lastLat != ubloxData.payload.posllh.lat || ubloxData.lastLon != ubloxData.payload.posllh.lon) {
-            ubloxData.lastLat = ubloxData.payload.posllh.lat;
-            ubloxData.lastLon = ubloxData.payload.posllh.lon;
+        if (ubloxData.lastLat != ubloxData.msg->posllh.lat || ubloxData.lastLon != ubloxData.msg->posllh.lon) {
+            ubloxData.lastLat = ubloxData.msg->posllh.lat;
+            ubloxData.lastLon = ubloxData.msg->posllh.lon;
 
-            gpsData.iTOW = ubloxData.payload.posllh.iTOW;
-            gpsData.lat = (double)ubloxData.payload.posllh.lat * (double)1e-7;
-            gpsData.lon = (double)ubloxData.payload.posllh.lon * (double)1e-7;
-            gpsData.height = ubloxData.payload.posllh.hMSL * 0.001f;    // mm => m
-            gpsData.hAcc = ubloxData.payload.posllh.hAcc * 0.001f;      // mm => m
-            gpsData.vAcc = ubloxData.payload.posllh.vAcc * 0.001f;      // mm => m
+            gpsData.iTOW = ubloxData.msg->posllh.iTOW;
+            gpsData.lat = (double)ubloxData.msg->posllh.lat * (double)1e-7;
+            gpsData.lon = (double)ubloxData.msg->posllh.lon * (double)1e-7;
+            gpsData.height = ubloxData.msg->posllh.hMSL * 0.001f;    // mm => m
+            gpsData.hAcc = ubloxData.msg->posllh.hAcc * 0.001f;      // mm => m
+            gpsData.vAcc = ubloxData.msg->posllh.vAcc * 0.001f;      // mm => m
 
 #ifdef GPS_LATENCY
             gpsData.lastPosUpdate = timerMicros() - GPS_LATENCY;
 #else
-            gpsData.lastPosUpdate = gpsData.lastTimepulse + (ubloxData.payload.posllh.iTOW - gpsData.TPtowMS) * 1000;
+            gpsData.lastPosUpdate = gpsData.lastTimepulse + (ubloxData.msg->posllh.iTOW - gpsData.TPtowMS) * 1000;
 #endif
             // position update
-            ret = 1;
+            ret = UBLOX_SPAN_POS;
         }
     }
     else if (ubloxData.class == UBLOX_NAV_CLASS && ubloxData.id == UBLOX_NAV_VALNED) {
-        gpsData.iTOW = ubloxData.payload.valned.iTOW;
-        gpsData.velN = ubloxData.payload.valned.velN * 0.01f;           // cm => m
-        gpsData.velE = ubloxData.payload.valned.velE * 0.01f;           // cm => m
-        gpsData.velD = ubloxData.payload.valned.velD * 0.01f;           // cm => m
-        gpsData.speed = ubloxData.payload.valned.gSpeed * 0.01f;        // cm/s => m/s
-        gpsData.heading = ubloxData.payload.valned.heading * 1e-5f;
-        gpsData.sAcc = ubloxData.payload.valned.sAcc * 0.01f;           // cm/s => m/s
-        gpsData.cAcc = ubloxData.payload.valned.cAcc * 1e-5f;
+        gpsData.iTOW = ubloxData.msg->valned.iTOW;
+        gpsData.velN = ubloxData.msg->valned.velN * 0.01f;           // cm => m
+        gpsData.velE = ubloxData.msg->valned.velE * 0.01f;           // cm => m
+        gpsData.velD = ubloxData.msg->valned.velD * 0.01f;           // cm => m
+        gpsData.speed = ubloxData.msg->valned.gSpeed * 0.01f;        // cm/s => m/s
+        gpsData.heading = ubloxData.msg->valned.heading * 1e-5f;
+        gpsData.sAcc = ubloxData.msg->valned.sAcc * 0.01f;           // cm/s => m/s
+        gpsData.cAcc = ubloxData.msg->valned.cAcc * 1e-5f;
 
 #ifdef GPS_LATENCY
         gpsData.lastVelUpdate = timerMicros() - GPS_LATENCY;
 #else
-        gpsData.lastVelUpdate = gpsData.lastTimepulse + (ubloxData.payload.valned.iTOW - gpsData.TPtowMS) * 1000;
+        gpsData.lastVelUpdate = gpsData.lastTimepulse + (ubloxData.msg->valned.iTOW - gpsData.TPtowMS) * 1000;
 #endif
 
         // velocity update
-        ret = 2;
+        ret = UBLOX_SPAN_VEL;
     }
     else if (ubloxData.class == UBLOX_TIM_CLASS && ubloxData.id == UBLOX_TIM_TP) {
-        gpsData.lastReceivedTPtowMS = ubloxData.payload.tp.towMS;
+        gpsData.lastReceivedTPtowMS = ubloxData.msg->tp.towMS;
     }
     else if (ubloxData.class == UBLOX_NAV_CLASS && ubloxData.id == UBLOX_NAV_DOP) {
-        gpsData.pDOP = ubloxData.payload.dop.pDOP * 0.01f;
-        gpsData.hDOP = ubloxData.payload.dop.hDOP * 0.01f;
-        gpsData.vDOP = ubloxData.payload.dop.vDOP * 0.01f;
-        gpsData.tDOP = ubloxData.payload.dop.tDOP * 0.01f;
-        gpsData.nDOP = ubloxData.payload.dop.nDOP * 0.01f;
-        gpsData.eDOP = ubloxData.payload.dop.eDOP * 0.01f;
-        gpsData.gDOP = ubloxData.payload.dop.gDOP * 0.01f;
+        gpsData.pDOP = ubloxData.msg->dop.pDOP * 0.01f;
+        gpsData.hDOP = ubloxData.msg->dop.hDOP * 0.01f;
+        gpsData.vDOP = ubloxData.msg->dop.vDOP * 0.01f;
+        gpsData.tDOP = ubloxData.msg->dop.tDOP * 0.01f;
+        gpsData.nDOP = ubloxData.msg->dop.nDOP * 0.01f;
+        gpsData.eDOP = ubloxData.msg->dop.eDOP * 0.01f;
+        gpsData.gDOP = ubloxData.msg->dop.gDOP * 0.01f;
     }
 
     // end of high priority section
     CoSetPriority(gpsData.gpsTask, GPS_PRIORITY);
 
-    if (ubloxData.class == UBLOX_NAV_CLASS && ubloxData.id == UBLOX_NAV_TIMEUTC && (ubloxData.payload.timeutc.valid & 0b100)) {
+    if (ubloxData.class == UBLOX_NAV_CLASS && ubloxData.id == UBLOX_NAV_TIMEUTC && (ubloxData.msg->timeutc.valid & 0b100)) {
         // if setting the RTC succeeds, disable the TIMEUTC message
-        if (rtcSetDataTime(ubloxData.payload.timeutc.year, ubloxData.payload.timeutc.month, ubloxData.payload.timeutc.day,
-                ubloxData.payload.timeutc.hour, ubloxData.payload.timeutc.min, ubloxData.payload.timeutc.sec))
+        if (rtcSetDataTime(ubloxData.msg->timeutc.year, ubloxData.msg->timeutc.month, ubloxData.msg->timeutc.day,
+                ubloxData.msg->timeutc.hour, ubloxData.msg->timeutc.min, ubloxData.msg->timeutc.sec))
             ubloxEnableMessage(UBLOX_NAV_CLASS, UBLOX_NAV_TIMEUTC, 0);
     }
     else if (ubloxData.class == UBLOX_MON_CLASS && ubloxData.id == UBLOX_MON_VER) {
-        ubloxData.hwVer = atoi(ubloxData.payload.ver.hwVersion) / 10000;
+        ubloxData.hwVer = atoi(ubloxData.msg->ver.hwVersion) / 10000;
         ubloxVersionSpecific(ubloxData.hwVer);
     }
 
@@ -426,7 +590,7 @@ unsigned char ubloxPublish(void) {
             *ptr = ((ubloxData.length & 0xff00) >> 8); ubloxTxChecksum(*ptr++);
 
             for (i = 0; i < ubloxData.length; i++) {
-                *ptr = (*((char *)&ubloxData.payload + i)); ubloxTxChecksum(*ptr++);
+                *ptr = (*((const char *)ubloxData.msg + i)); ubloxTxChecksum(*ptr++);
             }
 
             *ptr = (ubloxData.ubloxRxCK_A); ubloxTxChecksum(*ptr++);
@@ -442,12 +606,12 @@ unsigned char ubloxPublish(void) {
     return ret;
 }
 
-unsigned char ubloxCharIn(unsigned char c) {
+unsigned int ubloxCharIn(unsigned char c) {
     switch (ubloxData.state) {
     case UBLOX_WAIT_SYNC1:
         if (c == UBLOX_SYNC1)
             ubloxData.state = UBLOX_WAIT_SYNC2;
-        return 3;        // lost sync
+        return UBLOX_SPAN_SYNC;
         break;
 
     case UBLOX_WAIT_SYNC2:
@@ -455,7 +619,7 @@ unsigned char ubloxCharIn(unsigned char c) {
             ubloxData.state = UBLOX_WAIT_CLASS;
         else
             ubloxData.state = UBLOX_WAIT_SYNC1;
-        return 3;        // lost sync
+        return UBLOX_SPAN_SYNC;
         break;
 
     case UBLOX_WAIT_CLASS:
@@ -520,9 +684,96 @@ unsigned char ubloxCharIn(unsigned char c) {
         break;
 
     default:
-        return 3;        // lost sync
+        return UBLOX_SPAN_SYNC;
         break;
     }
 
     return 0;
 }
+
+// Publish a complete frame (sync chars included) directly from the caller's buffer,
+// returns UBLOX_SPAN_* bits or -1 on checksum error
+static int ubloxFrameIn(const unsigned char *buf, unsigned int length) {
+    int ret;
+
+    ubloxRxChecksumReset();
+    ubloxRxChecksumSpan(buf + 2, length + 4);
+
+    if (buf[length + 6] != ubloxData.ubloxRxCK_A || buf[length + 7] != ubloxData.ubloxRxCK_B) {
+        ubloxData.checksumErrors++;
+        return -1;
+    }
+
+    ubloxData.class = buf[2];
+    ubloxData.id = buf[3];
+    ubloxData.length = length;
+    ubloxData.msg = (const ubloxPayload_t *)(buf + 6);
+    ret = ubloxPublish();
+    ubloxData.msg = &ubloxData.payload;
+
+    return ret;
+}
+
+// Parse a contiguous span of received bytes.  Frames that lie wholly
+// within the span are checked and decoded in place, anything split
+// across spans is assembled in ubloxData.payload.  Returns UBLOX_SPAN_* bits.
+unsigned int ubloxSpanIn(const unsigned char *buf, unsigned int n) {
+    const unsigned char *p;
+    unsigned int ret = 0;
+    unsigned int length, k;
+    int r;
+
+    while (n > 0) {
+        if (ubloxData.state == UBLOX_WAIT_SYNC1) {
+            ret |= UBLOX_SPAN_SYNC;
+
+            p = memchr(buf, UBLOX_SYNC1, n);
+            if (!p)
+                break;
+
+            n -= p - buf;
+            buf = p;
+
+            if (n >= 8 && buf[1] == UBLOX_SYNC2) {
+                length = buf[4] | (buf[5] << 8);
+
+                if (length < (UBLOX_MAX_PAYLOAD-1) && n >= length + 8) {
+                    if ((r = ubloxFrameIn(buf, length)) >= 0) {
+                        ret |= r;
+                        k = length + 8;
+                    }
+                    else {
+                        // bad frame, resync from the next byte
+                        k = 1;
+                    }
+
+                    buf += k;
+                    n -= k;
+                    continue;
+                }
+            }
+        }
+        else if (ubloxData.state == UBLOX_PAYLOAD) {
+            k = ubloxData.length - ubloxData.count;
+            if (k > n)
+                k = n;
+
+            memcpy((char *)&ubloxData.payload + ubloxData.count, buf, k);
+            ubloxRxChecksumSpan(buf, k);
+
+            ubloxData.count += k;
+            if (ubloxData.count == ubloxData.length)
+                ubloxData.state = UBLOX_CHECK1;
+
+            buf += k;
+            n -= k;
+            continue;
+        }
+
+        // header, checksum and frames split across spans
+        ret |= ubloxCharIn(*buf++);
+        n--;
+    }
+
+    return ret;
+}
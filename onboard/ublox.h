@@ -28,10 +28,12 @@
 #define UBLOX_MON_CLASS	    0x0a
 #define UBLOX_AID_CLASS	    0x0b
 #define UBLOX_TIM_CLASS	    0x0d
+#define UBLOX_AQ_CLASS	    0xaa	// our own frames in the raw stream, ignored by other UBX readers
 
 
 #define UBLOX_NAV_POSLLH    0x02
 #define UBLOX_NAV_DOP	    0x04
+#define UBLOX_NAV_PVT	    0x07
 #define UBLOX_NAV_VALNED    0x12
 #define UBLOX_NAV_TIMEUTC   0x21
 #define UBLOX_NAV_SBAS	    0x32
@@ -41,6 +43,10 @@
 
 #define UBLOX_RXM_RAW	    0x10
 #define UBLOX_RXM_SFRB	    0x11
+#define UBLOX_RXM_SFRBX	    0x13
+#define UBLOX_RXM_RAWX	    0x15
+
+#define UBLOX_AQ_TIME	    0x01	// board time (us) and drop count for the frame that follows
 
 #define UBLOX_MON_VER	    0x04
 #define UBLOX_MON_HW	    0x09
@@ -60,9 +66,14 @@
 #define UBLOX_SBAS_MSAS	    0x00020200
 #define UBLOX_SBAS_GAGAN    0x00000108
 
-#define UBLOX_MAX_PAYLOAD   512
+#define UBLOX_MAX_PAYLOAD   1536	// RXM-RAWX is 16 + 32 bytes per measurement
 #define UBLOX_WAIT_MS	    20
 
+// ubloxCharIn() / ubloxSpanIn() result bits
+#define UBLOX_SPAN_POS	    0x01	// position update
+#define UBLOX_SPAN_VEL	    0x02	// velocity update
+#define UBLOX_SPAN_SYNC	    0x04	// searched for sync
+
 enum ubloxStates {
     UBLOX_WAIT_SYNC1 = 0,
     UBLOX_WAIT_SYNC2,
@@ -176,20 +187,23 @@ typedef struct {
     uint32_t reserved3;
 } __attribute__((packed)) ubloxStructPVT_t;
 
+typedef union {
+    ubloxStructPOSLLH_t posllh;
+    ubloxStructVALNED_t valned;
+    ubloxStructDOP_t dop;
+    ubloxStructTP_t tp;
+    ubloxStructTIMEUTC_t timeutc;
+    ubloxStructVER_t ver;
+    ubloxStructPVT_t pvt;		// uBlox 7 layout, uBlox 8 appends fields we ignore
+    char other[UBLOX_MAX_PAYLOAD];
+} ubloxPayload_t;
+
 typedef struct {
     int hwVer;
 
     signed long lastLat, lastLon;
-    union {
-	ubloxStructPOSLLH_t posllh;
-	ubloxStructVALNED_t valned;
-	ubloxStructDOP_t dop;
-	ubloxStructTP_t tp;
-	ubloxStructTIMEUTC_t timeutc;
-	ubloxStructVER_t ver;
-	ubloxStructPVT_t pvt;
-	char other[UBLOX_MAX_PAYLOAD];
-    } payload;
+    ubloxPayload_t payload;		// assembly buffer for messages split across reads
+    const ubloxPayload_t *msg;		// message being published, either payload or in place in the rx buffer
 
     unsigned char state;
     unsigned int count;
@@ -205,7 +219,8 @@ typedef struct {
     unsigned char ubloxTxCK_B;
 } ubloxStruct_t;
 
-extern unsigned char ubloxCharIn(unsigned char c);
+extern unsigned int ubloxCharIn(unsigned char c);
+extern unsigned int ubloxSpanIn(const unsigned char *buf, unsigned int n);
 extern void ubloxInit(void);
 extern void ubloxSendSetup(void);
 extern void ubloxInitGps(void);
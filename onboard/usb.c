@@ -21,6 +21,7 @@
 #include "usb_conf.h"
 #include "usbd_desc.h"
 #include "usbd_ioreq.h"
+#include "usbd_msc_scsi.h"
 #include "comm.h"
 
 #ifdef HAS_USB
@@ -108,6 +109,14 @@ static uint16_t usbVcpCtrl(uint32_t Cmd, uint8_t* Buf, uint32_t Len) {
 		    commSetStreamType(COMM_USB_PORT, COMM_STREAM_TYPE_GPS);
 		    break;
 
+		case USB_STREAM_FILEIO:
+		    commSetStreamType(COMM_USB_PORT, COMM_STREAM_TYPE_FILEIO);
+		    break;
+
+		case USB_STREAM_MULTIPLEX:
+		    commSetStreamType(COMM_USB_PORT, COMM_MUX_USB_STREAMS);
+		    break;
+
 		default:
 		    commSetStreamType(COMM_USB_PORT, COMM_STREAM_TYPE_MAVLINK);
 		    break;
@@ -205,6 +214,26 @@ uint8_t usbIsSuspend(void) {
     return (USB_OTG_dev.regs.DREGS->DSTS & 1);
 }
 
+// mass storage throughput while commands are in progress, B/s
+uint32_t usbMscReadRate(void) {
+    return SCSI_Stats.readMicros ? (uint64_t)SCSI_Stats.readBytes * 1000000 / SCSI_Stats.readMicros : 0;
+}
+
+uint32_t usbMscWriteRate(void) {
+    return SCSI_Stats.writeMicros ? (uint64_t)SCSI_Stats.writeBytes * 1000000 / SCSI_Stats.writeMicros : 0;
+}
+
+// percent of READ(10)s which found their data already read ahead
+uint8_t usbMscReadAhead(void) {
+    uint32_t n = SCSI_Stats.aheadHits + SCSI_Stats.aheadMisses;
+
+    return n ? (uint64_t)SCSI_Stats.aheadHits * 100 / n : 0;
+}
+
+uint32_t usbMscBytes(void) {
+    return SCSI_Stats.readBytes + SCSI_Stats.writeBytes;
+}
+
 extern USB_OTG_CORE_HANDLE           USB_OTG_dev;
 extern uint32_t USBD_OTG_ISR_Handler (USB_OTG_CORE_HANDLE *pdev);
 
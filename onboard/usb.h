@@ -26,6 +26,8 @@
 #define USB_STREAM_TELEMETRY	300
 #define USB_STREAM_MAVLINK	600
 #define USB_STREAM_GPS		1200
+#define USB_STREAM_FILEIO	2400
+#define USB_STREAM_MULTIPLEX	4800
 
 typedef struct {
     uint32_t bitrate;
@@ -48,6 +50,10 @@ extern void usbTx(uint8_t* buf, uint32_t len);
 extern uint8_t usbRx();
 extern uint8_t usbAvailable(void);
 extern uint8_t usbIsSuspend(void);
+extern uint32_t usbMscReadRate(void);
+extern uint32_t usbMscWriteRate(void);
+extern uint8_t usbMscReadAhead(void);
+extern uint32_t usbMscBytes(void);
 
 void USBD_USR_Init(void);
 void USBD_USR_DeviceReset (uint8_t speed);
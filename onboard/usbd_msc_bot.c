@@ -130,6 +130,7 @@ void MSC_BOT_Init (USB_OTG_CORE_HANDLE  *pdev)
 {
   MSC_BOT_State = BOT_IDLE;
   MSC_BOT_Status = BOT_STATE_NORMAL;
+  SCSI_ReadReset();
   USBD_STORAGE_fops->Init(0);
 
   DCD_EP_Flush(pdev, MSC_OUT_EP);
@@ -151,6 +152,7 @@ void MSC_BOT_Reset (USB_OTG_CORE_HANDLE  *pdev)
 {
   MSC_BOT_State = BOT_IDLE;
   MSC_BOT_Status = BOT_STATE_RECOVERY;
+  SCSI_ReadReset();
   /* Prapare EP to Receive First BOT Cmd */
   DCD_EP_PrepareRx (pdev,
                     MSC_OUT_EP,
@@ -191,8 +193,13 @@ void MSC_BOT_DataIn (USB_OTG_CORE_HANDLE  *pdev,
     }
     break;
 
-  case BOT_SEND_DATA:
   case BOT_LAST_DATA_IN:
+    SCSI_ProcessReadDone();
+    MSC_BOT_SendCSW (pdev, CSW_CMD_PASSED);
+
+    break;
+
+  case BOT_SEND_DATA:
     MSC_BOT_SendCSW (pdev, CSW_CMD_PASSED);
 
     break;
@@ -30,6 +30,8 @@
 #include "usbd_msc_scsi.h"
 #include "usbd_msc_mem.h"
 #include "usbd_msc_data.h"
+#include "aq_timer.h"
+#include <string.h>
 
 
 
@@ -79,10 +81,41 @@ uint8_t   SCSI_Sense_Tail;
 uint32_t  SCSI_blk_size;
 uint32_t  SCSI_blk_nbr;
 
-uint32_t  SCSI_blk_addr;
+uint32_t  SCSI_blk_addr;		// NEZ - in blocks, bytes overflow on cards > 4GB
 uint32_t  SCSI_blk_len;
 
 USB_OTG_CORE_HANDLE  *cdev;
+
+// NEZ - READ(10) data is double buffered so the card can fill one half of
+// MSC_BOT_Data while the other half goes out over USB, sequential reads
+// keep the card reading ahead of the host
+#define SCSI_READ_BUFS		2
+#define SCSI_READ_RESERVED	512	// head of MSC_BOT_Data, left for command responses
+#define SCSI_READ_CHUNK		(((MSC_MEDIA_PACKET - SCSI_READ_RESERVED) / SCSI_READ_BUFS) & ~511)
+
+enum {
+  SCSI_READ_FREE = 0,
+  SCSI_READ_FILLING,
+  SCSI_READ_READY,
+  SCSI_READ_SENDING
+};
+
+typedef struct {
+  uint8_t *buf;
+  uint32_t addr;		// first block held
+  uint32_t len;			// bytes
+  volatile uint8_t state;
+} SCSI_ReadBuf_TypeDef;
+
+static SCSI_ReadBuf_TypeDef SCSI_ReadBuf[SCSI_READ_BUFS];
+static uint32_t SCSI_ReadEnd;	// block following the last READ(10)
+static uint8_t SCSI_ReadSeq;	// last READ(10) followed on from the one before
+static volatile uint8_t SCSI_ReadCmd;	// a READ(10) owns the BOT state, or did last
+static volatile uint8_t SCSI_WritePending;	// WRITE(10) waiting for the read ahead to land
+static volatile uint8_t SCSI_ReadFailed;	// READ(10) failed while the IN endpoint was busy
+static uint32_t SCSI_CmdStart;	// us
+
+SCSI_Stats_TypeDef SCSI_Stats;
 /**
   * @}
   */
@@ -106,6 +139,10 @@ static int8_t SCSI_CheckAddressRange (uint8_t lun ,
                                       uint32_t blk_offset ,
                                       uint16_t blk_nbr);
 static int8_t SCSI_ProcessRead (uint8_t lun);
+static SCSI_ReadBuf_TypeDef *SCSI_ReadFind(uint32_t addr);
+static SCSI_ReadBuf_TypeDef *SCSI_ReadFilling(void);
+static SCSI_ReadBuf_TypeDef *SCSI_ReadSending(void);
+static void SCSI_WriteStart(void);
 
 static int8_t SCSI_ProcessWrite (uint8_t lun);
 /**
@@ -132,6 +169,9 @@ int8_t SCSI_ProcessCmd(USB_OTG_CORE_HANDLE  *pdev,
 {
   cdev = pdev;
 
+  /* NEZ - only READ(10) lets the SDIO completion drive the BOT state */
+  SCSI_ReadCmd = (params[0] == SCSI_READ10);
+
   switch (params[0])
   {
   case SCSI_TEST_UNIT_READY:
@@ -197,7 +237,8 @@ static int8_t SCSI_TestUnitReady(uint8_t lun, uint8_t *params)
     return -1;
   }
 
-  if(USBD_STORAGE_fops->IsReady(lun) !=0 )
+  /* a read ahead keeping the card busy is not a reason to stall the host */
+  if(!SCSI_ReadFilling() && USBD_STORAGE_fops->IsReady(lun) !=0 )
   {
     SCSI_SenseCode(lun,
                    NOT_READY,
@@ -465,7 +506,8 @@ static int8_t SCSI_Read10(uint8_t lun , uint8_t *params)
       return -1;
     }
 
-    if(USBD_STORAGE_fops->IsReady(lun) !=0 )
+    /* the card may still be busy reading ahead for us */
+    if(!SCSI_ReadFilling() && USBD_STORAGE_fops->IsReady(lun) !=0 )
     {
       SCSI_SenseCode(lun,
                      NOT_READY,
@@ -489,9 +531,16 @@ static int8_t SCSI_Read10(uint8_t lun , uint8_t *params)
     }
 
     MSC_BOT_State = BOT_DATA_IN;
-    SCSI_blk_addr *= SCSI_blk_size;
     SCSI_blk_len  *= SCSI_blk_size;
 
+    SCSI_ReadSeq = (SCSI_blk_addr == SCSI_ReadEnd);
+    SCSI_ReadFailed = 0;
+    if (SCSI_ReadFind(SCSI_blk_addr))
+      SCSI_Stats.aheadHits++;
+    else
+      SCSI_Stats.aheadMisses++;
+    SCSI_CmdStart = timerMicros();
+
     /* cases 4,5 : Hi <> Dn */
     if (MSC_BOT_cbw.dDataLength != SCSI_blk_len)
     {
@@ -529,8 +578,8 @@ static int8_t SCSI_Write10 (uint8_t lun , uint8_t *params)
       return -1;
     }
 
-    /* Check whether Media is ready */
-    if(USBD_STORAGE_fops->IsReady(lun) !=0 )
+    /* the card may still be busy with our read ahead, that is waited out below */
+    if(!SCSI_ReadFilling() && USBD_STORAGE_fops->IsReady(lun) !=0 )
     {
       SCSI_SenseCode(lun,
                      NOT_READY,
@@ -561,7 +610,6 @@ static int8_t SCSI_Write10 (uint8_t lun , uint8_t *params)
       return -1; /* error */
     }
 
-    SCSI_blk_addr *= SCSI_blk_size;
     SCSI_blk_len  *= SCSI_blk_size;
 
     /* cases 3,11,13 : Hn,Ho <> D0 */
@@ -573,12 +621,22 @@ static int8_t SCSI_Write10 (uint8_t lun , uint8_t *params)
       return -1;
     }
 
-    /* Prepare EP to receive first data packet */
+    SCSI_CmdStart = timerMicros();
     MSC_BOT_State = BOT_DATA_OUT;
-    DCD_EP_PrepareRx (cdev,
-                      MSC_OUT_EP,
-                      MSC_BOT_Data,
-                      MIN (SCSI_blk_len, MSC_MEDIA_PACKET));
+
+    /* data is received over the read buffers, so a read ahead still
+       filling one must land first; its completion starts the transfer */
+    __disable_irq();
+    if (SCSI_ReadFilling())
+    {
+      SCSI_WritePending = 1;
+      __enable_irq();
+    }
+    else
+    {
+      __enable_irq();
+      SCSI_WriteStart();
+    }
   }
   else /* Write Process ongoing */
   {
@@ -630,57 +688,146 @@ static int8_t SCSI_CheckAddressRange (uint8_t lun , uint32_t blk_offset , uint16
   return 0;
 }
 
-/**
-* @brief  SCSI_ProcessRead
-*         Handle Read Process
-* @param  lun: Logical unit number
-* @retval status
-*/
-static int8_t SCSI_ProcessRead (uint8_t lun)
+// NEZ - buffer holding (or about to hold) a block, 0 if none
+static SCSI_ReadBuf_TypeDef *SCSI_ReadFind(uint32_t addr)
 {
-  uint32_t len;
+  SCSI_ReadBuf_TypeDef *b;
+  int i;
 
-  len = MIN(SCSI_blk_len , MSC_MEDIA_PACKET);
+  for (i = 0; i < SCSI_READ_BUFS; i++)
+  {
+    b = &SCSI_ReadBuf[i];
+    if (b->state != SCSI_READ_FREE && addr >= b->addr && addr < b->addr + b->len / SCSI_blk_size)
+      return b;
+  }
 
-  if( USBD_STORAGE_fops->Read(lun ,
-                              MSC_BOT_Data,
-                              SCSI_blk_addr / SCSI_blk_size,
-                              len / SCSI_blk_size) < 0)
+  return 0;
+}
+
+static SCSI_ReadBuf_TypeDef *SCSI_ReadFilling(void)
+{
+  int i;
+
+  for (i = 0; i < SCSI_READ_BUFS; i++)
+    if (SCSI_ReadBuf[i].state == SCSI_READ_FILLING)
+      return &SCSI_ReadBuf[i];
+
+  return 0;
+}
+
+static SCSI_ReadBuf_TypeDef *SCSI_ReadSending(void)
+{
+  int i;
+
+  for (i = 0; i < SCSI_READ_BUFS; i++)
+    if (SCSI_ReadBuf[i].state == SCSI_READ_SENDING)
+      return &SCSI_ReadBuf[i];
+
+  return 0;
+}
+
+static uint8_t SCSI_ReadActive(void)
+{
+  return (SCSI_ReadCmd && MSC_BOT_State == BOT_DATA_IN && SCSI_blk_len);
+}
+
+// drop everything but the run of buffers the current command will send
+static void SCSI_ReadPrune(void)
+{
+  SCSI_ReadBuf_TypeDef *b;
+  uint8_t keep[SCSI_READ_BUFS];
+  uint32_t addr = SCSI_blk_addr;
+  int i;
+
+  if (!SCSI_ReadActive())
+    return;
+
+  memset(keep, 0, sizeof(keep));
+  while ((b = SCSI_ReadFind(addr)) != 0 && !keep[b - SCSI_ReadBuf])
   {
+    keep[b - SCSI_ReadBuf] = 1;
+    addr = b->addr + b->len / SCSI_blk_size;
+  }
 
-    SCSI_SenseCode(lun, HARDWARE_ERROR, UNRECOVERED_READ_ERROR);
-    return -1;
+  for (i = 0; i < SCSI_READ_BUFS; i++)
+    if (!keep[i] && SCSI_ReadBuf[i].state == SCSI_READ_READY)
+      SCSI_ReadBuf[i].state = SCSI_READ_FREE;
+}
+
+// start the card on the next blocks the host wants, or is likely to want
+static int8_t SCSI_ReadFetch(uint8_t lun)
+{
+  SCSI_ReadBuf_TypeDef *b, *f = 0;
+  uint32_t addr, limit, n;
+  int i;
+
+  /* never touch the buffers while another command owns the BOT state */
+  if (!SCSI_ReadCmd && MSC_BOT_State != BOT_IDLE)
+    return 0;
+
+  for (i = 0; i < SCSI_READ_BUFS; i++)
+  {
+    if (SCSI_ReadBuf[i].state == SCSI_READ_FILLING)
+      return 0;
+    if (SCSI_ReadBuf[i].state == SCSI_READ_FREE)
+      f = &SCSI_ReadBuf[i];
   }
+  if (!f)
+    return 0;
 
-//  DCD_EP_Tx (cdev,
-//             MSC_IN_EP,
-//             MSC_BOT_Data,
-//             len);
-//
-//
-//  SCSI_blk_addr   += len;
-//  SCSI_blk_len    -= len;
-//
-//  /* case 6 : Hi = Di */
-//  MSC_BOT_csw.dDataResidue -= len;
-//
-//  if (SCSI_blk_len == 0)
-//  {
-//    MSC_BOT_State = BOT_LAST_DATA_IN;
-//  }
+  addr = SCSI_ReadActive() ? SCSI_blk_addr : SCSI_ReadEnd;
+  while ((b = SCSI_ReadFind(addr)) != 0)
+    addr = b->addr + b->len / SCSI_blk_size;
+
+  if (SCSI_ReadSeq)
+    limit = SCSI_blk_nbr;
+  else if (SCSI_ReadActive())
+    limit = SCSI_blk_addr + SCSI_blk_len / SCSI_blk_size;
+  else
+    return 0;
+
+  if (addr >= limit)
+    return 0;
+
+  n = MIN(limit - addr, SCSI_READ_CHUNK / SCSI_blk_size);
+
+  f->addr = addr;
+  f->len = n * SCSI_blk_size;
+  f->state = SCSI_READ_FILLING;
+
+  if (USBD_STORAGE_fops->Read(lun, f->buf, addr, n) < 0)
+  {
+    f->state = SCSI_READ_FREE;
+    return SCSI_ReadActive() ? -1 : 0;
+  }
 
   return 0;
 }
 
-void SCSI_ProcessReadComplete(uint32_t len) {
+// hand the next ready data to the IN endpoint if it is idle
+static void SCSI_ReadSend(void)
+{
+  SCSI_ReadBuf_TypeDef *b;
+  uint32_t off, len;
+
+  if (!SCSI_ReadActive() || SCSI_ReadSending())
+    return;
+
+  if ((b = SCSI_ReadFind(SCSI_blk_addr)) == 0 || b->state != SCSI_READ_READY)
+    return;
+
+  off = (SCSI_blk_addr - b->addr) * SCSI_blk_size;
+  len = MIN(b->len - off, SCSI_blk_len);
+
+  b->state = SCSI_READ_SENDING;
   DCD_EP_Tx (cdev,
              MSC_IN_EP,
-             MSC_BOT_Data,
+             b->buf + off,
              len);
 
-
-  SCSI_blk_addr   += len;
+  SCSI_blk_addr   += len / SCSI_blk_size;
   SCSI_blk_len    -= len;
+  SCSI_Stats.readBytes += len;
 
   /* case 6 : Hi = Di */
   MSC_BOT_csw.dDataResidue -= len;
@@ -688,7 +835,138 @@ void SCSI_ProcessReadComplete(uint32_t len) {
   if (SCSI_blk_len == 0)
   {
     MSC_BOT_State = BOT_LAST_DATA_IN;
+    SCSI_ReadEnd = SCSI_blk_addr;
+    SCSI_Stats.readMicros += timerMicros() - SCSI_CmdStart;
+  }
+}
+
+// NEZ - prepare EP to receive the first WRITE(10) data packet
+static void SCSI_WriteStart(void)
+{
+  SCSI_WritePending = 0;
+  SCSI_ReadReset();
+
+  DCD_EP_PrepareRx (cdev,
+                    MSC_OUT_EP,
+                    MSC_BOT_Data,
+                    MIN (SCSI_blk_len, MSC_MEDIA_PACKET));
+}
+
+void SCSI_ReadReset(void)
+{
+  int i;
+
+  for (i = 0; i < SCSI_READ_BUFS; i++)
+  {
+    SCSI_ReadBuf[i].buf = MSC_BOT_Data + SCSI_READ_RESERVED + i * SCSI_READ_CHUNK;
+    // one still being filled is released by its completion
+    if (SCSI_ReadBuf[i].state != SCSI_READ_FILLING)
+      SCSI_ReadBuf[i].state = SCSI_READ_FREE;
+  }
+
+  SCSI_ReadSeq = 0;
+  SCSI_WritePending = 0;
+  SCSI_ReadFailed = 0;
+}
+
+// IN endpoint has finished with the buffer being sent
+static void SCSI_ReadRelease(void)
+{
+  SCSI_ReadBuf_TypeDef *b;
+  int i;
+
+  for (i = 0; i < SCSI_READ_BUFS; i++)
+  {
+    b = &SCSI_ReadBuf[i];
+    if (b->state == SCSI_READ_SENDING)
+    {
+      // anything past what was sent is kept as read ahead
+      if (b->addr + b->len / SCSI_blk_size > SCSI_blk_addr)
+        b->state = SCSI_READ_READY;
+      else
+        b->state = SCSI_READ_FREE;
+    }
+  }
+}
+
+/**
+* @brief  SCSI_ProcessRead
+*         Handle Read Process
+* @param  lun: Logical unit number
+* @retval status
+*/
+static int8_t SCSI_ProcessRead (uint8_t lun)
+{
+  SCSI_ReadRelease();
+
+  /* sense is already queued */
+  if (SCSI_ReadFailed)
+  {
+    SCSI_ReadFailed = 0;
+    return -1;
+  }
+
+  SCSI_ReadPrune();
+  SCSI_ReadSend();
+
+  if (SCSI_ReadFetch(lun) < 0)
+  {
+    SCSI_SenseCode(lun, HARDWARE_ERROR, UNRECOVERED_READ_ERROR);
+    return -1;
+  }
+
+  return 0;
+}
+
+// NEZ - last data of a READ(10) is out, keep the card busy reading ahead
+void SCSI_ProcessReadDone(void)
+{
+  SCSI_ReadRelease();
+  SCSI_ReadFetch(MSC_BOT_cbw.bLUN);
+}
+
+// fail the current READ(10), the CSW must not overtake data still on the IN endpoint
+static void SCSI_ReadFail(void)
+{
+  SCSI_SenseCode(MSC_BOT_cbw.bLUN, HARDWARE_ERROR, UNRECOVERED_READ_ERROR);
+
+  if (SCSI_ReadSending())
+    SCSI_ReadFailed = 1;
+  else
+    MSC_BOT_SendCSW (cdev, CSW_CMD_FAILED);
+}
+
+// NEZ - called from the SDIO interrupt, len is 0 on error
+void SCSI_ProcessReadComplete(uint32_t len) {
+  SCSI_ReadBuf_TypeDef *b;
+
+  if ((b = SCSI_ReadFilling()) == 0)
+    return;
+
+  if (SCSI_WritePending)
+  {
+    b->state = SCSI_READ_FREE;
+    SCSI_WriteStart();
+    return;
   }
+
+  if (!len)
+  {
+    b->state = SCSI_READ_FREE;
+    SCSI_ReadSeq = 0;
+
+    if (SCSI_ReadActive() && SCSI_ReadFind(SCSI_blk_addr) == 0)
+      SCSI_ReadFail();
+    return;
+  }
+
+  b->state = SCSI_READ_READY;
+
+  SCSI_ReadPrune();
+  SCSI_ReadSend();
+
+  if (SCSI_ReadFetch(MSC_BOT_cbw.bLUN) < 0)
+    SCSI_ReadFail();
 }
 
 /**
@@ -706,7 +984,7 @@ static int8_t SCSI_ProcessWrite (uint8_t lun)
 
   if(USBD_STORAGE_fops->Write(lun ,
                               MSC_BOT_Data,
-                              SCSI_blk_addr / SCSI_blk_size,
+                              SCSI_blk_addr,
                               len / SCSI_blk_size) < 0)
   {
     SCSI_SenseCode(lun, HARDWARE_ERROR, WRITE_FAULT);
@@ -736,14 +1014,16 @@ static int8_t SCSI_ProcessWrite (uint8_t lun)
 }
 
 void SCSI_ProcessWriteComplete(uint32_t len) {
-  SCSI_blk_addr  += len;
+  SCSI_blk_addr  += len / SCSI_blk_size;
   SCSI_blk_len   -= len;
+  SCSI_Stats.writeBytes += len;
 
   /* case 12 : Ho = Do */
   MSC_BOT_csw.dDataResidue -= len;
 
   if (SCSI_blk_len == 0)
   {
+    SCSI_Stats.writeMicros += timerMicros() - SCSI_CmdStart;
     MSC_BOT_SendCSW (cdev, CSW_CMD_PASSED);
   }
   else
@@ -176,6 +176,19 @@ void   SCSI_SenseCode(uint8_t lun,
                     uint8_t ASC);
 
 // NEZ
+typedef struct {
+  uint32_t readBytes;
+  uint32_t readMicros;		// time spent inside READ(10) commands
+  uint32_t writeBytes;
+  uint32_t writeMicros;		// time spent inside WRITE(10) commands
+  uint32_t aheadHits;		// READ(10)s whose first blocks were already read ahead
+  uint32_t aheadMisses;
+} SCSI_Stats_TypeDef;
+
+extern SCSI_Stats_TypeDef SCSI_Stats;
+
+extern void SCSI_ReadReset(void);
+extern void SCSI_ProcessReadDone(void);
 extern void SCSI_ProcessReadComplete(uint32_t len);
 extern void SCSI_ProcessWriteComplete(uint32_t len);
 
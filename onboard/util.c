@@ -25,6 +25,7 @@
 #include "aq_mavlink.h"
 #include "aq_timer.h"
 #include "getbuildnum.h"
+#include "OsTask.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -71,6 +72,193 @@ uint16_t utilGetStackFree(const char *stackName) {
 
 #endif
 
+#if CFG_TASK_STATS_EN > 0
+#define UTIL_DWT_CYCCNT	    (*(volatile uint32_t *)0xE0001004)
+#define UTIL_DWT_CONTROL    (*(volatile uint32_t *)0xE0001000)
+#define UTIL_SCB_DEMCR	    (*(volatile uint32_t *)0xE000EDFC)
+
+utilTaskStatsStruct_t utilTaskStats __attribute__((section(".ccm")));
+
+void utilTaskStatsInit(void) {
+    memset((void *)&utilTaskStats, 0, sizeof(utilTaskStats));
+
+    // enable the cycle counter
+    UTIL_SCB_DEMCR |= 0x01000000;
+    UTIL_DWT_CONTROL |= 1;
+
+    utilTaskStats.windowStart = UTIL_DWT_CYCCNT;
+    utilTaskStats.sliceStart = utilTaskStats.windowStart;
+}
+
+// charge cycles since the last switch to the running task, ISR time goes to its own bucket
+static void utilTaskCharge(uint32_t now) {
+    utilTaskCounters_t *c = &utilTaskStats.cur[utilTaskStats.curTask];
+    uint32_t slice;
+
+    if (utilTaskStats.isrDepth) {
+	utilTaskStats.isrCycles += now - utilTaskStats.isrStart;
+	utilTaskStats.sliceIsr += now - utilTaskStats.isrStart;
+	utilTaskStats.isrStart = now;
+    }
+
+    slice = now - utilTaskStats.sliceStart - utilTaskStats.sliceIsr;
+
+    c->cycles += slice;
+    if (slice > c->maxSlice)
+	c->maxSlice = slice;
+
+    utilTaskStats.sliceStart = now;
+    utilTaskStats.sliceIsr = 0;
+}
+
+void CoTaskSwitchHook(OS_TID from, OS_TID to, BOOL preempted) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    utilTaskStats.curTask = from;
+    utilTaskCharge(UTIL_DWT_CYCCNT);
+
+    if (preempted)
+	utilTaskStats.cur[from].preempts++;
+    utilTaskStats.cur[to].switches++;
+    utilTaskStats.curTask = to;
+
+    __set_PRIMASK(primask);
+}
+
+void CoIsrEnterHook(void) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if (utilTaskStats.isrDepth++ == 0)
+	utilTaskStats.isrStart = UTIL_DWT_CYCCNT;
+
+    __set_PRIMASK(primask);
+}
+
+void CoIsrExitHook(void) {
+    uint32_t primask = __get_PRIMASK();
+    uint32_t isr;
+
+    __disable_irq();
+
+    if (utilTaskStats.isrDepth && --utilTaskStats.isrDepth == 0) {
+	isr = UTIL_DWT_CYCCNT - utilTaskStats.isrStart;
+	utilTaskStats.isrCycles += isr;
+	utilTaskStats.sliceIsr += isr;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+// close the measurement window every UTIL_TASK_STATS_WINDOW ticks
+void CoTickHook(void) {
+    uint32_t primask;
+    uint32_t now;
+
+    if (++utilTaskStats.ticks < UTIL_TASK_STATS_WINDOW)
+	return;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    now = UTIL_DWT_CYCCNT;
+    utilTaskCharge(now);
+
+    memcpy(utilTaskStats.last, utilTaskStats.cur, sizeof(utilTaskStats.last));
+    memset(utilTaskStats.cur, 0, sizeof(utilTaskStats.cur));
+
+    utilTaskStats.lastIsrCycles = utilTaskStats.isrCycles;
+    utilTaskStats.isrCycles = 0;
+    utilTaskStats.lastWindowCycles = now - utilTaskStats.windowStart;
+    utilTaskStats.windowStart = now;
+    utilTaskStats.ticks = 0;
+
+    __set_PRIMASK(primask);
+}
+
+// find the CoOS task running on a named stack, callers should resolve once and keep the id
+int utilGetTaskId(const char *stackName) {
+#ifdef UTIL_STACK_CHECK
+    OS_STK *sp;
+    int i, j;
+
+    if (!strncmp(stackName, "IDLE", 20))
+	return 0;
+
+    for (i = 0; i < numStacks; i++) {
+	if (!strncmp(stackName, stackNames[i], 20)) {
+	    for (j = 1; j < UTIL_TASK_STATS_NUM; j++) {
+		sp = TCBTbl[j].stkPtr;
+		if (sp >= (OS_STK *)stackPointers[i] && sp < (OS_STK *)((char *)stackPointers[i] + stackSizes[i]))
+		    return j;
+	    }
+	    break;
+	}
+    }
+#endif
+
+    return -1;
+}
+
+// percent of CPU over the last window
+float utilGetTaskLoad(int id) {
+    if (id < 0 || !utilTaskStats.lastWindowCycles)
+	return 0.0f;
+    else
+	return utilTaskStats.last[id].cycles * 100.0f / utilTaskStats.lastWindowCycles;
+}
+
+// longest single run in us over the last window
+float utilGetTaskMaxSlice(int id) {
+    if (id < 0)
+	return 0.0f;
+    else
+	return utilTaskStats.last[id].maxSlice * (1e6f / (float)CFG_CPU_FREQ);
+}
+
+uint32_t utilGetTaskPreempts(int id) {
+    if (id < 0)
+	return 0;
+    else
+	return utilTaskStats.last[id].preempts;
+}
+
+// only handlers that call CoEnterISR/CoExitISR are seen, see utilTaskStatsStruct_t
+float utilGetIsrLoad(void) {
+    if (!utilTaskStats.lastWindowCycles)
+	return 0.0f;
+    else
+	return utilTaskStats.lastIsrCycles * 100.0f / utilTaskStats.lastWindowCycles;
+}
+
+void utilTaskStatsDump(void) {
+#ifdef UTIL_STACK_CHECK
+    char load[10], slice[10];
+    int i;
+
+    AQ_NOTICE("Task       load%  max us  preempt  switch\n");
+
+    for (i = -1; i < numStacks; i++) {
+	const char *name = (i < 0) ? "IDLE" : stackNames[i];
+	int id = utilGetTaskId(name);
+
+	if (id < 0)
+	    continue;
+
+	ftoa(load, utilGetTaskLoad(id), 1);
+	ftoa(slice, utilGetTaskMaxSlice(id), 0);
+	AQ_PRINTF("%-10s %6s %7s %8u %7u\n", name, load, slice, (unsigned int)utilTaskStats.last[id].preempts, (unsigned int)utilTaskStats.last[id].switches);
+    }
+
+    ftoa(load, utilGetIsrLoad(), 1);
+    AQ_PRINTF("%-10s %6s\n", "ISR", load);
+#endif
+}
+#endif
+
 void *aqCalloc(size_t count, size_t size) {
     char *addr = 0;
 
@@ -229,6 +417,138 @@ void utilFirFilterInit(utilFirFilter_t *f, const float *window, float *buffer, u
         f->data[i] = 0.0f;
 }
 
+// exact mean & squared deviations of the current window
+static void utilStatsRecompute(utilStats_t *s) {
+    float sum, m2, d;
+    int i;
+
+    sum = 0.0f;
+    for (i = 0; i < s->count; i++)
+        sum += s->data[i];
+    s->mean = sum / s->count;
+
+    m2 = 0.0f;
+    for (i = 0; i < s->count; i++) {
+        d = s->data[i] - s->mean;
+        m2 += d*d;
+    }
+
+    s->sum = sum;
+    s->comp = 0.0f;
+    s->m2 = m2;
+}
+
+void utilStatsInit(utilStats_t *s, float *buffer, uint16_t n) {
+    s->data = buffer;
+    s->n = n;
+    s->count = 0;
+    s->i = 0;
+    s->refresh = 0;
+    s->mean = 0.0f;
+    s->sum = 0.0f;
+    s->comp = 0.0f;
+    s->m2 = 0.0f;
+}
+
+// fill the whole window with a single value
+void utilStatsFill(utilStats_t *s, float value) {
+    int i;
+
+    for (i = 0; i < s->n; i++)
+        s->data[i] = value;
+
+    s->count = s->n;
+    s->i = 0;
+    s->refresh = 0;
+    s->mean = value;
+    s->sum = value * s->n;
+    s->comp = 0.0f;
+    s->m2 = 0.0f;
+}
+
+// O(1) update, sliding once the window is full
+void utilStatsAdd(utilStats_t *s, float value) {
+    float old, mean, y, t;
+    int full;
+
+    full = (s->count == s->n);
+    if (full) {
+        old = s->data[s->i];
+    }
+    else {
+        old = 0.0f;
+        s->count++;
+    }
+    s->data[s->i] = value;
+
+    // Kahan sum of the window
+    y = (value - old) - s->comp;
+    t = s->sum + y;
+    s->comp = (t - s->sum) - y;
+    s->sum = t;
+
+    mean = s->sum / s->count;
+
+    // Welford
+    if (full)
+        s->m2 += (value - old) * (value - mean + old - s->mean);
+    else
+        s->m2 += (value - s->mean) * (value - mean);
+    s->mean = mean;
+
+    if (s->m2 < 0.0f)
+        s->m2 = 0.0f;
+
+    if (++s->i == s->n) {
+        s->i = 0;
+
+        // bound accumulated float error
+        if (++s->refresh == UTIL_STATS_REFRESH) {
+            s->refresh = 0;
+            utilStatsRecompute(s);
+        }
+    }
+}
+
+// sample standard deviation (same as arm_std_f32)
+float utilStatsStd(utilStats_t *s) {
+    if (s->count < 2)
+        return 0.0f;
+    else
+        return sqrtf(s->m2 / (s->count - 1));
+}
+
+void utilLatencyAdd(utilLatency_t *l, uint32_t us) {
+    uint32_t ms = us / 1000;
+    int i;
+
+    for (i = 0; ms && i < UTIL_LATENCY_BINS-1; i++)
+	ms >>= 1;
+
+    l->hist[i]++;
+    l->count++;
+    if (us > l->max)
+	l->max = us;
+}
+
+// standard (zlib) CRC-32, pass 0 to start
+uint32_t utilCrc32(uint32_t crc, const void *buf, uint32_t len) {
+    static const uint32_t table[16] = {
+	0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    const uint8_t *p = buf;
+
+    crc = ~crc;
+    while (len--) {
+	crc ^= *p++;
+	crc = (crc >> 4) ^ table[crc & 0x0f];
+	crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+
+    return ~crc;
+}
+
 int ftoa(char *buf, float f, unsigned int digits) {
     int index = 0;
     int exponent;
@@ -35,6 +35,12 @@
 #define constrainInt(v, lo, hi)	    (((int)(v) < (int)(lo)) ? (int)(lo) : (((int)(v) > (int)(hi)) ? (int)(hi) : (int)(v)))
 #define constrainFloat(v, lo, hi)   (((float)(v) < (float)(lo)) ? (float)(lo) : (((float)(v) > (float)(hi)) ? (float)(hi) : (float)(v)))
 
+#define UTIL_TASK_STATS_WINDOW	    1000	// ticks per task load measurement window
+#define UTIL_TASK_STATS_NUM	    (CFG_MAX_USER_TASKS+1)	// user tasks + idle
+
+#define UTIL_STATS_REFRESH	    32		// window lengths between exact recomputes of running stats
+#define UTIL_LATENCY_BINS	    10		// <1ms, <2ms, <4ms ... >=256ms
+
 #define PERIPH2BB(addr, bit)        ((uint32_t *)(PERIPH_BB_BASE + ((addr) - PERIPH_BASE) * 32 + ((bit) * 4)))
 
 // first order filter
@@ -50,6 +56,53 @@ typedef struct {
     uint8_t i;
 } utilFirFilter_t;
 
+// sliding window mean & variance
+typedef struct {
+    float *data;
+    float mean;
+    float sum;				// Kahan compensated window sum
+    float comp;
+    float m2;				// Welford sum of squared deviations from mean
+    uint16_t n;
+    uint16_t count;
+    uint16_t i;
+    uint16_t refresh;
+} utilStats_t;
+
+// operation latency histogram
+typedef struct {
+    uint32_t hist[UTIL_LATENCY_BINS];
+    uint32_t count;
+    uint32_t max;			// us
+} utilLatency_t;
+
+#if CFG_TASK_STATS_EN > 0
+// per task CPU accounting, one measurement window
+typedef struct {
+    uint32_t cycles;			// run cycles, ISR time excluded
+    uint32_t maxSlice;			// longest single run in cycles
+    uint32_t preempts;			// switched out while still ready
+    uint32_t switches;			// switched in
+} utilTaskCounters_t;
+
+typedef struct {
+    utilTaskCounters_t cur[UTIL_TASK_STATS_NUM];
+    utilTaskCounters_t last[UTIL_TASK_STATS_NUM];
+    uint32_t isrCycles;			// SysTick and the CoEnterISR..CoExitISR part of other handlers only,
+    uint32_t lastIsrCycles;		// the rest of a handler is charged to the task it interrupted
+    uint32_t lastWindowCycles;
+    uint32_t windowStart;
+    uint32_t sliceStart;
+    uint32_t sliceIsr;
+    uint32_t isrStart;
+    uint16_t ticks;
+    uint8_t isrDepth;
+    uint8_t curTask;
+} utilTaskStatsStruct_t;
+
+extern utilTaskStatsStruct_t utilTaskStats;
+#endif
+
 extern void delay(unsigned long t);
 extern void delayMicros(unsigned long t);
 extern void dumpFloat(unsigned char n, float *floats);
@@ -59,6 +112,15 @@ extern OS_STK *aqStackInit(uint16_t size, char *name);
 extern void *aqCalloc(size_t count, size_t size);
 extern void aqFree(void *ptr, size_t count, size_t size);
 extern void *aqDataCalloc(uint16_t count, uint16_t size);
+#if CFG_TASK_STATS_EN > 0
+extern void utilTaskStatsInit(void);
+extern int utilGetTaskId(const char *stackName);
+extern float utilGetTaskLoad(int id);
+extern float utilGetTaskMaxSlice(int id);
+extern uint32_t utilGetTaskPreempts(int id);
+extern float utilGetIsrLoad(void);
+extern void utilTaskStatsDump(void);
+#endif
 extern void utilFilterInit(utilFilter_t *f, float dt, float tau, float setpoint);
 extern void utilFilterInit3(utilFilter_t *f, float dt, float tau, float setpoint);
 extern float utilFilter(utilFilter_t *f, float signal);
@@ -70,6 +132,12 @@ extern void utilSerialNoString(void);
 extern void utilVersionString(void);
 extern float utilFirFilter(utilFirFilter_t *f, float newValue);
 extern void utilFirFilterInit(utilFirFilter_t *f, const float *window, float *buffer, uint8_t n);
+extern void utilStatsInit(utilStats_t *s, float *buffer, uint16_t n);
+extern void utilStatsFill(utilStats_t *s, float value);
+extern void utilStatsAdd(utilStats_t *s, float value);
+extern float utilStatsStd(utilStats_t *s);
+extern void utilLatencyAdd(utilLatency_t *l, uint32_t us);
+extern uint32_t utilCrc32(uint32_t crc, const void *buf, uint32_t len);
 #ifdef UTIL_STACK_CHECK
 extern void utilStackCheck(void);
 extern uint16_t stackFrees[UTIL_STACK_CHECK];